@@ -23,6 +23,7 @@
 #include <string>
 
 #include "mjlib/base/fail.h"
+#include "mjlib/base/flight_recorder.h"
 #include "mjlib/base/system_error.h"
 
 namespace mjlib {
@@ -71,7 +72,8 @@ class AbortingPosixTimer {
   }
 
   /// Start the timer.  If it expires before Stop is called, then the
-  /// process will be aborted.
+  /// contents of the FlightRecorder are dumped and the process is
+  /// aborted.
   void Start(int64_t nanoseconds) {
     struct itimerspec it = {};
 
@@ -101,7 +103,7 @@ class AbortingPosixTimer {
     // We are in a signal handler.  There is almost nothing we can do
     // here.  Almost all library and system calls are off limits,
     // including memory allocation.  Write out a pre-allocated
-    // message, then abort the program.
+    // message and the flight recorder trace, then abort the program.
     [&]() {
       for (auto& context : contexts_) {
         if (signo == context.signal_number) {
@@ -111,6 +113,8 @@ class AbortingPosixTimer {
       }
     }();
 
+    FlightRecorder::DumpFromSignal();
+
     ::abort();
   }
 
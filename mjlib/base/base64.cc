@@ -0,0 +1,86 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/base64.h"
+
+#include <cstdint>
+
+namespace mjlib {
+namespace base {
+
+namespace {
+constexpr char kAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int DecodeChar(char c) {
+  if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+  if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+  if (c >= '0' && c <= '9') { return c - '0' + 52; }
+  if (c == '+') { return 62; }
+  if (c == '/') { return 63; }
+  return -1;
+}
+}
+
+std::string Base64Encode(std::string_view data) {
+  std::string result;
+  result.reserve((data.size() + 2) / 3 * 4);
+
+  for (size_t i = 0; i < data.size(); i += 3) {
+    const size_t remaining = data.size() - i;
+    uint32_t group = static_cast<uint8_t>(data[i]) << 16;
+    if (remaining > 1) { group |= static_cast<uint8_t>(data[i + 1]) << 8; }
+    if (remaining > 2) { group |= static_cast<uint8_t>(data[i + 2]); }
+
+    result.push_back(kAlphabet[(group >> 18) & 0x3f]);
+    result.push_back(kAlphabet[(group >> 12) & 0x3f]);
+    result.push_back(remaining > 1 ? kAlphabet[(group >> 6) & 0x3f] : '=');
+    result.push_back(remaining > 2 ? kAlphabet[group & 0x3f] : '=');
+  }
+
+  return result;
+}
+
+std::optional<std::string> Base64Decode(std::string_view data) {
+  if (data.size() % 4 != 0) { return {}; }
+
+  std::string result;
+  result.reserve(data.size() / 4 * 3);
+
+  for (size_t i = 0; i < data.size(); i += 4) {
+    const bool last = (i + 4) == data.size();
+    const int padding =
+        (last && data[i + 3] == '=') ? ((data[i + 2] == '=') ? 2 : 1) : 0;
+
+    uint32_t group = 0;
+    for (int j = 0; j < 4 - padding; j++) {
+      const int value = DecodeChar(data[i + j]);
+      if (value < 0) { return {}; }
+      group |= static_cast<uint32_t>(value) << (18 - 6 * j);
+    }
+
+    result.push_back(static_cast<char>((group >> 16) & 0xff));
+    if (padding < 2) {
+      result.push_back(static_cast<char>((group >> 8) & 0xff));
+    }
+    if (padding < 1) {
+      result.push_back(static_cast<char>(group & 0xff));
+    }
+  }
+
+  return result;
+}
+
+}
+}
@@ -0,0 +1,32 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace mjlib {
+namespace base {
+
+/// Encode @p data using the standard base64 alphabet, with padding.
+std::string Base64Encode(std::string_view data);
+
+/// Decode standard, padded base64.  @return nullopt if @p data is
+/// malformed.
+std::optional<std::string> Base64Decode(std::string_view data);
+
+}
+}
@@ -0,0 +1,218 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/flight_recorder.h"
+
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <sys/stat.h>
+#endif  // _WIN32
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace mjlib {
+namespace base {
+
+namespace {
+constexpr size_t kMaxPath = 256;
+
+char g_dump_path[kMaxPath] = {};
+
+#ifndef _WIN32
+int64_t CurrentThreadId() { return ::syscall(SYS_gettid); }
+int WriteFd(int fd, const char* data, size_t size) {
+  return ::write(fd, data, size);
+}
+int OpenDump(const char* path) {
+  return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+void CloseFd(int fd) { ::close(fd); }
+#else
+int64_t CurrentThreadId() {
+  return static_cast<int64_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+int WriteFd(int fd, const char* data, size_t size) {
+  return ::_write(fd, data, static_cast<unsigned int>(size));
+}
+int OpenDump(const char* path) {
+  return ::_open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+}
+void CloseFd(int fd) { ::_close(fd); }
+#endif  // _WIN32
+
+const char* TypeName(FlightRecorder::Type type) {
+  switch (type) {
+    case FlightRecorder::kHandlerStart: { return "handler_start"; }
+    case FlightRecorder::kHandlerEnd: { return "handler_end"; }
+    case FlightRecorder::kBusWrite: { return "bus_write"; }
+    case FlightRecorder::kBusRead: { return "bus_read"; }
+    case FlightRecorder::kBusTimeout: { return "bus_timeout"; }
+    case FlightRecorder::kLogWrite: { return "log_write"; }
+    case FlightRecorder::kLogFileWrite: { return "log_file_write"; }
+    case FlightRecorder::kLogFlush: { return "log_flush"; }
+    case FlightRecorder::kUser: { return "user"; }
+  }
+  return "unknown";
+}
+
+/// Formats output into a fixed buffer, without using anything which
+/// is unsafe to call from a signal handler.
+class SignalSafeWriter {
+ public:
+  SignalSafeWriter(int fd) : fd_(fd) {}
+
+  SignalSafeWriter& operator<<(const char* str) {
+    const size_t size = ::strlen(str);
+    const size_t to_copy = std::min(size, sizeof(buf_) - size_);
+    ::memcpy(&buf_[size_], str, to_copy);
+    size_ += to_copy;
+    return *this;
+  }
+
+  SignalSafeWriter& operator<<(int64_t value) {
+    char digits[24] = {};
+    size_t pos = sizeof(digits) - 1;
+    const bool negative = value < 0;
+    uint64_t magnitude = negative ?
+        (~static_cast<uint64_t>(value) + 1) : static_cast<uint64_t>(value);
+    do {
+      digits[--pos] = '0' + (magnitude % 10);
+      magnitude /= 10;
+    } while (magnitude);
+    if (negative) { digits[--pos] = '-'; }
+    return *this << &digits[pos];
+  }
+
+  /// Write out the buffer only if it is getting full, to keep the
+  /// number of system calls down.
+  void MaybeFlush() {
+    if (size_ > sizeof(buf_) / 2) { Flush(); }
+  }
+
+  void Flush() {
+    const char* ptr = buf_;
+    size_t remaining = size_;
+    while (remaining) {
+      const int result = WriteFd(fd_, ptr, remaining);
+      if (result <= 0) { break; }
+      ptr += result;
+      remaining -= result;
+    }
+    size_ = 0;
+  }
+
+ private:
+  const int fd_;
+  char buf_[4096] = {};
+  size_t size_ = 0;
+};
+}
+
+std::array<FlightRecorder::ThreadBuffer,
+           FlightRecorder::kMaxThreads> FlightRecorder::buffers_;
+
+FlightRecorder::ThreadBuffer* FlightRecorder::ClaimThreadBuffer() {
+  // Prefer buffers which have never been used, so that those of
+  // exited threads remain available to dump for as long as possible.
+  for (const auto from : {kUnused, kReleased}) {
+    for (auto& buffer : buffers_) {
+      State expected = from;
+      if (!buffer.state.compare_exchange_strong(expected, kActive)) {
+        continue;
+      }
+      buffer.next.store(0, std::memory_order_release);
+      buffer.thread_id = CurrentThreadId();
+      return &buffer;
+    }
+  }
+  return nullptr;
+}
+
+void FlightRecorder::ReleaseThreadBuffer(ThreadBuffer* buffer) {
+  if (buffer == nullptr) { return; }
+  buffer->state.store(kReleased, std::memory_order_release);
+}
+
+void FlightRecorder::SetDumpPath(std::string_view path) {
+  const size_t size = std::min(path.size(), kMaxPath - 1);
+  ::memcpy(g_dump_path, path.data(), size);
+  g_dump_path[size] = 0;
+}
+
+void FlightRecorder::Dump(int fd) {
+  SignalSafeWriter out{fd};
+  int64_t used = 0;
+  for (const auto& buffer : buffers_) {
+    if (buffer.state.load(std::memory_order_acquire) != kUnused) { used++; }
+  }
+
+  out << "flight recorder: " << used << " thread(s)\n";
+
+  for (const auto& buffer : buffers_) {
+    const auto state = buffer.state.load(std::memory_order_acquire);
+    if (state == kUnused) { continue; }
+
+    const uint64_t end = buffer.next.load(std::memory_order_acquire);
+    const uint64_t begin =
+        (end > kRecordsPerThread) ? (end - kRecordsPerThread) : 0;
+
+    out << "thread " << buffer.thread_id
+        << (state == kReleased ? " (exited)" : "") << ": "
+        << static_cast<int64_t>(end - begin) << " of "
+        << static_cast<int64_t>(end) << " events\n";
+
+    for (uint64_t j = begin; j < end; j++) {
+      const auto& entry = buffer.records[j % kRecordsPerThread];
+      out << entry.timestamp_ns << " " << TypeName(entry.type)
+          << " " << static_cast<int64_t>(entry.arg);
+      if (entry.label) { out << " " << entry.label; }
+      out << "\n";
+      out.MaybeFlush();
+    }
+  }
+  out.Flush();
+}
+
+void FlightRecorder::DumpFromSignal() {
+  if (g_dump_path[0] == 0) {
+    Dump(2);
+    return;
+  }
+
+  const int fd = OpenDump(g_dump_path);
+  if (fd < 0) {
+    Dump(2);
+    return;
+  }
+  Dump(fd);
+  CloseFd(fd);
+}
+
+void FlightRecorder::Clear() {
+  for (auto& buffer : buffers_) {
+    buffer.next.store(0);
+  }
+}
+
+}
+}
@@ -0,0 +1,138 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace mjlib {
+namespace base {
+
+/// An always-on trace of recent events, kept in a fixed size circular
+/// buffer per thread.
+///
+/// Recording is lock free and does not allocate, so it is cheap
+/// enough to leave enabled in production.  The contents can be
+/// written out from a signal handler, which AbortingPosixTimer does
+/// before aborting, leaving a record of what ran in the lead up to a
+/// missed deadline.
+class FlightRecorder {
+ public:
+  enum Type : uint8_t {
+    kHandlerStart,
+    kHandlerEnd,
+    kBusWrite,
+    kBusRead,
+    kBusTimeout,
+    kLogWrite,
+    kLogFileWrite,
+    kLogFlush,
+    kUser,
+  };
+
+  struct Entry {
+    int64_t timestamp_ns = 0;
+    /// If non-null, this must have static storage duration, as it
+    /// is only dereferenced when dumping.
+    const char* label = nullptr;
+    uint32_t arg = 0;
+    Type type = kUser;
+  };
+
+  static constexpr size_t kRecordsPerThread = 512;
+  static constexpr size_t kMaxThreads = 16;
+
+  /// Record an event in the current thread's buffer.  A thread's
+  /// buffer is released when it exits, and then reused by a new
+  /// thread only once every buffer has been used, so that the history
+  /// of exited threads is kept as long as possible.  If kMaxThreads
+  /// live threads have recorded something, events from any further
+  /// threads are dropped.
+  static void Record(Type type, uint32_t arg = 0,
+                     const char* label = nullptr) {
+    ThreadBuffer* const buffer = GetThreadBuffer();
+    if (buffer == nullptr) { return; }
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+    const uint64_t index = buffer->next.load(std::memory_order_relaxed);
+    auto& record = buffer->records[index % kRecordsPerThread];
+    record.timestamp_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    record.label = label;
+    record.arg = arg;
+    record.type = type;
+    buffer->next.store(index + 1, std::memory_order_release);
+  }
+
+  /// Set the file which DumpFromSignal writes to.  If empty, or never
+  /// set, the trace is written to stderr.
+  static void SetDumpPath(std::string_view path);
+
+  /// Write a text rendering of all thread buffers, oldest event
+  /// first, to the given descriptor.  This is async-signal-safe.
+  /// Threads which are still recording while this runs may have
+  /// their most recent entries torn.
+  static void Dump(int fd);
+
+  /// Write the trace to the configured dump path.  This is
+  /// async-signal-safe.
+  static void DumpFromSignal();
+
+  /// Discard everything recorded so far.  Only intended for tests.
+  static void Clear();
+
+ private:
+  enum State : uint8_t {
+    kUnused,
+    kActive,
+    kReleased,
+  };
+
+  struct ThreadBuffer {
+    std::atomic<State> state{kUnused};
+    std::atomic<uint64_t> next{0};
+    int64_t thread_id = 0;
+    std::array<Entry, kRecordsPerThread> records;
+  };
+
+  /// Holds the current thread's buffer for as long as it runs.
+  struct ThreadSlot {
+    ThreadBuffer* buffer = ClaimThreadBuffer();
+
+    ~ThreadSlot() {
+      ReleaseThreadBuffer(buffer);
+      buffer = nullptr;
+    }
+  };
+
+  static ThreadBuffer* GetThreadBuffer() {
+    thread_local ThreadSlot slot;
+    return slot.buffer;
+  }
+
+  static ThreadBuffer* ClaimThreadBuffer();
+  static void ReleaseThreadBuffer(ThreadBuffer*);
+
+  // This is statically allocated, so that it remains valid no matter
+  // which threads have exited by the time a dump happens.
+  static std::array<ThreadBuffer, kMaxThreads> buffers_;
+};
+
+}
+}
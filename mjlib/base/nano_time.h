@@ -0,0 +1,217 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+/// @file
+///
+/// Lightweight integer nanosecond alternatives to
+/// boost::posix_time::ptime and time_duration.  Each is a single
+/// int64_t, so construction, arithmetic and conversion to the
+/// microseconds used in log files are trivial.
+///
+/// Special values use the same int64 encoding as time_conversions.h.
+/// Arithmetic does not treat them specially.
+
+namespace mjlib {
+namespace base {
+
+namespace detail {
+constexpr int64_t kNanoNegInfin = std::numeric_limits<int64_t>::min();
+constexpr int64_t kNanoPosInfin = std::numeric_limits<int64_t>::max();
+constexpr int64_t kNanoNotADateTime = std::numeric_limits<int64_t>::min() + 1;
+}
+
+/// A signed duration, as an integer count of nanoseconds.  It is
+/// zero when default constructed.
+class NanoDuration {
+ public:
+  constexpr NanoDuration() {}
+  constexpr explicit NanoDuration(int64_t count) : count_(count) {}
+
+  static constexpr NanoDuration seconds(int64_t value) {
+    return NanoDuration(value * 1000000000);
+  }
+  static constexpr NanoDuration milliseconds(int64_t value) {
+    return NanoDuration(value * 1000000);
+  }
+  static constexpr NanoDuration microseconds(int64_t value) {
+    return NanoDuration(value * 1000);
+  }
+  static constexpr NanoDuration nanoseconds(int64_t value) {
+    return NanoDuration(value);
+  }
+
+  static constexpr NanoDuration neg_infin() {
+    return NanoDuration(detail::kNanoNegInfin);
+  }
+  static constexpr NanoDuration pos_infin() {
+    return NanoDuration(detail::kNanoPosInfin);
+  }
+  static constexpr NanoDuration not_a_date_time() {
+    return NanoDuration(detail::kNanoNotADateTime);
+  }
+
+  constexpr int64_t count() const { return count_; }
+  constexpr int64_t total_microseconds() const { return count_ / 1000; }
+  constexpr double total_seconds() const { return count_ * 1e-9; }
+
+  constexpr bool is_neg_infinity() const {
+    return count_ == detail::kNanoNegInfin;
+  }
+  constexpr bool is_pos_infinity() const {
+    return count_ == detail::kNanoPosInfin;
+  }
+  constexpr bool is_not_a_date_time() const {
+    return count_ == detail::kNanoNotADateTime;
+  }
+  constexpr bool is_special() const {
+    return is_neg_infinity() || is_pos_infinity() || is_not_a_date_time();
+  }
+
+  constexpr NanoDuration operator-() const { return NanoDuration(-count_); }
+  constexpr NanoDuration operator+(NanoDuration rhs) const {
+    return NanoDuration(count_ + rhs.count_);
+  }
+  constexpr NanoDuration operator-(NanoDuration rhs) const {
+    return NanoDuration(count_ - rhs.count_);
+  }
+  constexpr NanoDuration operator*(int64_t rhs) const {
+    return NanoDuration(count_ * rhs);
+  }
+  constexpr NanoDuration operator/(int64_t rhs) const {
+    return NanoDuration(count_ / rhs);
+  }
+  NanoDuration& operator+=(NanoDuration rhs) {
+    count_ += rhs.count_;
+    return *this;
+  }
+  NanoDuration& operator-=(NanoDuration rhs) {
+    count_ -= rhs.count_;
+    return *this;
+  }
+
+  constexpr bool operator==(NanoDuration rhs) const { return count_ == rhs.count_; }
+  constexpr bool operator!=(NanoDuration rhs) const { return count_ != rhs.count_; }
+  constexpr bool operator<(NanoDuration rhs) const { return count_ < rhs.count_; }
+  constexpr bool operator<=(NanoDuration rhs) const { return count_ <= rhs.count_; }
+  constexpr bool operator>(NanoDuration rhs) const { return count_ > rhs.count_; }
+  constexpr bool operator>=(NanoDuration rhs) const { return count_ >= rhs.count_; }
+
+ private:
+  int64_t count_ = 0;
+};
+
+/// A point in time, as an integer count of nanoseconds since the
+/// epoch of Clock.  Like ptime, it is not_a_date_time when default
+/// constructed.  Times from different clocks cannot be mixed.
+template <typename Clock>
+class NanoTime {
+ public:
+  constexpr NanoTime() {}
+  constexpr explicit NanoTime(int64_t count) : count_(count) {}
+
+  static constexpr NanoTime neg_infin() {
+    return NanoTime(detail::kNanoNegInfin);
+  }
+  static constexpr NanoTime pos_infin() {
+    return NanoTime(detail::kNanoPosInfin);
+  }
+  static constexpr NanoTime not_a_date_time() {
+    return NanoTime(detail::kNanoNotADateTime);
+  }
+
+  /// Nanoseconds since the clock's epoch.
+  constexpr int64_t count() const { return count_; }
+
+  constexpr bool is_neg_infinity() const {
+    return count_ == detail::kNanoNegInfin;
+  }
+  constexpr bool is_pos_infinity() const {
+    return count_ == detail::kNanoPosInfin;
+  }
+  constexpr bool is_not_a_date_time() const {
+    return count_ == detail::kNanoNotADateTime;
+  }
+  constexpr bool is_special() const {
+    return is_neg_infinity() || is_pos_infinity() || is_not_a_date_time();
+  }
+
+  constexpr NanoTime operator+(NanoDuration rhs) const {
+    return NanoTime(count_ + rhs.count());
+  }
+  constexpr NanoTime operator-(NanoDuration rhs) const {
+    return NanoTime(count_ - rhs.count());
+  }
+  constexpr NanoDuration operator-(NanoTime rhs) const {
+    return NanoDuration(count_ - rhs.count_);
+  }
+  NanoTime& operator+=(NanoDuration rhs) {
+    count_ += rhs.count();
+    return *this;
+  }
+  NanoTime& operator-=(NanoDuration rhs) {
+    count_ -= rhs.count();
+    return *this;
+  }
+
+  constexpr bool operator==(NanoTime rhs) const { return count_ == rhs.count_; }
+  constexpr bool operator!=(NanoTime rhs) const { return count_ != rhs.count_; }
+  constexpr bool operator<(NanoTime rhs) const { return count_ < rhs.count_; }
+  constexpr bool operator<=(NanoTime rhs) const { return count_ <= rhs.count_; }
+  constexpr bool operator>(NanoTime rhs) const { return count_ > rhs.count_; }
+  constexpr bool operator>=(NanoTime rhs) const { return count_ >= rhs.count_; }
+
+ private:
+  int64_t count_ = detail::kNanoNotADateTime;
+};
+
+/// Wall clock time, whose epoch is 1970-01-01 UTC.  This is the time
+/// base used for log files.
+struct RealtimeClock {
+  static NanoTime<RealtimeClock> now() {
+    return NanoTime<RealtimeClock>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+  }
+};
+
+/// A clock which never jumps, with an unspecified epoch.
+struct MonotonicClock {
+  static NanoTime<MonotonicClock> now() {
+    return NanoTime<MonotonicClock>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& ostr, NanoDuration value) {
+  return ostr << value.count() << "ns";
+}
+
+template <typename Clock>
+std::ostream& operator<<(std::ostream& ostr, NanoTime<Clock> value) {
+  return ostr << value.count() << "ns";
+}
+
+using RealtimeNanoTime = NanoTime<RealtimeClock>;
+using MonotonicNanoTime = NanoTime<MonotonicClock>;
+
+}
+}
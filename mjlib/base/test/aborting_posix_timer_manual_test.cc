@@ -25,11 +25,13 @@ int main(int argc, char** argv) {
 
   int64_t delay_us = 0;
   int64_t sleep_us = 0;
+  std::string dump_path;
 
   desc.add_options()
       ("help,h", "display usage message")
       ("delay-us", po::value(&delay_us), "make timer delay this much")
       ("sleep-us", po::value(&sleep_us), "sleep this much")
+      ("dump-path", po::value(&dump_path), "write flight recorder here")
       ;
 
   po::variables_map vm;
@@ -41,6 +43,10 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  mjlib::base::FlightRecorder::SetDumpPath(dump_path);
+  mjlib::base::FlightRecorder::Record(
+      mjlib::base::FlightRecorder::kUser, 1, "before start");
+
   mjlib::base::AbortingPosixTimer dut("my test message\n");
   dut.Start(delay_us * 1000);
   ::usleep(sleep_us);
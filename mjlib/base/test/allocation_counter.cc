@@ -0,0 +1,227 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/test/allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+}
+
+#define MJLIB_ALLOCATION_HOOK_MALLOC 1
+#endif
+
+namespace mjlib {
+namespace base {
+namespace test {
+
+namespace {
+thread_local AllocationCounter* g_current = nullptr;
+
+// Set while we are recording, so that allocations made by the
+// recording itself, (for instance backtrace loading its unwinder),
+// are not counted.
+thread_local bool g_recording = false;
+
+void* RawAllocate(size_t size) {
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+  return __libc_malloc(size);
+#else
+  return std::malloc(size);
+#endif
+}
+
+void* RawAllocateAligned(size_t size, size_t alignment) {
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+  return __libc_memalign(alignment, size);
+#else
+  return std::aligned_alloc(
+      alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+}
+
+void RawFree(void* ptr) {
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+  __libc_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+void* CountedNew(size_t size) {
+  AllocationCounter::RecordAllocation(size);
+  void* const result = RawAllocate(size == 0 ? 1 : size);
+  if (result == nullptr) { throw std::bad_alloc(); }
+  return result;
+}
+
+void* CountedNewAligned(size_t size, std::align_val_t alignment) {
+  AllocationCounter::RecordAllocation(size);
+  void* const result =
+      RawAllocateAligned(size == 0 ? 1 : size, static_cast<size_t>(alignment));
+  if (result == nullptr) { throw std::bad_alloc(); }
+  return result;
+}
+
+void CountedDelete(void* ptr) {
+  if (ptr == nullptr) { return; }
+  AllocationCounter::RecordDeallocation();
+  RawFree(ptr);
+}
+}
+
+AllocationCounter::AllocationCounter() : parent_(g_current) {
+  g_current = this;
+}
+
+AllocationCounter::~AllocationCounter() {
+  g_current = parent_;
+}
+
+void AllocationCounter::RecordAllocation(size_t size) {
+  if (g_current == nullptr || g_recording) { return; }
+  g_recording = true;
+
+  void* frames[kMaxDepth] = {};
+  int depth = 0;
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+  depth = ::backtrace(frames, kMaxDepth);
+#endif
+
+  for (auto* counter = g_current; counter; counter = counter->parent_) {
+    counter->allocations_++;
+    counter->bytes_ += size;
+    if (counter->num_samples_ < kMaxSamples) {
+      auto& sample = counter->samples_[counter->num_samples_++];
+      sample.size = size;
+      sample.depth = depth;
+      for (int i = 0; i < depth; i++) { sample.frames[i] = frames[i]; }
+    }
+  }
+
+  g_recording = false;
+}
+
+void AllocationCounter::RecordDeallocation() {
+  if (g_current == nullptr || g_recording) { return; }
+  for (auto* counter = g_current; counter; counter = counter->parent_) {
+    counter->deallocations_++;
+  }
+}
+
+std::string AllocationCounter::Report() const {
+  // Building the report should not count against any active scope.
+  const bool old_recording = g_recording;
+  g_recording = true;
+
+  std::ostringstream ostr;
+  ostr << allocations_ << " allocations (" << bytes_ << " bytes), "
+       << deallocations_ << " deallocations\n";
+  for (int i = 0; i < num_samples_; i++) {
+    const auto& sample = samples_[i];
+    ostr << "allocation " << i << " of " << sample.size << " bytes:\n";
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+    char** const symbols = ::backtrace_symbols(sample.frames, sample.depth);
+    for (int j = 0; symbols && j < sample.depth; j++) {
+      ostr << "  " << symbols[j] << "\n";
+    }
+    RawFree(symbols);
+#endif
+  }
+
+  std::string result = ostr.str();
+  g_recording = old_recording;
+  return result;
+}
+
+}
+}
+}
+
+using mjlib::base::test::CountedDelete;
+using mjlib::base::test::CountedNew;
+using mjlib::base::test::CountedNewAligned;
+
+void* operator new(size_t size) { return CountedNew(size); }
+void* operator new[](size_t size) { return CountedNew(size); }
+void* operator new(size_t size, std::align_val_t alignment) {
+  return CountedNewAligned(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return CountedNewAligned(size, alignment);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try { return CountedNew(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try { return CountedNew(size); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* ptr) noexcept { CountedDelete(ptr); }
+void operator delete[](void* ptr) noexcept { CountedDelete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { CountedDelete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { CountedDelete(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  CountedDelete(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  CountedDelete(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  CountedDelete(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  CountedDelete(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  CountedDelete(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  CountedDelete(ptr);
+}
+
+#ifdef MJLIB_ALLOCATION_HOOK_MALLOC
+extern "C" {
+void* malloc(size_t size) {
+  mjlib::base::test::AllocationCounter::RecordAllocation(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  mjlib::base::test::AllocationCounter::RecordAllocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  mjlib::base::test::AllocationCounter::RecordAllocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+  if (ptr == nullptr) { return; }
+  mjlib::base::test::AllocationCounter::RecordDeallocation();
+  __libc_free(ptr);
+}
+}
+#endif
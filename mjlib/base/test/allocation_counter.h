@@ -0,0 +1,72 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace mjlib {
+namespace base {
+namespace test {
+
+/// Counts the heap allocations made by the current thread while an
+/// instance is alive.  Linking this library replaces the global
+/// operator new and delete, and on glibc, malloc and friends.
+///
+/// Instances may be nested, in which case every active instance
+/// counts each allocation.
+class AllocationCounter {
+ public:
+  static constexpr int kMaxSamples = 4;
+  static constexpr int kMaxDepth = 16;
+
+  AllocationCounter();
+  ~AllocationCounter();
+
+  AllocationCounter(const AllocationCounter&) = delete;
+  AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+  size_t allocations() const { return allocations_; }
+  size_t deallocations() const { return deallocations_; }
+  size_t bytes() const { return bytes_; }
+
+  /// Return a human readable summary, including the call stacks of
+  /// the first few allocations where they are available.
+  std::string Report() const;
+
+  /// Invoked by the allocation hooks, not intended for direct use.
+  static void RecordAllocation(size_t size);
+  static void RecordDeallocation();
+
+ private:
+  AllocationCounter* const parent_;
+
+  size_t allocations_ = 0;
+  size_t deallocations_ = 0;
+  size_t bytes_ = 0;
+
+  struct Sample {
+    size_t size = 0;
+    int depth = 0;
+    void* frames[kMaxDepth] = {};
+  };
+
+  Sample samples_[kMaxSamples];
+  int num_samples_ = 0;
+};
+
+}
+}
+}
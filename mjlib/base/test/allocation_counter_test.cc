@@ -0,0 +1,54 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/test/allocation_counter.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjlib::base::test::AllocationCounter;
+
+BOOST_AUTO_TEST_CASE(AllocationCounterTest) {
+  std::vector<int> outside;
+  outside.reserve(10);
+
+  AllocationCounter outer;
+  BOOST_TEST(outer.allocations() == 0);
+
+  {
+    AllocationCounter inner;
+    auto value = std::make_unique<int>(3);
+    BOOST_TEST(inner.allocations() == 1);
+    BOOST_TEST(inner.bytes() == sizeof(int));
+    value.reset();
+    BOOST_TEST(inner.deallocations() == 1);
+  }
+
+  // Allocation counts propagate to enclosing scopes.
+  BOOST_TEST(outer.allocations() == 1);
+  BOOST_TEST(outer.deallocations() == 1);
+
+  // Using memory allocated elsewhere is free.
+  for (int i = 0; i < 10; i++) { outside.push_back(i); }
+  BOOST_TEST(outer.allocations() == 1);
+
+  outside.push_back(11);
+  BOOST_TEST(outer.allocations() == 2);
+
+  const auto report = outer.Report();
+  BOOST_TEST(report.find("2 allocations") == 0);
+  BOOST_TEST(outer.allocations() == 2);
+}
@@ -0,0 +1,41 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/base64.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib::base;
+
+BOOST_AUTO_TEST_CASE(Base64EncodeTest) {
+  BOOST_TEST(Base64Encode("") == "");
+  BOOST_TEST(Base64Encode("f") == "Zg==");
+  BOOST_TEST(Base64Encode("fo") == "Zm8=");
+  BOOST_TEST(Base64Encode("foo") == "Zm9v");
+  BOOST_TEST(Base64Encode("foobar") == "Zm9vYmFy");
+  BOOST_TEST(Base64Encode(std::string("\x00\xff\xfe", 3)) == "AP/+");
+}
+
+BOOST_AUTO_TEST_CASE(Base64DecodeTest) {
+  BOOST_TEST(Base64Decode("").value() == "");
+  BOOST_TEST(Base64Decode("Zg==").value() == "f");
+  BOOST_TEST(Base64Decode("Zm8=").value() == "fo");
+  BOOST_TEST(Base64Decode("Zm9vYmFy").value() == "foobar");
+  BOOST_TEST(Base64Decode("AP/+").value() == std::string("\x00\xff\xfe", 3));
+
+  // Malformed input is rejected.
+  BOOST_TEST(!Base64Decode("Zm9"));
+  BOOST_TEST(!Base64Decode("Zm9*"));
+  BOOST_TEST(!Base64Decode("Zg==Zm9v"));
+}
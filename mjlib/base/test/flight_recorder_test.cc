@@ -0,0 +1,180 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/flight_recorder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+
+using mjlib::base::FlightRecorder;
+
+namespace {
+std::string ReadFile(const std::string& filename) {
+  std::ifstream inf(filename);
+  std::ostringstream ostr;
+  ostr << inf.rdbuf();
+  return ostr.str();
+}
+
+std::vector<std::string> Lines(const std::string& data) {
+  std::vector<std::string> result;
+  std::istringstream istr(data);
+  std::string line;
+  while (std::getline(istr, line)) { result.push_back(line); }
+  return result;
+}
+
+size_t Count(const std::string& data, const std::string& needle) {
+  size_t result = 0;
+  size_t pos = 0;
+  while ((pos = data.find(needle, pos)) != std::string::npos) {
+    result++;
+    pos += needle.size();
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(FlightRecorderBasic) {
+  FlightRecorder::Clear();
+
+  FlightRecorder::Record(FlightRecorder::kHandlerStart, 1, "first");
+  FlightRecorder::Record(FlightRecorder::kBusWrite, 2);
+  FlightRecorder::Record(FlightRecorder::kHandlerEnd, 3, "first");
+
+  mjlib::base::TemporaryFile temp;
+  FlightRecorder::SetDumpPath(temp.native());
+  FlightRecorder::DumpFromSignal();
+  FlightRecorder::SetDumpPath("");
+
+  const auto lines = Lines(ReadFile(temp.native()));
+  BOOST_TEST_REQUIRE(lines.size() >= 5u);
+  BOOST_TEST(lines[0].find("flight recorder: ") == 0u);
+
+  // Find our thread's section.
+  size_t start = 0;
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i].find(" 3 of 3 events") != std::string::npos) {
+      start = i;
+      break;
+    }
+  }
+  BOOST_TEST_REQUIRE(start != 0u);
+
+  auto field = [&](size_t index, size_t field_num) {
+    std::istringstream istr(lines[index]);
+    std::string result;
+    for (size_t i = 0; i <= field_num; i++) { istr >> result; }
+    return result;
+  };
+
+  BOOST_TEST(field(start + 1, 1) == "handler_start");
+  BOOST_TEST(field(start + 1, 2) == "1");
+  BOOST_TEST(field(start + 1, 3) == "first");
+  BOOST_TEST(field(start + 2, 1) == "bus_write");
+  BOOST_TEST(field(start + 2, 2) == "2");
+  BOOST_TEST(field(start + 3, 1) == "handler_end");
+
+  // Timestamps are monotonic.
+  BOOST_TEST(std::stoll(field(start + 1, 0)) <=
+             std::stoll(field(start + 3, 0)));
+}
+
+BOOST_AUTO_TEST_CASE(FlightRecorderWrap) {
+  FlightRecorder::Clear();
+
+  const size_t total = FlightRecorder::kRecordsPerThread + 10;
+  for (size_t i = 0; i < total; i++) {
+    FlightRecorder::Record(FlightRecorder::kUser, i);
+  }
+
+  mjlib::base::TemporaryFile temp;
+  FlightRecorder::SetDumpPath(temp.native());
+  FlightRecorder::DumpFromSignal();
+  FlightRecorder::SetDumpPath("");
+
+  const auto data = ReadFile(temp.native());
+  std::ostringstream expected_header;
+  expected_header << " " << FlightRecorder::kRecordsPerThread
+                  << " of " << total << " events";
+  BOOST_TEST(data.find(expected_header.str()) != std::string::npos);
+
+  // Only the most recent entries remain.
+  BOOST_TEST(data.find(" user 9\n") == std::string::npos);
+  BOOST_TEST(data.find(" user 10\n") != std::string::npos);
+  std::ostringstream last;
+  last << " user " << (total - 1) << "\n";
+  BOOST_TEST(data.find(last.str()) != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(FlightRecorderThreads) {
+  FlightRecorder::Clear();
+
+  std::thread thread([]() {
+      FlightRecorder::Record(FlightRecorder::kLogWrite, 7, "other_thread");
+    });
+  thread.join();
+
+  FlightRecorder::Record(FlightRecorder::kLogWrite, 8, "this_thread");
+
+  mjlib::base::TemporaryFile temp;
+  const int fd = ::open(temp.native().c_str(), O_WRONLY | O_CREAT, 0644);
+  BOOST_TEST_REQUIRE(fd >= 0);
+  FlightRecorder::Dump(fd);
+  ::close(fd);
+
+  const auto data = ReadFile(temp.native());
+
+  // Records from a thread which has since exited remain available.
+  BOOST_TEST(Count(data, "log_write 7 other_thread") == 1u);
+  BOOST_TEST(Count(data, "log_write 8 this_thread") == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(FlightRecorderReleasesThreads) {
+  FlightRecorder::Clear();
+
+  // Many more threads than buffers come and go, one at a time.
+  for (size_t i = 0; i < 2 * FlightRecorder::kMaxThreads; i++) {
+    std::thread thread([i]() {
+        FlightRecorder::Record(FlightRecorder::kUser, i, "short_lived");
+      });
+    thread.join();
+  }
+
+  mjlib::base::TemporaryFile temp;
+  const int fd = ::open(temp.native().c_str(), O_WRONLY | O_CREAT, 0644);
+  BOOST_TEST_REQUIRE(fd >= 0);
+  FlightRecorder::Dump(fd);
+  ::close(fd);
+
+  const auto data = ReadFile(temp.native());
+
+  // Each reused the buffer of one which had exited, so the most
+  // recent is still recorded.
+  std::ostringstream last;
+  last << " user " << (2 * FlightRecorder::kMaxThreads - 1)
+       << " short_lived\n";
+  BOOST_TEST(Count(data, last.str()) == 1u);
+  BOOST_TEST(Count(data, " (exited): ") > 0u);
+}
@@ -0,0 +1,60 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/base/nano_time.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+namespace base = mjlib::base;
+
+BOOST_AUTO_TEST_CASE(NanoDurationTest) {
+  BOOST_TEST(base::NanoDuration().count() == 0);
+  BOOST_TEST(base::NanoDuration::seconds(2).count() == 2000000000);
+  BOOST_TEST(base::NanoDuration::milliseconds(3).count() == 3000000);
+  BOOST_TEST(base::NanoDuration::microseconds(-4).count() == -4000);
+  BOOST_TEST(base::NanoDuration::microseconds(5).total_microseconds() == 5);
+  BOOST_TEST(base::NanoDuration::milliseconds(1500).total_seconds() == 1.5);
+
+  const auto a = base::NanoDuration::seconds(1);
+  const auto b = base::NanoDuration::milliseconds(250);
+  BOOST_TEST((a + b).count() == 1250000000);
+  BOOST_TEST((a - b).count() == 750000000);
+  BOOST_TEST((-b).count() == -250000000);
+  BOOST_TEST((b * 4 == a));
+  BOOST_TEST((a / 4 == b));
+  BOOST_TEST((b < a));
+
+  BOOST_TEST(!a.is_special());
+  BOOST_TEST(base::NanoDuration::pos_infin().is_pos_infinity());
+  BOOST_TEST(base::NanoDuration::neg_infin().is_neg_infinity());
+  BOOST_TEST(base::NanoDuration::not_a_date_time().is_not_a_date_time());
+}
+
+BOOST_AUTO_TEST_CASE(NanoTimeTest) {
+  BOOST_TEST(base::RealtimeNanoTime().is_not_a_date_time());
+
+  const base::RealtimeNanoTime t1{1000};
+  const auto t2 = t1 + base::NanoDuration::microseconds(1);
+  BOOST_TEST(t2.count() == 2000);
+  BOOST_TEST(((t2 - t1) == base::NanoDuration(1000)));
+  BOOST_TEST(((t2 - base::NanoDuration(1000)) == t1));
+  BOOST_TEST((t1 < t2));
+
+  // The realtime clock should be somewhere after 2020.
+  BOOST_TEST(base::RealtimeClock::now().count() > 1577836800LL * 1000000000);
+
+  const auto m1 = base::MonotonicClock::now();
+  const auto m2 = base::MonotonicClock::now();
+  BOOST_TEST((m2 >= m1));
+}
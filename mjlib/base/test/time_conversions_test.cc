@@ -71,3 +71,76 @@ BOOST_AUTO_TEST_CASE(ConvertPtimeToEpochSeconds) {
 
 BOOST_AUTO_TEST_CASE(ConvertPtimeToEpochMicroseconds) {
 }
+
+BOOST_AUTO_TEST_CASE(ConvertNanoDuration) {
+  BOOST_TEST(base::ConvertDurationToNanoDuration(
+                 boost::posix_time::milliseconds(3)).count() == 3000000);
+  BOOST_TEST(base::ConvertDurationToNanoDuration(
+                 boost::posix_time::pos_infin).is_pos_infinity());
+  BOOST_TEST(base::ConvertDurationToNanoDuration(
+                 boost::posix_time::neg_infin).is_neg_infinity());
+  BOOST_TEST(base::ConvertDurationToNanoDuration(
+                 boost::posix_time::not_a_date_time).is_not_a_date_time());
+
+  BOOST_TEST(base::ConvertNanoDurationToDuration(
+                 base::NanoDuration::microseconds(-7)) ==
+             boost::posix_time::microseconds(-7));
+  BOOST_TEST(base::ConvertNanoDurationToDuration(
+                 base::NanoDuration::pos_infin()).is_pos_infinity());
+  BOOST_TEST(base::ConvertNanoDurationToDuration(
+                 base::NanoDuration::not_a_date_time()).is_not_a_date_time());
+}
+
+BOOST_AUTO_TEST_CASE(ConvertNanoTime) {
+  const auto ptime = boost::posix_time::time_from_string("2020-03-10 01:02:03.456789");
+  const auto nano = base::ConvertPtimeToNanoTime(ptime);
+  BOOST_TEST(nano.count() == 1583802123456789000LL);
+  BOOST_TEST(base::ConvertNanoTimeToPtime(nano) == ptime);
+
+  BOOST_TEST(base::ConvertNanoTimeToEpochMicroseconds(nano) ==
+             base::ConvertPtimeToEpochMicroseconds(ptime));
+  BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(1583802123456789LL) ==
+              nano));
+
+  BOOST_TEST(base::ConvertPtimeToNanoTime(
+                 boost::posix_time::ptime()).is_not_a_date_time());
+  BOOST_TEST(base::ConvertNanoTimeToPtime(
+                 base::RealtimeNanoTime()).is_not_a_date_time());
+  BOOST_TEST(base::ConvertNanoTimeToPtime(
+                 base::RealtimeNanoTime::pos_infin()).is_pos_infinity());
+
+  // Special values keep their encoding in microseconds.
+  for (auto special : { base::RealtimeNanoTime::pos_infin(),
+          base::RealtimeNanoTime::neg_infin(),
+          base::RealtimeNanoTime::not_a_date_time() }) {
+    const auto us = base::ConvertNanoTimeToEpochMicroseconds(special);
+    BOOST_TEST(us == base::ConvertPtimeToEpochMicroseconds(
+                   base::ConvertNanoTimeToPtime(special)));
+    BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(us) == special));
+  }
+
+  // Finite values which do not fit in nanoseconds saturate.
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(kMax - 1) ==
+              base::RealtimeNanoTime::pos_infin()));
+  BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(kMax / 1000 + 1) ==
+              base::RealtimeNanoTime::pos_infin()));
+  BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(kMin + 2) ==
+              base::RealtimeNanoTime::neg_infin()));
+  BOOST_TEST((base::ConvertEpochMicrosecondsToNanoTime(kMin / 1000 - 1) ==
+              base::RealtimeNanoTime::neg_infin()));
+  BOOST_TEST(base::ConvertEpochMicrosecondsToNanoTime(kMax / 1000).count() ==
+             kMax / 1000 * 1000);
+  BOOST_TEST(
+      base::ConvertEpochMicrosecondsToNanoTime(kMin / 1000).count() ==
+      kMin / 1000 * 1000);
+
+  // int64 nanoseconds only reach to 2262, which a ptime can exceed.
+  BOOST_TEST(base::ConvertPtimeToNanoTime(
+                 boost::posix_time::time_from_string("2300-01-01 00:00:00"))
+             .is_pos_infinity());
+  BOOST_TEST(base::ConvertPtimeToNanoTime(
+                 boost::posix_time::time_from_string("1600-01-01 00:00:00"))
+             .is_neg_infinity());
+}
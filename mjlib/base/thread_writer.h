@@ -28,6 +28,7 @@
 
 #include "mjlib/base/fail.h"
 #include "mjlib/base/fast_stream.h"
+#include "mjlib/base/flight_recorder.h"
 #include "mjlib/base/system_error.h"
 #include "mjlib/base/system_fd.h"
 #include "mjlib/base/system_file.h"
@@ -288,6 +289,7 @@ class ThreadWriter : boost::noncopyable {
 
   void HandleTimer() {
     BOOST_ASSERT(std::this_thread::get_id() == thread_.get_id());
+    FlightRecorder::Record(FlightRecorder::kLogFlush, 0, "thread_writer");
     ::fflush(fd_);
   }
 
@@ -324,6 +326,7 @@ class ThreadWriter : boost::noncopyable {
 
   void HandleFlush() {
     BOOST_ASSERT(std::this_thread::get_id() == thread_.get_id());
+    FlightRecorder::Record(FlightRecorder::kLogFlush, 0, "thread_writer");
     ::fflush(fd_);
   }
 
@@ -342,6 +345,8 @@ class ThreadWriter : boost::noncopyable {
 
     const char* ptr = &(*stream.data())[stream.start()];
     size_t size = stream.size();
+    FlightRecorder::Record(
+        FlightRecorder::kLogFileWrite, size, "thread_writer");
     size_t result = ::fwrite(ptr, size, 1, fd_);
     mjlib::base::FailIfErrno(result == 0);
 
@@ -14,11 +14,39 @@
 
 #include "mjlib/base/time_conversions.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace mjlib {
 namespace base {
 namespace {
 const boost::posix_time::ptime kEpoch(
     boost::gregorian::date(1970, boost::gregorian::Jan, 1));
+
+constexpr int64_t kNanosPerSecond = 1000000000;
+
+// Values which are out of range for nanoseconds saturate to the
+// infinity encodings.
+int64_t TicksToNanoseconds(int64_t ticks) {
+  const int64_t tps = boost::posix_time::time_duration::ticks_per_second();
+  if (tps <= kNanosPerSecond) {
+    constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+    constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+    const int64_t scale = kNanosPerSecond / tps;
+    if (ticks > kMax / scale) { return kMax; }
+    if (ticks < (kMin + 2) / scale) { return kMin; }
+    return ticks * scale;
+  }
+  return ticks / std::max<int64_t>(1, tps / kNanosPerSecond);
+}
+
+int64_t NanosecondsToTicks(int64_t nanoseconds) {
+  const int64_t tps = boost::posix_time::time_duration::ticks_per_second();
+  if (tps <= kNanosPerSecond) {
+    return nanoseconds / std::max<int64_t>(1, kNanosPerSecond / tps);
+  }
+  return nanoseconds * (tps / kNanosPerSecond);
+}
 }
 
 boost::posix_time::time_duration ConvertSecondsToDuration(double time_s) {
@@ -131,5 +159,57 @@ int64_t ConvertPtimeToEpochMicroseconds(boost::posix_time::ptime time) {
   return (time - kEpoch).total_microseconds();
 }
 
+NanoDuration ConvertDurationToNanoDuration(
+    boost::posix_time::time_duration time) {
+  if (time.is_pos_infinity()) {
+    return NanoDuration::pos_infin();
+  } else if (time.is_neg_infinity()) {
+    return NanoDuration::neg_infin();
+  } else if (time.is_special()) {
+    return NanoDuration::not_a_date_time();
+  }
+
+  return NanoDuration(TicksToNanoseconds(time.ticks()));
+}
+
+boost::posix_time::time_duration ConvertNanoDurationToDuration(
+    NanoDuration time) {
+  if (time.is_pos_infinity()) {
+    return boost::posix_time::pos_infin;
+  } else if (time.is_neg_infinity()) {
+    return boost::posix_time::neg_infin;
+  } else if (time.is_not_a_date_time()) {
+    return boost::posix_time::not_a_date_time;
+  }
+
+  return boost::posix_time::time_duration(
+      0, 0, 0, NanosecondsToTicks(time.count()));
+}
+
+RealtimeNanoTime ConvertPtimeToNanoTime(boost::posix_time::ptime time) {
+  if (time.is_pos_infinity()) {
+    return RealtimeNanoTime::pos_infin();
+  } else if (time.is_neg_infinity()) {
+    return RealtimeNanoTime::neg_infin();
+  } else if (time.is_special()) {
+    return RealtimeNanoTime::not_a_date_time();
+  }
+
+  return RealtimeNanoTime(TicksToNanoseconds((time - kEpoch).ticks()));
+}
+
+boost::posix_time::ptime ConvertNanoTimeToPtime(RealtimeNanoTime time) {
+  if (time.is_pos_infinity()) {
+    return boost::posix_time::pos_infin;
+  } else if (time.is_neg_infinity()) {
+    return boost::posix_time::neg_infin;
+  } else if (time.is_not_a_date_time()) {
+    return boost::posix_time::ptime();
+  }
+
+  return kEpoch + boost::posix_time::time_duration(
+      0, 0, 0, NanosecondsToTicks(time.count()));
+}
+
 }
 }
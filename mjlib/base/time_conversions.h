@@ -18,10 +18,13 @@
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
+#include "mjlib/base/nano_time.h"
+
 /// @file
 ///
-/// Translates between boost::posix_time::ptime and various more
-/// standardized formats.  Special values are translated as follows.
+/// Translates between boost::posix_time::ptime, the integer
+/// nanosecond types of nano_time.h, and various more standardized
+/// formats.  Special values are translated as follows.
 ///
 ///                           double                       int64
 /// ptime::neg_infin          -nm<double>::infinity()      nm<int64_t>::min()
@@ -44,5 +47,35 @@ boost::posix_time::ptime ConvertEpochMicrosecondsToPtime(int64_t);
 double ConvertPtimeToEpochSeconds(boost::posix_time::ptime);
 int64_t ConvertPtimeToEpochMicroseconds(boost::posix_time::ptime);
 
+NanoDuration ConvertDurationToNanoDuration(boost::posix_time::time_duration);
+boost::posix_time::time_duration ConvertNanoDurationToDuration(NanoDuration);
+
+/// Finite values which are out of range for nanoseconds saturate to
+/// the infinities.
+RealtimeNanoTime ConvertPtimeToNanoTime(boost::posix_time::ptime);
+boost::posix_time::ptime ConvertNanoTimeToPtime(RealtimeNanoTime);
+
+/// These are the cheap path to and from the microseconds used in log
+/// files, and do not involve ptime at all.
+inline int64_t ConvertNanoTimeToEpochMicroseconds(RealtimeNanoTime time) {
+  if (time.is_special()) { return time.count(); }
+  return time.count() / 1000;
+}
+
+/// Values which are out of range for nanoseconds saturate to the
+/// infinities.
+inline RealtimeNanoTime ConvertEpochMicrosecondsToNanoTime(int64_t value) {
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  if (value == kMax || value == kMin || value == kMin + 1) {
+    return RealtimeNanoTime(value);
+  }
+  // The smallest finite result must not collide with the special
+  // values either.
+  if (value > kMax / 1000) { return RealtimeNanoTime::pos_infin(); }
+  if (value < (kMin + 1) / 1000) { return RealtimeNanoTime::neg_infin(); }
+  return RealtimeNanoTime(value * 1000);
+}
+
 }
 }
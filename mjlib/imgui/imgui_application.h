@@ -14,10 +14,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 #include <Eigen/Core>
 
+#include "mjlib/base/visitor.h"
+
 namespace mjlib {
 namespace imgui {
 
@@ -37,13 +41,65 @@ class ImguiApplication {
     int gl_version_minor = 0;
     std::string glsl_version = "#version 400";
 
+    /// Passed to glfwSwapInterval.  1 paces frames to the display's
+    /// refresh rate, 0 renders as fast as possible.
+    int swap_interval = 1;
+
+    /// When true, PollEvents blocks until input arrives, RequestRedraw
+    /// is called, or idle_timeout_s elapses, so that an application
+    /// with nothing changing uses no CPU.
+    bool idle = false;
+
+    /// The longest PollEvents will block for in idle mode.  If 0, it
+    /// waits indefinitely.
+    double idle_timeout_s = 1.0;
+
+    /// After waking from idle, this many frames are drawn before
+    /// blocking again, so that imgui can settle hover and focus
+    /// state which depends upon the previous frame.
+    int idle_frames = 3;
+
     Options() {}
   };
 
+  struct Stats {
+    uint64_t frames = 0;
+
+    /// The remainder are measured over the most recently completed
+    /// one second window.
+    double frame_rate = 0.0;
+
+    /// Time from PollEvents returning to SwapBuffers returning,
+    /// i.e. excluding any time spent waiting for events.
+    double mean_frame_time_s = 0.0;
+    double max_frame_time_s = 0.0;
+
+    /// The CPU time used by the whole process, as a fraction of one
+    /// core.
+    double cpu_usage = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(frames));
+      a->Visit(MJ_NVP(frame_rate));
+      a->Visit(MJ_NVP(mean_frame_time_s));
+      a->Visit(MJ_NVP(max_frame_time_s));
+      a->Visit(MJ_NVP(cpu_usage));
+    }
+  };
+
   ImguiApplication(const Options&);
   ~ImguiApplication();
 
+  /// Process pending window events.  In idle mode, this may block
+  /// until there is a reason to draw another frame.
   void PollEvents();
+
+  /// Cause the next PollEvents to return promptly, even in idle
+  /// mode.  Data sources should call this when they have something
+  /// new to show.  This may be called from any thread.
+  void RequestRedraw();
+
   void SwapBuffers();
   void NewFrame();
   void Render();
@@ -57,6 +113,8 @@ class ImguiApplication {
   Eigen::Vector2i size();
   Eigen::Vector2i framebuffer_size();
 
+  const Stats& stats() const;
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
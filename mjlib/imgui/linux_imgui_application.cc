@@ -14,6 +14,11 @@
 
 #include "mjlib/imgui/imgui_application.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
 #include <GL/gl3w.h>
 
 // GL must be included *before* we include glfw
@@ -39,7 +44,9 @@ void glfw_error_callback(int error, const char* description) {
 
 class ImguiApplication::Impl {
  public:
-  Impl(const Options& options) {
+  using Clock = std::chrono::steady_clock;
+
+  Impl(const Options& options) : options_(options) {
     glfwSetErrorCallback(glfw_error_callback);
 
     if (!glfwInit()) {
@@ -58,7 +65,7 @@ class ImguiApplication::Impl {
     }
 
     glfwMakeContextCurrent(window_);
-    glfwSwapInterval(1);
+    glfwSwapInterval(options.swap_interval);
 
     const bool err = gl3wInit() != 0;
     if (err) {
@@ -90,8 +97,80 @@ class ImguiApplication::Impl {
     glfwTerminate();
   }
 
+  void PollEvents() {
+    const bool redraw = redraw_requested_.exchange(false);
+
+    if (options_.idle && !redraw && remaining_frames_ <= 0) {
+      if (options_.idle_timeout_s > 0.0) {
+        glfwWaitEventsTimeout(options_.idle_timeout_s);
+      } else {
+        glfwWaitEvents();
+      }
+      // Whatever woke us, it could have changed what imgui will
+      // draw for the next few frames.
+      remaining_frames_ = options_.idle_frames;
+    } else {
+      glfwPollEvents();
+      if (redraw) {
+        remaining_frames_ = options_.idle_frames;
+      } else if (remaining_frames_ > 0) {
+        remaining_frames_--;
+      }
+    }
+
+    frame_start_ = Clock::now();
+  }
+
+  void RequestRedraw() {
+    redraw_requested_.store(true);
+    glfwPostEmptyEvent();
+  }
+
+  void EndFrame() {
+    const auto now = Clock::now();
+    const double frame_time_s = ToSeconds(now - frame_start_);
+
+    stats_.frames++;
+    window_frames_++;
+    window_frame_time_s_ += frame_time_s;
+    window_max_frame_time_s_ = std::max(window_max_frame_time_s_, frame_time_s);
+
+    const double window_s = ToSeconds(now - window_start_);
+    if (window_s < 1.0) { return; }
+
+    const std::clock_t cpu = std::clock();
+
+    stats_.frame_rate = window_frames_ / window_s;
+    stats_.mean_frame_time_s = window_frame_time_s_ / window_frames_;
+    stats_.max_frame_time_s = window_max_frame_time_s_;
+    stats_.cpu_usage =
+        static_cast<double>(cpu - window_cpu_) / CLOCKS_PER_SEC / window_s;
+
+    window_start_ = now;
+    window_cpu_ = cpu;
+    window_frames_ = 0;
+    window_frame_time_s_ = 0.0;
+    window_max_frame_time_s_ = 0.0;
+  }
+
+  static double ToSeconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+  }
+
+  const Options options_;
   GLFWwindow* window_ = nullptr;
   Eigen::Vector4f clear_color_{0.45f, 0.55f, 0.60f, 1.0f};
+
+  std::atomic<bool> redraw_requested_{false};
+  int remaining_frames_ = 0;
+
+  Stats stats_;
+  Clock::time_point frame_start_ = Clock::now();
+  Clock::time_point window_start_ = Clock::now();
+  std::clock_t window_cpu_ = std::clock();
+  int window_frames_ = 0;
+  double window_frame_time_s_ = 0.0;
+  double window_max_frame_time_s_ = 0.0;
 };
 
 ImguiApplication::ImguiApplication(const Options& options)
@@ -101,14 +180,19 @@ ImguiApplication::~ImguiApplication() {}
 
 void ImguiApplication::PollEvents() {
   MJ_TRACE_GL_ERROR();
-  glfwPollEvents();
+  impl_->PollEvents();
   MJ_TRACE_GL_ERROR();
 }
 
+void ImguiApplication::RequestRedraw() {
+  impl_->RequestRedraw();
+}
+
 void ImguiApplication::SwapBuffers() {
   MJ_TRACE_GL_ERROR();
   glfwSwapBuffers(impl_->window_);
   MJ_TRACE_GL_ERROR();
+  impl_->EndFrame();
 }
 
 void ImguiApplication::NewFrame() {
@@ -161,5 +245,9 @@ Eigen::Vector2i ImguiApplication::framebuffer_size() {
   return { result_w, result_h };
 }
 
+const ImguiApplication::Stats& ImguiApplication::stats() const {
+  return impl_->stats_;
+}
+
 }
 }
@@ -31,6 +31,10 @@ class AsyncReadStream : boost::noncopyable {
   virtual ~AsyncReadStream() {}
 
   virtual void async_read_some(MutableBufferSequence, ReadHandler) = 0;
+
+  /// If this stream is backed directly by a POSIX file descriptor,
+  /// return it so that consumers may bypass user space, otherwise -1.
+  virtual int native_read_descriptor() { return -1; }
 };
 
 class AsyncWriteStream : boost::noncopyable {
@@ -40,6 +44,10 @@ class AsyncWriteStream : boost::noncopyable {
   virtual ~AsyncWriteStream() {}
 
   virtual void async_write_some(ConstBufferSequence, WriteHandler) = 0;
+
+  /// If this stream is backed directly by a POSIX file descriptor,
+  /// return it so that consumers may bypass user space, otherwise -1.
+  virtual int native_write_descriptor() { return -1; }
 };
 
 class AsyncStream : public AsyncReadStream, public AsyncWriteStream {
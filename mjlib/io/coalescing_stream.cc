@@ -0,0 +1,303 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/coalescing_stream.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/assert.h"
+#include "mjlib/io/deadline_timer.h"
+
+namespace mjlib {
+namespace io {
+
+class CoalescingStream::Impl : public std::enable_shared_from_this<Impl> {
+ public:
+  Impl(AsyncStream* base, const Options& options)
+      : base_(base),
+        options_(options),
+        executor_(base->get_executor()),
+        timer_(executor_),
+        buffer_(options.buffer_size) {
+    MJ_ASSERT(options_.buffer_size > 0);
+    options_.flush_size = std::max<size_t>(
+        1, std::min(options_.flush_size, options_.buffer_size));
+  }
+
+  void AsyncWriteSome(ConstBufferSequence buffers, WriteHandler handler) {
+    MJ_ASSERT(!blocked_handler_);
+
+    stats_.writes++;
+
+    if (ec_) {
+      Post(std::move(handler), ec_, 0);
+      return;
+    }
+
+    if (boost::asio::buffer_size(buffers) == 0) {
+      Post(std::move(handler), {}, 0);
+      return;
+    }
+
+    if (staged() == buffer_.size()) {
+      stats_.blocked_writes++;
+      blocked_buffers_ = std::move(buffers);
+      blocked_handler_ = std::move(handler);
+      return;
+    }
+
+    Post(std::move(handler), {}, Stage(buffers));
+    MaybeFlush();
+  }
+
+  void AsyncFlush(ErrorCallback callback) {
+    MJ_ASSERT(!flush_callback_);
+
+    if (ec_) {
+      boost::asio::post(executor_, std::bind(std::move(callback), ec_));
+      return;
+    }
+
+    flush_callback_ = std::move(callback);
+    due_total_ = staged_total_;
+    MaybeFlush();
+    MaybeCompleteFlush();
+  }
+
+  void Cancel() {
+    base_->cancel();
+
+    if (blocked_handler_) {
+      Post(std::move(blocked_handler_),
+           boost::asio::error::operation_aborted, 0);
+      blocked_handler_ = {};
+    }
+  }
+
+  AsyncStream* const base_;
+  Stats stats_;
+
+ private:
+  // Bind a member function such that it is ignored if we have been
+  // destroyed in the meantime.
+  template <typename Method>
+  auto Bind(Method method) {
+    return [weak=weak_from_this(), method](const auto&... args) {
+      auto self = weak.lock();
+      if (!self) { return; }
+      ((*self).*method)(args...);
+    };
+  }
+
+  size_t staged() const { return staged_total_ - written_total_; }
+
+  void Post(WriteHandler handler, const base::error_code& ec, size_t size) {
+    boost::asio::post(executor_, std::bind(std::move(handler), ec, size));
+  }
+
+  // Copy as much of @p buffers as will fit, returning the number of
+  // bytes copied.
+  size_t Stage(const ConstBufferSequence& buffers) {
+    size_t result = 0;
+    for (const auto& buffer : buffers) {
+      const char* src = static_cast<const char*>(buffer.data());
+      size_t remaining = buffer.size();
+      while (remaining && staged() < buffer_.size()) {
+        const size_t offset = staged_total_ % buffer_.size();
+        const size_t to_copy = std::min({
+            remaining,
+            buffer_.size() - offset,
+            buffer_.size() - staged()});
+        std::memcpy(&buffer_[offset], src, to_copy);
+        src += to_copy;
+        remaining -= to_copy;
+        staged_total_ += to_copy;
+        result += to_copy;
+      }
+      if (remaining) { break; }
+    }
+    stats_.bytes += result;
+    return result;
+  }
+
+  void MaybeFlush() {
+    if (writing_ || ec_ || staged() == 0) { return; }
+
+    if (written_total_ < due_total_) {
+      // Anything staged before a flush was triggered is written out
+      // as soon as possible.
+    } else if (staged() >= options_.flush_size) {
+      stats_.size_flushes++;
+    } else if (options_.max_delay <= boost::posix_time::time_duration()) {
+      // Without a delay, we write whenever the base stream is idle.
+    } else {
+      StartTimer();
+      return;
+    }
+
+    StartWrite();
+  }
+
+  void StartTimer() {
+    if (timer_started_) { return; }
+    timer_started_ = true;
+    timer_.expires_from_now(options_.max_delay);
+    timer_.async_wait(Bind(&Impl::HandleTimer));
+  }
+
+  void HandleTimer(const base::error_code& ec) {
+    timer_started_ = false;
+    if (ec == boost::asio::error::operation_aborted) { return; }
+
+    stats_.delay_flushes++;
+    due_total_ = staged_total_;
+    MaybeFlush();
+  }
+
+  void StartWrite() {
+    if (timer_started_) {
+      timer_.cancel();
+      timer_started_ = false;
+    }
+
+    due_total_ = std::max(due_total_, staged_total_);
+
+    // The staged data occupies at most two contiguous regions of the
+    // ring buffer.
+    const size_t offset = written_total_ % buffer_.size();
+    const size_t first = std::min(staged(), buffer_.size() - offset);
+    std::array<boost::asio::const_buffer, 2> buffers = {
+      boost::asio::buffer(&buffer_[offset], first),
+      boost::asio::buffer(&buffer_[0], staged() - first),
+    };
+
+    writing_ = true;
+    stats_.flushes++;
+
+    // The underlying stream refers to our buffer until it completes,
+    // so keep ourselves alive until then.
+    base_->async_write_some(
+        ConstBufferSequence(buffers),
+        [self=shared_from_this()](const base::error_code& ec, size_t size) {
+          self->HandleWrite(ec, size);
+        });
+  }
+
+  void HandleWrite(const base::error_code& ec, size_t size) {
+    writing_ = false;
+    written_total_ += size;
+    stats_.flush_bytes += size;
+
+    if (ec && ec != boost::asio::error::operation_aborted) {
+      Fail(ec);
+      return;
+    }
+
+    if (blocked_handler_ && staged() < buffer_.size()) {
+      Post(std::move(blocked_handler_), {}, Stage(blocked_buffers_));
+      blocked_handler_ = {};
+      blocked_buffers_ = {};
+    }
+
+    MaybeCompleteFlush();
+
+    // Cancellation only applies to the write which was in progress.
+    // Whatever remains staged is still written.
+    MaybeFlush();
+  }
+
+  void MaybeCompleteFlush() {
+    if (!flush_callback_ || written_total_ < due_total_) { return; }
+
+    boost::asio::post(
+        executor_, std::bind(std::move(flush_callback_), base::error_code()));
+    flush_callback_ = {};
+  }
+
+  void Fail(const base::error_code& ec) {
+    ec_ = ec;
+
+    if (blocked_handler_) {
+      Post(std::move(blocked_handler_), ec, 0);
+      blocked_handler_ = {};
+    }
+    if (flush_callback_) {
+      boost::asio::post(executor_, std::bind(std::move(flush_callback_), ec));
+      flush_callback_ = {};
+    }
+  }
+
+  Options options_;
+  boost::asio::any_io_executor executor_;
+  DeadlineTimer timer_;
+
+  std::vector<char> buffer_;
+  uint64_t staged_total_ = 0;
+  uint64_t written_total_ = 0;
+
+  // Everything before this offset should be written without waiting
+  // for either limit.
+  uint64_t due_total_ = 0;
+
+  bool writing_ = false;
+  bool timer_started_ = false;
+  base::error_code ec_;
+
+  ConstBufferSequence blocked_buffers_;
+  WriteHandler blocked_handler_;
+  ErrorCallback flush_callback_;
+};
+
+CoalescingStream::CoalescingStream(AsyncStream* base, const Options& options)
+    : impl_(std::make_shared<Impl>(base, options)) {}
+
+CoalescingStream::~CoalescingStream() {}
+
+boost::asio::any_io_executor CoalescingStream::get_executor() {
+  return impl_->base_->get_executor();
+}
+
+void CoalescingStream::async_read_some(MutableBufferSequence buffers,
+                                       ReadHandler handler) {
+  impl_->base_->async_read_some(std::move(buffers), std::move(handler));
+}
+
+void CoalescingStream::async_write_some(ConstBufferSequence buffers,
+                                        WriteHandler handler) {
+  impl_->AsyncWriteSome(std::move(buffers), std::move(handler));
+}
+
+void CoalescingStream::cancel() {
+  impl_->Cancel();
+}
+
+int CoalescingStream::native_read_descriptor() {
+  return impl_->base_->native_read_descriptor();
+}
+
+void CoalescingStream::AsyncFlush(ErrorCallback callback) {
+  impl_->AsyncFlush(std::move(callback));
+}
+
+const CoalescingStream::Stats& CoalescingStream::stats() const {
+  return impl_->stats_;
+}
+
+}
+}
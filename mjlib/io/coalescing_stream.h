@@ -0,0 +1,122 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_stream.h"
+#include "mjlib/io/async_types.h"
+
+namespace mjlib {
+namespace io {
+
+/// An AsyncStream which gathers many small writes into fewer, larger
+/// writes on an underlying stream.
+///
+/// Written data is copied into a ring buffer and the write completes
+/// immediately.  The buffer is written to the underlying stream, as
+/// a single scatter-gather write, once flush_size bytes are pending
+/// or max_delay has passed since the oldest pending byte was staged,
+/// whichever comes first.  When the ring buffer is full, writes wait
+/// for space, so backpressure from the underlying stream is
+/// propagated to the writer.
+///
+/// Reads are passed through unchanged.
+class CoalescingStream : public AsyncStream {
+ public:
+  struct Options {
+    /// The maximum number of bytes which may be staged at once.
+    size_t buffer_size = 4096;
+
+    /// Write out as soon as at least this many bytes are staged.
+    size_t flush_size = 1024;
+
+    /// Write out anything which has been staged for this long.  If
+    /// zero, data is written whenever the underlying stream is idle,
+    /// so writes only coalesce while a previous one is outstanding.
+    boost::posix_time::time_duration max_delay =
+        boost::posix_time::milliseconds(1);
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(buffer_size));
+      a->Visit(MJ_NVP(flush_size));
+      a->Visit(MJ_NVP(max_delay));
+    }
+
+    Options() {}
+  };
+
+  struct Stats {
+    /// Calls to async_write_some on this stream.
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+
+    /// Writes issued to the underlying stream.
+    uint64_t flushes = 0;
+    uint64_t flush_bytes = 0;
+
+    /// Flushes triggered by each of the two limits.
+    uint64_t size_flushes = 0;
+    uint64_t delay_flushes = 0;
+
+    /// Writes which had to wait because the buffer was full.
+    uint64_t blocked_writes = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(writes));
+      a->Visit(MJ_NVP(bytes));
+      a->Visit(MJ_NVP(flushes));
+      a->Visit(MJ_NVP(flush_bytes));
+      a->Visit(MJ_NVP(size_flushes));
+      a->Visit(MJ_NVP(delay_flushes));
+      a->Visit(MJ_NVP(blocked_writes));
+    }
+  };
+
+  /// @p base must outlive this object.
+  CoalescingStream(AsyncStream* base, const Options& options = Options());
+  ~CoalescingStream() override;
+
+  boost::asio::any_io_executor get_executor() override;
+
+  void async_read_some(MutableBufferSequence, ReadHandler) override;
+  void async_write_some(ConstBufferSequence, WriteHandler) override;
+
+  /// Cancel outstanding reads and any write which is waiting for
+  /// buffer space.  Data already staged is still written.
+  void cancel() override;
+
+  int native_read_descriptor() override;
+
+  /// Write out everything staged so far without waiting for either
+  /// limit, and invoke @p callback once it has all been written.
+  /// Only one flush may be outstanding at a time.
+  void AsyncFlush(ErrorCallback callback);
+
+  const Stats& stats() const;
+
+ private:
+  class Impl;
+  std::shared_ptr<Impl> impl_;
+};
+
+}
+}
@@ -22,6 +22,7 @@
 #include <boost/system/error_code.hpp>
 
 #include "mjlib/base/system_error.h"
+#include "mjlib/base/time_conversions.h"
 #include "mjlib/io/timer_selector.h"
 
 namespace mjlib {
@@ -84,6 +85,16 @@ class DeadlineTimer {
     return make_delegate()->expires_at(expiry_time, ec);
   }
 
+  /// Integer nanosecond variants.  The underlying timer services are
+  /// ptime based, so these convert once at the boundary.
+  std::size_t expires_at(base::RealtimeNanoTime expiry_time) {
+    return expires_at(base::ConvertNanoTimeToPtime(expiry_time));
+  }
+
+  std::size_t expires_from_now(base::NanoDuration expiry_time) {
+    return expires_from_now(base::ConvertNanoDurationToDuration(expiry_time));
+  }
+
   std::size_t expires_from_now(const duration_type& expiry_time) {
     boost::system::error_code ec;
     auto result = make_delegate()->expires_from_now(expiry_time, ec);
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include "mjlib/base/time_conversions.h"
 #include "mjlib/io/timer_selector.h"
 
 namespace mjlib {
@@ -23,5 +24,11 @@ inline boost::posix_time::ptime Now(boost::asio::execution_context& context) {
   return boost::asio::use_service<TimerSelector>(context).now();
 }
 
+/// The same as Now, but as an integer nanosecond time.  When a debug
+/// timer service is in use, this reflects its simulated time.
+inline base::RealtimeNanoTime NowNano(boost::asio::execution_context& context) {
+  return base::ConvertPtimeToNanoTime(Now(context));
+}
+
 }
 }
@@ -14,11 +14,14 @@
 
 #pragma once
 
+#include <typeinfo>
+
 #include <boost/asio/execution_context.hpp>
 #include <boost/asio/io_context.hpp>
 
 #include "mjlib/base/assert.h"
 #include "mjlib/base/aborting_posix_timer.h"
+#include "mjlib/base/flight_recorder.h"
 
 namespace mjlib {
 namespace io {
@@ -29,6 +32,9 @@ namespace io {
 /// posix signal is delivered if the event loop does not empty with
 /// sufficient frequency.
 ///
+/// The start and end of every event is noted in the
+/// base::FlightRecorder, which is dumped when either timer expires.
+///
 /// It wraps an existing executor.
 class RealtimeExecutor {
  public:
@@ -154,6 +160,7 @@ class RealtimeExecutor {
     }
 
     int outstanding_work_ = 0;
+    uint32_t event_count_ = 0;
 
     Options options_;
 
@@ -172,6 +179,11 @@ class RealtimeExecutor {
         : service_(service), callback_(std::move(callback)) {}
 
     void operator()() {
+      const uint32_t event_id = service_->event_count_++;
+      base::FlightRecorder::Record(
+          base::FlightRecorder::kHandlerStart, event_id,
+          typeid(Callback).name());
+
       if (service_->options_.event_timeout_ns) {
         service_->event_timer_.Start(service_->options_.event_timeout_ns);
       }
@@ -181,6 +193,9 @@ class RealtimeExecutor {
       if (service_->options_.event_timeout_ns) {
         service_->event_timer_.Stop();
       }
+
+      base::FlightRecorder::Record(
+          base::FlightRecorder::kHandlerEnd, event_id);
       service_->StopWork();
     }
 
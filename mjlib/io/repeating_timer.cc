@@ -36,6 +36,10 @@ void RepeatingTimer::start(boost::posix_time::time_duration period,
   StartInternal();
 }
 
+void RepeatingTimer::start(base::NanoDuration period, Callback callback) {
+  start(base::ConvertNanoDurationToDuration(period), std::move(callback));
+}
+
 std::size_t RepeatingTimer::cancel() {
   callback_ = {};
   return timer_.cancel();
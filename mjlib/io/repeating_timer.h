@@ -40,6 +40,7 @@ class RepeatingTimer {
   // Unlike most boost::asio callbacks, @p callback is invoked
   // possibly many times, at a regular interval.
   void start(boost::posix_time::time_duration, Callback callback);
+  void start(base::NanoDuration, Callback callback);
 
   // Stop invoking the callback.  Return if anything was actually
   // cancelled.  If the timer callback has already been enqueued, the
@@ -0,0 +1,420 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/stream_copy.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __linux__
+#include <boost/asio/posix/stream_descriptor.hpp>
+#endif  // __linux__
+
+#include "mjlib/base/assert.h"
+
+namespace mjlib {
+namespace io {
+
+class StreamCopy::Impl : public std::enable_shared_from_this<Impl> {
+ public:
+  Impl(const boost::asio::any_io_executor& executor,
+       AsyncReadStream* read_stream, AsyncWriteStream* write_stream,
+       ErrorCallback done_callback,
+       const Options& options)
+      : executor_(executor),
+        read_stream_(read_stream),
+        write_stream_(write_stream),
+        done_callback_(std::move(done_callback)),
+        options_(options) {
+    MJ_ASSERT(options_.buffer_size > 0);
+  }
+
+  ~Impl() {
+#ifdef __linux__
+    CloseSplice();
+#endif  // __linux__
+  }
+
+  void Start() {
+#ifdef __linux__
+    if (options_.splice && StartSplice()) { return; }
+#endif  // __linux__
+
+    buffer_.resize(options_.buffer_size);
+    MaybeStartRead();
+  }
+
+  void Cancel() {
+#ifdef __linux__
+    if (splice_) {
+      splice_ = false;
+      stats_.splice = false;
+      CloseSplice();
+    }
+#endif  // __linux__
+    Finish(boost::asio::error::operation_aborted);
+  }
+
+  Stats stats_;
+
+ private:
+  // Bind a member function such that it is ignored if we have been
+  // destroyed in the meantime.
+  template <typename Method>
+  auto Bind(Method method) {
+    return [weak=weak_from_this(), method](const auto&... args) {
+      auto self = weak.lock();
+      if (!self) { return; }
+      ((*self).*method)(args...);
+    };
+  }
+
+  size_t buffered() const { return read_total_ - write_total_; }
+
+  void MaybeStartRead() {
+    if (reading_ || read_ec_ || done_) { return; }
+
+    const size_t used = buffered();
+    if (used == buffer_.size()) { return; }
+
+    const size_t offset = read_total_ % buffer_.size();
+    const size_t size = std::min(buffer_.size() - offset,
+                                 buffer_.size() - used);
+    reading_ = true;
+    read_stream_->async_read_some(
+        boost::asio::buffer(&buffer_[offset], size),
+        Bind(&Impl::HandleRead));
+  }
+
+  void HandleRead(const base::error_code& ec, size_t size) {
+    reading_ = false;
+
+    read_total_ += size;
+    stats_.bytes_read += size;
+    stats_.read_count++;
+
+    if (ec) {
+      read_ec_ = ec;
+      MaybeFinish();
+      return;
+    }
+
+    MaybeStartWrite();
+    MaybeStartRead();
+  }
+
+  void MaybeStartWrite() {
+    if (writing_ || done_) { return; }
+
+    const size_t used = buffered();
+    if (used == 0) { return; }
+
+    const size_t offset = write_total_ % buffer_.size();
+    const size_t size = std::min(buffer_.size() - offset, used);
+    writing_ = true;
+    write_stream_->async_write_some(
+        boost::asio::buffer(&buffer_[offset], size),
+        Bind(&Impl::HandleWrite));
+  }
+
+  void HandleWrite(const base::error_code& ec, size_t size) {
+    writing_ = false;
+
+    write_total_ += size;
+    stats_.bytes_written += size;
+    stats_.write_count++;
+
+    if (ec) {
+      Finish(ec);
+      return;
+    }
+
+    MaybeStartRead();
+    MaybeStartWrite();
+    MaybeFinish();
+  }
+
+  // Once the read side has failed, report that error only after
+  // everything which was read before it has been written.
+  void MaybeFinish() {
+    if (!read_ec_ || writing_) { return; }
+    if (buffered() != 0) {
+      MaybeStartWrite();
+      return;
+    }
+    Finish(read_ec_);
+  }
+
+  void Finish(const base::error_code& ec) {
+    if (done_) { return; }
+    done_ = true;
+    if (!done_callback_) { return; }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(done_callback_), ec));
+    done_callback_ = {};
+  }
+
+#ifdef __linux__
+  bool StartSplice() {
+    const int read_fd = read_stream_->native_read_descriptor();
+    const int write_fd = write_stream_->native_write_descriptor();
+    if (read_fd < 0 || write_fd < 0) { return false; }
+
+    // The duplicates share their file description, and thus its
+    // flags, with the originals.  We won't change those out from
+    // under the owner, so require that they be non-blocking already.
+    auto non_blocking = [](int fd) {
+      const int flags = ::fcntl(fd, F_GETFL);
+      return flags >= 0 && (flags & O_NONBLOCK) != 0;
+    };
+    if (!non_blocking(read_fd) || !non_blocking(write_fd)) { return false; }
+
+    if (::pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) < 0) { return false; }
+
+    // The kernel rounds this up to a page multiple, and may refuse it
+    // entirely if it exceeds the system limit.  Either way, what we
+    // actually got is what governs flow control.
+    ::fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(options_.buffer_size));
+    const int capacity = ::fcntl(pipe_[1], F_GETPIPE_SZ);
+    if (capacity <= 0) {
+      ClosePipe();
+      return false;
+    }
+    pipe_capacity_ = capacity;
+
+    // We need our own descriptors to wait on, as the streams have
+    // already registered theirs with the reactor.
+    boost::system::error_code ec;
+    const int in_fd = ::fcntl(read_fd, F_DUPFD_CLOEXEC, 0);
+    const int out_fd = ::fcntl(write_fd, F_DUPFD_CLOEXEC, 0);
+    if (in_fd >= 0) { in_.assign(in_fd, ec); }
+    if (out_fd >= 0) { out_.assign(out_fd, ec); }
+    if (in_fd < 0 || out_fd < 0 || ec) {
+      if (in_fd >= 0 && !in_.is_open()) { ::close(in_fd); }
+      if (out_fd >= 0 && !out_.is_open()) { ::close(out_fd); }
+      CloseSplice();
+      return false;
+    }
+
+    splice_ = true;
+    stats_.splice = true;
+    MaybeSpliceRead();
+    return true;
+  }
+
+  void MaybeSpliceRead() {
+    if (reading_ || read_ec_ || done_) { return; }
+    if (pipe_used_ >= pipe_capacity_) { return; }
+
+    reading_ = true;
+    in_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                   Bind(&Impl::HandleSpliceRead));
+  }
+
+  void HandleSpliceRead(const base::error_code& ec) {
+    if (!splice_) { return; }
+    reading_ = false;
+
+    if (ec) {
+      read_ec_ = ec;
+      MaybeFinishSplice();
+      return;
+    }
+
+    const ssize_t result = ::splice(
+        in_.native_handle(), nullptr, pipe_[1], nullptr,
+        pipe_capacity_ - pipe_used_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (result < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        MaybeSpliceRead();
+        return;
+      }
+      if (errno == EINVAL && stats_.bytes_read == 0) {
+        // This kind of descriptor does not support splice.
+        FallBackToBuffered();
+        return;
+      }
+      read_ec_ = base::error_code::syserrno("splice");
+      MaybeFinishSplice();
+      return;
+    }
+    if (result == 0) {
+      read_ec_ = boost::asio::error::eof;
+      MaybeFinishSplice();
+      return;
+    }
+
+    pipe_used_ += result;
+    stats_.bytes_read += result;
+    stats_.read_count++;
+
+    MaybeSpliceWrite();
+    MaybeSpliceRead();
+  }
+
+  void MaybeSpliceWrite() {
+    if (writing_ || done_) { return; }
+    if (pipe_used_ == 0) { return; }
+
+    writing_ = true;
+    out_.async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                    Bind(&Impl::HandleSpliceWrite));
+  }
+
+  void HandleSpliceWrite(const base::error_code& ec) {
+    if (!splice_) { return; }
+    writing_ = false;
+
+    if (ec) {
+      Finish(ec);
+      return;
+    }
+
+    const ssize_t result = ::splice(
+        pipe_[0], nullptr, out_.native_handle(), nullptr,
+        pipe_used_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (result < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        MaybeSpliceWrite();
+        return;
+      }
+      if (errno == EINVAL && stats_.bytes_written == 0) {
+        FallBackToBuffered();
+        return;
+      }
+      Finish(base::error_code::syserrno("splice"));
+      return;
+    }
+
+    pipe_used_ -= result;
+    stats_.bytes_written += result;
+    stats_.write_count++;
+
+    MaybeSpliceRead();
+    MaybeSpliceWrite();
+    MaybeFinishSplice();
+  }
+
+  void MaybeFinishSplice() {
+    if (!read_ec_ || writing_) { return; }
+    if (pipe_used_ != 0) {
+      MaybeSpliceWrite();
+      return;
+    }
+    Finish(read_ec_);
+  }
+
+  void FallBackToBuffered() {
+    // Anything already spliced into the pipe becomes the initial
+    // contents of the ring buffer.
+    buffer_.resize(std::max(options_.buffer_size, pipe_capacity_));
+    while (pipe_used_ > 0) {
+      const ssize_t result = ::read(
+          pipe_[0], &buffer_[read_total_], pipe_used_);
+      if (result <= 0) {
+        Finish(base::error_code::syserrno("reading splice pipe"));
+        return;
+      }
+      read_total_ += result;
+      pipe_used_ -= result;
+    }
+
+    splice_ = false;
+    stats_.splice = false;
+    reading_ = false;
+    writing_ = false;
+    CloseSplice();
+
+    MaybeStartWrite();
+    MaybeStartRead();
+  }
+
+  void CloseSplice() {
+    boost::system::error_code ec;
+    in_.close(ec);
+    out_.close(ec);
+    ClosePipe();
+  }
+
+  void ClosePipe() {
+    for (auto& fd : pipe_) {
+      if (fd >= 0) { ::close(fd); }
+      fd = -1;
+    }
+  }
+
+#endif  // __linux__
+
+  boost::asio::any_io_executor executor_;
+  AsyncReadStream* const read_stream_;
+  AsyncWriteStream* const write_stream_;
+  ErrorCallback done_callback_;
+  const Options options_;
+
+  std::vector<char> buffer_;
+  uint64_t read_total_ = 0;
+  uint64_t write_total_ = 0;
+
+  bool reading_ = false;
+  bool writing_ = false;
+  bool done_ = false;
+  base::error_code read_ec_;
+
+#ifdef __linux__
+  boost::asio::posix::stream_descriptor in_{executor_};
+  boost::asio::posix::stream_descriptor out_{executor_};
+  int pipe_[2] = {-1, -1};
+  size_t pipe_capacity_ = 0;
+  size_t pipe_used_ = 0;
+  bool splice_ = false;
+#endif  // __linux__
+};
+
+StreamCopy::StreamCopy(const boost::asio::any_io_executor& executor,
+                       AsyncReadStream* read_stream,
+                       AsyncWriteStream* write_stream,
+                       ErrorCallback done_callback)
+    : StreamCopy(executor, read_stream, write_stream,
+                 std::move(done_callback), Options()) {}
+
+StreamCopy::StreamCopy(const boost::asio::any_io_executor& executor,
+                       AsyncReadStream* read_stream,
+                       AsyncWriteStream* write_stream,
+                       ErrorCallback done_callback,
+                       const Options& options)
+    : impl_(std::make_shared<Impl>(
+                executor, read_stream, write_stream,
+                std::move(done_callback), options)) {
+  impl_->Start();
+}
+
+StreamCopy::~StreamCopy() {}
+
+void StreamCopy::cancel() {
+  impl_->Cancel();
+}
+
+const StreamCopy::Stats& StreamCopy::stats() const {
+  return impl_->stats_;
+}
+
+}
+}
@@ -14,88 +14,110 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
+
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/asio/post.hpp>
-#include <boost/asio/write.hpp>
 
-#include "mjlib/base/fail.h"
+#include "mjlib/base/visitor.h"
 #include "mjlib/io/async_stream.h"
 #include "mjlib/io/async_types.h"
 
 namespace mjlib {
 namespace io {
 
+/// Copy everything from one stream to another until an error occurs.
+///
+/// Data is staged in a ring buffer, so that a new read may be
+/// outstanding while previously read data is still being written.
+/// Optionally, when both streams expose native file descriptors on
+/// Linux, data is instead moved with splice(2) through a kernel pipe
+/// and never enters user space.
 class StreamCopy {
  public:
-  StreamCopy(const boost::asio::any_io_executor& executor,
-             AsyncReadStream* read_stream, AsyncWriteStream* write_stream,
-             ErrorCallback done_callback)
-      : executor_(executor),
-        read_stream_(read_stream),
-        write_stream_(write_stream),
-        done_callback_(std::move(done_callback)) {
-    StartRead();
-  }
+  struct Options {
+    /// The maximum number of bytes which may be staged between the
+    /// read and write sides at once.
+    size_t buffer_size = 4096;
 
- private:
-  void StartRead() {
-    read_stream_->async_read_some(
-        boost::asio::buffer(buffer_),
-        std::bind(&StreamCopy::HandleRead, this,
-                  std::placeholders::_1, std::placeholders::_2));
-  }
+    /// Use splice(2) when both streams have native descriptors which
+    /// are already in non-blocking mode.  The copy then holds
+    /// duplicates of those descriptors, so it must be cancelled or
+    /// destroyed before the underlying file is actually closed.
+    bool splice = false;
 
-  void HandleRead(const base::error_code& ec, size_t size) {
-    if (ec) {
-      if (done_callback_) {
-        boost::asio::post(
-            executor_,
-            std::bind(std::move(done_callback_), ec));
-        done_callback_ = {};
-      }
-      return;
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(buffer_size));
+      a->Visit(MJ_NVP(splice));
     }
-    boost::asio::async_write(
-        *write_stream_,
-        boost::asio::buffer(buffer_, size),
-        std::bind(&StreamCopy::HandleWrite, this,
-                  std::placeholders::_1, std::placeholders::_2));
-  }
+  };
+
+  struct Stats {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t read_count = 0;
+    uint64_t write_count = 0;
 
-  void HandleWrite(const base::error_code& ec, size_t) {
-    if (ec) {
-      if (done_callback_) {
-        boost::asio::post(
-            executor_,
-            std::bind(std::move(done_callback_), ec));
-        done_callback_ = {};
-      }
-      return;
+    /// True if data is being moved with splice(2).
+    bool splice = false;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(bytes_read));
+      a->Visit(MJ_NVP(bytes_written));
+      a->Visit(MJ_NVP(read_count));
+      a->Visit(MJ_NVP(write_count));
+      a->Visit(MJ_NVP(splice));
     }
-    StartRead();
-  }
+  };
 
-  boost::asio::any_io_executor executor_;
-  AsyncReadStream* const read_stream_;
-  AsyncWriteStream* const write_stream_;
-  char buffer_[4096] = {};
-  ErrorCallback done_callback_;
+  StreamCopy(const boost::asio::any_io_executor& executor,
+             AsyncReadStream* read_stream, AsyncWriteStream* write_stream,
+             ErrorCallback done_callback);
+  StreamCopy(const boost::asio::any_io_executor& executor,
+             AsyncReadStream* read_stream, AsyncWriteStream* write_stream,
+             ErrorCallback done_callback,
+             const Options& options);
+  ~StreamCopy();
+
+  /// Stop copying and close any duplicated descriptors.  The done
+  /// callback is invoked with operation_aborted.  Operations already
+  /// outstanding on the wrapped streams are not cancelled.
+  void cancel();
+
+  const Stats& stats() const;
+
+ private:
+  class Impl;
+  std::shared_ptr<Impl> impl_;
 };
 
 class BidirectionalStreamCopy {
  public:
   BidirectionalStreamCopy(const boost::asio::any_io_executor& executor,
                           AsyncStream* left, AsyncStream* right,
-                          ErrorCallback done_callback)
+                          ErrorCallback done_callback,
+                          const StreamCopy::Options& options =
+                          StreamCopy::Options())
       : executor_(executor),
         copy1_(executor, left, right, std::bind(
                    &BidirectionalStreamCopy::HandleDone, this,
-                   std::placeholders::_1)),
+                   std::placeholders::_1), options),
         copy2_(executor, right, left, std::bind(
                    &BidirectionalStreamCopy::HandleDone, this,
-                   std::placeholders::_1)),
+                   std::placeholders::_1), options),
         done_callback_(std::move(done_callback)) {}
 
+  void cancel() {
+    copy1_.cancel();
+    copy2_.cancel();
+  }
+
+  const StreamCopy::Stats& left_to_right() const { return copy1_.stats(); }
+  const StreamCopy::Stats& right_to_left() const { return copy2_.stats(); }
+
  private:
   void HandleDone(const base::error_code& ec) {
     if (!done_callback_) { return; }
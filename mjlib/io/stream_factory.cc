@@ -17,6 +17,7 @@
 #include <boost/asio/post.hpp>
 
 #include "mjlib/io/stream_factory_serial.h"
+#include "mjlib/io/stream_factory_shm.h"
 #include "mjlib/io/stream_factory_stdio.h"
 #include "mjlib/io/stream_factory_tcp_client.h"
 #include "mjlib/io/stream_factory_tcp_server.h"
@@ -32,6 +33,7 @@ std::map<StreamFactory::Type, const char*> StreamFactory::TypeMapper() {
     { Type::kTcpClient, "tcp" },
     { Type::kTcpServer, "tcp_server" },
     { Type::kPipe, "pipe" },
+    { Type::kShm, "shm" },
   };
 }
 
@@ -73,6 +75,10 @@ void StreamFactory::AsyncCreate(const Options& options, StreamHandler handler) {
                         std::bind(std::move(handler), base::error_code(), stream));
       return;
     }
+    case Type::kShm: {
+      detail::AsyncCreateShm(impl_->executor_, options, std::move(handler));
+      return;
+    }
   }
 }
 
@@ -17,6 +17,7 @@
 #include <map>
 
 #include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/ip/tcp.hpp>
 
 #include "mjlib/base/args_visitor.h"
 #include "mjlib/io/async_stream.h"
@@ -34,6 +35,7 @@ class StreamFactory : boost::noncopyable {
     kTcpClient,
     kTcpServer,
     kPipe,
+    kShm,
   };
 
   static std::map<Type, const char*> TypeMapper();
@@ -55,9 +57,35 @@ class StreamFactory : boost::noncopyable {
 
     int tcp_server_port = 0;
 
+    // When set, the tcp server accepts many clients at once.  Writes
+    // are sent to all of them, while reads come from the controller
+    // client (the oldest still connected), or from all clients when
+    // tcp_server_merge_reads is set.
+    bool tcp_server_fanout = false;
+    int tcp_server_max_clients = 8;
+    // The most bytes which may be queued for any one client.
+    int tcp_server_client_queue = 65536;
+    // If true, writes do not complete until every client has drained
+    // below its queue limit.  Otherwise, data which would overflow a
+    // slow client's queue is dropped for that client only.
+    bool tcp_server_backpressure = false;
+    bool tcp_server_merge_reads = false;
+
+    // Applied to tcp client and server sockets.
+    bool tcp_nodelay = false;
+    // If non-zero, the SO_SNDBUF size in bytes.
+    int tcp_send_buffer = 0;
+
     std::string pipe_key;
     int pipe_direction = 0;
 
+    // Streams with the same key and opposite directions are
+    // connected through shared memory, even across processes.
+    std::string shm_key;
+    int shm_direction = 0;
+    // The capacity in bytes of each direction.  Both sides must agree.
+    int shm_size = 1 << 20;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVPT(type));
@@ -71,8 +99,18 @@ class StreamFactory : boost::noncopyable {
       a->Visit(MJ_NVP(tcp_target));
       a->Visit(MJ_NVP(tcp_target_port));
       a->Visit(MJ_NVP(tcp_server_port));
+      a->Visit(MJ_NVP(tcp_server_fanout));
+      a->Visit(MJ_NVP(tcp_server_max_clients));
+      a->Visit(MJ_NVP(tcp_server_client_queue));
+      a->Visit(MJ_NVP(tcp_server_backpressure));
+      a->Visit(MJ_NVP(tcp_server_merge_reads));
+      a->Visit(MJ_NVP(tcp_nodelay));
+      a->Visit(MJ_NVP(tcp_send_buffer));
       a->Visit(MJ_NVP(pipe_key));
       a->Visit(MJ_NVP(pipe_direction));
+      a->Visit(MJ_NVP(shm_key));
+      a->Visit(MJ_NVP(shm_direction));
+      a->Visit(MJ_NVP(shm_size));
     }
   };
 
@@ -83,6 +121,13 @@ class StreamFactory : boost::noncopyable {
   /// to @p handler upon completion.
   void AsyncCreate(const Options&, StreamHandler handler);
 
+  /// Apply the tcp_nodelay and tcp_send_buffer options to a connected
+  /// socket.  This is for other tcp servers and clients which should
+  /// honor the same options.  Failures are ignored, as these only
+  /// affect performance.
+  static void ConfigureTcpSocket(boost::asio::ip::tcp::socket*,
+                                 const Options&);
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
@@ -108,6 +108,11 @@ class SerialStream : public AsyncStream {
     port_.cancel();
   }
 
+#ifndef _WIN32
+  int native_read_descriptor() override { return port_.native_handle(); }
+  int native_write_descriptor() override { return port_.native_handle(); }
+#endif  // _WIN32
+
  private:
   boost::asio::any_io_executor executor_;
   const StreamFactory::Options options_;
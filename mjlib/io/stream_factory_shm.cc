@@ -0,0 +1,483 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/stream_factory_shm.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <optional>
+
+#include <boost/asio/post.hpp>
+
+#ifdef __linux__
+#include <boost/asio/posix/stream_descriptor.hpp>
+#endif  // __linux__
+
+#include "mjlib/base/system_error.h"
+
+namespace mjlib {
+namespace io {
+namespace detail {
+
+#ifdef __linux__
+namespace {
+
+/// One direction of the stream.  The producer only ever writes
+/// 'head' and the consumer only ever writes 'tail', so no locks are
+/// needed.  Each lives on its own cache line.
+struct Ring {
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+
+  // Set by a side which found the ring empty (consumer) or full
+  // (producer) and is about to sleep on its doorbell.
+  alignas(64) std::atomic<uint32_t> consumer_waiting;
+  std::atomic<uint32_t> producer_waiting;
+
+  // Set when the producer has gone away.
+  std::atomic<uint32_t> closed;
+
+  // Incremented each time a producer opens the ring.  The consumer
+  // skips anything before 'session_start', which may have been left
+  // by an earlier producer that crashed.
+  std::atomic<uint32_t> generation;
+  std::atomic<uint64_t> session_start;
+};
+
+/// The start of the shared segment.  The ring data follows it.  A
+/// freshly created segment is all zeros, which is a valid initial
+/// state for every member.
+struct Header {
+  std::atomic<uint64_t> capacity;
+  std::atomic<uint32_t> attached;
+  Ring rings[2];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+/// A stream connected through shared memory to another process (or
+/// the same one) which opened the same key with the opposite
+/// direction.
+///
+/// Data is copied directly into and out of a pair of single
+/// producer, single consumer rings.  The kernel is only involved
+/// when one side finds its ring empty or full and needs to sleep.
+/// Then it is woken through a named FIFO "doorbell", which unlike an
+/// eventfd, can be opened by unrelated processes and waited on by
+/// asio.
+class ShmStream : public AsyncStream,
+                  public std::enable_shared_from_this<ShmStream> {
+ public:
+  ShmStream(const boost::asio::any_io_executor& executor,
+            const StreamFactory::Options& options)
+      : executor_(executor),
+        options_(options) {
+    BOOST_ASSERT(options.type == StreamFactory::Type::kShm);
+  }
+
+  ~ShmStream() override {
+    if (tx_) {
+      tx_->closed.store(1);
+      RingDoorbell();
+
+      if (header_->attached.fetch_sub(1) == 1) {
+        // We were the last one out, so nothing will be left behind.
+        ::shm_unlink(ShmName().c_str());
+        ::unlink(DoorbellName(0).c_str());
+        ::unlink(DoorbellName(1).c_str());
+      }
+    }
+    if (header_) { ::munmap(header_, mapped_size_); }
+    if (peer_doorbell_ >= 0) { ::close(peer_doorbell_); }
+  }
+
+  void Open(base::error_code* ec) {
+    if (options_.shm_key.empty() ||
+        options_.shm_key.find('/') != std::string::npos) {
+      *ec = base::error_code::einval("invalid shm_key");
+      return;
+    }
+    if (options_.shm_direction != 0 && options_.shm_direction != 1) {
+      *ec = base::error_code::einval("shm_direction must be 0 or 1");
+      return;
+    }
+    if (options_.shm_size <= 0) {
+      *ec = base::error_code::einval("shm_size must be positive");
+      return;
+    }
+
+    const uint64_t capacity = options_.shm_size;
+    mapped_size_ = sizeof(Header) + 2 * capacity;
+
+    const int fd = ::shm_open(ShmName().c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+      *ec = base::error_code::syserrno("shm_open");
+      return;
+    }
+    struct stat st = {};
+    if (::fstat(fd, &st) < 0) {
+      *ec = base::error_code::syserrno("fstat");
+      ::close(fd);
+      return;
+    }
+    if (st.st_size != 0 &&
+        static_cast<uint64_t>(st.st_size) != mapped_size_) {
+      *ec = base::error_code::einval("shm_size does not match peer");
+      ::close(fd);
+      return;
+    }
+    if (::ftruncate(fd, mapped_size_) < 0) {
+      *ec = base::error_code::syserrno("ftruncate");
+      ::close(fd);
+      return;
+    }
+    void* const mapped = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+      *ec = base::error_code::syserrno("mmap");
+      return;
+    }
+    header_ = static_cast<Header*>(mapped);
+
+    uint64_t expected_capacity = 0;
+    if (!header_->capacity.compare_exchange_strong(
+            expected_capacity, capacity) &&
+        expected_capacity != capacity) {
+      *ec = base::error_code::einval("shm_size does not match peer");
+      return;
+    }
+    capacity_ = capacity;
+
+    const int direction = options_.shm_direction;
+    char* const data = reinterpret_cast<char*>(header_ + 1);
+    tx_ = &header_->rings[direction];
+    tx_data_ = data + direction * capacity_;
+    rx_ = &header_->rings[1 - direction];
+    rx_data_ = data + (1 - direction) * capacity_;
+
+    header_->attached.fetch_add(1);
+
+    // Start a new session on the ring we produce for.  The consumer
+    // will discard anything written before this point.  Waiting and
+    // closed flags left by a previous user of our side are cleared
+    // first, so that a consumer which picks up the new generation
+    // never sees the old producer's close.
+    tx_->producer_waiting.store(0);
+    tx_->closed.store(0);
+    tx_->session_start.store(tx_->head.load());
+    tx_->generation.fetch_add(1);
+
+    rx_->consumer_waiting.store(0);
+    SyncRxSession();
+
+    // Both doorbells are opened read-write, so that neither open
+    // blocks nor fails when the other side is not yet present.
+    for (int i = 0; i < 2; i++) {
+      if (::mkfifo(DoorbellName(i).c_str(), 0600) < 0 && errno != EEXIST) {
+        *ec = base::error_code::syserrno("mkfifo");
+        return;
+      }
+    }
+    const int my_doorbell = ::open(
+        DoorbellName(direction).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (my_doorbell < 0) {
+      *ec = base::error_code::syserrno("opening doorbell");
+      return;
+    }
+    boost::system::error_code boost_ec;
+    doorbell_.assign(my_doorbell, boost_ec);
+    if (boost_ec) {
+      *ec = boost_ec;
+      return;
+    }
+    peer_doorbell_ = ::open(
+        DoorbellName(1 - direction).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (peer_doorbell_ < 0) {
+      *ec = base::error_code::syserrno("opening doorbell");
+      return;
+    }
+  }
+
+  boost::asio::any_io_executor get_executor() override { return executor_; }
+
+  void async_read_some(MutableBufferSequence buffers,
+                       ReadHandler handler) override {
+    BOOST_ASSERT(!read_handler_);
+    read_buffers_ = std::move(buffers);
+    read_handler_ = std::move(handler);
+    ProcessRead();
+  }
+
+  void async_write_some(ConstBufferSequence buffers,
+                        WriteHandler handler) override {
+    BOOST_ASSERT(!write_handler_);
+    write_buffers_ = std::move(buffers);
+    write_handler_ = std::move(handler);
+    ProcessWrite();
+  }
+
+  void cancel() override {
+    boost::system::error_code ec;
+    doorbell_.cancel(ec);
+
+    if (read_handler_) {
+      CompleteRead(boost::asio::error::operation_aborted, 0);
+    }
+    if (write_handler_) {
+      CompleteWrite(boost::asio::error::operation_aborted, 0);
+    }
+  }
+
+ private:
+  template <typename Method>
+  auto Bind(Method method) {
+    return [weak=weak_from_this(), method](const auto&... args) {
+      auto self = weak.lock();
+      if (!self) { return; }
+      ((*self).*method)(args...);
+    };
+  }
+
+  std::string ShmName() const {
+    return "/mjlib-" + options_.shm_key;
+  }
+
+  std::string DoorbellName(int direction) const {
+    return "/dev/shm/mjlib-" + options_.shm_key +
+        ".doorbell" + std::to_string(direction);
+  }
+
+  /// If the producer has started a new session since we last looked,
+  /// skip whatever it left behind before that.
+  void SyncRxSession() {
+    const uint32_t generation = rx_->generation.load();
+    if (generation == rx_generation_) { return; }
+    rx_generation_ = generation;
+
+    const uint64_t start = rx_->session_start.load();
+    if (rx_->tail.load() < start) { rx_->tail.store(start); }
+  }
+
+  void ProcessRead() {
+    if (!read_handler_) { return; }
+
+    SyncRxSession();
+
+    const uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+    uint64_t head = rx_->head.load(std::memory_order_acquire);
+
+    if (head == tail && boost::asio::buffer_size(*read_buffers_) != 0) {
+      if (rx_->closed.load()) {
+        CompleteRead(boost::asio::error::eof, 0);
+        return;
+      }
+
+      // Announce that we are about to sleep, then look once more, as
+      // the producer may have written in between.
+      rx_->consumer_waiting.store(1);
+      head = rx_->head.load();
+      if (head == tail) {
+        if (rx_->closed.load()) {
+          rx_->consumer_waiting.store(0);
+          CompleteRead(boost::asio::error::eof, 0);
+          return;
+        }
+        WaitDoorbell();
+        return;
+      }
+      rx_->consumer_waiting.store(0);
+    }
+
+    size_t available = head - tail;
+    uint64_t position = tail;
+    for (const auto& buffer : *read_buffers_) {
+      if (available == 0) { break; }
+      char* out = static_cast<char*>(buffer.data());
+      size_t remaining = std::min(buffer.size(), available);
+      available -= remaining;
+      while (remaining) {
+        const size_t offset = position % capacity_;
+        const size_t chunk = std::min(remaining, capacity_ - offset);
+        std::memcpy(out, rx_data_ + offset, chunk);
+        out += chunk;
+        position += chunk;
+        remaining -= chunk;
+      }
+    }
+
+    rx_->tail.store(position);
+    if (rx_->producer_waiting.exchange(0)) { RingDoorbell(); }
+
+    CompleteRead({}, position - tail);
+  }
+
+  void ProcessWrite() {
+    if (!write_handler_) { return; }
+
+    // The peer has gone away, so nothing will ever drain our ring.
+    if (rx_->closed.load()) {
+      CompleteWrite(boost::asio::error::broken_pipe, 0);
+      return;
+    }
+
+    const uint64_t head = tx_->head.load(std::memory_order_relaxed);
+    uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+
+    if ((head - tail) == capacity_ &&
+        boost::asio::buffer_size(*write_buffers_) != 0) {
+      tx_->producer_waiting.store(1);
+      tail = tx_->tail.load();
+      if ((head - tail) == capacity_) {
+        WaitDoorbell();
+        return;
+      }
+      tx_->producer_waiting.store(0);
+    }
+
+    size_t space = capacity_ - (head - tail);
+    uint64_t position = head;
+    for (const auto& buffer : *write_buffers_) {
+      if (space == 0) { break; }
+      const char* in = static_cast<const char*>(buffer.data());
+      size_t remaining = std::min(buffer.size(), space);
+      space -= remaining;
+      while (remaining) {
+        const size_t offset = position % capacity_;
+        const size_t chunk = std::min(remaining, capacity_ - offset);
+        std::memcpy(tx_data_ + offset, in, chunk);
+        in += chunk;
+        position += chunk;
+        remaining -= chunk;
+      }
+    }
+
+    tx_->head.store(position);
+    if (tx_->consumer_waiting.exchange(0)) { RingDoorbell(); }
+
+    CompleteWrite({}, position - head);
+  }
+
+  void CompleteRead(const base::error_code& ec, size_t size) {
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(*read_handler_), ec, size));
+    read_handler_ = {};
+    read_buffers_ = {};
+  }
+
+  void CompleteWrite(const base::error_code& ec, size_t size) {
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(*write_handler_), ec, size));
+    write_handler_ = {};
+    write_buffers_ = {};
+  }
+
+  void WaitDoorbell() {
+    if (waiting_) { return; }
+    waiting_ = true;
+    doorbell_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                         Bind(&ShmStream::HandleDoorbell));
+  }
+
+  void HandleDoorbell(const base::error_code& ec) {
+    waiting_ = false;
+    if (ec) { return; }
+
+    char discard[64] = {};
+    while (::read(doorbell_.native_handle(), discard, sizeof(discard)) > 0) {}
+
+    ProcessRead();
+    ProcessWrite();
+  }
+
+  void RingDoorbell() {
+    // If the FIFO is full, the peer already has a wakeup pending.
+    const char value = 0;
+    [[maybe_unused]] const auto result = ::write(peer_doorbell_, &value, 1);
+  }
+
+  boost::asio::any_io_executor executor_;
+  const StreamFactory::Options options_;
+
+  Header* header_ = nullptr;
+  size_t mapped_size_ = 0;
+  size_t capacity_ = 0;
+
+  Ring* tx_ = nullptr;
+  char* tx_data_ = nullptr;
+  Ring* rx_ = nullptr;
+  char* rx_data_ = nullptr;
+  uint32_t rx_generation_ = 0;
+
+  boost::asio::posix::stream_descriptor doorbell_{executor_};
+  int peer_doorbell_ = -1;
+  bool waiting_ = false;
+
+  std::optional<MutableBufferSequence> read_buffers_;
+  std::optional<ReadHandler> read_handler_;
+
+  std::optional<ConstBufferSequence> write_buffers_;
+  std::optional<WriteHandler> write_handler_;
+};
+
+}
+
+void AsyncCreateShm(
+    const boost::asio::any_io_executor& executor,
+    const StreamFactory::Options& options,
+    StreamHandler handler) {
+  auto stream = std::make_shared<ShmStream>(executor, options);
+  base::error_code ec;
+  stream->Open(&ec);
+
+  if (ec) {
+    ec.Append("When opening shm: '" + options.shm_key + "'");
+    boost::asio::post(
+        executor,
+        std::bind(std::move(handler), ec, SharedStream()));
+    return;
+  }
+
+  boost::asio::post(executor, std::bind(std::move(handler), ec, stream));
+}
+
+#else  // __linux__
+
+void AsyncCreateShm(
+    const boost::asio::any_io_executor& executor,
+    const StreamFactory::Options&,
+    StreamHandler handler) {
+  boost::asio::post(
+      executor,
+      std::bind(std::move(handler),
+                base::error_code(boost::asio::error::operation_not_supported),
+                SharedStream()));
+}
+
+#endif  // __linux__
+
+}
+}
+}
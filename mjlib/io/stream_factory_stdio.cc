@@ -61,6 +61,9 @@ class StdioStream : public AsyncStream {
     stdout_.cancel();
   }
 
+  int native_read_descriptor() override { return stdin_.native_handle(); }
+  int native_write_descriptor() override { return stdout_.native_handle(); }
+
  private:
   boost::asio::any_io_executor executor_;
   boost::asio::posix::stream_descriptor stdin_;
@@ -12,7 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "mjlib/io/stream_factory_serial.h"
+#include "mjlib/io/stream_factory_tcp_client.h"
 
 #include <boost/asio/post.hpp>
 #include <boost/asio/ip/tcp.hpp>
@@ -59,6 +59,11 @@ class TcpStream : public AsyncStream {
     socket_.cancel();
   }
 
+#ifndef _WIN32
+  int native_read_descriptor() override { return socket_.native_handle(); }
+  int native_write_descriptor() override { return socket_.native_handle(); }
+#endif  // _WIN32
+
   ErrorCallback start_handler_;
 
  private:
@@ -80,6 +85,8 @@ class TcpStream : public AsyncStream {
     if (ec) {
       ec.Append(fmt::format("when connecting to: {}:{}",
                             options_.tcp_target, options_.tcp_target_port));
+    } else {
+      StreamFactory::ConfigureTcpSocket(&socket_, options_);
     }
     boost::asio::post(
         executor_,
@@ -103,5 +110,20 @@ void AsyncCreateTcpClient(
 }
 
 }
+
+void StreamFactory::ConfigureTcpSocket(
+    boost::asio::ip::tcp::socket* socket, const Options& options) {
+  // These are only tuning, so failures are not fatal.
+  boost::system::error_code ec;
+  if (options.tcp_nodelay) {
+    socket->set_option(boost::asio::ip::tcp::no_delay(true), ec);
+  }
+  if (options.tcp_send_buffer > 0) {
+    socket->set_option(
+        boost::asio::socket_base::send_buffer_size(options.tcp_send_buffer),
+        ec);
+  }
+}
+
 }
 }
@@ -14,7 +14,17 @@
 
 #include "mjlib/io/stream_factory_tcp_server.h"
 
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <vector>
+
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
+#include "mjlib/io/deadline_timer.h"
 
 namespace mjlib {
 namespace io {
@@ -114,6 +124,7 @@ class TcpServerStream : public AsyncStream {
       started_ = true;
     }
     connected_ = true;
+    StreamFactory::ConfigureTcpSocket(&socket_, options_);
 
     if (read_queued_) {
       read_queued_ = false;
@@ -168,12 +179,319 @@ class TcpServerStream : public AsyncStream {
   WriteHandler write_handler_;
   bool write_queued_ = false;
 };
+
+/// Serves any number of clients at once.  Each write is copied once
+/// into a shared buffer, which is then queued to every client.
+class FanoutTcpServerStream
+    : public AsyncStream,
+      public std::enable_shared_from_this<FanoutTcpServerStream> {
+ public:
+  FanoutTcpServerStream(const boost::asio::any_io_executor& executor,
+                        const StreamFactory::Options& options)
+      : executor_(executor),
+        options_(options),
+        acceptor_(executor) {
+    tcp::endpoint endpoint(tcp::v4(), options_.tcp_server_port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+  }
+
+  ~FanoutTcpServerStream() override {
+    accept_timer_.cancel();
+    // Outstanding operations keep each client alive, so make sure
+    // they all complete.
+    for (auto& client : clients_) {
+      boost::system::error_code ignored;
+      client->socket.close(ignored);
+    }
+  }
+
+  void Start() {
+    Accept();
+  }
+
+  boost::asio::any_io_executor get_executor() override { return executor_; }
+
+  void async_read_some(MutableBufferSequence buffers,
+                       ReadHandler handler) override {
+    BOOST_ASSERT(!read_handler_);
+
+    read_buffers_ = buffers;
+    read_handler_ = std::move(handler);
+
+    MaybeCompleteRead();
+  }
+
+  void async_write_some(ConstBufferSequence buffers,
+                        WriteHandler handler) override {
+    BOOST_ASSERT(!write_handler_);
+
+    const auto size = boost::asio::buffer_size(buffers);
+    if (size > 0 && !clients_.empty()) {
+      auto data = std::make_shared<std::vector<char>>(size);
+      boost::asio::buffer_copy(boost::asio::buffer(*data), buffers);
+      for (auto& client : clients_) {
+        Enqueue(client, data);
+      }
+    }
+
+    write_size_ = size;
+    write_handler_ = std::move(handler);
+
+    MaybeCompleteWrite();
+  }
+
+  void cancel() override {
+    if (read_handler_) {
+      boost::asio::post(
+          executor_,
+          std::bind(std::move(read_handler_),
+                    boost::asio::error::operation_aborted, 0));
+      read_handler_ = {};
+    }
+    if (write_handler_) {
+      boost::asio::post(
+          executor_,
+          std::bind(std::move(write_handler_),
+                    boost::asio::error::operation_aborted, 0));
+      write_handler_ = {};
+    }
+  }
+
+ private:
+  struct Client {
+    Client(const boost::asio::any_io_executor& executor)
+        : socket(executor) {}
+
+    tcp::socket socket;
+
+    std::deque<std::shared_ptr<const std::vector<char>>> queue;
+    size_t queued_bytes = 0;
+    bool writing = false;
+
+    char read_buffer[4096] = {};
+    bool reading = false;
+  };
+
+  using ClientPtr = std::shared_ptr<Client>;
+
+  // Invoke a member function only if this stream still exists.
+  template <typename Method, typename... Args>
+  auto Bind(Method method, Args... bound) {
+    return [weak=weak_from_this(), method, bound...](const auto&... args) {
+      auto self = weak.lock();
+      if (!self) { return; }
+      ((*self).*method)(bound..., args...);
+    };
+  }
+
+  void Accept() {
+    auto client = std::make_shared<Client>(executor_);
+    // The handler must not be generic, as asio checks it against the
+    // move-accept signature too.
+    acceptor_.async_accept(
+        client->socket,
+        [weak=weak_from_this(), client](const base::error_code& ec) {
+          auto self = weak.lock();
+          if (!self) { return; }
+          self->HandleAccept(client, ec);
+        });
+  }
+
+  void HandleAccept(ClientPtr client, const base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+
+    if (ec) {
+      // Errors like running out of file descriptors tend to persist,
+      // so wait a bit rather than spinning.
+      accept_timer_.expires_from_now(boost::posix_time::milliseconds(100));
+      accept_timer_.async_wait(
+          Bind(&FanoutTcpServerStream::HandleAcceptTimer));
+      return;
+    }
+
+    if (static_cast<int>(clients_.size()) >=
+        options_.tcp_server_max_clients) {
+      boost::system::error_code ignored;
+      client->socket.close(ignored);
+    } else {
+      StreamFactory::ConfigureTcpSocket(&client->socket, options_);
+      clients_.push_back(client);
+      StartClientRead(client);
+    }
+
+    Accept();
+  }
+
+  void HandleAcceptTimer(const base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    Accept();
+  }
+
+  bool IsReader(const ClientPtr& client) const {
+    return options_.tcp_server_merge_reads ||
+        (!clients_.empty() && clients_.front() == client);
+  }
+
+  void StartClientRead(ClientPtr client) {
+    if (client->reading) { return; }
+    // Stop reading when the application has fallen behind.  Reads
+    // resume once it catches up.
+    if (static_cast<int>(inbound_.size()) >=
+        options_.tcp_server_client_queue) {
+      return;
+    }
+
+    client->reading = true;
+    client->socket.async_read_some(
+        boost::asio::buffer(client->read_buffer),
+        Bind(&FanoutTcpServerStream::HandleClientRead, client));
+  }
+
+  void HandleClientRead(ClientPtr client, const base::error_code& ec,
+                        size_t size) {
+    client->reading = false;
+    if (ec) {
+      RemoveClient(client);
+      return;
+    }
+
+    // Input from anyone other than the controller is discarded
+    // unless reads are being merged.
+    if (IsReader(client)) {
+      inbound_.commit(boost::asio::buffer_copy(
+                          inbound_.prepare(size),
+                          boost::asio::buffer(client->read_buffer, size)));
+      MaybeCompleteRead();
+    }
+
+    StartClientRead(client);
+  }
+
+  void MaybeCompleteRead() {
+    if (!read_handler_) { return; }
+    if (inbound_.size() == 0) { return; }
+
+    const size_t size = boost::asio::buffer_copy(
+        read_buffers_, inbound_.data());
+    inbound_.consume(size);
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(read_handler_), base::error_code(), size));
+    read_handler_ = {};
+
+    for (auto& client : clients_) { StartClientRead(client); }
+  }
+
+  void Enqueue(const ClientPtr& client,
+               std::shared_ptr<const std::vector<char>> data) {
+    if (!options_.tcp_server_backpressure &&
+        static_cast<int>(client->queued_bytes + data->size()) >
+        options_.tcp_server_client_queue) {
+      // This client is too slow.  It just misses out.
+      return;
+    }
+
+    client->queued_bytes += data->size();
+    client->queue.push_back(std::move(data));
+    StartClientWrite(client);
+  }
+
+  void StartClientWrite(ClientPtr client) {
+    if (client->writing) { return; }
+    if (client->queue.empty()) { return; }
+
+    client->writing = true;
+    // The buffer is shared with all other clients, and kept alive by
+    // the queue until this write completes.
+    boost::asio::async_write(
+        client->socket,
+        boost::asio::buffer(*client->queue.front()),
+        Bind(&FanoutTcpServerStream::HandleClientWrite, client));
+  }
+
+  void HandleClientWrite(ClientPtr client, const base::error_code& ec,
+                         size_t) {
+    client->writing = false;
+    if (ec) {
+      RemoveClient(client);
+      return;
+    }
+
+    client->queued_bytes -= client->queue.front()->size();
+    client->queue.pop_front();
+
+    StartClientWrite(client);
+    MaybeCompleteWrite();
+  }
+
+  void MaybeCompleteWrite() {
+    if (!write_handler_) { return; }
+
+    if (options_.tcp_server_backpressure) {
+      for (const auto& client : clients_) {
+        if (static_cast<int>(client->queued_bytes) >
+            options_.tcp_server_client_queue) {
+          return;
+        }
+      }
+    }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(write_handler_), base::error_code(), write_size_));
+    write_handler_ = {};
+  }
+
+  void RemoveClient(ClientPtr client) {
+    auto it = std::find(clients_.begin(), clients_.end(), client);
+    if (it == clients_.end()) { return; }
+
+    boost::system::error_code ignored;
+    client->socket.close(ignored);
+    clients_.erase(it);
+
+    // Someone else may have just been promoted to controller, and a
+    // writer blocked on this client may now proceed.
+    for (auto& other : clients_) { StartClientRead(other); }
+    MaybeCompleteWrite();
+  }
+
+  boost::asio::any_io_executor executor_;
+  const StreamFactory::Options options_;
+  tcp::acceptor acceptor_;
+  DeadlineTimer accept_timer_{executor_};
+
+  // In order of connection.  The front is the controller.
+  std::list<ClientPtr> clients_;
+
+  MutableBufferSequence read_buffers_;
+  ReadHandler read_handler_;
+  boost::asio::streambuf inbound_;
+
+  WriteHandler write_handler_;
+  size_t write_size_ = 0;
+};
 }
 
 void AsyncCreateTcpServer(
     const boost::asio::any_io_executor& executor,
     const StreamFactory::Options& options,
     StreamHandler handler) {
+  if (options.tcp_server_fanout) {
+    // Clients may come and go, so the stream is available as soon as
+    // we are listening.
+    auto stream = std::make_shared<FanoutTcpServerStream>(executor, options);
+    stream->Start();
+    boost::asio::post(
+        executor,
+        std::bind(std::move(handler), base::error_code(), stream));
+    return;
+  }
+
   auto stream = std::make_shared<TcpServerStream>(executor, options);
   stream->start_handler_ = std::bind(std::move(handler), pl::_1, stream);
 }
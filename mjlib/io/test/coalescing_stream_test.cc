@@ -0,0 +1,362 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/coalescing_stream.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/io/debug_deadline_service.h"
+
+using namespace mjlib;
+
+namespace {
+/// Records every write, and optionally holds its completion until
+/// released.
+class RecordingStream : public io::AsyncStream {
+ public:
+  RecordingStream(boost::asio::io_context& context)
+      : executor_(context.get_executor()) {}
+
+  boost::asio::any_io_executor get_executor() override { return executor_; }
+
+  void async_read_some(io::MutableBufferSequence,
+                       io::ReadHandler handler) override {
+    read_handler_ = std::move(handler);
+  }
+
+  void async_write_some(io::ConstBufferSequence buffers,
+                        io::WriteHandler handler) override {
+    size_t buffer_count = 0;
+    std::string data;
+    for (const auto& buffer : buffers) {
+      if (buffer.size() == 0) { continue; }
+      buffer_count++;
+      data += std::string(static_cast<const char*>(buffer.data()),
+                          buffer.size());
+    }
+    writes.push_back(data);
+    buffer_counts.push_back(buffer_count);
+
+    pending_size_ = std::min(data.size(), max_write);
+    pending_ = std::move(handler);
+    if (!hold) { Release(); }
+  }
+
+  void cancel() override {
+    if (read_handler_) {
+      boost::asio::post(
+          executor_,
+          std::bind(std::move(read_handler_),
+                    boost::asio::error::operation_aborted, 0));
+      read_handler_ = {};
+    }
+    if (pending_) {
+      Release(boost::asio::error::operation_aborted);
+    }
+  }
+
+  void Release(const base::error_code& ec = {}) {
+    BOOST_TEST_REQUIRE(!!pending_);
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(pending_), ec, ec ? 0 : pending_size_));
+    pending_ = {};
+  }
+
+  bool pending() const { return !!pending_; }
+
+  std::string all() const {
+    std::string result;
+    for (const auto& write : writes) { result += write; }
+    return result;
+  }
+
+  bool hold = false;
+  size_t max_write = 1000000;
+  std::vector<std::string> writes;
+  std::vector<size_t> buffer_counts;
+
+ private:
+  boost::asio::any_io_executor executor_;
+  io::WriteHandler pending_;
+  size_t pending_size_ = 0;
+  io::ReadHandler read_handler_;
+};
+
+struct Fixture {
+  Fixture() {
+    debug_time->SetTime(now);
+  }
+
+  void Poll() {
+    context.poll();
+    context.restart();
+  }
+
+  void Advance(boost::posix_time::time_duration value) {
+    now += value;
+    debug_time->SetTime(now);
+    Poll();
+  }
+
+  boost::asio::io_context context;
+  io::DebugDeadlineService* const debug_time =
+      io::DebugDeadlineService::Install(context);
+  boost::posix_time::ptime now{
+    boost::gregorian::date(2020, boost::gregorian::Jan, 1)};
+  RecordingStream base{context};
+};
+
+struct WriteResult {
+  base::error_code ec;
+  size_t size = 0;
+};
+
+void Write(io::AsyncWriteStream* stream,
+           const std::string& data,
+           std::optional<WriteResult>* result) {
+  *result = {};
+  stream->async_write_some(
+      boost::asio::buffer(data),
+      [result](const base::error_code& ec, size_t size) {
+        *result = WriteResult{ec, size};
+      });
+}
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamDelay, Fixture) {
+  io::CoalescingStream::Options options;
+  options.max_delay = boost::posix_time::milliseconds(5);
+  io::CoalescingStream dut{&base, options};
+
+  const std::vector<std::string> pieces = {"abc", "de", "fghij", "k"};
+  for (const auto& piece : pieces) {
+    std::optional<WriteResult> result;
+    Write(&dut, piece, &result);
+    Poll();
+
+    // Each write completes immediately.
+    BOOST_TEST_REQUIRE(!!result);
+    BOOST_TEST(!result->ec);
+    BOOST_TEST(result->size == piece.size());
+  }
+
+  BOOST_TEST(base.writes.size() == 0u);
+
+  Advance(boost::posix_time::milliseconds(4));
+  BOOST_TEST(base.writes.size() == 0u);
+
+  Advance(boost::posix_time::milliseconds(1));
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+  BOOST_TEST(base.writes[0] == "abcdefghijk");
+
+  BOOST_TEST(dut.stats().writes == 4u);
+  BOOST_TEST(dut.stats().bytes == 11u);
+  BOOST_TEST(dut.stats().flushes == 1u);
+  BOOST_TEST(dut.stats().flush_bytes == 11u);
+  BOOST_TEST(dut.stats().delay_flushes == 1u);
+  BOOST_TEST(dut.stats().size_flushes == 0u);
+
+  // Nothing more is written once idle.
+  Advance(boost::posix_time::milliseconds(100));
+  BOOST_TEST(base.writes.size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamSize, Fixture) {
+  io::CoalescingStream::Options options;
+  options.buffer_size = 16;
+  options.flush_size = 8;
+  options.max_delay = boost::posix_time::seconds(1);
+  io::CoalescingStream dut{&base, options};
+
+  std::optional<WriteResult> result;
+  Write(&dut, "0123", &result);
+  Poll();
+  BOOST_TEST(base.writes.size() == 0u);
+
+  Write(&dut, "4567", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+  BOOST_TEST(base.writes[0] == "01234567");
+  BOOST_TEST(dut.stats().size_flushes == 1u);
+
+  // Now write enough that the ring buffer wraps, which should result
+  // in a single write of two buffers.
+  Write(&dut, "abcdefghij", &result);
+  Poll();
+  BOOST_TEST(result->size == 10u);
+  BOOST_TEST_REQUIRE(base.writes.size() == 2u);
+  BOOST_TEST(base.writes[1] == "abcdefghij");
+  BOOST_TEST(base.buffer_counts[1] == 2u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamBackpressure, Fixture) {
+  io::CoalescingStream::Options options;
+  options.buffer_size = 8;
+  options.flush_size = 4;
+  io::CoalescingStream dut{&base, options};
+
+  base.hold = true;
+
+  std::optional<WriteResult> result;
+  Write(&dut, "abcdef", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(!!result);
+  BOOST_TEST(result->size == 6u);
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+  BOOST_TEST(base.pending());
+
+  // Only part of this fits.
+  Write(&dut, "ghijkl", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(!!result);
+  BOOST_TEST(result->size == 2u);
+
+  // And now there is no room at all, so the write must wait.  The
+  // data must remain valid until then.
+  const std::string blocked = "mnop";
+  Write(&dut, blocked, &result);
+  Poll();
+  BOOST_TEST(!result);
+  BOOST_TEST(dut.stats().blocked_writes == 1u);
+
+  base.Release();
+  Poll();
+  BOOST_TEST_REQUIRE(!!result);
+  BOOST_TEST(!result->ec);
+  BOOST_TEST(result->size == 4u);
+
+  // The remainder goes out in one write.
+  BOOST_TEST_REQUIRE(base.writes.size() == 2u);
+  BOOST_TEST(base.writes[1] == "ghmnop");
+  base.Release();
+  Poll();
+
+  BOOST_TEST(base.all() == "abcdefghmnop");
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamPartialWrite, Fixture) {
+  io::CoalescingStream::Options options;
+  options.max_delay = boost::posix_time::milliseconds(5);
+  io::CoalescingStream dut{&base, options};
+
+  base.max_write = 3;
+
+  const std::string data = "0123456789";
+  std::optional<WriteResult> result;
+  Write(&dut, data, &result);
+  Advance(boost::posix_time::milliseconds(5));
+
+  // Once due, the data continues to be written until it is all out,
+  // without waiting for the delay again.
+  BOOST_TEST(base.writes.size() == 4u);
+  BOOST_TEST(dut.stats().flush_bytes == data.size());
+  BOOST_TEST(dut.stats().delay_flushes == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamFlush, Fixture) {
+  io::CoalescingStream::Options options;
+  options.max_delay = boost::posix_time::seconds(1);
+  io::CoalescingStream dut{&base, options};
+
+  std::optional<WriteResult> result;
+  Write(&dut, "hello", &result);
+  Poll();
+  BOOST_TEST(base.writes.size() == 0u);
+
+  std::optional<base::error_code> flushed;
+  dut.AsyncFlush([&](const base::error_code& ec) { flushed = ec; });
+  Poll();
+  BOOST_TEST_REQUIRE(!!flushed);
+  BOOST_TEST(!*flushed);
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+  BOOST_TEST(base.writes[0] == "hello");
+
+  // Flushing with nothing staged completes right away.
+  flushed = {};
+  dut.AsyncFlush([&](const base::error_code& ec) { flushed = ec; });
+  Poll();
+  BOOST_TEST(!!flushed);
+  BOOST_TEST(base.writes.size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamError, Fixture) {
+  io::CoalescingStream::Options options;
+  options.max_delay = {};
+  io::CoalescingStream dut{&base, options};
+
+  base.hold = true;
+
+  std::optional<WriteResult> result;
+  Write(&dut, "abc", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+
+  // With no delay, this is held until the first write completes.
+  Write(&dut, "def", &result);
+  Poll();
+  BOOST_TEST(base.writes.size() == 1u);
+
+  base.Release(boost::asio::error::broken_pipe);
+  Poll();
+
+  // The error is reported to subsequent writers.
+  Write(&dut, "ghi", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(!!result);
+  BOOST_TEST(result->ec == boost::asio::error::broken_pipe);
+  BOOST_TEST(base.writes.size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(CoalescingStreamCancel, Fixture) {
+  io::CoalescingStream::Options options;
+  options.max_delay = {};
+  io::CoalescingStream dut{&base, options};
+
+  base.hold = true;
+
+  std::optional<WriteResult> result;
+  Write(&dut, "abc", &result);
+  Poll();
+  BOOST_TEST_REQUIRE(base.writes.size() == 1u);
+
+  Write(&dut, "def", &result);
+  Poll();
+
+  std::optional<base::error_code> flushed;
+  dut.AsyncFlush([&](const base::error_code& ec) { flushed = ec; });
+  Poll();
+  BOOST_TEST(!flushed);
+
+  // The outstanding write is aborted, but everything staged is
+  // written again.
+  dut.cancel();
+  Poll();
+  BOOST_TEST_REQUIRE(base.writes.size() == 2u);
+  BOOST_TEST(base.writes[1] == "abcdef");
+  BOOST_TEST(!flushed);
+
+  base.Release();
+  Poll();
+  BOOST_TEST_REQUIRE(!!flushed);
+  BOOST_TEST(!*flushed);
+  BOOST_TEST(dut.stats().flush_bytes == 6u);
+}
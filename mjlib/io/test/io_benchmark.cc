@@ -0,0 +1,451 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure the overhead of the io building blocks used in control
+/// loops.  Results are written as a single JSON document, so that
+/// they can be compared from one run to the next.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/assert.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/deadline_timer.h"
+#include "mjlib/io/exclusive_command.h"
+#include "mjlib/io/realtime_executor.h"
+#include "mjlib/io/stream_copy.h"
+#include "mjlib/io/stream_pipe_factory.h"
+
+namespace po = boost::program_options;
+using namespace mjlib;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double ElapsedNs(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+struct Result {
+  std::string name;
+  int64_t iterations = 0;
+  double total_s = 0.0;
+  double ns_per_op = 0.0;
+
+  /// Only filled in for throughput measurements.
+  double mb_per_s = 0.0;
+
+  /// Only filled in for latency measurements.
+  double p50_ns = 0.0;
+  double p99_ns = 0.0;
+  double max_ns = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(iterations));
+    a->Visit(MJ_NVP(total_s));
+    a->Visit(MJ_NVP(ns_per_op));
+    a->Visit(MJ_NVP(mb_per_s));
+    a->Visit(MJ_NVP(p50_ns));
+    a->Visit(MJ_NVP(p99_ns));
+    a->Visit(MJ_NVP(max_ns));
+  }
+};
+
+struct Report {
+  std::vector<Result> results;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(results));
+  }
+};
+
+Result MakeResult(const std::string& name, int64_t iterations,
+                  Clock::time_point start, Clock::time_point end) {
+  Result result;
+  result.name = name;
+  result.iterations = iterations;
+  result.total_s = ElapsedNs(start, end) * 1e-9;
+  result.ns_per_op = ElapsedNs(start, end) / iterations;
+  return result;
+}
+
+void FillLatency(std::vector<double>* samples, Result* result) {
+  if (samples->empty()) { return; }
+  std::sort(samples->begin(), samples->end());
+  auto percentile = [&](double p) {
+    return (*samples)[std::min(samples->size() - 1,
+                               static_cast<size_t>(p * samples->size()))];
+  };
+  result->p50_ns = percentile(0.50);
+  result->p99_ns = percentile(0.99);
+  result->max_ns = samples->back();
+}
+
+// RealtimeExecutor only provides the member function form of post
+// and dispatch, so we use that for both it and the raw executor.
+template <typename Executor>
+Result MeasurePost(const std::string& name, boost::asio::io_context& context,
+                   Executor executor, int64_t count) {
+  int64_t done = 0;
+  const auto start = Clock::now();
+  for (int64_t i = 0; i < count; i++) {
+    executor.post([&]() { done++; }, std::allocator<void>());
+  }
+  context.run();
+  context.restart();
+  const auto end = Clock::now();
+  MJ_ASSERT(done == count);
+  return MakeResult(name, count, start, end);
+}
+
+template <typename Executor>
+Result MeasureDispatch(const std::string& name,
+                       boost::asio::io_context& context,
+                       Executor executor, int64_t count) {
+  // Dispatch from within a running handler, so that each one may run
+  // inline.
+  int64_t done = 0;
+  Clock::time_point start, end;
+  boost::asio::post(context, [&]() {
+      start = Clock::now();
+      for (int64_t i = 0; i < count; i++) {
+        executor.dispatch([&]() { done++; }, std::allocator<void>());
+      }
+    });
+  context.run();
+  context.restart();
+  end = Clock::now();
+  MJ_ASSERT(done == count);
+  return MakeResult(name, count, start, end);
+}
+
+std::vector<Result> BenchmarkExecutor(int64_t count) {
+  std::vector<Result> results;
+
+  boost::asio::io_context context;
+  io::RealtimeExecutor realtime{context.get_executor()};
+
+  results.push_back(MeasurePost(
+      "io_context_post", context, context.get_executor(), count));
+  results.push_back(MeasurePost(
+      "realtime_executor_post", context, realtime, count));
+  results.push_back(MeasureDispatch(
+      "io_context_dispatch", context, context.get_executor(), count));
+  results.push_back(MeasureDispatch(
+      "realtime_executor_dispatch", context, realtime, count));
+
+  return results;
+}
+
+std::vector<Result> BenchmarkTimer(int64_t count) {
+  std::vector<Result> results;
+
+  boost::asio::io_context context;
+  io::DeadlineTimer timer{context.get_executor()};
+
+  {
+    int64_t aborted = 0;
+    const auto start = Clock::now();
+    for (int64_t i = 0; i < count; i++) {
+      timer.expires_from_now(boost::posix_time::seconds(10));
+      timer.async_wait([&](const base::error_code& ec) {
+          if (ec == boost::asio::error::operation_aborted) { aborted++; }
+        });
+      timer.cancel();
+      context.poll();
+      context.restart();
+    }
+    const auto end = Clock::now();
+    MJ_ASSERT(aborted == count);
+    results.push_back(MakeResult("deadline_timer_arm_cancel",
+                                 count, start, end));
+  }
+
+  {
+    // Timers which expire immediately measure the complete path
+    // through the timer service.
+    int64_t fired = 0;
+    const auto start = Clock::now();
+    for (int64_t i = 0; i < count; i++) {
+      timer.expires_from_now(boost::posix_time::time_duration());
+      timer.async_wait([&](const base::error_code&) { fired++; });
+      context.run();
+      context.restart();
+    }
+    const auto end = Clock::now();
+    MJ_ASSERT(fired == count);
+    results.push_back(MakeResult("deadline_timer_expire",
+                                 count, start, end));
+  }
+
+  return results;
+}
+
+/// Write everything from one stream while reading it from another,
+/// returning the time taken.
+Result MeasureThroughput(const std::string& name,
+                         boost::asio::io_context& context,
+                         io::AsyncWriteStream* source,
+                         io::AsyncReadStream* sink,
+                         size_t total, size_t chunk) {
+  const std::string data(chunk, 'x');
+  size_t written = 0;
+  size_t read = 0;
+  std::vector<char> read_buffer(chunk);
+
+  std::function<void ()> start_write = [&]() {
+    if (written >= total) { return; }
+    boost::asio::async_write(
+        *source, boost::asio::buffer(data),
+        [&](const base::error_code& ec, size_t size) {
+          base::FailIf(ec);
+          written += size;
+          start_write();
+        });
+  };
+
+  std::function<void ()> start_read = [&]() {
+    if (read >= total) { return; }
+    sink->async_read_some(
+        boost::asio::buffer(read_buffer),
+        [&](const base::error_code& ec, size_t size) {
+          base::FailIf(ec);
+          read += size;
+          start_read();
+        });
+  };
+
+  const auto start = Clock::now();
+  start_write();
+  start_read();
+  context.run();
+  context.restart();
+  MJ_ASSERT(read == total);
+  const auto end = Clock::now();
+
+  auto result = MakeResult(name, total / chunk, start, end);
+  result.mb_per_s = total / result.total_s / 1e6;
+  return result;
+}
+
+std::vector<Result> BenchmarkPipe(int64_t count, size_t chunk) {
+  std::vector<Result> results;
+
+  boost::asio::io_context context;
+  io::StreamPipeFactory pipes{context.get_executor()};
+
+  {
+    auto left = pipes.GetStream("throughput", 0);
+    auto right = pipes.GetStream("throughput", 1);
+    results.push_back(MeasureThroughput(
+        fmt::format("stream_pipe_throughput_{}", chunk), context,
+        left.get(), right.get(), count * chunk, chunk));
+  }
+
+  {
+    // Bounce a single byte back and forth.
+    auto left = pipes.GetStream("latency", 0);
+    auto right = pipes.GetStream("latency", 1);
+
+    char left_buf[1] = {};
+    char right_buf[1] = {};
+    std::vector<double> samples;
+    samples.reserve(count);
+
+    const auto start = Clock::now();
+    for (int64_t i = 0; i < count; i++) {
+      const auto sample_start = Clock::now();
+      bool done = false;
+      right->async_read_some(
+          boost::asio::buffer(right_buf),
+          [&](const base::error_code& ec, size_t) {
+            base::FailIf(ec);
+            boost::asio::async_write(
+                *right, boost::asio::buffer(right_buf),
+                [](const base::error_code& ec, size_t) {
+                  base::FailIf(ec);
+                });
+          });
+      left->async_read_some(
+          boost::asio::buffer(left_buf),
+          [&](const base::error_code& ec, size_t) {
+            base::FailIf(ec);
+            done = true;
+          });
+      boost::asio::async_write(
+          *left, boost::asio::buffer(left_buf),
+          [](const base::error_code& ec, size_t) { base::FailIf(ec); });
+      context.run();
+      context.restart();
+      MJ_ASSERT(done);
+      samples.push_back(ElapsedNs(sample_start, Clock::now()));
+    }
+    const auto end = Clock::now();
+
+    auto result = MakeResult("stream_pipe_round_trip", count, start, end);
+    FillLatency(&samples, &result);
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+std::vector<Result> BenchmarkStreamCopy(int64_t count, size_t chunk) {
+  boost::asio::io_context context;
+  io::StreamPipeFactory pipes{context.get_executor()};
+
+  auto source = pipes.GetStream("in", 0);
+  auto copy_in = pipes.GetStream("in", 1);
+  auto copy_out = pipes.GetStream("out", 0);
+  auto sink = pipes.GetStream("out", 1);
+
+  io::StreamCopy copy{
+    context.get_executor(), copy_in.get(), copy_out.get(),
+        [](const base::error_code&) {}};
+
+  return {MeasureThroughput(
+        fmt::format("stream_copy_throughput_{}", chunk), context,
+        source.get(), sink.get(), count * chunk, chunk)};
+}
+
+std::vector<Result> BenchmarkExclusiveCommand(int64_t count, int clients) {
+  boost::asio::io_context context;
+  io::ExclusiveCommand dut{context.get_executor()};
+
+  // Each client continuously queues a command, which completes
+  // asynchronously.  We measure the time from queueing to the
+  // command starting.
+  std::vector<double> samples;
+  samples.reserve(count);
+  int64_t issued = 0;
+
+  std::function<void ()> issue = [&]() {
+    if (issued >= count) { return; }
+    issued++;
+    const auto queued = Clock::now();
+    dut.Invoke(
+        [&, queued](auto handler) {
+          samples.push_back(ElapsedNs(queued, Clock::now()));
+          boost::asio::post(
+              context, [handler=std::move(handler)]() mutable {
+                handler(base::error_code());
+              });
+        },
+        [&](const base::error_code&) {
+          issue();
+        });
+  };
+
+  const auto start = Clock::now();
+  for (int i = 0; i < clients; i++) { issue(); }
+  context.run();
+  const auto end = Clock::now();
+
+  auto result = MakeResult(
+      fmt::format("exclusive_command_{}_clients", clients),
+      count, start, end);
+  FillLatency(&samples, &result);
+  return {result};
+}
+}
+
+int main(int argc, char** argv) {
+  po::options_description desc;
+
+  int64_t count = 200000;
+  int64_t chunk = 256;
+  int clients = 8;
+  std::string filter;
+  std::string output;
+
+  desc.add_options()
+      ("help,h", "display usage message")
+      ("count", po::value(&count), "iterations of each benchmark")
+      ("chunk", po::value(&chunk), "bytes per write in throughput tests")
+      ("clients", po::value(&clients),
+       "contending clients for ExclusiveCommand")
+      ("filter", po::value(&filter),
+       "only report benchmarks whose names contain this")
+      ("output,o", po::value(&output), "write results here, not stdout")
+      ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc;
+    return 0;
+  }
+
+  Report report;
+  auto add = [&](const std::vector<Result>& results) {
+    for (const auto& result : results) {
+      if (result.name.find(filter) == std::string::npos) { continue; }
+      std::cerr << fmt::format("{:40} {:12.1f} ns/op\n",
+                               result.name, result.ns_per_op);
+      report.results.push_back(result);
+    }
+  };
+
+  // Skip any group which cannot produce a matching result.
+  auto run = [&](std::vector<std::string> prefixes, auto benchmark) {
+    const bool matches = filter.empty() || std::any_of(
+        prefixes.begin(), prefixes.end(), [&](const auto& prefix) {
+          return prefix.find(filter) != std::string::npos ||
+              filter.find(prefix) != std::string::npos;
+        });
+    if (!matches) { return; }
+    add(benchmark());
+  };
+
+  run({"io_context_", "realtime_executor_"},
+      [&]() { return BenchmarkExecutor(count); });
+  run({"deadline_timer_"}, [&]() { return BenchmarkTimer(count); });
+  run({"stream_pipe_"}, [&]() { return BenchmarkPipe(count, chunk); });
+  run({"stream_copy_"}, [&]() { return BenchmarkStreamCopy(count, chunk); });
+  run({"exclusive_command_"}, [&]() {
+      return BenchmarkExclusiveCommand(count, clients);
+    });
+
+  const auto json = base::Json5WriteArchive::Write(
+      report, base::Json5WriteArchive::Options().set_standard(true));
+  if (output.empty()) {
+    std::cout << json << "\n";
+  } else {
+    std::ofstream(output) << json << "\n";
+  }
+
+  return 0;
+}
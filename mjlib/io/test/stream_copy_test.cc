@@ -0,0 +1,251 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/stream_copy.h"
+
+#include <optional>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/io/stream_pipe_factory.h"
+#include "mjlib/io/test/reader.h"
+
+using namespace mjlib;
+
+namespace {
+std::string MakeData(size_t size) {
+  std::string result;
+  for (size_t i = 0; i < size; i++) {
+    result.push_back(static_cast<char>(i * 7 + i / 256));
+  }
+  return result;
+}
+
+/// A minimal stream around a connected unix domain socket, which
+/// exposes its descriptor.
+class SocketStream : public io::AsyncStream {
+ public:
+  SocketStream(boost::asio::local::stream_protocol::socket* socket)
+      : socket_(socket) {}
+
+  boost::asio::any_io_executor get_executor() override {
+    return socket_->get_executor();
+  }
+
+  void async_read_some(io::MutableBufferSequence buffers,
+                       io::ReadHandler handler) override {
+    socket_->async_read_some(buffers, std::move(handler));
+  }
+
+  void async_write_some(io::ConstBufferSequence buffers,
+                        io::WriteHandler handler) override {
+    socket_->async_write_some(buffers, std::move(handler));
+  }
+
+  void cancel() override { socket_->cancel(); }
+
+  int native_read_descriptor() override { return socket_->native_handle(); }
+  int native_write_descriptor() override { return socket_->native_handle(); }
+
+ private:
+  boost::asio::local::stream_protocol::socket* const socket_;
+};
+}
+
+BOOST_AUTO_TEST_CASE(StreamCopyBufferedTest) {
+  boost::asio::io_context context;
+  io::StreamPipeFactory pipes{context.get_executor()};
+
+  auto source = pipes.GetStream("in", 0);
+  auto copy_in = pipes.GetStream("in", 1);
+  auto copy_out = pipes.GetStream("out", 0);
+  auto sink = pipes.GetStream("out", 1);
+
+  io::test::Reader reader{sink.get()};
+
+  io::StreamCopy::Options options;
+  // Use a buffer which is not a multiple of anything, so that we
+  // exercise the ring buffer wrapping around.
+  options.buffer_size = 61;
+
+  int done_count = 0;
+  io::StreamCopy dut{
+    context.get_executor(), copy_in.get(), copy_out.get(),
+        [&](const base::error_code& ec) {
+          done_count++;
+          BOOST_TEST(ec == boost::asio::error::operation_aborted);
+        },
+        options};
+  BOOST_TEST(dut.stats().splice == false);
+
+  const std::string data = MakeData(10000);
+  bool write_done = false;
+  boost::asio::async_write(
+      *source, boost::asio::buffer(data),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        BOOST_TEST(size == data.size());
+        write_done = true;
+      });
+
+  context.run();
+
+  BOOST_TEST(write_done);
+  BOOST_TEST(reader.data() == data);
+  BOOST_TEST(dut.stats().bytes_read == data.size());
+  BOOST_TEST(dut.stats().bytes_written == data.size());
+  BOOST_TEST(dut.stats().read_count > 1);
+  BOOST_TEST(dut.stats().write_count > 1);
+
+  // Cancelling the read side should be reported.
+  BOOST_TEST(done_count == 0);
+  copy_in->cancel();
+  context.restart();
+  context.run();
+  BOOST_TEST(done_count == 1);
+}
+
+BOOST_AUTO_TEST_CASE(StreamCopySpliceTest) {
+  boost::asio::io_context context;
+  using socket = boost::asio::local::stream_protocol::socket;
+
+  socket source{context}, copy_in{context};
+  socket copy_out{context}, sink{context};
+  boost::asio::local::connect_pair(source, copy_in);
+  boost::asio::local::connect_pair(copy_out, sink);
+
+  copy_in.non_blocking(true);
+  copy_out.non_blocking(true);
+
+  SocketStream copy_in_stream{&copy_in};
+  SocketStream copy_out_stream{&copy_out};
+
+  io::StreamCopy::Options options;
+  options.splice = true;
+
+  std::optional<base::error_code> done;
+  io::StreamCopy dut{
+    context.get_executor(), &copy_in_stream, &copy_out_stream,
+        [&](const base::error_code& ec) {
+          done = ec;
+        },
+        options};
+  BOOST_TEST(dut.stats().splice == true);
+
+  const std::string data = MakeData(100000);
+  boost::asio::async_write(
+      source, boost::asio::buffer(data),
+      [&](const base::error_code& ec, size_t) {
+        BOOST_TEST(!ec);
+        source.shutdown(socket::shutdown_send);
+      });
+
+  std::string received(data.size(), '\0');
+  boost::asio::async_read(
+      sink, boost::asio::buffer(received),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        BOOST_TEST(size == data.size());
+      });
+
+  context.run();
+
+  BOOST_TEST(received == data);
+
+  // End of file on the read side is only reported once everything
+  // has been written.
+  BOOST_TEST_REQUIRE(!!done);
+  BOOST_TEST(*done == boost::asio::error::eof);
+  BOOST_TEST(dut.stats().bytes_read == data.size());
+  BOOST_TEST(dut.stats().bytes_written == data.size());
+}
+
+BOOST_AUTO_TEST_CASE(StreamCopySpliceRequiresNonBlockingTest) {
+  boost::asio::io_context context;
+  using socket = boost::asio::local::stream_protocol::socket;
+
+  socket source{context}, copy_in{context};
+  socket copy_out{context}, sink{context};
+  boost::asio::local::connect_pair(source, copy_in);
+  boost::asio::local::connect_pair(copy_out, sink);
+
+  SocketStream copy_in_stream{&copy_in};
+  SocketStream copy_out_stream{&copy_out};
+
+  // Splice is off by default.
+  {
+    io::StreamCopy dut{
+      context.get_executor(), &copy_in_stream, &copy_out_stream,
+          [](const base::error_code&) {}};
+    BOOST_TEST(dut.stats().splice == false);
+  }
+
+  // And is not used for blocking descriptors, whose flags we will
+  // not change.
+  io::StreamCopy::Options options;
+  options.splice = true;
+  io::StreamCopy dut{
+    context.get_executor(), &copy_in_stream, &copy_out_stream,
+        [](const base::error_code&) {}, options};
+  BOOST_TEST(dut.stats().splice == false);
+  BOOST_TEST(copy_in.non_blocking() == false);
+}
+
+BOOST_AUTO_TEST_CASE(StreamCopySpliceCancelTest) {
+  boost::asio::io_context context;
+  using socket = boost::asio::local::stream_protocol::socket;
+
+  socket source{context}, copy_in{context};
+  socket copy_out{context}, sink{context};
+  boost::asio::local::connect_pair(source, copy_in);
+  boost::asio::local::connect_pair(copy_out, sink);
+  copy_in.non_blocking(true);
+  copy_out.non_blocking(true);
+
+  SocketStream copy_in_stream{&copy_in};
+  SocketStream copy_out_stream{&copy_out};
+
+  io::StreamCopy::Options options;
+  options.splice = true;
+
+  std::optional<base::error_code> done;
+  io::StreamCopy dut{
+    context.get_executor(), &copy_in_stream, &copy_out_stream,
+        [&](const base::error_code& ec) { done = ec; },
+        options};
+  BOOST_TEST(dut.stats().splice == true);
+
+  dut.cancel();
+  context.poll();
+  BOOST_TEST_REQUIRE(!!done);
+  BOOST_TEST(*done == boost::asio::error::operation_aborted);
+
+  // Once cancelled, the copy no longer holds the descriptors open, so
+  // closing the stream is visible to the peer.
+  copy_out.close();
+  char byte = 0;
+  boost::system::error_code read_ec;
+  sink.read_some(boost::asio::buffer(&byte, 1), read_ec);
+  BOOST_TEST(read_ec == boost::asio::error::eof);
+
+  // Nothing more is copied.
+  copy_in.close();
+  BOOST_TEST(dut.stats().bytes_read == 0);
+}
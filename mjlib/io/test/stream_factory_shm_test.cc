@@ -0,0 +1,261 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/stream_factory.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <optional>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib;
+
+namespace {
+io::SharedStream Create(boost::asio::io_context& context,
+                        io::StreamFactory& factory,
+                        const std::string& key, int direction,
+                        int size) {
+  io::StreamFactory::Options options;
+  options.type = io::StreamFactory::Type::kShm;
+  options.shm_key = key;
+  options.shm_direction = direction;
+  options.shm_size = size;
+
+  io::SharedStream result;
+  factory.AsyncCreate(options, [&](const base::error_code& ec,
+                                   io::SharedStream stream) {
+                        BOOST_TEST(!ec);
+                        result = stream;
+                      });
+  context.run();
+  context.restart();
+  BOOST_TEST_REQUIRE(!!result);
+  return result;
+}
+
+std::string MakeData(size_t size) {
+  std::string result;
+  for (size_t i = 0; i < size; i++) {
+    result.push_back(static_cast<char>(i * 13 + i / 256));
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(StreamFactoryShmTest) {
+  boost::asio::io_context context;
+  io::StreamFactory factory{context.get_executor()};
+
+  const std::string key = "test-" + std::to_string(::getpid());
+  // Use a ring which is smaller than the data, and not a power of 2,
+  // so that both sides have to wait on each other.
+  auto left = Create(context, factory, key, 0, 1000);
+  auto right = Create(context, factory, key, 1, 1000);
+
+  const std::string data = MakeData(100000);
+  std::string received(data.size(), '\0');
+  bool write_done = false;
+  bool read_done = false;
+
+  boost::asio::async_write(
+      *left, boost::asio::buffer(data),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        BOOST_TEST(size == data.size());
+        write_done = true;
+      });
+  boost::asio::async_read(
+      *right, boost::asio::buffer(received),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        BOOST_TEST(size == data.size());
+        read_done = true;
+      });
+  context.run();
+  context.restart();
+
+  BOOST_TEST(write_done);
+  BOOST_TEST(read_done);
+  BOOST_TEST(received == data);
+
+  // The other direction works too.
+  const std::string reply = "hello";
+  boost::asio::async_write(
+      *right, boost::asio::buffer(reply),
+      [&](const base::error_code& ec, size_t) {
+        BOOST_TEST(!ec);
+      });
+  char buf[16] = {};
+  std::optional<size_t> reply_size;
+  left->async_read_some(
+      boost::asio::buffer(buf),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        reply_size = size;
+      });
+  context.run();
+  context.restart();
+  BOOST_TEST_REQUIRE(!!reply_size);
+  BOOST_TEST(std::string(buf, *reply_size) == reply);
+
+  // Once one side goes away, the other sees end of file.
+  std::optional<base::error_code> eof;
+  left->async_read_some(
+      boost::asio::buffer(buf),
+      [&](const base::error_code& ec, size_t) {
+        eof = ec;
+      });
+  context.poll();
+  context.restart();
+  BOOST_TEST(!eof);
+
+  right.reset();
+  context.run();
+  BOOST_TEST_REQUIRE(!!eof);
+  BOOST_TEST(*eof == boost::asio::error::eof);
+}
+
+BOOST_AUTO_TEST_CASE(StreamFactoryShmReopen) {
+  boost::asio::io_context context;
+  io::StreamFactory factory{context.get_executor()};
+
+  const std::string key = "reopen-" + std::to_string(::getpid());
+  auto left = Create(context, factory, key, 0, 1000);
+  auto right = Create(context, factory, key, 1, 1000);
+
+  // The producer closes cleanly, which the consumer sees as end of
+  // file.
+  left.reset();
+  char buf[16] = {};
+  std::optional<base::error_code> eof;
+  right->async_read_some(
+      boost::asio::buffer(buf),
+      [&](const base::error_code& ec, size_t) {
+        eof = ec;
+      });
+  context.run();
+  context.restart();
+  BOOST_TEST_REQUIRE(!!eof);
+  BOOST_TEST(*eof == boost::asio::error::eof);
+
+  // A new producer starts a session which is not closed.
+  left = Create(context, factory, key, 0, 1000);
+  boost::asio::async_write(
+      *left, boost::asio::buffer(std::string("again")),
+      [](const base::error_code& ec, size_t) { BOOST_TEST(!ec); });
+
+  std::optional<size_t> size;
+  right->async_read_some(
+      boost::asio::buffer(buf),
+      [&](const base::error_code& ec, size_t read_size) {
+        BOOST_TEST(!ec);
+        size = read_size;
+      });
+  context.run();
+  context.restart();
+  BOOST_TEST_REQUIRE(!!size);
+  BOOST_TEST(std::string(buf, *size) == "again");
+
+  // And the consumer can still write back to it.
+  std::optional<base::error_code> write_ec;
+  boost::asio::async_write(
+      *right, boost::asio::buffer(std::string("ok")),
+      [&](const base::error_code& ec, size_t) { write_ec = ec; });
+  context.run();
+  BOOST_TEST_REQUIRE(!!write_ec);
+  BOOST_TEST(!*write_ec);
+}
+
+BOOST_AUTO_TEST_CASE(StreamFactoryShmSizeMismatch) {
+  boost::asio::io_context context;
+  io::StreamFactory factory{context.get_executor()};
+
+  const std::string key = "mismatch-" + std::to_string(::getpid());
+  auto left = Create(context, factory, key, 0, 1000);
+
+  io::StreamFactory::Options options;
+  options.type = io::StreamFactory::Type::kShm;
+  options.shm_key = key;
+  options.shm_direction = 1;
+  options.shm_size = 2000;
+
+  std::optional<base::error_code> result;
+  factory.AsyncCreate(options, [&](const base::error_code& ec,
+                                   io::SharedStream) {
+                        result = ec;
+                      });
+  context.run();
+  BOOST_TEST_REQUIRE(!!result);
+  BOOST_TEST(!!*result);
+}
+
+BOOST_AUTO_TEST_CASE(StreamFactoryShmRestart) {
+  const std::string key = "restart-" + std::to_string(::getpid());
+
+  // A producer which writes, then dies without cleaning up.
+  const pid_t child = ::fork();
+  BOOST_TEST_REQUIRE(child >= 0);
+  if (child == 0) {
+    boost::asio::io_context context;
+    io::StreamFactory factory{context.get_executor()};
+    auto stale = Create(context, factory, key, 0, 1000);
+    boost::asio::async_write(
+        *stale, boost::asio::buffer(std::string("stale")),
+        [](const base::error_code&, size_t) {});
+    context.run();
+    ::_exit(0);
+  }
+  int status = 0;
+  ::waitpid(child, &status, 0);
+  BOOST_TEST(WIFEXITED(status));
+
+  boost::asio::io_context context;
+  io::StreamFactory factory{context.get_executor()};
+
+  // The consumer attaches first, then the producer restarts.
+  auto right = Create(context, factory, key, 1, 1000);
+  auto left = Create(context, factory, key, 0, 1000);
+
+  boost::asio::async_write(
+      *left, boost::asio::buffer(std::string("fresh")),
+      [](const base::error_code& ec, size_t) { BOOST_TEST(!ec); });
+
+  char buf[16] = {};
+  std::optional<size_t> size;
+  right->async_read_some(
+      boost::asio::buffer(buf),
+      [&](const base::error_code& ec, size_t read_size) {
+        BOOST_TEST(!ec);
+        size = read_size;
+      });
+  context.run();
+  BOOST_TEST_REQUIRE(!!size);
+  BOOST_TEST(std::string(buf, *size) == "fresh");
+
+  // The crashed producer never detached, so clean up after it.
+  left.reset();
+  right.reset();
+  ::shm_unlink(("/mjlib-" + key).c_str());
+  for (int i = 0; i < 2; i++) {
+    ::unlink(("/dev/shm/mjlib-" + key + ".doorbell" +
+              std::to_string(i)).c_str());
+  }
+}
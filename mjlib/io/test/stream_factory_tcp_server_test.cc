@@ -0,0 +1,312 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/io/stream_factory.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+std::string MakeData(size_t size) {
+  std::string result;
+  for (size_t i = 0; i < size; i++) {
+    result.push_back(static_cast<char>(i * 11 + i / 256));
+  }
+  return result;
+}
+
+int FindFreePort(boost::asio::io_context& context) {
+  tcp::acceptor acceptor{context, tcp::endpoint(tcp::v4(), 0)};
+  return acceptor.local_endpoint().port();
+}
+
+/// Run the context until @p predicate is true, or a timeout passes.
+bool RunUntil(boost::asio::io_context& context,
+              std::function<bool ()> predicate,
+              std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+  const auto end = std::chrono::steady_clock::now() + timeout;
+  while (!predicate()) {
+    if (std::chrono::steady_clock::now() > end) { return false; }
+    context.run_for(std::chrono::milliseconds(1));
+    context.restart();
+  }
+  return true;
+}
+
+/// A client of the server under test, which reads continuously when
+/// enabled.
+class Client {
+ public:
+  Client(boost::asio::io_context& context, int port,
+         int receive_buffer = 0)
+      : socket_(context) {
+    socket_.open(tcp::v4());
+    if (receive_buffer) {
+      socket_.set_option(
+          boost::asio::socket_base::receive_buffer_size(receive_buffer));
+    }
+    socket_.async_connect(
+        tcp::endpoint(boost::asio::ip::address_v4::loopback(), port),
+        [this](const base::error_code& ec) {
+          BOOST_TEST(!ec);
+          connected_ = true;
+        });
+  }
+
+  void StartReading() {
+    if (reading_) { return; }
+    reading_ = true;
+    socket_.async_read_some(
+        boost::asio::buffer(buffer_),
+        [this](const base::error_code& ec, size_t size) {
+          reading_ = false;
+          if (ec) {
+            ec_ = ec;
+            return;
+          }
+          data_ += std::string(buffer_, size);
+          StartReading();
+        });
+  }
+
+  void Write(const std::string& data) {
+    boost::asio::write(socket_, boost::asio::buffer(data));
+  }
+
+  void Close() { socket_.close(); }
+
+  size_t available() { return socket_.available(); }
+  bool connected() const { return connected_; }
+  const std::string& data() const { return data_; }
+  const base::error_code& ec() const { return ec_; }
+
+ private:
+  tcp::socket socket_;
+  bool connected_ = false;
+  bool reading_ = false;
+  char buffer_[4096] = {};
+  std::string data_;
+  base::error_code ec_;
+};
+
+class Fixture {
+ public:
+  Fixture(io::StreamFactory::Options options = {}) {
+    port = FindFreePort(context);
+    options.type = io::StreamFactory::Type::kTcpServer;
+    options.tcp_server_fanout = true;
+    options.tcp_server_port = port;
+    factory.AsyncCreate(options, [&](const base::error_code& ec,
+                                     io::SharedStream stream) {
+                          BOOST_TEST(!ec);
+                          server = stream;
+                        });
+    BOOST_TEST_REQUIRE(RunUntil(context, [&]() { return !!server; }));
+  }
+
+  // Write @p data to the server and wait for it to complete.
+  void Write(const std::string& data) {
+    bool done = false;
+    boost::asio::async_write(
+        *server, boost::asio::buffer(data),
+        [&](const base::error_code& ec, size_t) {
+          BOOST_TEST(!ec);
+          done = true;
+        });
+    BOOST_TEST_REQUIRE(RunUntil(context, [&]() { return done; }));
+  }
+
+  // Connect a client, and wait until the server is known to be
+  // sending it data, so that clients are accepted in a known order.
+  std::unique_ptr<Client> Connect(bool read = true, int receive_buffer = 0) {
+    auto result = std::make_unique<Client>(context, port, receive_buffer);
+    if (read) { result->StartReading(); }
+    BOOST_TEST_REQUIRE(RunUntil(context, [&]() {
+          if (!result->data().empty()) { return true; }
+          if (!result->connected()) { return false; }
+          if (result->available() > 0) { return true; }
+          Write("s");
+          return false;
+        }));
+    return result;
+  }
+
+  boost::asio::io_context context;
+  io::StreamFactory factory{context.get_executor()};
+  int port = 0;
+  io::SharedStream server;
+};
+}
+
+BOOST_AUTO_TEST_CASE(TcpServerFanoutTest) {
+  Fixture f;
+
+  auto client1 = f.Connect();
+  auto client2 = f.Connect();
+
+  const std::string data = MakeData(100000);
+  const size_t start1 = client1->data().size();
+  const size_t start2 = client2->data().size();
+  f.Write(data);
+
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+        return client1->data().size() == start1 + data.size() &&
+            client2->data().size() == start2 + data.size();
+      }));
+  BOOST_TEST(client1->data().substr(start1) == data);
+  BOOST_TEST(client2->data().substr(start2) == data);
+}
+
+BOOST_AUTO_TEST_CASE(TcpServerFanoutDropTest) {
+  io::StreamFactory::Options options;
+  options.tcp_server_client_queue = 8192;
+  options.tcp_send_buffer = 4096;
+  Fixture f{options};
+
+  auto fast = f.Connect();
+  // This client does not read at all, so the kernel buffers and then
+  // its queue fill.
+  auto slow = f.Connect(false, 4096);
+
+  // Writes must still complete, and the fast client must see
+  // everything.
+  const size_t fast_start = fast->data().size();
+  const std::string chunk = MakeData(4096);
+  const size_t kChunks = 500;
+  std::string expected;
+  for (size_t i = 0; i < kChunks; i++) {
+    f.Write(chunk);
+    expected += chunk;
+    BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+          return fast->data().size() == fast_start + expected.size();
+        }));
+  }
+  BOOST_TEST(fast->data().substr(fast_start) == expected);
+
+  // The slow client missed out on most of it.
+  slow->StartReading();
+  f.context.run_for(std::chrono::milliseconds(200));
+  BOOST_TEST(slow->data().size() > 0u);
+  BOOST_TEST(slow->data().size() < expected.size() / 4);
+}
+
+BOOST_AUTO_TEST_CASE(TcpServerFanoutBackpressureTest) {
+  io::StreamFactory::Options options;
+  options.tcp_server_client_queue = 8192;
+  options.tcp_server_backpressure = true;
+  options.tcp_send_buffer = 4096;
+  Fixture f{options};
+
+  auto fast = f.Connect();
+  auto slow = f.Connect(false, 4096);
+
+  const size_t fast_start = fast->data().size();
+  const std::string data = MakeData(4 << 20);
+  bool done = false;
+  boost::asio::async_write(
+      *f.server, boost::asio::buffer(data),
+      [&](const base::error_code& ec, size_t size) {
+        BOOST_TEST(!ec);
+        BOOST_TEST(size == data.size());
+        done = true;
+      });
+
+  // The slow client is not reading, so the write cannot complete, and
+  // the fast client can get no further ahead than the queue allows.
+  f.context.run_for(std::chrono::milliseconds(200));
+  f.context.restart();
+  BOOST_TEST(!done);
+  BOOST_TEST(fast->data().size() < fast_start + data.size() / 4);
+
+  // Once it catches up, everyone gets everything.
+  slow->StartReading();
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+        return done &&
+            fast->data().size() == fast_start + data.size() &&
+            slow->data().size() >= data.size();
+      }));
+  BOOST_TEST(fast->data().substr(fast_start) == data);
+  BOOST_TEST(slow->data().substr(slow->data().size() - data.size()) == data);
+}
+
+BOOST_AUTO_TEST_CASE(TcpServerFanoutMaxClientsTest) {
+  io::StreamFactory::Options options;
+  options.tcp_server_max_clients = 1;
+  Fixture f{options};
+
+  auto client1 = f.Connect();
+
+  // The second client is accepted and immediately closed.
+  Client client2{f.context, f.port};
+  client2.StartReading();
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() { return !!client2.ec(); }));
+  BOOST_TEST(client2.ec() == boost::asio::error::eof);
+
+  // While the first is unaffected.
+  const size_t start = client1->data().size();
+  f.Write("hello");
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+        return client1->data().size() == start + 5;
+      }));
+  BOOST_TEST(client1->data().substr(start) == "hello");
+}
+
+BOOST_AUTO_TEST_CASE(TcpServerFanoutControllerTest) {
+  Fixture f;
+
+  auto client1 = f.Connect();
+  auto client2 = f.Connect();
+
+  std::string received;
+  char buffer[256] = {};
+  std::function<void ()> start_read = [&]() {
+    f.server->async_read_some(
+        boost::asio::buffer(buffer),
+        [&](const base::error_code& ec, size_t size) {
+          BOOST_TEST(!ec);
+          received += std::string(buffer, size);
+          start_read();
+        });
+  };
+  start_read();
+
+  // Only the oldest client, the controller, is listened to.
+  client2->Write("ignored");
+  client1->Write("first");
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+        return received == "first";
+      }));
+  f.context.run_for(std::chrono::milliseconds(50));
+  f.context.restart();
+  BOOST_TEST(received == "first");
+
+  // When it leaves, the next oldest is promoted.
+  client1->Close();
+  f.context.run_for(std::chrono::milliseconds(50));
+  f.context.restart();
+  client2->Write("second");
+  BOOST_TEST_REQUIRE(RunUntil(f.context, [&]() {
+        return received == "firstsecond";
+      }));
+}
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -26,11 +27,30 @@
 namespace mjlib {
 namespace micro {
 
+/// Bytes which have been read from a stream, but not yet consumed.
+struct AsyncReadBuffer {
+  base::string_span storage;
+  uint16_t start = 0;
+  uint16_t end = 0;
+
+  AsyncReadBuffer() {}
+  AsyncReadBuffer(base::string_span storage_in) : storage(storage_in) {}
+
+  uint16_t size() const { return end - start; }
+};
+
 struct AsyncReadUntilContext {
   AsyncReadStream* stream = nullptr;
   base::string_span buffer;
   SizeCallback callback;
   const char* delimiters = nullptr;
+
+  /// If set, the stream is read in chunks as large as this buffer's
+  /// storage and searched for delimiters in bulk, rather than one
+  /// byte per read.  Anything following the delimiter is retained
+  /// for the next call, so the same AsyncReadBuffer must be used for
+  /// all reads of a given stream.
+  AsyncReadBuffer* read_buffer = nullptr;
 };
 
 namespace detail {
@@ -65,14 +85,111 @@ inline void AsyncReadUntilHelper(AsyncReadUntilContext& context,
       base::string_span(context.buffer.data() + position,
                         context.buffer.data() + position + 1), handler);
 }
+
+/// Find the first delimiter in the unconsumed portion of the read
+/// buffer, examining no more than @p max_size bytes.  @return the
+/// number of bytes up to and including the delimiter, or -1 if none
+/// was found.
+inline int FindDelimiter(const AsyncReadUntilContext& context,
+                         uint16_t max_size) {
+  const auto* const rb = context.read_buffer;
+  const char* const data = rb->storage.data() + rb->start;
+  const uint16_t to_search = std::min(rb->size(), max_size);
+  for (uint16_t i = 0; i < to_search; i++) {
+    if (std::strchr(context.delimiters, data[i]) != nullptr) {
+      return i + 1;
+    }
+  }
+  return -1;
+}
+
+/// Fill the read buffer from the stream, then invoke @p handler.
+template <typename Handler>
+void AsyncFillReadBuffer(AsyncReadUntilContext& context, Handler handler) {
+  auto* const rb = context.read_buffer;
+  rb->start = 0;
+  rb->end = 0;
+  context.stream->AsyncReadSome(
+      rb->storage,
+      [ctx=&context, handler](error_code error, std::size_t size) {
+        ctx->read_buffer->end = size;
+        handler(error);
+      });
+}
+
+inline void BufferedAsyncReadUntilHelper(AsyncReadUntilContext& context,
+                                         uint16_t position) {
+  auto* const rb = context.read_buffer;
+  const uint16_t remaining = context.buffer.size() - position;
+  const int found = FindDelimiter(context, remaining);
+  const uint16_t to_copy =
+      (found >= 0) ? found : std::min(rb->size(), remaining);
+
+  std::memcpy(context.buffer.data() + position,
+              rb->storage.data() + rb->start, to_copy);
+  rb->start += to_copy;
+  position += to_copy;
+
+  if (found >= 0) {
+    context.callback({}, position);
+    return;
+  }
+
+  if (position == context.buffer.size()) {
+    // We overfilled our buffer without getting a terminator.
+    context.callback(errc::kDelimiterNotFound, position - 1);
+    return;
+  }
+
+  AsyncFillReadBuffer(
+      context,
+      [ctx=&context, position](error_code error) {
+        if (error) {
+          ctx->callback(error, position);
+          return;
+        }
+        BufferedAsyncReadUntilHelper(*ctx, position);
+      });
+}
+
+inline void BufferedAsyncIgnoreUntil(AsyncReadUntilContext& context) {
+  auto* const rb = context.read_buffer;
+  const int found = FindDelimiter(context, rb->size());
+  if (found >= 0) {
+    rb->start += found;
+    context.callback({}, 0);
+    return;
+  }
+
+  AsyncFillReadBuffer(
+      context,
+      [ctx=&context](error_code error) {
+        if (error) {
+          ctx->callback(error, 0);
+          return;
+        }
+        BufferedAsyncIgnoreUntil(*ctx);
+      });
+}
 }
 
 inline void AsyncReadUntil(AsyncReadUntilContext& context) {
   MJ_ASSERT(context.buffer.size() < std::numeric_limits<uint16_t>::max());
+  if (context.read_buffer) {
+    MJ_ASSERT(context.read_buffer->storage.size() <
+              std::numeric_limits<uint16_t>::max());
+    detail::BufferedAsyncReadUntilHelper(context, 0);
+    return;
+  }
   detail::AsyncReadUntilHelper(context, 0);
 }
 
 inline void AsyncIgnoreUntil(AsyncReadUntilContext& context) {
+  if (context.read_buffer) {
+    detail::BufferedAsyncIgnoreUntil(context);
+    return;
+  }
+
   context.stream->AsyncReadSome(
       base::string_span(context.buffer.data(), context.buffer.data() + 1),
       [ctx=&context](error_code error, std::size_t) {
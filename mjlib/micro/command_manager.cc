@@ -36,7 +36,19 @@ class CommandManager::Impl {
         line_buffer_(reinterpret_cast<char*>(
                          pool->Allocate(options.max_line_length, 1))),
         arguments_(reinterpret_cast<char*>(
-                       pool->Allocate(options.max_line_length, 1))) {}
+                       pool->Allocate(options.max_line_length, 1))) {
+    if (options.read_buffer_size > 0) {
+      read_buffer_ = AsyncReadBuffer(
+          base::string_span(
+              reinterpret_cast<char*>(
+                  pool->Allocate(options.read_buffer_size, 1)),
+              options.read_buffer_size));
+    }
+  }
+
+  AsyncReadBuffer* read_buffer() {
+    return options_.read_buffer_size > 0 ? &read_buffer_ : nullptr;
+  }
 
   void MaybeStartRead() {
     if (write_outstanding_) { return; }
@@ -45,6 +57,7 @@ class CommandManager::Impl {
     read_until_context_.buffer =
         base::string_span(line_buffer_, options_.max_line_length);
     read_until_context_.delimiters = "\r\n";
+    read_until_context_.read_buffer = read_buffer();
     read_until_context_.callback =
         [this](error_code error, int size) {
       this->HandleRead(error, size);
@@ -64,6 +77,7 @@ class CommandManager::Impl {
       read_until_context_.buffer =
           base::string_span(line_buffer_, options_.max_line_length);
       read_until_context_.delimiters = "\r\n";
+      read_until_context_.read_buffer = read_buffer();
       read_until_context_.callback = [this](error_code, int) {
         this->MaybeStartRead();
       };
@@ -161,6 +175,7 @@ class CommandManager::Impl {
   CommandFunction current_command_;
   VoidCallback done_callback_;
 
+  AsyncReadBuffer read_buffer_;
   AsyncReadUntilContext read_until_context_;
 };
 
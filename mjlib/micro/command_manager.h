@@ -33,6 +33,10 @@ class CommandManager {
   struct Options {
     int max_line_length = 100;
 
+    /// Input is read from the stream in chunks of up to this many
+    /// bytes.  0 reads a single byte at a time.
+    int read_buffer_size = 64;
+
     Options() {}
   };
 
@@ -34,13 +34,19 @@ class EventQueue {
   }
 
   void Poll() {
-    while (!events_.empty()) {
-      auto copy = events_;
-      events_ = {};
-      for (auto& item : copy) {
-        item();
-      }
+    if (polling_) {
+      // An event is polling from within an outer Poll, which is still
+      // iterating over running_, so use a queue of our own.
+      std::deque<VoidCallback> running;
+      Run(&running);
+      return;
     }
+
+    polling_ = true;
+    // Swap rather than copy, so that the storage of both queues is
+    // reused from one poll to the next.
+    Run(&running_);
+    polling_ = false;
   }
 
   bool empty() const {
@@ -48,7 +54,19 @@ class EventQueue {
   }
 
  private:
+  void Run(std::deque<VoidCallback>* running) {
+    while (!events_.empty()) {
+      std::swap(events_, *running);
+      for (auto& item : *running) {
+        item();
+      }
+      running->clear();
+    }
+  }
+
   std::deque<VoidCallback> events_;
+  std::deque<VoidCallback> running_;
+  bool polling_ = false;
 };
 
 }
@@ -60,6 +60,14 @@ class SizeCountingStream : public base::WriteStream {
  private:
   size_t size_ = 0;
 };
+
+uint32_t HashName(const std::string_view& name) {
+  uint32_t result = 2166136261u;
+  for (const char c : name) {
+    result = (result ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return result;
+}
 }
 
 class PersistentConfig::Impl {
@@ -106,6 +114,11 @@ class PersistentConfig::Impl {
     SerializableHandlerBase* serializable = nullptr;
     base::inplace_function<void ()> updated;
     bool enumerate = true;
+
+    // The schema of a serializable never changes, so its CRC is
+    // calculated once at registration.
+    uint32_t schema_crc = 0;
+    uint32_t name_hash = 0;
   };
 
   using ElementMap = PoolMap<std::string_view, Element>;
@@ -355,25 +368,22 @@ class PersistentConfig::Impl {
       // We are now committed to reading the entirety of the data one
       // way or another.
 
-      const auto element_it = elements_.find(name);
-      if (element_it == elements_.end()) {
+      auto* const element = FindElement(name);
+      if (element == nullptr) {
         // TODO jpieper: It would be nice to warn about situations
         // like this.
         flash_stream.ignore(data_size);
         continue;
       }
 
-      auto& element = element_it->second;
-
-      const uint32_t actual_crc = CalculateSchemaCrc(element.serializable);
-      if (actual_crc != expected_crc) {
+      if (element->schema_crc != expected_crc) {
         // TODO jpieper: It would be nice to warn about situations like
         // this.
         flash_stream.ignore(data_size);
         continue;
       }
 
-      if (element.serializable->ReadBinary(flash_stream)) {
+      if (element->serializable->ReadBinary(flash_stream)) {
         // It would be nice to let the caller know this failed.
       }
     }
@@ -384,7 +394,19 @@ class PersistentConfig::Impl {
     }
   }
 
-  uint32_t CalculateSchemaCrc(SerializableHandlerBase* base) const {
+  /// Look up an element by comparing name hashes, only comparing the
+  /// strings themselves when the hashes match.
+  Element* FindElement(const std::string_view& name) {
+    const uint32_t hash = HashName(name);
+    for (auto& item_pair : elements_) {
+      if (item_pair.second.name_hash == hash && item_pair.first == name) {
+        return &item_pair.second;
+      }
+    }
+    return nullptr;
+  }
+
+  static uint32_t CalculateSchemaCrc(SerializableHandlerBase* base) {
     base::NullWriteStream null;
     base::CrcWriteStream<boost::crc_32_type> crc_stream(null);
 
@@ -404,8 +426,7 @@ class PersistentConfig::Impl {
       const auto& element = item_pair.second;
 
       stream.WriteString(item_pair.first);
-      stream.Write(static_cast<uint32_t>(
-                       CalculateSchemaCrc(element.serializable)));
+      stream.Write(element.schema_crc);
 
       SizeCountingStream size_stream;
       element.serializable->WriteBinary(size_stream);
@@ -502,6 +523,8 @@ void PersistentConfig::RegisterDetail(
   element.serializable = base;
   element.updated = updated;
   element.enumerate = options.enumerate;
+  element.schema_crc = Impl::CalculateSchemaCrc(base);
+  element.name_hash = HashName(name);
 
   const auto result = impl_->elements_.insert({name, element});
   // We do not allow duplicate names.
@@ -0,0 +1,100 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mjlib {
+namespace micro {
+
+/// Shares a value written from one context, such as an interrupt
+/// handler, with readers in another.
+///
+/// The writer never blocks or waits on readers.  A reader copies the
+/// value out and retries if it was modified part way through, so
+/// readers always observe a consistent snapshot.  There may be only
+/// one writer at a time.
+template <typename T>
+class Seqlock {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock values are copied byte-wise");
+
+  Seqlock() {}
+  explicit Seqlock(const T& value) : value_(value) {}
+
+  Seqlock(const Seqlock&) = delete;
+  Seqlock& operator=(const Seqlock&) = delete;
+
+  /// Begin modifying the value in place.  Until the matching
+  /// EndWrite, readers will retry.
+  T* BeginWrite() {
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return &value_;
+  }
+
+  /// Publish the changes made since BeginWrite.
+  void EndWrite() {
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_release);
+  }
+
+  /// Replace the entire value.
+  void Write(const T& value) {
+    std::memcpy(static_cast<void*>(BeginWrite()), &value, sizeof(T));
+    EndWrite();
+  }
+
+  /// Make one attempt to copy the value into @p output.
+  ///
+  /// @return false if a write was in progress, in which case the
+  /// contents of @p output are unspecified.
+  bool TryRead(T* output) const {
+    const uint32_t before = sequence_.load(std::memory_order_acquire);
+    if (before & 1) { return false; }
+    std::memcpy(static_cast<void*>(output), &value_, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence_.load(std::memory_order_relaxed) == before;
+  }
+
+  /// Copy a consistent snapshot of the value into @p output.  This
+  /// must not be called from a context which can preempt the writer.
+  void Read(T* output) const {
+    while (!TryRead(output));
+  }
+
+  T Read() const {
+    T result;
+    Read(&result);
+    return result;
+  }
+
+  /// The number of writes which have been published.
+  uint32_t version() const {
+    return sequence_.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  std::atomic<uint32_t> sequence_{0};
+  T value_ = {};
+};
+
+}
+}
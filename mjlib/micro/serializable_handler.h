@@ -24,6 +24,7 @@
 
 #include "mjlib/micro/async_stream.h"
 #include "mjlib/micro/async_types.h"
+#include "mjlib/micro/seqlock.h"
 #include "mjlib/micro/serializable_handler_detail.h"
 
 namespace mjlib {
@@ -130,5 +131,58 @@ class SerializableHandler : public SerializableHandlerBase {
   T* const item_;
 };
 
+/// Serializes consistent snapshots of a value published through a
+/// Seqlock.  The value is read only through this interface, as the
+/// Seqlock may have only one writer.
+template <typename T>
+class SeqlockSerializableHandler : public SerializableHandlerBase {
+ public:
+  SeqlockSerializableHandler(const Seqlock<T>* seqlock) : seqlock_(seqlock) {}
+  ~SeqlockSerializableHandler() override {}
+
+  int WriteBinary(base::WriteStream& stream) override final {
+    seqlock_->Read(&snapshot_);
+    return handler_.WriteBinary(stream);
+  }
+
+  void WriteSchema(base::WriteStream& stream) override final {
+    handler_.WriteSchema(stream);
+  }
+
+  int ReadBinary(base::ReadStream&) override final {
+    return 1;
+  }
+
+  int Set(const std::string_view&, const std::string_view&) override final {
+    return 1;
+  }
+
+  void Enumerate(detail::EnumerateArchive::Context* context,
+                 const base::string_span& buffer,
+                 const std::string_view& prefix,
+                 AsyncWriteStream& stream,
+                 ErrorCallback callback) override final {
+    // The enumeration may span several asynchronous writes, all of
+    // which will be made from this one snapshot.
+    seqlock_->Read(&snapshot_);
+    handler_.Enumerate(context, buffer, prefix, stream, callback);
+  }
+
+  int Read(const std::string_view& key,
+           const base::string_span& buffer,
+           AsyncWriteStream& stream,
+           ErrorCallback callback) override final {
+    seqlock_->Read(&snapshot_);
+    return handler_.Read(key, buffer, stream, callback);
+  }
+
+  void SetDefault() override final {}
+
+ private:
+  const Seqlock<T>* const seqlock_;
+  T snapshot_ = {};
+  SerializableHandler<T> handler_{&snapshot_};
+};
+
 }
 }
@@ -0,0 +1,201 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/telemetry_log_writer.h"
+
+#include <boost/crc.hpp>
+
+#include "mjlib/base/assert.h"
+
+#include "mjlib/telemetry/format.h"
+
+#include "mjlib/micro/pool_array.h"
+
+namespace mjlib {
+namespace micro {
+
+namespace {
+using Format = telemetry::Format;
+
+template <typename T>
+uint64_t u64(T value) {
+  return static_cast<uint64_t>(value);
+}
+
+// The largest possible block type, block size, identifier, flags,
+// previous offset, timestamp, and checksum.
+constexpr size_t kMaxDataHeaderSize = 1 + 10 + 5 + 1 + 10 + 8 + 4;
+}
+
+class TelemetryLogWriter::Impl {
+ public:
+  Impl(Pool* pool, base::WriteStream* stream, const Options& options)
+      : options_(options),
+        counting_stream_(stream),
+        buffer_(pool, options.buffer_size),
+        last_positions_(pool, options.max_records) {
+    MJ_ASSERT(options.buffer_size > 0);
+    output_.RawWrite({"TLOG0003", 8});
+    output_.WriteVaruint(0);
+  }
+
+  base::BufferWriteStream* StartBlock() {
+    block_stream_.reset(buffer_.begin());
+    return &block_stream_;
+  }
+
+  Identifier FinishSchema(const std::string_view& name) {
+    MJ_ASSERT(next_identifier_ <= options_.max_records);
+    const Identifier identifier = next_identifier_++;
+
+    const auto schema_size = block_stream_.offset();
+    const auto body_size =
+        Format::GetVaruintSize(identifier) +
+        1 +  // flags
+        Format::GetVaruintSize(name.size()) + name.size() +
+        schema_size;
+
+    output_.WriteVaruint(u64(Format::BlockType::kSchema));
+    output_.WriteVaruint(body_size);
+    output_.WriteVaruint(identifier);
+    output_.WriteVaruint(0);
+    output_.WriteString(name);
+    output_.RawWrite({buffer_.begin(), static_cast<size_t>(schema_size)});
+
+    return identifier;
+  }
+
+  void FinishData(Identifier identifier, base::RealtimeNanoTime timestamp) {
+    MJ_ASSERT(identifier > 0 && identifier < next_identifier_);
+
+    const std::string_view data{
+      buffer_.begin(), static_cast<size_t>(block_stream_.offset())};
+
+    uint64_t flags = 0;
+    uint64_t flag_header_size = 0;
+    uint64_t previous_offset = 0;
+    auto& last_position = last_positions_[identifier - 1];
+
+    if (options_.previous_offsets) {
+      flags |= u64(Format::BlockDataFlags::kPreviousOffset);
+      previous_offset =
+          last_position ? (counting_stream_.position - last_position) : 0;
+      flag_header_size += Format::GetVaruintSize(previous_offset);
+    }
+    if (!timestamp.is_not_a_date_time()) {
+      flags |= u64(Format::BlockDataFlags::kTimestamp);
+      flag_header_size += 8;
+    }
+    if (options_.checksum) {
+      flags |= u64(Format::BlockDataFlags::kChecksum);
+      flag_header_size += 4;
+    }
+
+    const auto body_size =
+        Format::GetVaruintSize(identifier) +
+        Format::GetVaruintSize(flags) +
+        flag_header_size +
+        data.size();
+
+    // The header is assembled separately so that the checksum can be
+    // filled in before anything reaches the output stream.
+    char header[kMaxDataHeaderSize] = {};
+    base::BufferWriteStream header_stream{header};
+    telemetry::WriteStream writer{header_stream};
+    writer.WriteVaruint(u64(Format::BlockType::kData));
+    writer.WriteVaruint(body_size);
+    writer.WriteVaruint(identifier);
+    writer.WriteVaruint(flags);
+    if (flags & u64(Format::BlockDataFlags::kPreviousOffset)) {
+      writer.WriteVaruint(previous_offset);
+    }
+    if (flags & u64(Format::BlockDataFlags::kTimestamp)) {
+      writer.Write(timestamp);
+    }
+    if (options_.checksum) {
+      char* const crc_position = header_stream.position();
+      writer.Write(static_cast<uint32_t>(0));
+
+      boost::crc_32_type crc;
+      crc.process_bytes(header, header_stream.offset());
+      crc.process_bytes(data.data(), data.size());
+
+      header_stream.reset(crc_position);
+      writer.Write(static_cast<uint32_t>(crc.checksum()));
+    }
+
+    last_position = counting_stream_.position;
+
+    output_.RawWrite({header, static_cast<size_t>(header_stream.offset())});
+    output_.RawWrite(data);
+  }
+
+  // Forwards to the output stream, while keeping track of how much
+  // has been written.
+  class CountingStream : public base::WriteStream {
+   public:
+    CountingStream(base::WriteStream* base) : base_(base) {}
+
+    void write(const std::string_view& data) override {
+      base_->write(data);
+      position += data.size();
+    }
+
+    uint64_t position = 0;
+
+   private:
+    base::WriteStream* const base_;
+  };
+
+  const Options options_;
+  CountingStream counting_stream_;
+  telemetry::WriteStream output_{counting_stream_};
+
+  PoolArray<char> buffer_;
+  base::BufferWriteStream block_stream_{
+    base::string_span(buffer_.begin(), buffer_.end())};
+
+  // The position of the most recent data block for each identifier,
+  // or 0 if there has been none.
+  PoolArray<uint64_t> last_positions_;
+
+  Identifier next_identifier_ = 1;
+};
+
+TelemetryLogWriter::TelemetryLogWriter(
+    Pool* pool, base::WriteStream* stream, const Options& options)
+    : impl_(pool, pool, stream, options) {}
+
+TelemetryLogWriter::~TelemetryLogWriter() {}
+
+uint64_t TelemetryLogWriter::position() const {
+  return impl_->counting_stream_.position;
+}
+
+base::BufferWriteStream* TelemetryLogWriter::StartBlock() {
+  return impl_->StartBlock();
+}
+
+TelemetryLogWriter::Identifier TelemetryLogWriter::FinishSchema(
+    const std::string_view& name) {
+  return impl_->FinishSchema(name);
+}
+
+void TelemetryLogWriter::FinishData(
+    Identifier identifier, base::RealtimeNanoTime timestamp) {
+  return impl_->FinishData(identifier, timestamp);
+}
+
+}
+}
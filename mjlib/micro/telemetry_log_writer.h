@@ -0,0 +1,100 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string_view>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/nano_time.h"
+#include "mjlib/base/stream.h"
+
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "mjlib/micro/pool_ptr.h"
+
+namespace mjlib {
+namespace micro {
+
+/// Writes log files in the TLOG0003 format, as read by
+/// telemetry::FileReader, without using the heap.
+///
+/// All storage is allocated from the pool at construction.  Each
+/// record is serialized exactly once into a working buffer, then
+/// emitted as a complete block to the output stream, which may for
+/// instance be a FlashWriteStream.
+class TelemetryLogWriter {
+ public:
+  using Identifier = uint32_t;
+
+  struct Options {
+    /// The maximum number of records which may be registered.
+    size_t max_records = 16;
+
+    /// The size of the working buffer.  It must be able to hold the
+    /// largest serialized schema or data value.
+    size_t buffer_size = 512;
+
+    /// Append a CRC32 to each data block.
+    bool checksum = true;
+
+    /// Record the distance to the previous data block with the same
+    /// identifier, so that readers can walk backwards.
+    bool previous_offsets = true;
+
+    Options() {}
+  };
+
+  /// The file header is written to @p stream immediately.
+  TelemetryLogWriter(Pool*, base::WriteStream* stream,
+                     const Options& = Options());
+  ~TelemetryLogWriter();
+
+  /// Write the schema for a new record.  @p name is not aliased.
+  ///
+  /// @return the identifier to use for data from this record.
+  template <typename T>
+  Identifier Register(const std::string_view& name) {
+    auto* stream = StartBlock();
+    telemetry::BinarySchemaArchive archive(*stream);
+    T temporary;
+    archive.Accept(&temporary);
+    return FinishSchema(name);
+  }
+
+  /// Write one instance of a record.  If @p timestamp is
+  /// not_a_date_time, no timestamp is included.
+  template <typename T>
+  void Write(Identifier identifier, const T& value,
+             base::RealtimeNanoTime timestamp = {}) {
+    auto* stream = StartBlock();
+    telemetry::BinaryWriteArchive archive(*stream);
+    archive.Accept(&value);
+    FinishData(identifier, timestamp);
+  }
+
+  /// The total number of bytes written to the stream.
+  uint64_t position() const;
+
+ private:
+  base::BufferWriteStream* StartBlock();
+  Identifier FinishSchema(const std::string_view& name);
+  void FinishData(Identifier, base::RealtimeNanoTime timestamp);
+
+  class Impl;
+  PoolPtr<Impl> impl_;
+};
+
+}
+}
@@ -49,6 +49,18 @@ class TelemetryManager {
     return RegisterDetail(name, concrete.get());
   }
 
+  /// Associate a value published through a Seqlock with the given
+  /// name.  The publisher may update it from an interrupt at any
+  /// time, and a consistent snapshot is taken each time it is
+  /// emitted.  The returned function must still be called from the
+  /// main context.
+  template <typename T>
+  base::inplace_function<void ()> Register(
+      const std::string_view& name, Seqlock<T>* seqlock) {
+    PoolPtr<SeqlockSerializableHandler<T>> concrete(pool(), seqlock);
+    return RegisterDetail(name, concrete.get());
+  }
+
   /// This should be invoked every millisecond.
   void PollMillisecond();
 
@@ -0,0 +1,146 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/async_read.h"
+
+#include <string>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib::micro;
+namespace base = mjlib::base;
+
+namespace {
+/// Serves a fixed string, completing each read synchronously with as
+/// much as fits.
+class StringReadStream : public AsyncReadStream {
+ public:
+  StringReadStream(std::string data) : data_(data) {}
+
+  void AsyncReadSome(const base::string_span& buffer,
+                     const SizeCallback& callback) override {
+    reads_++;
+    const auto size = std::min<std::size_t>(
+        buffer.size(), data_.size() - offset_);
+    if (size == 0) {
+      callback(errc::kDelimiterNotFound, 0);
+      return;
+    }
+    std::memcpy(buffer.data(), data_.data() + offset_, size);
+    offset_ += size;
+    callback({}, size);
+  }
+
+  int reads_ = 0;
+
+ private:
+  const std::string data_;
+  std::size_t offset_ = 0;
+};
+
+struct Fixture {
+  Fixture(std::string data) : stream(data) {
+    context.stream = &stream;
+    context.buffer = base::string_span(line, sizeof(line));
+    context.delimiters = "\r\n";
+    context.read_buffer = &read_buffer;
+    context.callback = [this](error_code ec, std::size_t size) {
+      result_ec = ec;
+      result = std::string(line, size);
+      done++;
+    };
+  }
+
+  StringReadStream stream;
+  char line[16] = {};
+  char read_storage[32] = {};
+  AsyncReadBuffer read_buffer{base::string_span(read_storage)};
+  AsyncReadUntilContext context;
+
+  int done = 0;
+  error_code result_ec;
+  std::string result;
+};
+}
+
+BOOST_AUTO_TEST_CASE(BufferedAsyncReadUntilTest) {
+  Fixture f{"first\nsecond\r\nthird line\n"};
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 1);
+  BOOST_TEST(!f.result_ec);
+  BOOST_TEST(f.result == "first\n");
+  BOOST_TEST(f.stream.reads_ == 1);
+
+  // The remaining lines are served from what was already read.
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 2);
+  BOOST_TEST(f.result == "second\r");
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.result == "\n");
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 4);
+  BOOST_TEST(f.result == "third line\n");
+  BOOST_TEST(f.stream.reads_ == 1);
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 5);
+  BOOST_TEST(f.result_ec == errc::kDelimiterNotFound);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedAsyncReadUntilSplitTest) {
+  // A line which spans more than one read of the stream.
+  Fixture f{"0123456789012345678901234567890123\nnext\n"};
+  f.context.buffer = base::string_span(f.line, 8);
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 1);
+  BOOST_TEST(f.result_ec == errc::kDelimiterNotFound);
+  BOOST_TEST(f.result == "0123456");
+
+  // The remainder of the overlong line can be skipped.
+  f.context.callback = [&](error_code ec, std::size_t) {
+    f.result_ec = ec;
+    f.done++;
+  };
+  AsyncIgnoreUntil(f.context);
+  BOOST_TEST(f.done == 2);
+  BOOST_TEST(!f.result_ec);
+  BOOST_TEST(f.stream.reads_ == 2);
+
+  f.context.buffer = base::string_span(f.line, sizeof(f.line));
+  f.context.callback = [&](error_code ec, std::size_t size) {
+    f.result_ec = ec;
+    f.result = std::string(f.line, size);
+    f.done++;
+  };
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.done == 3);
+  BOOST_TEST(!f.result_ec);
+  BOOST_TEST(f.result == "next\n");
+}
+
+BOOST_AUTO_TEST_CASE(UnbufferedAsyncReadUntilTest) {
+  Fixture f{"first\nsecond\n"};
+  f.context.read_buffer = nullptr;
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.result == "first\n");
+  BOOST_TEST(f.stream.reads_ == 6);
+
+  AsyncReadUntil(f.context);
+  BOOST_TEST(f.result == "second\n");
+}
@@ -0,0 +1,39 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/event_queue.h"
+
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(EventQueueNestedPoll) {
+  mjlib::micro::EventQueue dut;
+
+  std::vector<int> order;
+  dut.Post([&]() {
+      order.push_back(1);
+      dut.Post([&]() { order.push_back(3); });
+      dut.Poll();
+      order.push_back(4);
+    });
+  dut.Post([&]() { order.push_back(2); });
+
+  dut.Poll();
+
+  // The nested poll runs only what was posted after the outer one
+  // started, and the outer one carries on where it left off.
+  BOOST_TEST(order == (std::vector<int>{1, 3, 4, 2}));
+  BOOST_TEST(dut.empty());
+}
@@ -128,3 +128,29 @@ BOOST_FIXTURE_TEST_CASE(PersistentConfigFlash, Fixture) {
   Command("conf size\n");
   ExpectResponse("72\r\nOK\r\n");
 }
+
+BOOST_FIXTURE_TEST_CASE(PersistentConfigFlashMismatch, Fixture) {
+  my_data.value = 76;
+  other_data.stuff = 23;
+  non_enumerated.value = 12;
+  Command("conf write\n");
+  ExpectResponse("OK\r\n");
+
+  // Each element is a name, a schema CRC, a data size, then the data.
+  BOOST_TEST(std::string_view(&flash.buffer_[1], 7) == "my_data");
+  BOOST_TEST(std::string_view(&flash.buffer_[21], 10) == "other_data");
+  BOOST_TEST(std::string_view(&flash.buffer_[42], 14) == "non_enumerated");
+
+  // Rename the first, and corrupt the schema CRC of the second.
+  flash.buffer_[7] = 'b';
+  flash.buffer_[31] ^= 0x01;
+
+  Command("conf default\n");
+  ExpectResponse("OK\r\n");
+  Command("conf load\n");
+  ExpectResponse("OK\r\n");
+
+  BOOST_TEST(my_data.value == 0);
+  BOOST_TEST(other_data.stuff == 0);
+  BOOST_TEST(non_enumerated.value == 12);
+}
@@ -0,0 +1,84 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/seqlock.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib::micro;
+
+namespace {
+struct Sample {
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t c = 0;
+};
+}
+
+BOOST_AUTO_TEST_CASE(SeqlockBasic) {
+  Seqlock<Sample> dut;
+  BOOST_TEST(dut.version() == 0);
+  BOOST_TEST(dut.Read().a == 0);
+
+  dut.Write(Sample{1, 2, 3});
+  BOOST_TEST(dut.version() == 1);
+
+  Sample result;
+  BOOST_TEST(dut.TryRead(&result));
+  BOOST_TEST(result.a == 1);
+  BOOST_TEST(result.b == 2);
+  BOOST_TEST(result.c == 3);
+
+  auto* value = dut.BeginWrite();
+  value->b = 10;
+
+  // While a write is in progress, readers cannot complete.
+  BOOST_TEST(!dut.TryRead(&result));
+
+  dut.EndWrite();
+  BOOST_TEST(dut.version() == 2);
+  BOOST_TEST(dut.TryRead(&result));
+  BOOST_TEST(result.a == 1);
+  BOOST_TEST(result.b == 10);
+}
+
+BOOST_AUTO_TEST_CASE(SeqlockConcurrent) {
+  Seqlock<Sample> dut;
+  std::atomic<bool> done{false};
+
+  std::thread writer([&]() {
+    for (int32_t i = 1; i <= 200000; i++) {
+      auto* value = dut.BeginWrite();
+      value->a = i;
+      value->b = i * 2;
+      value->c = i * 3;
+      dut.EndWrite();
+    }
+    done = true;
+  });
+
+  int inconsistent = 0;
+  while (!done) {
+    const auto sample = dut.Read();
+    if (sample.b != sample.a * 2 || sample.c != sample.a * 3) {
+      inconsistent++;
+    }
+  }
+  writer.join();
+
+  BOOST_TEST(inconsistent == 0);
+  BOOST_TEST(dut.Read().a == 200000);
+}
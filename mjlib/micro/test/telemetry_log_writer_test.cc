@@ -0,0 +1,139 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/telemetry_log_writer.h"
+
+#include <fstream>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/base/visitor.h"
+
+#include "mjlib/telemetry/binary_read_archive.h"
+#include "mjlib/telemetry/file_reader.h"
+
+using namespace mjlib;
+
+namespace {
+struct Sample {
+  int32_t count = 0;
+  float value = 0.0f;
+  std::array<int16_t, 3> array = {};
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(value));
+    a->Visit(MJ_NVP(array));
+  }
+};
+
+struct Other {
+  uint8_t stuff = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(stuff));
+  }
+};
+
+template <typename T>
+T Decode(const std::string& data) {
+  T result;
+  base::BufferReadStream stream{data};
+  telemetry::BinaryReadArchive(stream).Accept(&result);
+  return result;
+}
+
+void TestWriter(const micro::TelemetryLogWriter::Options& options) {
+  micro::SizedPool<4096> pool;
+  base::FastOStringStream output;
+
+  {
+    micro::TelemetryLogWriter dut{&pool, &output, options};
+    const auto sample_id = dut.Register<Sample>("sample");
+    const auto other_id = dut.Register<Other>("other");
+    BOOST_TEST(sample_id != other_id);
+
+    for (int i = 0; i < 10; i++) {
+      Sample sample;
+      sample.count = i;
+      sample.value = i * 0.5f;
+      sample.array = {{static_cast<int16_t>(i), 2, 3}};
+      dut.Write(sample_id, sample,
+                base::RealtimeNanoTime(1600000000000000000ll + i * 1000000ll));
+      if (i % 3 == 0) {
+        Other other;
+        other.stuff = i;
+        dut.Write(other_id, other);
+      }
+    }
+
+    BOOST_TEST(dut.position() == output.str().size());
+  }
+
+  base::TemporaryFile temp;
+  {
+    std::ofstream of(temp.native());
+    const auto data = output.str();
+    of.write(data.data(), data.size());
+  }
+
+  telemetry::FileReader reader{temp.native()};
+  BOOST_TEST(reader.records().size() == 2);
+  BOOST_TEST_REQUIRE(!!reader.record("sample"));
+  BOOST_TEST_REQUIRE(!!reader.record("other"));
+
+  int sample_count = 0;
+  int other_count = 0;
+  for (const auto& item : reader.items()) {
+    if (item.record->name == "sample") {
+      const auto sample = Decode<Sample>(item.data);
+      BOOST_TEST(sample.count == sample_count);
+      BOOST_TEST(sample.value == sample_count * 0.5f);
+      BOOST_TEST(sample.array[0] == sample_count);
+      BOOST_TEST(sample.array[2] == 3);
+      BOOST_TEST(item.nano_timestamp.count() ==
+                 1600000000000000000ll + sample_count * 1000000ll);
+      sample_count++;
+    } else {
+      const auto other = Decode<Other>(item.data);
+      BOOST_TEST(other.stuff == other_count * 3);
+      BOOST_TEST(item.nano_timestamp.is_not_a_date_time());
+      other_count++;
+    }
+  }
+  BOOST_TEST(sample_count == 10);
+  BOOST_TEST(other_count == 4);
+
+  // Seeking relies upon the previous offsets, when present.
+  const auto seek = reader.Seek(
+      base::RealtimeNanoTime(1600000000000000000ll + 4500000ll));
+  BOOST_TEST(seek.count(reader.record("sample")) == 1);
+}
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryLogWriterTest) {
+  TestWriter({});
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryLogWriterMinimalTest) {
+  micro::TelemetryLogWriter::Options options;
+  options.checksum = false;
+  options.previous_offsets = false;
+  TestWriter(options);
+}
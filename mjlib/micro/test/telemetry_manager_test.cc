@@ -59,6 +59,24 @@ BOOST_FIXTURE_TEST_CASE(TelemetryManagerSchema, Fixture) {
   ExpectResponsePrefix("schema my_data\r\n");
 }
 
+BOOST_FIXTURE_TEST_CASE(TelemetryManagerSeqlock, Fixture) {
+  Seqlock<test::MyData> published;
+  auto update = dut.Register("published", &published);
+
+  published.BeginWrite()->value = 3;
+  published.EndWrite();
+
+  Command("tel get published\n");
+  ExpectResponse(str("emit published\r\n\x04\x00\x00\x00\x03\x00\x00\x00"));
+
+  Command("tel fmt published 1\n");
+  ExpectResponse("OK\r\n");
+
+  published.Write(test::MyData{7});
+  Command("tel get published\n");
+  ExpectResponse("published.value 7\r\nOK\r\n");
+}
+
 BOOST_FIXTURE_TEST_CASE(TelemetryManagerRate, Fixture) {
   Command("tel rate my_data 20\n");
   ExpectResponse("OK\r\n");
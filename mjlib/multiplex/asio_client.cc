@@ -0,0 +1,106 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/asio_client.h"
+
+#include <memory>
+
+#include <boost/asio/error.hpp>
+
+#include "mjlib/base/assert.h"
+
+namespace mjlib {
+namespace multiplex {
+
+namespace {
+class SequentialDiscover
+    : public std::enable_shared_from_this<SequentialDiscover> {
+ public:
+  SequentialDiscover(AsioClient* client,
+                     const AsioClient::DiscoverOptions& options,
+                     AsioClient::Discovery* discovery,
+                     io::ErrorCallback callback)
+      : client_(client),
+        options_(options),
+        discovery_(discovery),
+        callback_(std::move(callback)),
+        ids_(AsioClient::DiscoverIds(options)) {}
+
+  void Start() {
+    request_ = {{ids_.at(next_), options_.identity}};
+    client_->AsyncTransmit(
+        &request_, &reply_,
+        [self=shared_from_this()](const base::error_code& ec) {
+          self->HandleReply(ec);
+        });
+  }
+
+ private:
+  void HandleReply(const base::error_code& ec) {
+    if (ec && ec != boost::asio::error::operation_aborted) {
+      callback_(ec);
+      return;
+    }
+
+    if (!ec) {
+      // Even an empty reply means someone was there.
+      auto& identity = (*discovery_)[ids_.at(next_)];
+      for (const auto& item : reply_) {
+        identity[item.reg] = item.value;
+      }
+    }
+
+    next_++;
+    if (next_ >= ids_.size()) {
+      callback_(base::error_code());
+      return;
+    }
+
+    Start();
+  }
+
+  AsioClient* const client_;
+  const AsioClient::DiscoverOptions options_;
+  AsioClient::Discovery* const discovery_;
+  io::ErrorCallback callback_;
+  const std::vector<uint8_t> ids_;
+
+  size_t next_ = 0;
+  AsioClient::Request request_;
+  AsioClient::Reply reply_;
+};
+}
+
+void AsioClient::AsyncDiscover(const DiscoverOptions& options,
+                               Discovery* discovery,
+                               io::ErrorCallback callback) {
+  MJ_ASSERT(options.identity.request_reply());
+  discovery->clear();
+
+  std::make_shared<SequentialDiscover>(
+      this, options, discovery, std::move(callback))->Start();
+}
+
+std::vector<uint8_t> AsioClient::DiscoverIds(const DiscoverOptions& options) {
+  if (!options.ids.empty()) { return options.ids; }
+
+  std::vector<uint8_t> result;
+  for (uint8_t id = 1; id < Format::kBroadcastId; id++) {
+    result.push_back(id);
+  }
+  return result;
+}
+
+}
+}
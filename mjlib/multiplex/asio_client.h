@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <map>
+#include <vector>
+
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <function2/function2.hpp>
@@ -69,6 +72,56 @@ class AsioClient {
       uint8_t id,
       uint32_t channel,
       const TunnelOptions& options = TunnelOptions()) = 0;
+
+  struct DiscoverOptions {
+    /// The IDs to probe.  If empty, every non-broadcast ID is probed.
+    std::vector<uint8_t> ids;
+
+    /// Registers to read from each device in order to identify it.
+    /// This must contain at least one read.
+    RegisterRequest identity;
+
+    /// Send the identity request to the broadcast address before
+    /// probing individually, and skip any IDs which respond to it.
+    /// This is only useful where simultaneous replies are
+    /// arbitrated, as on CAN.
+    bool broadcast = false;
+
+    /// The number of probes which may be outstanding at once.  As
+    /// with broadcast, values larger than 1 should only be used where
+    /// simultaneous replies are arbitrated.
+    int window = 1;
+
+    /// The time to wait for replies starts at max_timeout, and once
+    /// any device has replied, shrinks to twice the longest observed
+    /// reply latency, but no less than min_timeout.
+    boost::posix_time::time_duration min_timeout =
+        boost::posix_time::milliseconds(2);
+    boost::posix_time::time_duration max_timeout =
+        boost::posix_time::milliseconds(15);
+
+    DiscoverOptions() {
+      identity.ReadSingle(0, 0);
+    }
+  };
+
+  /// The identity registers of each device which responded.
+  using Discovery = std::map<uint8_t, RegisterReply>;
+
+  /// Find which devices are present.  The handler is invoked once
+  /// every ID has been probed, with @p discovery holding those that
+  /// responded.  @p discovery must remain valid until then.  A
+  /// communication error ends discovery early and is passed to the
+  /// handler, leaving @p discovery incomplete.
+  ///
+  /// The default implementation probes each ID in turn with
+  /// AsyncTransmit.
+  virtual void AsyncDiscover(const DiscoverOptions&,
+                             Discovery* discovery,
+                             io::ErrorCallback);
+
+  /// @return the IDs which @p options asks to be probed.
+  static std::vector<uint8_t> DiscoverIds(const DiscoverOptions& options);
 };
 
 }
@@ -25,17 +25,6 @@ import mjlib.multiplex.multiplex_protocol as mp
 import mjlib.multiplex.aioserial as aioserial
 
 
-async def readline(stream):
-    result = bytearray()
-    while True:
-        char = await stream.read(1)
-        if char == b'\r' or char == b'\n':
-            if len(result):
-                return result
-        else:
-            result += char
-
-
 async def main():
     parser = argparse.ArgumentParser(description=__doc__)
     parser.add_argument('data', type=str,
@@ -67,7 +56,7 @@ async def main():
             mc.write(line)
             await mc.drain()
 
-            result = (await readline(mc)).strip()
+            result = (await mc.readline()).strip()
             print('>', result.decode('latin1'))
             if result != b'OK':
                 raise RuntimeError('Unknown response: ' + result)
@@ -126,6 +126,37 @@
 ///
 /// A frame that contains a tunneled stream subframe may contain
 /// exactly 1 subframe total.
+///
+/// # Service: Register Subscriptions #
+///
+/// The subscription service lets a client ask a server to send
+/// register values on its own, rather than polling for them with
+/// read subframes.
+///
+/// ## Subframes ##
+///
+///  0x60 - subscribe
+///    - varuint => subscription slot
+///    - varuint => period in milliseconds (non-zero)
+///    - float => deadband
+///    - varuint => read subframe type (0x10-0x1f)
+///    - varuint => number of registers (may be optionally encoded as
+///      a non-zero 2 LSBs of the read subframe type)
+///    - varuint => start register #
+///  0x61 - unsubscribe
+///    - varuint => subscription slot
+///  0x62 - subscription data
+///    - varuint => subscription slot
+///    - followed by either a reply subframe or a read error subframe
+///
+/// After receiving a 0x60 subframe, the slave will send an
+/// unsolicited frame containing a 0x62 subframe to the subscribing
+/// client once every period.  If the deadband is non-negative, the
+/// frame is only sent when at least one register has changed by more
+/// than the deadband since the last values that were sent.
+/// Subscribing again on the same slot replaces the previous
+/// subscription.  The number of slots and the maximum number of
+/// registers per slot are device dependent.
 
 #include <cstdint>
 #include <variant>
@@ -170,6 +201,11 @@ struct Format {
     kClientPollServer = 0x42,
 
     kNop = 0x50,
+
+    // # Register Subscriptions #
+    kSubscribe = 0x60,
+    kUnsubscribe = 0x61,
+    kSubscriptionData = 0x62,
   };
 
   using Register = uint32_t;
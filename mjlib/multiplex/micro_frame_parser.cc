@@ -0,0 +1,194 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/micro_frame_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "mjlib/base/assert.h"
+
+namespace mjlib {
+namespace multiplex {
+
+namespace {
+// Anything larger than this is assumed to be garbage, regardless of
+// how large our buffer is.
+constexpr uint32_t kMaxPayloadSize = 4096;
+}
+
+size_t MicroFrameParser::Frame::CopyTo(const base::string_span& output) const {
+  const size_t size1 = std::min<size_t>(payload1.size(), output.size());
+  std::memcpy(output.data(), payload1.data(), size1);
+  const size_t size2 = std::min<size_t>(payload2.size(), output.size() - size1);
+  std::memcpy(output.data() + size1, payload2.data(), size2);
+  return size1 + size2;
+}
+
+MicroFrameParser::MicroFrameParser(const base::string_span& storage)
+    : storage_(storage.data()),
+      capacity_(storage.size()) {
+  MJ_ASSERT(capacity_ > static_cast<uint64_t>(
+                kHeaderSize + kMinVaruintSize + kCrcSize));
+}
+
+base::string_span MicroFrameParser::write_span() const {
+  const uint64_t offset = head_ % capacity_;
+  const uint64_t free = capacity_ - (head_ - tail_);
+  return base::string_span(
+      storage_ + offset,
+      static_cast<std::ptrdiff_t>(std::min(free, capacity_ - offset)));
+}
+
+void MicroFrameParser::Commit(size_t size) {
+  MJ_ASSERT(size <= static_cast<size_t>(write_span().size()));
+  head_ += size;
+  Parse();
+}
+
+void MicroFrameParser::Pop() {
+  if (!complete_) { return; }
+  complete_ = false;
+  frame_ = {};
+  tail_ = position_;
+  state_ = kSync0;
+  Parse();
+}
+
+void MicroFrameParser::Reset() {
+  tail_ = position_ = head_ = 0;
+  state_ = kSync0;
+  complete_ = false;
+  frame_ = {};
+}
+
+void MicroFrameParser::Resync() {
+  position_ = frame_start_ + 1;
+  tail_ = position_;
+  state_ = kSync0;
+}
+
+void MicroFrameParser::Parse() {
+  constexpr uint8_t kHeaderLowByte = kHeader & 0xff;
+  constexpr uint8_t kHeaderHighByte = (kHeader >> 8) & 0xff;
+
+  while (position_ != head_ && !complete_) {
+    switch (state_) {
+      case kSync0: {
+        // Search the contiguous run of unparsed bytes at once.
+        const uint64_t offset = position_ % capacity_;
+        const size_t run = std::min(head_ - position_, capacity_ - offset);
+        const void* const found =
+            std::memchr(storage_ + offset, kHeaderLowByte, run);
+        if (found == nullptr) {
+          position_ += run;
+          tail_ = position_;
+          break;
+        }
+        position_ += static_cast<const char*>(found) - (storage_ + offset);
+        frame_start_ = position_;
+        tail_ = position_;
+        crc_.reset();
+        crc_.process_byte(kHeaderLowByte);
+        position_++;
+        state_ = kSync1;
+        break;
+      }
+      case kSync1: {
+        const uint8_t value = byte(position_++);
+        if (value != kHeaderHighByte) {
+          stats_.bad_header++;
+          Resync();
+          break;
+        }
+        crc_.process_byte(value);
+        state_ = kSource;
+        break;
+      }
+      case kSource: {
+        frame_.source = byte(position_++);
+        crc_.process_byte(frame_.source);
+        state_ = kDestination;
+        break;
+      }
+      case kDestination: {
+        frame_.destination = byte(position_++);
+        crc_.process_byte(frame_.destination);
+        payload_size_ = 0;
+        size_shift_ = 0;
+        state_ = kSize;
+        break;
+      }
+      case kSize: {
+        const uint8_t value = byte(position_++);
+        crc_.process_byte(value);
+        payload_size_ |= static_cast<uint32_t>(value & 0x7f) << size_shift_;
+        size_shift_ += 7;
+        if (value & 0x80) {
+          if (size_shift_ >= 7 * kMaxVaruintSize) {
+            stats_.oversize++;
+            Resync();
+          }
+          break;
+        }
+        if (payload_size_ > kMaxPayloadSize ||
+            (payload_size_ + position_ - frame_start_ + kCrcSize) >
+            capacity_) {
+          stats_.oversize++;
+          Resync();
+          break;
+        }
+        payload_start_ = position_;
+        payload_remaining_ = payload_size_;
+        state_ = payload_size_ ? kPayload : kCrc0;
+        break;
+      }
+      case kPayload: {
+        const uint64_t offset = position_ % capacity_;
+        const size_t run = std::min<uint64_t>(
+            {payload_remaining_, head_ - position_, capacity_ - offset});
+        crc_.process_bytes(storage_ + offset, run);
+        position_ += run;
+        payload_remaining_ -= run;
+        if (payload_remaining_ == 0) { state_ = kCrc0; }
+        break;
+      }
+      case kCrc0: {
+        crc_low_ = byte(position_++);
+        state_ = kCrc1;
+        break;
+      }
+      case kCrc1: {
+        const uint16_t actual_crc =
+            crc_low_ | (static_cast<uint16_t>(byte(position_++)) << 8);
+        if (actual_crc != crc_.checksum()) {
+          stats_.checksum_mismatch++;
+          Resync();
+          break;
+        }
+
+        const uint64_t offset = payload_start_ % capacity_;
+        const size_t size1 = std::min<uint64_t>(
+            payload_size_, capacity_ - offset);
+        frame_.payload1 = std::string_view(storage_ + offset, size1);
+        frame_.payload2 = std::string_view(storage_, payload_size_ - size1);
+        complete_ = true;
+        break;
+      }
+    }
+  }
+}
+
+}
+}
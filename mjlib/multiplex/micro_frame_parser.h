@@ -0,0 +1,147 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include <boost/crc.hpp>
+
+#include "mjlib/base/string_span.h"
+#include "mjlib/base/visitor.h"
+
+#include "mjlib/multiplex/format.h"
+
+namespace mjlib {
+namespace multiplex {
+
+/// Incrementally extracts multiplex frames from a byte stream held in
+/// a caller provided circular buffer.
+///
+/// Bytes are deposited directly into the buffer at write_span(),
+/// whether by a stream read or by a DMA engine, and then announced
+/// with Commit().  Each byte is examined once as it arrives, and the
+/// CRC is accumulated as it goes, so nothing is ever moved within the
+/// buffer.  Bytes are only examined a second time when a candidate
+/// frame fails validation, in which case the search for a header
+/// resumes one byte after the failed candidate started.
+///
+/// At most one complete frame is held at a time.  It remains valid
+/// until Pop() is called.
+class MicroFrameParser : public Format {
+ public:
+  struct Frame {
+    uint8_t source = 0;
+    uint8_t destination = 0;
+
+    /// The payload, which may wrap around the end of the buffer.  The
+    /// second part is empty if it does not.
+    std::string_view payload1;
+    std::string_view payload2;
+
+    size_t size() const { return payload1.size() + payload2.size(); }
+
+    /// Copy as much of the payload as fits into @p output, returning
+    /// the number of bytes copied.
+    size_t CopyTo(const base::string_span& output) const;
+  };
+
+  struct Stats {
+    uint32_t checksum_mismatch = 0;
+    uint32_t bad_header = 0;
+    uint32_t oversize = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(checksum_mismatch));
+      a->Visit(MJ_NVP(bad_header));
+      a->Visit(MJ_NVP(oversize));
+    }
+  };
+
+  /// @p storage is used as the circular buffer.  It must outlive this
+  /// object.  Frames whose payload cannot fit are discarded.
+  MicroFrameParser(const base::string_span& storage);
+
+  /// The largest contiguous region which may be filled next.  It is
+  /// empty only when a complete frame is pending and everything else
+  /// is occupied by unparsed data.
+  base::string_span write_span() const;
+
+  /// Announce that @p size bytes were placed at the start of
+  /// write_span(), and parse as many of them as possible.
+  void Commit(size_t size);
+
+  /// The current complete frame, or nullptr if there is none.
+  const Frame* frame() const { return complete_ ? &frame_ : nullptr; }
+
+  /// Release the current frame, and continue parsing any bytes
+  /// which follow it.
+  void Pop();
+
+  /// Discard everything.
+  void Reset();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  enum State {
+    kSync0,
+    kSync1,
+    kSource,
+    kDestination,
+    kSize,
+    kPayload,
+    kCrc0,
+    kCrc1,
+  };
+
+  void Parse();
+  void Resync();
+
+  uint8_t byte(uint64_t position) const {
+    return static_cast<uint8_t>(storage_[position % capacity_]);
+  }
+
+  char* const storage_;
+  const uint64_t capacity_;
+
+  // All positions are absolute counts of bytes since the beginning,
+  // and are reduced modulo the capacity only when indexing storage.
+
+  // Everything before tail_ may be overwritten.
+  uint64_t tail_ = 0;
+  // The next byte to be parsed.
+  uint64_t position_ = 0;
+  // Everything before head_ has been committed.
+  uint64_t head_ = 0;
+
+  State state_ = kSync0;
+  uint64_t frame_start_ = 0;
+  uint64_t payload_start_ = 0;
+  uint32_t payload_size_ = 0;
+  uint32_t payload_remaining_ = 0;
+  int size_shift_ = 0;
+  uint8_t crc_low_ = 0;
+  boost::crc_ccitt_type crc_;
+
+  bool complete_ = false;
+  Frame frame_;
+
+  Stats stats_;
+};
+
+}
+}
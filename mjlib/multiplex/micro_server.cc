@@ -14,7 +14,10 @@
 
 #include "mjlib/multiplex/micro_server.h"
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <limits>
 
 #include <boost/crc.hpp>
 
@@ -37,6 +40,15 @@ template <typename T>
 constexpr uint8_t u8(T value) {
   return static_cast<uint8_t>(value);
 }
+
+// FNV-1a
+uint32_t HashPayload(const std::string_view& data) {
+  uint32_t result = 2166136261u;
+  for (const char c : data) {
+    result = (result ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return result;
+}
 }
 
 class MicroServer::Impl {
@@ -123,7 +135,12 @@ class MicroServer::Impl {
                          pool->Allocate(options.buffer_size, 1))),
         write_buffer_(static_cast<char*>(
                           pool->Allocate(options.buffer_size, 1))),
-        tunnels_(pool, static_cast<size_t>(options.max_tunnel_streams)) {
+        tunnels_(pool, static_cast<size_t>(options.max_tunnel_streams)),
+        subscriptions_(pool, static_cast<size_t>(options.max_subscriptions)),
+        subscription_values_(
+            pool, static_cast<size_t>(2 * options.max_subscriptions *
+                                      options.max_subscription_registers)),
+        request_cache_(pool, static_cast<size_t>(options.request_cache_size)) {
     config_.id = options.default_id;
     for (auto& tunnel : tunnels_) {
       tunnel.set_parent(this);
@@ -163,10 +180,73 @@ class MicroServer::Impl {
     }
   }
 
+  void PollMillisecond() {
+    for (auto& subscription : subscriptions_) {
+      if (subscription.active && subscription.remaining_ms > 0) {
+        subscription.remaining_ms--;
+      }
+    }
+
+    if (!server_) { return; }
+
+    for (int i = 0; i < options_.max_subscriptions; i++) {
+      auto& subscription = subscriptions_[i];
+      if (!subscription.active || subscription.remaining_ms != 0) {
+        continue;
+      }
+
+      if (write_outstanding_) {
+        // We'll try again next time.
+        stats_.subscription_delayed++;
+        return;
+      }
+
+      subscription.remaining_ms = subscription.period_ms;
+      EmitSubscription(i);
+    }
+  }
+
   const Stats* stats() const { return &stats_; }
   Config* config() { return &config_; }
 
  private:
+  struct Subscription {
+    bool active = false;
+    // True if 'last_values' holds what was most recently sent.
+    bool sent = false;
+    uint8_t client_id = 0;
+    MicroDatagramServer::Header query_header;
+    uint32_t period_ms = 0;
+    uint32_t remaining_ms = 0;
+    float deadband = -1.0f;
+    uint8_t type = 0;
+    uint32_t num_registers = 0;
+    Register start_register = 0;
+  };
+
+  static constexpr int kMaxCachedPayload = 24;
+  static constexpr int kMaxCachedReads = 4;
+
+  // One read subframe of a cached request, along with the header of
+  // its reply.
+  struct CachedRead {
+    uint8_t type = 0;
+    uint8_t reply_header_size = 0;
+    uint16_t num_registers = 0;
+    Register start_register = 0;
+    char reply_header[1 + 2 * kMaxVaruintSize] = {};
+  };
+
+  struct CachedRequest {
+    // A size of 0 marks an unused entry.
+    uint8_t size = 0;
+    uint8_t num_reads = 0;
+    uint32_t hash = 0;
+    uint32_t last_used = 0;
+    char payload[kMaxCachedPayload] = {};
+    CachedRead reads[kMaxCachedReads];
+  };
+
   void MaybeStartReadFrame() {
     if (read_outstanding_) { return; }
 
@@ -188,6 +268,18 @@ class MicroServer::Impl {
       return;
     }
 
+    const bool for_us =
+        read_header_.destination == kBroadcastId ||
+        read_header_.destination == (config_.id & 0x7f);
+    if (for_us && (read_header_.source & 0x80) != 0 &&
+        subscription_outstanding_) {
+      // Our only write buffer is busy with subscription data the
+      // client did not ask for.  Hold this frame, and further reads,
+      // until it is free, so that the request is still answered.
+      frame_deferred_ = true;
+      return;
+    }
+
     ProcessFrame();
 
     MaybeStartReadFrame();
@@ -213,22 +305,35 @@ class MicroServer::Impl {
 
     server_->StartFrame();
 
+    const std::string_view payload(read_buffer_, read_header_.size);
+
     // Everything checked out.  Now we we can process our subframes.
-    ProcessSubframes(
-        std::string_view(read_buffer_, read_header_.size),
-        &buffer_write_stream,
-        need_response ? &write_stream : nullptr);
+    if (need_response) {
+      const uint32_t hash = HashPayload(payload);
+      const auto* const cached = FindCachedRequest(payload, hash);
+      if (cached) {
+        stats_.request_cache_hit++;
+        ProcessCachedRequest(*cached, &write_stream);
+      } else {
+        ProcessSubframes(payload, &buffer_write_stream, &write_stream);
+        MaybeCacheRequest(payload, hash);
+      }
+    } else {
+      ProcessSubframes(payload, &buffer_write_stream, nullptr);
+    }
 
     const auto action = server_->CompleteFrame();
 
     if (action == Server::kDiscard) {
       stats_.discards++;
     } else if (need_response && action == Server::kAccept) {
-      WriteResponse(read_header_.source & 0x7f, buffer_write_stream.offset());
+      WriteResponse(read_header_.source & 0x7f, buffer_write_stream.offset(),
+                    read_header_);
     }
   }
 
-  void WriteResponse(uint8_t client_id, std::streamsize response_size) {
+  void WriteResponse(uint8_t client_id, std::streamsize response_size,
+                     const MicroDatagramServer::Header& query_header) {
     MJ_ASSERT(!write_outstanding_);
 
     write_header_.size = response_size;
@@ -239,7 +344,7 @@ class MicroServer::Impl {
     datagram_server_->AsyncWrite(
         write_header_,
         std::string_view(write_buffer_, response_size),
-        read_header_,
+        query_header,
         std::bind(&Impl::HandleWrite, this, std::placeholders::_1));
   }
 
@@ -249,6 +354,13 @@ class MicroServer::Impl {
       stats_.last_write_error = ec.value();
     }
     write_outstanding_ = false;
+    subscription_outstanding_ = false;
+
+    if (frame_deferred_) {
+      frame_deferred_ = false;
+      ProcessFrame();
+      MaybeStartReadFrame();
+    }
   }
 
   void ProcessSubframes(const std::string_view& subframes,
@@ -295,6 +407,25 @@ class MicroServer::Impl {
         continue;
       }
 
+      if (subframe_type == u8(Subframe::kSubscribe)) {
+        if (ProcessSubframeSubscribe(str)) {
+          stats_.malformed_subframe++;
+          return;
+        }
+        continue;
+      }
+
+      if (subframe_type == u8(Subframe::kUnsubscribe)) {
+        const auto maybe_slot = str.ReadVaruint();
+        if (!maybe_slot ||
+            *maybe_slot >= static_cast<uint32_t>(options_.max_subscriptions)) {
+          stats_.malformed_subframe++;
+          return;
+        }
+        subscriptions_[*maybe_slot].active = false;
+        continue;
+      }
+
       if (subframe_type >= u8(Subframe::kWriteBase) &&
           subframe_type < u8(Subframe::kWriteBase) + 16) {
         if (ProcessSubframeWrite(subframe_type - u8(Subframe::kWriteBase),
@@ -541,17 +672,37 @@ class MicroServer::Impl {
     // error.
     auto* const start = response->base()->position();
 
+    EmitReplyHeader(response, type, encoded_length,
+                    *num_registers, *start_register);
+
+    return EmitReadValues(response, start, type,
+                          *num_registers, *start_register);
+  }
+
+  void EmitReplyHeader(BufferWriteStream* response,
+                       uint8_t type, uint8_t encoded_length,
+                       uint32_t num_registers, Register start_register) {
     const uint8_t subframe_id =
         u8(Format::Subframe::kReplyBase) | (type * 4) | encoded_length;
     response->WriteVaruint(subframe_id);
     if (encoded_length == 0) {
-      response->WriteVaruint(*num_registers);
+      response->WriteVaruint(num_registers);
     }
-    response->WriteVaruint(*start_register);
+    response->WriteVaruint(start_register);
+  }
 
-    auto current_register = *start_register;
+  // Emit the values following a reply header which begins at @p
+  // start.
+  //
+  // @return true if an error was emitted instead.
+  bool EmitReadValues(BufferWriteStream* response,
+                      char* start,
+                      uint8_t type, uint32_t num_registers,
+                      Register start_register)
+      __attribute__ ((optimize("O3"))) {
+    auto current_register = start_register;
 
-    for (size_t i = 0; i < *num_registers; i++) {
+    for (size_t i = 0; i < num_registers; i++) {
       const auto read_result =
           server_ ? server_->Read(current_register, type) : uint32_t(1);
 
@@ -575,6 +726,238 @@ class MicroServer::Impl {
     return false;
   }
 
+  // @return true if malformed
+  bool ProcessSubframeSubscribe(BufferReadStream& str) {
+    const auto maybe_slot = str.ReadVaruint();
+    const auto maybe_period_ms = str.ReadVaruint();
+    const auto maybe_deadband = str.ReadScalar<float>();
+    const auto maybe_read_type = str.ReadVaruint();
+    if (!maybe_slot || !maybe_period_ms || !maybe_deadband ||
+        !maybe_read_type) {
+      return true;
+    }
+
+    if (*maybe_read_type < u8(Subframe::kReadBase) ||
+        *maybe_read_type >= u8(Subframe::kReadBase) + 16) {
+      return true;
+    }
+
+    const auto type_length = *maybe_read_type - u8(Subframe::kReadBase);
+    const auto encoded_length = type_length % 4;
+    const auto num_registers = (encoded_length == 0) ? str.ReadVaruint()
+        : std::make_optional<uint32_t>(encoded_length);
+    if (!num_registers) { return true; }
+
+    const auto start_register = str.ReadVaruint();
+    if (!start_register) { return true; }
+
+    if (*maybe_slot >= static_cast<uint32_t>(options_.max_subscriptions) ||
+        *maybe_period_ms == 0 ||
+        *num_registers == 0 ||
+        *num_registers > static_cast<uint32_t>(
+            options_.max_subscription_registers)) {
+      return true;
+    }
+
+    auto& subscription = subscriptions_[*maybe_slot];
+    subscription.active = true;
+    subscription.sent = false;
+    subscription.client_id = read_header_.source & 0x7f;
+    subscription.query_header = read_header_;
+    subscription.period_ms = *maybe_period_ms;
+    subscription.remaining_ms = *maybe_period_ms;
+    subscription.deadband = *maybe_deadband;
+    subscription.type = type_length / 4;
+    subscription.num_registers = *num_registers;
+    subscription.start_register = *start_register;
+
+    return false;
+  }
+
+  void EmitSubscription(int slot) {
+    auto& subscription = subscriptions_[slot];
+
+    base::BufferWriteStream buffer_write_stream{
+      base::string_span(write_buffer_, options_.buffer_size)};
+    BufferWriteStream write_stream{buffer_write_stream};
+
+    write_stream.WriteVaruint(u8(Subframe::kSubscriptionData));
+    write_stream.WriteVaruint(slot);
+
+    server_->StartFrame();
+    const bool changed = EmitSubscriptionValues(slot, &write_stream);
+    const auto action = server_->CompleteFrame();
+
+    if (action == Server::kDiscard) {
+      stats_.discards++;
+      return;
+    }
+    if (!changed) { return; }
+
+    subscription_outstanding_ = true;
+    WriteResponse(subscription.client_id, buffer_write_stream.offset(),
+                  subscription.query_header);
+  }
+
+  // @return true if the values should be sent.
+  bool EmitSubscriptionValues(int slot, BufferWriteStream* response) {
+    auto& subscription = subscriptions_[slot];
+
+    // Each slot gets the values which were last sent, followed by
+    // scratch space for the ones being read now.
+    float* const last_values =
+        &subscription_values_[2 * slot * options_.max_subscription_registers];
+    float* const new_values =
+        last_values + options_.max_subscription_registers;
+
+    auto* const start = response->base()->position();
+
+    const auto num_registers = subscription.num_registers;
+    EmitReplyHeader(response, subscription.type,
+                    (num_registers < 4) ? num_registers : 0,
+                    num_registers, subscription.start_register);
+
+    bool changed = !subscription.sent || subscription.deadband < 0.0f;
+
+    for (uint32_t i = 0; i < num_registers; i++) {
+      const auto current_register = subscription.start_register + i;
+      const auto read_result =
+          server_->Read(current_register, subscription.type);
+      if (read_result.index() != 0) {
+        response->base()->reset(start);
+        EmitReadError(response, current_register,
+                      std::get<uint32_t>(read_result));
+        subscription.sent = false;
+        return true;
+      }
+
+      std::visit([&](auto actual_value) {
+          response->Write(actual_value);
+          new_values[i] = static_cast<float>(actual_value);
+        }, std::get<0>(read_result));
+
+      // Written this way so that a NaN counts as a change.
+      if (!(std::abs(new_values[i] - last_values[i]) <=
+            subscription.deadband)) {
+        changed = true;
+      }
+    }
+
+    if (changed) {
+      std::copy(new_values, new_values + num_registers, last_values);
+      subscription.sent = true;
+    }
+
+    return changed;
+  }
+
+  const CachedRequest* FindCachedRequest(const std::string_view& payload,
+                                         uint32_t hash) {
+    for (auto& cached : request_cache_) {
+      if (cached.size == 0 ||
+          cached.hash != hash ||
+          cached.size != payload.size() ||
+          std::memcmp(cached.payload, payload.data(), payload.size()) != 0) {
+        continue;
+      }
+      cached.last_used = ++request_cache_counter_;
+      return &cached;
+    }
+    return nullptr;
+  }
+
+  void ProcessCachedRequest(const CachedRequest& cached,
+                            BufferWriteStream* response)
+      __attribute__ ((optimize("O3"))) {
+    for (uint8_t i = 0; i < cached.num_reads; i++) {
+      const auto& read = cached.reads[i];
+
+      auto* const start = response->base()->position();
+      response->base()->write(
+          std::string_view(read.reply_header, read.reply_header_size));
+
+      if (EmitReadValues(response, start, read.type,
+                         read.num_registers, read.start_register)) {
+        stats_.malformed_subframe++;
+        return;
+      }
+    }
+  }
+
+  // Remember @p payload if it consists only of read subframes.
+  void MaybeCacheRequest(const std::string_view& payload, uint32_t hash) {
+    if (options_.request_cache_size == 0) { return; }
+    if (payload.empty() ||
+        payload.size() > static_cast<size_t>(kMaxCachedPayload)) {
+      return;
+    }
+
+    // Most requests which are not cacheable contain a write, so
+    // check the whole thing before evicting anything.
+    if (!ParseCachedReads(payload, nullptr)) { return; }
+
+    // Evict whichever entry was least recently used.
+    CachedRequest* entry = &request_cache_[0];
+    for (auto& cached : request_cache_) {
+      if (cached.last_used < entry->last_used) { entry = &cached; }
+    }
+
+    ParseCachedReads(payload, entry);
+    entry->size = payload.size();
+    entry->hash = hash;
+    entry->last_used = ++request_cache_counter_;
+    std::memcpy(entry->payload, payload.data(), payload.size());
+  }
+
+  // @return true if @p payload could be cached.  If @p entry is
+  // non-null, its reads are filled in.
+  bool ParseCachedReads(const std::string_view& payload,
+                        CachedRequest* entry) {
+    base::BufferReadStream buffer_stream(payload);
+    BufferReadStream str(buffer_stream);
+
+    uint8_t num_reads = 0;
+    while (buffer_stream.remaining()) {
+      const auto maybe_subframe_type = str.ReadVaruint();
+      if (!maybe_subframe_type ||
+          *maybe_subframe_type < u8(Subframe::kReadBase) ||
+          *maybe_subframe_type >= u8(Subframe::kReadBase) + 16 ||
+          num_reads >= kMaxCachedReads) {
+        return false;
+      }
+
+      const auto type_length = *maybe_subframe_type - u8(Subframe::kReadBase);
+      const auto encoded_length = type_length % 4;
+      const auto num_registers = (encoded_length == 0) ? str.ReadVaruint()
+          : std::make_optional<uint32_t>(encoded_length);
+      if (!num_registers) { return false; }
+      const auto start_register = str.ReadVaruint();
+      if (!start_register) { return false; }
+      if (*num_registers > std::numeric_limits<uint16_t>::max()) {
+        return false;
+      }
+
+      if (entry) {
+        auto& read = entry->reads[num_reads];
+        read.type = type_length / 4;
+        read.num_registers = *num_registers;
+        read.start_register = *start_register;
+
+        base::BufferWriteStream header_buffer_stream{
+          base::string_span(read.reply_header, sizeof(read.reply_header))};
+        BufferWriteStream header_stream{header_buffer_stream};
+        EmitReplyHeader(&header_stream, read.type, encoded_length,
+                        read.num_registers, read.start_register);
+        read.reply_header_size = header_buffer_stream.offset();
+      }
+
+      num_reads++;
+    }
+
+    if (entry) { entry->num_reads = num_reads; }
+    return true;
+  }
+
   TunnelStream* FindTunnel(uint32_t id) {
     for (auto& tunnel : tunnels_) {
       if (tunnel.id() == id) { return &tunnel; }
@@ -596,10 +979,16 @@ class MicroServer::Impl {
   MicroDatagramServer::Header write_header_;
   char* const write_buffer_ = {};
   bool write_outstanding_ = false;
+  bool subscription_outstanding_ = false;
+  bool frame_deferred_ = false;
 
   bool anything_to_do_ = false;
 
   micro::PoolArray<TunnelStream> tunnels_;
+  micro::PoolArray<Subscription> subscriptions_;
+  micro::PoolArray<float> subscription_values_;
+  micro::PoolArray<CachedRequest> request_cache_;
+  uint32_t request_cache_counter_ = 0;
   Stats stats_;
 
   micro::AsyncWriter async_writer_;
@@ -625,6 +1014,10 @@ void MicroServer::Poll() {
   impl_->Poll();
 }
 
+void MicroServer::PollMillisecond() {
+  impl_->PollMillisecond();
+}
+
 const MicroServer::Stats* MicroServer::stats() const {
   return impl_->stats();
 }
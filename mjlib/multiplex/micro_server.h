@@ -67,6 +67,16 @@ class MicroServer : public Format {
     int buffer_size = 256;
     int max_tunnel_streams = 1;
     uint8_t default_id = 1;
+
+    /// The number of register subscriptions which may be active at
+    /// once, and the largest number of registers each may contain.
+    int max_subscriptions = 1;
+    int max_subscription_registers = 16;
+
+    /// The number of distinct read-only requests whose parsed form
+    /// is remembered, so that repeating one only requires reading
+    /// the register values.
+    int request_cache_size = 2;
   };
 
   MicroServer(micro::Pool*, MicroDatagramServer*, const Options&);
@@ -80,6 +90,10 @@ class MicroServer : public Format {
 
   void Poll();
 
+  /// Call once per millisecond to send any register subscriptions
+  /// which are due.
+  void PollMillisecond();
+
   // Exposed mostly for debugging and unit testing.
   struct Stats {
     uint32_t wrong_id = 0;
@@ -90,6 +104,8 @@ class MicroServer : public Format {
     uint32_t write_error = 0;
     uint32_t last_write_error = 0;
     uint32_t discards = 0;
+    uint32_t subscription_delayed = 0;
+    uint32_t request_cache_hit = 0;
 
     template <typename Archive>
     void Serialize(Archive* a) {
@@ -101,6 +117,8 @@ class MicroServer : public Format {
       a->Visit(MJ_NVP(write_error));
       a->Visit(MJ_NVP(last_write_error));
       a->Visit(MJ_NVP(discards));
+      a->Visit(MJ_NVP(subscription_delayed));
+      a->Visit(MJ_NVP(request_cache_hit));
     }
   };
 
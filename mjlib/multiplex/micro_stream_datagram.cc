@@ -26,13 +26,13 @@
 
 #include "mjlib/multiplex/format.h"
 #include "mjlib/multiplex/micro_error.h"
+#include "mjlib/multiplex/micro_frame_parser.h"
 #include "mjlib/multiplex/stream.h"
 
 namespace mjlib {
 namespace multiplex {
 
 namespace pl = std::placeholders;
-using BufferReadStream = multiplex::ReadStream<base::BufferReadStream>;
 using BufferWriteStream = multiplex::WriteStream<base::BufferWriteStream>;
 
 class MicroStreamDatagram::Impl : public Format {
@@ -40,8 +40,9 @@ class MicroStreamDatagram::Impl : public Format {
   Impl(micro::Pool* pool, micro::AsyncStream* stream, const Options& options)
       : stream_(stream),
         options_(options),
-        read_buffer_(static_cast<char*>(
-                         pool->Allocate(options.buffer_size, 1))),
+        parser_(base::string_span(
+                    static_cast<char*>(pool->Allocate(options.buffer_size, 1)),
+                    options.buffer_size)),
         write_buffer_(static_cast<char*>(
                           pool->Allocate(options.buffer_size, 1))) {
   }
@@ -123,21 +124,24 @@ class MicroStreamDatagram::Impl : public Format {
   }
 
   void StartReadFrame() {
+    // We read directly into the parser's circular buffer.
+    const auto span = parser_.write_span();
+    MJ_ASSERT(span.size() > 0);
     stream_->AsyncReadSome(
-        base::string_span(&read_buffer_[read_start_],
-                          options_.buffer_size - read_start_),
+        span,
         std::bind(&Impl::HandleReadFrame, this,
                   pl::_1, pl::_2));
   }
 
   void HandleReadFrame(const micro::error_code& ec, size_t size) {
     if (ec) {
-      read_start_ = 0;
+      parser_.Reset();
       InvokeReadCallback(ec, 0);
       return;
     }
 
-    read_start_ += size;
+    parser_.Commit(size);
+    UpdateStats();
 
     if (TryEmitOneFrame()) {
       // We're all done now.
@@ -149,125 +153,22 @@ class MicroStreamDatagram::Impl : public Format {
   }
 
   /// Return true if we successfully emitted one frame.
-  bool TryEmitOneFrame() __attribute__ ((optimize("O3"))) {
-    // For now, we'll require that we fit a whole valid packet into
-    // our buffer at once before acting on it.  So we'll just keep
-    // calling StartReadFrame until we get there.
-
-    // Work to start our buffer out with the frame header.
-
-    constexpr char kHeaderLowByte = (kHeader & 0xff);
-
-    // This is basically memchr, but executes a lot faster.
-    char* const found = [&]() -> char* {
-      for (int i = 0; i < read_start_; i++) {
-        if (read_buffer_[i] == kHeaderLowByte) {
-          return read_buffer_ + i;
-        }
-      }
-      return nullptr;
-    }();
-
-    if (found == nullptr) {
-      // We don't have anything which could be a header in our
-      // buffer.  Just wipe it all out and start over.
-      read_start_ = 0;
-      return false;
-    }
-
-    Consume(found - read_buffer_);
-
-    if (read_start_ < 2) {
-      // We need more to even have a header.
-      return false;
-    }
-
-    if (static_cast<uint8_t>(read_buffer_[1]) != ((kHeader >> 8) & 0xff)) {
-      // We had the first byte of a header, but not the second byte.
-
-      // Move out this false start and try again.
-      Consume(2);
-      return true;
-    }
-
-    // We need at least 7 bytes to have a minimal frame.
-    if (read_start_ < (kHeaderSize + kCrcSize + kMinVaruintSize)) {
-      return false;
-    }
-
-    // See if we have enough data to have a valid varuint for size.
-    base::BufferReadStream data({&read_buffer_[2],
-            static_cast<size_t>(read_start_ - 2)});
-    BufferReadStream read_stream{data};
-
-    const auto maybe_source_id = read_stream.Read<uint8_t>();
-    const auto maybe_dest_id = read_stream.Read<uint8_t>();
-    const auto maybe_size = read_stream.ReadVaruint();
-
-    if (!maybe_size) {
-      // We don't have enough for the size yet.
-      return false;
-    }
-
-    const auto payload_size = *maybe_size;
-    if (payload_size > 4096) {
-      // We'll claim this is guaranteed to be too big.  Just wipe
-      // everything out and start over.
-      read_start_ = 0;
-      return false;
-    }
-
-    if (payload_size > (options_.buffer_size - 7))  {
-      // We can't fit this either.
-      read_start_ = 0;
-      return false;
-    }
-
-    // Do we have enough data yet?
-    const char* const payload_start = data.position();
-    const auto data_we_have =
-        &read_buffer_[read_start_] - data.position();
-    if (data_we_have < static_cast<std::ptrdiff_t>(payload_size + 2)) {
-      // We need more still.
-      return false;
-    }
-
-    const char* const crc_location =
-        data.position() + payload_size;
-
-    // Woohoo.  We nominally have enough for a whole frame.  Verify
-    // the checksum!
-    boost::crc_ccitt_type crc;
-    crc.process_bytes(read_buffer_, crc_location - read_buffer_);
-    const uint16_t expected_crc = crc.checksum();
-
-    data.ignore(payload_size);
-    const auto maybe_actual_crc = read_stream.Read<uint16_t>();
-    MJ_ASSERT(!!maybe_actual_crc);
-    const auto actual_crc = *maybe_actual_crc;
-
-    if (expected_crc != actual_crc) {
-      // Whoops, we should log this checksum mismatch somewhere.
-      // Assume that we are no longer synchronized and start from the
-      // next header possibility.
-      stats_.checksum_mismatch++;
-      Consume(2);
-      return false;
-    }
+  bool TryEmitOneFrame() {
+    const auto* const frame = parser_.frame();
+    if (frame == nullptr) { return false; }
 
-    // Great, we got something!
-    const auto size_to_write =
-        std::min<std::ptrdiff_t>(payload_size, current_read_data_.size());
-    std::memcpy(current_read_data_.data(), payload_start, size_to_write);
+    const auto payload_size = frame->size();
+    const auto size_to_write = frame->CopyTo(current_read_data_);
 
-    current_read_header_->source = *maybe_source_id;
-    current_read_header_->destination = *maybe_dest_id;
+    current_read_header_->source = frame->source;
+    current_read_header_->destination = frame->destination;
     current_read_header_->size = payload_size;
 
-    Consume(crc_location - read_buffer_ + 2);
+    parser_.Pop();
+    UpdateStats();
 
     InvokeReadCallback(
-        (static_cast<std::ptrdiff_t>(payload_size) > size_to_write) ?
+        (payload_size > size_to_write) ?
         micro::error_code(errc::kPayloadTruncated) :
         micro::error_code(),
         size_to_write);
@@ -275,11 +176,11 @@ class MicroStreamDatagram::Impl : public Format {
     return true;
   }
 
-  void Consume(std::streamsize size) {
-    if (size == 0) { return; }
-    MJ_ASSERT(read_start_ >= size);
-    std::memmove(read_buffer_, &read_buffer_[size], read_start_ - size);
-    read_start_ -= size;
+  void UpdateStats() {
+    const auto& parser_stats = parser_.stats();
+    stats_.checksum_mismatch = parser_stats.checksum_mismatch;
+    stats_.bad_header = parser_stats.bad_header;
+    stats_.oversize = parser_stats.oversize;
   }
 
   void InvokeReadCallback(const micro::error_code& ec, std::ptrdiff_t size) {
@@ -296,8 +197,7 @@ class MicroStreamDatagram::Impl : public Format {
   micro::AsyncStream* const stream_;
   const Options options_;
 
-  std::streamsize read_start_ = 0;
-  char* const read_buffer_ = {};
+  MicroFrameParser parser_;
   char* const write_buffer_ = {};
 
   micro::AsyncWriter async_writer_;
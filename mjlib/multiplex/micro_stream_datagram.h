@@ -43,10 +43,14 @@ class MicroStreamDatagram : public MicroDatagramServer {
   // Exposed mostly for debugging and unit testing.
   struct Stats {
     uint32_t checksum_mismatch = 0;
+    uint32_t bad_header = 0;
+    uint32_t oversize = 0;
 
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(checksum_mismatch));
+      a->Visit(MJ_NVP(bad_header));
+      a->Visit(MJ_NVP(oversize));
     }
   };
 
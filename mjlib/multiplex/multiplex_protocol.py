@@ -25,6 +25,12 @@ import struct
 
 import mjlib.multiplex.stream_helpers as stream_helpers
 
+try:
+    import mjlib.multiplex._multiplex_protocol as _native
+except ImportError:
+    # The pure python implementation below is used instead.
+    _native = None
+
 
 _FRAME_HEADER_STRUCT = struct.Struct('<HBB')
 _FRAME_HEADER_MAGIC = 0xab54
@@ -34,6 +40,13 @@ _STREAM_CLIENT_TO_SERVER = 0x40
 _STREAM_SERVER_TO_CLIENT = 0x41
 
 
+# NOTE: The register subframe identifiers below are not those of
+# format.h, which numbers each group by type and register count
+# together, (for instance kReadInt8 = 0x10 through kReadFloat = 0x1c).
+# This module uses its own numbering, with separate single and
+# multiple subframes, and so only interoperates with servers which
+# expect it.  The optional _multiplex_protocol extension follows this
+# module, not format.h.
 _REGISTER_READ_SINGLE_I8 = 0x18
 _REGISTER_READ_SINGLE_I16 = 0x19
 _REGISTER_READ_SINGLE_I32 = 0x1a
@@ -87,6 +100,10 @@ async def read_varuint(stream):
 
 def write_varuint(stream, value):
     assert value >= 0 and value < 2 ** 32
+    if _native:
+        stream.write(_native.write_varuint(value))
+        return
+
     while True:
         this_byte = value & 0x7f
         value = value >> 7
@@ -98,10 +115,16 @@ def write_varuint(stream, value):
 
 
 def _pack_frame(source, dest, payload):
+        if _native:
+            return _native.pack_frame(source, dest, payload)
+
         header = _FRAME_HEADER_STRUCT.pack(
             _FRAME_HEADER_MAGIC, source, dest)
 
-        frame_minus_crc = header + struct.pack('<B', len(payload)) + payload
+        payload_len = io.BytesIO()
+        write_varuint(payload_len, len(payload))
+
+        frame_minus_crc = header + payload_len.getvalue() + payload
         crc = binascii.crc_hqx(frame_minus_crc, 0xffff)
         frame = frame_minus_crc + struct.pack('<H', crc)
 
@@ -135,9 +158,14 @@ class MultiplexManager:
 
         recording_stream = stream_helpers.RecordingStream(self.stream)
 
-        result_frame_header = await recording_stream.read(_FRAME_HEADER_STRUCT.size)
+        # Read the header and the first byte of the payload length
+        # together, since nearly all payloads fit in a single byte
+        # varuint.
+        result_frame_header = await recording_stream.read(
+            _FRAME_HEADER_STRUCT.size + 1)
 
-        header, source, dest = _FRAME_HEADER_STRUCT.unpack(result_frame_header)
+        header, source, dest = _FRAME_HEADER_STRUCT.unpack(
+            result_frame_header[0:_FRAME_HEADER_STRUCT.size])
         if header != _FRAME_HEADER_MAGIC:
             print('multiplex_protocol: re-synchronizing! {:04x}'.format(header),
                   flush=True)
@@ -148,8 +176,18 @@ class MultiplexManager:
             # Report a timeout error.
             raise asyncio.TimeoutError()
 
+        async def read_payload_len():
+            last_byte = result_frame_header[-1]
+            payload_len = last_byte & 0x7f
+            shift = 7
+            while last_byte & 0x80:
+                last_byte = (await recording_stream.read(1))[0]
+                payload_len |= (last_byte & 0x7f) << shift
+                shift += 7
+            return payload_len
+
         async def read_payload():
-            payload_len = await read_varuint(recording_stream)
+            payload_len = await read_payload_len()
             sizeof_crc = 2
             payload_and_crc = await recording_stream.read(
                 payload_len + sizeof_crc)
@@ -208,30 +246,42 @@ class MultiplexClient:
     async def read(self, size):
         # Poll repeatedly until we have enough.
         while len(self._read_data) < size:
-            async with self._manager.lock:
-                result = await self._try_one_poll()
-                if result is not None:
-                    self._read_data += result
+            await self._poll()
 
-            if len(self._read_data) >= size:
-                break
+        to_return, self._read_data = (
+            self._read_data[0:size], self._read_data[size:])
+        return to_return
+
+    async def readline(self):
+        '''Return the next non-empty line, without its terminator.
 
+        This searches the data already received, rather than reading
+        one byte at a time.'''
+        while True:
+            data = self._read_data.lstrip(b'\r\n')
+            ends = [x for x in (data.find(b'\r'), data.find(b'\n')) if x >= 0]
+            if ends:
+                end = min(ends)
+                self._read_data = data[end + 1:]
+                return data[0:end]
+
+            self._read_data = data
+            await self._poll()
+
+    async def _poll(self):
+        start_size = len(self._read_data)
+        async with self._manager.lock:
+            result = await self._try_one_poll()
+            if result is not None:
+                self._read_data += result
+
+        if len(self._read_data) == start_size:
             # We didn't get anything, so wait our polling period and
             # try again.
             await asyncio.sleep(self._poll_rate_s)
 
-        to_return, self._read_data = (
-            self._read_data[0:size], self._read_data[size:])
-        return to_return
-
     def _make_stream_client_to_server(self, response, data):
         '''Returns a tuple of (target_message, remaining_data)'''
-        header = _FRAME_HEADER_STRUCT.pack(
-            _FRAME_HEADER_MAGIC,
-            (_FRAME_RESPONSE_REQUEST if response else 0x00) |
-            self._manager.source_id,
-            self._destination_id)
-
         write_size = min(len(data), 100)
         payload = struct.pack(
             '<BBB',
@@ -239,11 +289,11 @@ class MultiplexClient:
             self._channel,
             write_size) + data[0:write_size]
 
-        # So that we don't need a varuint.
-        assert len(payload) < 127
-        frame_minus_crc = header + struct.pack('<B', len(payload)) + payload
-        crc = binascii.crc_hqx(frame_minus_crc, 0xffff)
-        frame = frame_minus_crc + struct.pack('<H', crc)
+        frame = _pack_frame(
+            (_FRAME_RESPONSE_REQUEST if response else 0x00) |
+            self._manager.source_id,
+            self._destination_id,
+            payload)
 
         return frame, data[write_size:]
 
@@ -269,18 +319,11 @@ class MultiplexClient:
                 # came back with no data at all.
                 break
 
-            payload_stream = stream_helpers.AsyncStream(io.BytesIO(payload))
-            subframe_id = await read_varuint(payload_stream)
-            channel = await read_varuint(payload_stream)
-            server_len = await read_varuint(payload_stream)
-
-            if subframe_id is None or channel is None or server_len is None:
-                break
-
-            if subframe_id != _STREAM_SERVER_TO_CLIENT:
+            data = await _parse_stream_reply(payload)
+            if data is None:
                 break
 
-            result += payload[payload_stream.tell():]
+            result += data
 
             # On subsequent tries through this, we barely want to wait
             # at all, we're just looking to see if something is
@@ -311,6 +354,28 @@ class MultiplexClient:
             await self._manager.drain()
 
 
+async def _parse_stream_reply(payload):
+    '''Returns the data from a server to client stream subframe, or None.'''
+    if payload is None:
+        return None
+
+    if _native:
+        return _native.parse_stream_reply(payload)
+
+    payload_stream = stream_helpers.AsyncStream(io.BytesIO(payload))
+    subframe_id = await read_varuint(payload_stream)
+    channel = await read_varuint(payload_stream)
+    server_len = await read_varuint(payload_stream)
+
+    if subframe_id is None or channel is None or server_len is None:
+        return None
+
+    if subframe_id != _STREAM_SERVER_TO_CLIENT:
+        return None
+
+    return payload[payload_stream.tell():]
+
+
 class RegisterType(enum.Enum):
     INT8 = 0
     INT16 = 1
@@ -326,6 +391,21 @@ _TYPE_FORMAT = [
 ]
 
 
+def _encode_subframe(varuints, reg_type=None, values=()):
+    '''Returns each of varuints, followed by each of values packed as
+    reg_type.'''
+    if _native:
+        return _native.encode_subframe(
+            varuints, -1 if reg_type is None else int(reg_type), values)
+
+    result = io.BytesIO()
+    for value in varuints:
+        write_varuint(result, value)
+    for value in values:
+        result.write(_TYPE_FORMAT[int(reg_type)].pack(value))
+    return result.getvalue()
+
+
 class RegisterRequest:
     '''Constructs subframes necessary to read or write individual
     registers.'''
@@ -333,29 +413,28 @@ class RegisterRequest:
         self.data = io.BytesIO()
 
     def read_single(self, register, reg_type):
-        write_varuint(self.data, _REGISTER_READ_SINGLE_I8 + int(reg_type))
-        write_varuint(self.data, register)
+        self.data.write(_encode_subframe(
+            [_REGISTER_READ_SINGLE_I8 + int(reg_type), register]))
 
     def read_multiple(self, register, length, reg_type):
-        write_varuint(self.data, _REGISTER_READ_MULTIPLE_I8 + int(reg_type))
-        write_varuint(self.data, register)
-        write_varuint(self.data, length)
+        self.data.write(_encode_subframe(
+            [_REGISTER_READ_MULTIPLE_I8 + int(reg_type), register, length]))
 
     def write_single(self, register, reg_value):
-        write_varuint(self.data, _REGISTER_WRITE_SINGLE_I8 + int(reg_value.reg_type))
-        write_varuint(self.data, register)
-        self.data.write(_TYPE_FORMAT[reg_value.reg_type].pack(reg_value.value))
+        self.data.write(_encode_subframe(
+            [_REGISTER_WRITE_SINGLE_I8 + int(reg_value.reg_type), register],
+            reg_value.reg_type, [reg_value.value]))
 
     def write_multiple(self, start_register, reg_values):
         assert len(reg_values) > 0
         same_as_first = [x.reg_type == reg_values[0].reg_type for x in reg_values]
         assert all(same_as_first)
 
-        write_varuint(self.data, _REGISTER_WRITE_MULTIPLE_I8 + reg_values[0].reg_type)
-        write_varuint(self.data, start_register)
-        write_varuint(self.data, len(reg_values))
-        for value in reg_values:
-            self.data.write(_TYPE_FORMAT[value.reg_type].pack(value.value))
+        reg_type = reg_values[0].reg_type
+        self.data.write(_encode_subframe(
+            [_REGISTER_WRITE_MULTIPLE_I8 + reg_type, start_register,
+             len(reg_values)],
+            reg_type, [x.value for x in reg_values]))
 
 
 class RegisterValue:
@@ -380,6 +459,13 @@ class RegisterError:
 
 async def ParseRegisterReply(data):
     '''Parses a reply from a register operation.'''
+    if _native:
+        return {
+            reg: (RegisterError(value) if reg_type == _native.ERROR_TYPE
+                  else RegisterValue(value, reg_type))
+            for reg, value, reg_type in _native.parse_register_reply(data)
+        }
+
     # The resulting data is stored here.
     result = {}
     stream = stream_helpers.AsyncStream(io.BytesIO(data))
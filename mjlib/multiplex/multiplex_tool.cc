@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <fstream>
 #include <optional>
 #include <vector>
 
@@ -51,6 +52,17 @@ struct Options {
   bool console = false;
   bool register_tool = false;
   int poll_rate_ms = mp::AsioClient::TunnelOptions().poll_rate.total_milliseconds();
+
+  bool discover = false;
+  std::string discover_cache;
+  // Read registers which are fixed for a given device, by default the
+  // model number and firmware version, so that a cached map only goes
+  // stale when the devices on the bus actually change.
+  std::string discover_identity = "ri 256 2";
+  bool discover_broadcast = false;
+  int discover_window = 1;
+  int discover_timeout_ms =
+      mp::AsioClient::DiscoverOptions().max_timeout.total_milliseconds();
 };
 
 struct ValueFormatter {
@@ -116,6 +128,16 @@ class CommandRunner {
   }
 
   void RunCommand() {
+    if (options_.discover ||
+        (options_.console && options_.targets.empty())) {
+      RunDiscover();
+      return;
+    }
+
+    RunTool();
+  }
+
+  void RunTool() {
     if (options_.console) {
       RunConsole();
     } else if (options_.register_tool) {
@@ -126,8 +148,135 @@ class CommandRunner {
     }
   }
 
+  void RunDiscover() {
+    discover_options_.identity.clear();
+    for (const auto& op : Split(options_.discover_identity, ",")) {
+      std::istringstream op_str(op);
+      std::string op_name;
+      std::string reg_str;
+      std::string maybe_reg_count;
+      op_str >> op_name >> reg_str >> maybe_reg_count;
+      if (op_name.size() != 2 || op_name[0] != 'r') {
+        base::Fail("identity may only contain reads: " + op);
+      }
+      AddReadRequest(&discover_options_.identity, op_name, reg_str,
+                     maybe_reg_count);
+    }
+    discover_options_.broadcast = options_.discover_broadcast;
+    discover_options_.window = options_.discover_window;
+    discover_options_.max_timeout =
+        boost::posix_time::milliseconds(options_.discover_timeout_ms);
+    discover_options_.min_timeout = std::min(
+        discover_options_.min_timeout, discover_options_.max_timeout);
+
+    // If we have a map from last time, first see if it still holds,
+    // which only requires probing the devices it names.
+    cached_discovery_ = ReadDiscoveryCache();
+    if (!cached_discovery_.empty()) {
+      for (const auto& pair : cached_discovery_) {
+        discover_options_.ids.push_back(pair.first);
+      }
+    }
+
+    client_->AsyncDiscover(
+        discover_options_, &discovery_,
+        std::bind(&CommandRunner::HandleDiscover, this, pl::_1));
+  }
+
+  void HandleDiscover(const base::error_code& ec) {
+    base::FailIf(ec);
+
+    if (!discover_options_.ids.empty()) {
+      if (discovery_ == cached_discovery_) {
+        std::cout << "cached device map validated\n";
+      } else {
+        std::cout << "cached device map is stale, rescanning\n";
+        cached_discovery_ = {};
+        discover_options_.ids.clear();
+        client_->AsyncDiscover(
+            discover_options_, &discovery_,
+            std::bind(&CommandRunner::HandleDiscover, this, pl::_1));
+        return;
+      }
+    } else {
+      WriteDiscoveryCache();
+    }
+
+    for (const auto& pair : discovery_) {
+      std::cout << FormatDevice(pair.first, pair.second) << "\n";
+    }
+
+    if (options_.targets.empty()) {
+      for (const auto& pair : discovery_) {
+        options_.targets.push_back(pair.first);
+      }
+    }
+
+    if (options_.console || options_.register_tool) {
+      if (options_.targets.empty()) {
+        std::cerr << "no devices found!\n";
+        std::exit(1);
+      }
+      RunTool();
+    } else {
+      std::exit(0);
+    }
+  }
+
+  std::string FormatDevice(int id, const RegisterReply& identity) {
+    std::string result = fmt::format("{}", id);
+    for (const auto& pair : identity) {
+      result += fmt::format(" {}:{}", pair.first, FormatValue(pair.second));
+    }
+    return result;
+  }
+
+  mp::AsioClient::Discovery ReadDiscoveryCache() {
+    mp::AsioClient::Discovery result;
+    if (options_.discover_cache.empty()) { return result; }
+
+    std::ifstream inf(options_.discover_cache);
+    std::string line;
+    while (std::getline(inf, line)) {
+      std::istringstream istr(line);
+      int id = 0;
+      istr >> id;
+      if (!istr) { continue; }
+
+      auto& identity = result[id];
+      std::string item;
+      while (istr >> item) {
+        const auto colon = item.find(':');
+        if (colon == std::string::npos) {
+          base::Fail("malformed discovery cache: " + line);
+        }
+        identity[std::stoi(item.substr(0, colon))] =
+            ParseReadResult(item.substr(colon + 1));
+      }
+    }
+    return result;
+  }
+
+  void WriteDiscoveryCache() {
+    if (options_.discover_cache.empty()) { return; }
+
+    std::ofstream of(options_.discover_cache);
+    for (const auto& pair : discovery_) {
+      of << FormatDevice(pair.first, pair.second) << "\n";
+    }
+  }
+
+  /// The inverse of FormatValue.
+  mp::Format::ReadResult ParseReadResult(const std::string& str) {
+    if (str.substr(0, 4) == "err/") {
+      return static_cast<uint32_t>(std::stoul(str.substr(4)));
+    }
+    if (str.empty()) { base::Fail("empty value"); }
+    return ParseValue(str.substr(0, str.size() - 1),
+                      GetTypeIndex(str.back()));
+  }
+
   void RunConsole() {
-    // TODO(jpieper): Auto-discover if empty.
     BOOST_ASSERT(!options_.targets.empty());
 
     mp::AsioClient::TunnelOptions tunnel_options;
@@ -413,7 +562,7 @@ class CommandRunner {
 
   boost::asio::any_io_executor executor_;
   io::Selector<AsioClient>* const client_selector_;
-  const Options options_;
+  Options options_;
   mp::AsioClient* client_ = nullptr;
 
   io::SharedStream tunnel_;
@@ -425,6 +574,10 @@ class CommandRunner {
   mp::AsioClient::Reply reply_;
 
   io::DeadlineTimer delay_timer_{executor_};
+
+  mp::AsioClient::DiscoverOptions discover_options_;
+  mp::AsioClient::Discovery discovery_;
+  mp::AsioClient::Discovery cached_discovery_;
 };
 }
 
@@ -449,7 +602,21 @@ int multiplex_main(boost::asio::io_context& context,
            clipp::integer("TGT", options.targets)) % "one or more target devices"),
       clipp::option("c", "console").set(options.console),
       clipp::option("r", "register").set(options.register_tool),
-      clipp::option("", "poll-rate-ms") & clipp::integer("MS", options.poll_rate_ms)
+      clipp::option("", "poll-rate-ms") & clipp::integer("MS", options.poll_rate_ms),
+      clipp::option("d", "discover").set(options.discover) %
+      "list the devices present, also done when no targets are given",
+      (clipp::option("", "discover-cache") &
+       clipp::value("FILE", options.discover_cache)) %
+      "validate and store the discovered devices here",
+      (clipp::option("", "discover-identity") &
+       clipp::value("OPS", options.discover_identity)) %
+      "registers to read from each device and compare against the cache, "
+      "which should not change at runtime",
+      clipp::option("", "discover-broadcast").set(options.discover_broadcast),
+      clipp::option("", "discover-window") &
+      clipp::integer("N", options.discover_window),
+      clipp::option("", "discover-timeout-ms") &
+      clipp::integer("MS", options.discover_timeout_ms)
   );
   group.merge(clipp::with_prefix("client.", selector->program_options()));
 
@@ -0,0 +1,360 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// A CPython extension which accelerates the byte level portions of
+/// multiplex_protocol.py.  That module falls back to its pure python
+/// implementation when this one is not available, so for well formed
+/// input every function here must produce results identical to its
+/// python equivalent.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/multiplex/frame.h"
+#include "mjlib/multiplex/stream.h"
+
+namespace {
+namespace base = mjlib::base;
+namespace mp = mjlib::multiplex;
+
+// These match the register subframe identifiers used by
+// multiplex_protocol.py, which are deliberately not those of
+// format.h.  This module only accelerates the python one, so it must
+// speak the same protocol, and that is pinned by its tests.
+constexpr uint32_t kRegisterReplySingle = 0x20;
+constexpr uint32_t kRegisterReplyMultiple = 0x24;
+constexpr uint32_t kRegisterWriteError = 0x28;
+constexpr uint32_t kRegisterReadError = 0x29;
+
+constexpr uint32_t kStreamServerToClient = 0x41;
+
+/// Returned in the type field of a register reply entry which
+/// represents an error.
+constexpr int kErrorType = -1;
+
+class Buffer {
+ public:
+  Buffer() {}
+  ~Buffer() {
+    if (valid_) { PyBuffer_Release(&buffer_); }
+  }
+
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  Py_buffer* get() { return &buffer_; }
+  void set_valid() { valid_ = true; }
+
+  std::string_view view() const {
+    return std::string_view(static_cast<const char*>(buffer_.buf),
+                            buffer_.len);
+  }
+
+ private:
+  Py_buffer buffer_ = {};
+  bool valid_ = false;
+};
+
+PyObject* ToBytes(std::string_view data) {
+  return PyBytes_FromStringAndSize(data.data(), data.size());
+}
+
+template <typename T>
+PyObject* ReadValue(mp::ReadStream<base::BufferReadStream>* stream) {
+  const auto maybe_value = stream->Read<T>();
+  if (!maybe_value) { return nullptr; }
+  if constexpr (std::is_floating_point_v<T>) {
+    return PyFloat_FromDouble(*maybe_value);
+  } else {
+    return PyLong_FromLong(*maybe_value);
+  }
+}
+
+PyObject* ReadRegisterValue(mp::ReadStream<base::BufferReadStream>* stream,
+                            int type) {
+  switch (type) {
+    case 0: { return ReadValue<int8_t>(stream); }
+    case 1: { return ReadValue<int16_t>(stream); }
+    case 2: { return ReadValue<int32_t>(stream); }
+    case 3: { return ReadValue<float>(stream); }
+  }
+  return nullptr;
+}
+
+/// Append (register, value, type) to @p list, taking ownership of
+/// @p value.  Returns false on error.
+bool AppendEntry(PyObject* list, uint32_t reg, PyObject* value, int type) {
+  PyObject* const entry = Py_BuildValue(
+      "(kNi)", static_cast<unsigned long>(reg), value, type);
+  if (!entry) { return false; }
+  const int result = PyList_Append(list, entry);
+  Py_DECREF(entry);
+  return result == 0;
+}
+
+PyObject* PackFrame(PyObject*, PyObject* args) {
+  unsigned int source = 0;
+  unsigned int dest = 0;
+  Buffer payload;
+  if (!PyArg_ParseTuple(args, "IIy*", &source, &dest, payload.get())) {
+    return nullptr;
+  }
+  payload.set_valid();
+
+  if (payload.view().size() > std::numeric_limits<uint32_t>::max()) {
+    PyErr_SetString(PyExc_ValueError, "payload too large");
+    return nullptr;
+  }
+
+  const mp::Frame frame{
+    static_cast<uint8_t>(source & 0x7f),
+        (source & 0x80) != 0,
+        static_cast<uint8_t>(dest),
+        std::string(payload.view())};
+
+  base::FastOStringStream stream;
+  frame.encode(&stream);
+  return ToBytes(stream.str());
+}
+
+PyObject* WriteVaruint(PyObject*, PyObject* args) {
+  unsigned long value = 0;
+  if (!PyArg_ParseTuple(args, "k", &value)) { return nullptr; }
+  if (value > std::numeric_limits<uint32_t>::max()) {
+    PyErr_SetString(PyExc_ValueError, "varuint out of range");
+    return nullptr;
+  }
+
+  char buffer[5] = {};
+  base::BufferWriteStream buffer_stream{buffer};
+  mp::WriteStream<base::BufferWriteStream> stream{buffer_stream};
+  stream.WriteVaruint(value);
+  return ToBytes(std::string_view(buffer, buffer_stream.offset()));
+}
+
+/// Convert @p object to a varuint.  Returns false with a python
+/// exception set on error.
+bool ToVaruint(PyObject* object, uint32_t* value) {
+  const unsigned long result = PyLong_AsUnsignedLong(object);
+  if (PyErr_Occurred()) { return false; }
+  if (result > std::numeric_limits<uint32_t>::max()) {
+    PyErr_SetString(PyExc_ValueError, "varuint out of range");
+    return false;
+  }
+  *value = result;
+  return true;
+}
+
+template <typename T>
+bool WriteInteger(mp::WriteStream<base::FastOStringStream>* stream,
+                  PyObject* object) {
+  const long value = PyLong_AsLong(object);
+  if (PyErr_Occurred()) { return false; }
+  if (value < std::numeric_limits<T>::min() ||
+      value > std::numeric_limits<T>::max()) {
+    PyErr_SetString(PyExc_ValueError, "register value out of range");
+    return false;
+  }
+  stream->Write(static_cast<T>(value));
+  return true;
+}
+
+bool WriteRegisterValue(mp::WriteStream<base::FastOStringStream>* stream,
+                        int type, PyObject* object) {
+  switch (type) {
+    case 0: { return WriteInteger<int8_t>(stream, object); }
+    case 1: { return WriteInteger<int16_t>(stream, object); }
+    case 2: { return WriteInteger<int32_t>(stream, object); }
+    case 3: {
+      const double value = PyFloat_AsDouble(object);
+      if (PyErr_Occurred()) { return false; }
+      stream->Write(static_cast<float>(value));
+      return true;
+    }
+  }
+  PyErr_SetString(PyExc_ValueError, "unknown register type");
+  return false;
+}
+
+PyObject* EncodeSubframe(PyObject*, PyObject* args) {
+  PyObject* varuints = nullptr;
+  int type = kErrorType;
+  PyObject* values = nullptr;
+  if (!PyArg_ParseTuple(args, "O|iO", &varuints, &type, &values)) {
+    return nullptr;
+  }
+
+  base::FastOStringStream ostr;
+  mp::WriteStream<base::FastOStringStream> stream{ostr};
+
+  // Call @p write with each item of @p sequence, stopping at the
+  // first failure.
+  auto for_each = [](PyObject* sequence, auto write) {
+    PyObject* const items = PySequence_Fast(sequence, "expected a sequence");
+    if (!items) { return false; }
+    const Py_ssize_t size = PySequence_Fast_GET_SIZE(items);
+    bool result = true;
+    for (Py_ssize_t i = 0; result && i < size; i++) {
+      result = write(PySequence_Fast_GET_ITEM(items, i));
+    }
+    Py_DECREF(items);
+    return result;
+  };
+
+  const bool success =
+      for_each(varuints, [&](PyObject* item) {
+          uint32_t value = 0;
+          if (!ToVaruint(item, &value)) { return false; }
+          stream.WriteVaruint(value);
+          return true;
+        }) &&
+      (!values || for_each(values, [&](PyObject* item) {
+          return WriteRegisterValue(&stream, type, item);
+        }));
+  if (!success) { return nullptr; }
+
+  return ToBytes(ostr.str());
+}
+
+PyObject* ParseStreamReply(PyObject*, PyObject* args) {
+  Buffer data;
+  if (!PyArg_ParseTuple(args, "y*", data.get())) { return nullptr; }
+  data.set_valid();
+
+  const auto view = data.view();
+  base::BufferReadStream buffer_stream{view};
+  mp::ReadStream<base::BufferReadStream> stream{buffer_stream};
+
+  const auto subframe_id = stream.ReadVaruint();
+  const auto channel = stream.ReadVaruint();
+  const auto server_len = stream.ReadVaruint();
+
+  if (!subframe_id || !channel || !server_len ||
+      *subframe_id != kStreamServerToClient) {
+    Py_RETURN_NONE;
+  }
+
+  return ToBytes(view.substr(view.size() - buffer_stream.remaining()));
+}
+
+PyObject* ParseRegisterReply(PyObject*, PyObject* args) {
+  Buffer data;
+  if (!PyArg_ParseTuple(args, "y*", data.get())) { return nullptr; }
+  data.set_valid();
+
+  PyObject* const result = PyList_New(0);
+  if (!result) { return nullptr; }
+
+  base::BufferReadStream buffer_stream{data.view()};
+  mp::ReadStream<base::BufferReadStream> stream{buffer_stream};
+
+  auto error = [&]() -> PyObject* {
+    Py_DECREF(result);
+    return nullptr;
+  };
+
+  while (true) {
+    const auto maybe_subframe_id = stream.ReadVaruint();
+    if (!maybe_subframe_id) { break; }
+    const auto subframe_id = *maybe_subframe_id;
+    const int type = subframe_id & 0x03;
+
+    if ((subframe_id & ~0x03u) == kRegisterReplySingle) {
+      const auto reg = stream.ReadVaruint();
+      if (!reg) { break; }
+      PyObject* const value = ReadRegisterValue(&stream, type);
+      if (!value) {
+        if (PyErr_Occurred()) { return error(); }
+        break;
+      }
+      if (!AppendEntry(result, *reg, value, type)) { return error(); }
+    } else if ((subframe_id & ~0x03u) == kRegisterReplyMultiple) {
+      const auto start_reg = stream.ReadVaruint();
+      const auto number_of_reg = stream.ReadVaruint();
+      if (!start_reg || !number_of_reg) { break; }
+      bool complete = true;
+      for (uint32_t i = 0; i < *number_of_reg; i++) {
+        PyObject* const value = ReadRegisterValue(&stream, type);
+        if (!value) {
+          if (PyErr_Occurred()) { return error(); }
+          complete = false;
+          break;
+        }
+        if (!AppendEntry(result, *start_reg + i, value, type)) {
+          return error();
+        }
+      }
+      if (!complete) { break; }
+    } else if (subframe_id == kRegisterWriteError ||
+               subframe_id == kRegisterReadError) {
+      const auto reg = stream.ReadVaruint();
+      const auto err = stream.ReadVaruint();
+      if (!reg || !err) { break; }
+      if (!AppendEntry(result, *reg, PyLong_FromUnsignedLong(*err),
+                       kErrorType)) {
+        return error();
+      }
+    } else {
+      break;
+    }
+  }
+
+  return result;
+}
+
+PyMethodDef kMethods[] = {
+  {"pack_frame", PackFrame, METH_VARARGS,
+   "pack_frame(source, dest, payload) -> bytes\n\n"
+   "Encode a complete frame, including the header and checksum."},
+  {"write_varuint", WriteVaruint, METH_VARARGS,
+   "write_varuint(value) -> bytes"},
+  {"encode_subframe", EncodeSubframe, METH_VARARGS,
+   "encode_subframe(varuints, type=-1, values=()) -> bytes\n\n"
+   "Encode each of varuints, followed by each of values as a register\n"
+   "of the given type."},
+  {"parse_stream_reply", ParseStreamReply, METH_VARARGS,
+   "parse_stream_reply(payload) -> bytes or None\n\n"
+   "Return the data from a server to client stream subframe."},
+  {"parse_register_reply", ParseRegisterReply, METH_VARARGS,
+   "parse_register_reply(payload) -> [(register, value, type)]\n\n"
+   "Errors are reported with a type of -1 and the error code as value."},
+  {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef kModule = {
+  PyModuleDef_HEAD_INIT,
+  "_multiplex_protocol",
+  "Native helpers for mjlib.multiplex.multiplex_protocol",
+  -1,
+  kMethods,
+};
+}
+
+PyMODINIT_FUNC PyInit__multiplex_protocol() {
+  PyObject* const module = PyModule_Create(&kModule);
+  if (!module) { return nullptr; }
+  if (PyModule_AddIntConstant(module, "ERROR_TYPE", kErrorType) != 0) {
+    Py_DECREF(module);
+    return nullptr;
+  }
+  return module;
+}
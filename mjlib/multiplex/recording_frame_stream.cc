@@ -0,0 +1,118 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/recording_frame_stream.h"
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/io/now.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+namespace mjlib {
+namespace multiplex {
+
+class RecordingFrameStream::Impl {
+ public:
+  Impl(FrameStream* base, telemetry::FileWriter* writer,
+       const Options& options)
+      : base_(base),
+        writer_(writer),
+        executor_(base->get_executor()),
+        identifier_(writer->AllocateIdentifier(options.record_name)) {
+    writer_->WriteSchema(
+        identifier_,
+        telemetry::BinarySchemaArchive::schema<RecordedFrame>());
+  }
+
+  void Record(const Frame& frame, bool received) {
+    record_.received = received;
+    record_.source_id = frame.source_id;
+    record_.dest_id = frame.dest_id;
+    record_.request_reply = frame.request_reply;
+    record_.payload.assign(frame.payload.begin(), frame.payload.end());
+
+    write_buffer_.data()->clear();
+    telemetry::BinaryWriteArchive(write_buffer_).Accept(&record_);
+    writer_->WriteData(io::Now(executor_.context()), identifier_,
+                       write_buffer_.view());
+  }
+
+  FrameStream* const base_;
+  telemetry::FileWriter* const writer_;
+  boost::asio::any_io_executor executor_;
+  const telemetry::FileWriter::Identifier identifier_;
+
+  RecordedFrame record_;
+  base::FastOStringStream write_buffer_;
+};
+
+RecordingFrameStream::RecordingFrameStream(
+    FrameStream* base, telemetry::FileWriter* writer, const Options& options)
+    : impl_(std::make_unique<Impl>(base, writer, options)) {}
+
+RecordingFrameStream::~RecordingFrameStream() {}
+
+FrameStream::Properties RecordingFrameStream::properties() const {
+  return impl_->base_->properties();
+}
+
+void RecordingFrameStream::AsyncWrite(const Frame* frame,
+                                      io::ErrorCallback callback) {
+  impl_->base_->AsyncWrite(
+      frame,
+      [impl = impl_.get(), frame, callback = std::move(callback)](
+          const base::error_code& ec) mutable {
+        if (!ec) { impl->Record(*frame, false); }
+        callback(ec);
+      });
+}
+
+void RecordingFrameStream::AsyncWriteMultiple(
+    const std::vector<const Frame*>& frames, io::ErrorCallback callback) {
+  impl_->base_->AsyncWriteMultiple(
+      frames,
+      [impl = impl_.get(), frames, callback = std::move(callback)](
+          const base::error_code& ec) mutable {
+        if (!ec) {
+          for (const auto* frame : frames) { impl->Record(*frame, false); }
+        }
+        callback(ec);
+      });
+}
+
+void RecordingFrameStream::AsyncRead(Frame* frame,
+                                     boost::posix_time::time_duration timeout,
+                                     io::ErrorCallback callback) {
+  impl_->base_->AsyncRead(
+      frame, timeout,
+      [impl = impl_.get(), frame, callback = std::move(callback)](
+          const base::error_code& ec) mutable {
+        if (!ec) { impl->Record(*frame, true); }
+        callback(ec);
+      });
+}
+
+void RecordingFrameStream::cancel() {
+  impl_->base_->cancel();
+}
+
+bool RecordingFrameStream::read_data_queued() const {
+  return impl_->base_->read_data_queued();
+}
+
+boost::asio::any_io_executor RecordingFrameStream::get_executor() const {
+  return impl_->executor_;
+}
+
+}
+}
@@ -0,0 +1,93 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/bytes.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+#include "mjlib/multiplex/frame_stream.h"
+#include "mjlib/telemetry/file_writer.h"
+
+namespace mjlib {
+namespace multiplex {
+
+/// The telemetry record used to log each frame.
+struct RecordedFrame {
+  /// True if the frame was read from the underlying stream, false if
+  /// it was written to it.
+  bool received = false;
+
+  uint8_t source_id = 0;
+  uint8_t dest_id = 0;
+  bool request_reply = false;
+  base::Bytes payload;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(received));
+    a->Visit(MJ_NVP(source_id));
+    a->Visit(MJ_NVP(dest_id));
+    a->Visit(MJ_NVP(request_reply));
+    a->Visit(MJ_NVP(payload));
+  }
+};
+
+/// Forwards all operations to another FrameStream, and logs every
+/// frame which is successfully written or read to a telemetry log.
+/// Timestamps are taken from the executor's timer service.
+class RecordingFrameStream : public FrameStream {
+ public:
+  struct Options {
+    std::string record_name = "multiplex_frames";
+
+    Options() {}
+  };
+
+  /// Both @p base and @p writer are aliased and must outlive this
+  /// instance.
+  RecordingFrameStream(FrameStream* base, telemetry::FileWriter* writer,
+                       const Options& = {});
+  ~RecordingFrameStream() override;
+
+  Properties properties() const override;
+
+  void AsyncWrite(const Frame*, io::ErrorCallback) override;
+
+  void AsyncWriteMultiple(const std::vector<const Frame*>&,
+                          io::ErrorCallback) override;
+
+  void AsyncRead(Frame*, boost::posix_time::time_duration timeout,
+                 io::ErrorCallback callback) override;
+
+  void cancel() override;
+
+  bool read_data_queued() const override;
+
+  boost::asio::any_io_executor get_executor() const override;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -95,6 +95,34 @@ void RegisterRequest::WriteMultiple(Register start_reg,
   }
 }
 
+void RegisterRequest::Subscribe(uint32_t slot, uint32_t period_ms,
+                                float deadband,
+                                Register start_reg, uint32_t num_registers,
+                                size_t type_index) {
+  MJ_ASSERT(num_registers > 0);
+  MJ_ASSERT(period_ms > 0);
+  WriteStream stream{buffer_};
+
+  MJ_ASSERT(type_index <= 3);
+  const int encoded_length = (num_registers < 4) ? num_registers : 0;
+
+  stream.WriteVaruint(u32(Format::Subframe::kSubscribe));
+  stream.WriteVaruint(slot);
+  stream.WriteVaruint(period_ms);
+  stream.Write(deadband);
+  stream.WriteVaruint(u32(Format::Subframe::kReadBase) +
+                      type_index * 4 + encoded_length);
+  if (!encoded_length) { stream.WriteVaruint(num_registers); }
+  stream.WriteVaruint(start_reg);
+}
+
+void RegisterRequest::Unsubscribe(uint32_t slot) {
+  WriteStream stream{buffer_};
+
+  stream.WriteVaruint(u32(Format::Subframe::kUnsubscribe));
+  stream.WriteVaruint(slot);
+}
+
 std::string_view RegisterRequest::buffer() const {
   return std::string_view(buffer_.data()->data(), buffer_.data()->size());
 }
@@ -166,6 +194,17 @@ bool ParseSubframe(BaseReadStream& stream, std::vector<RegisterValue>* output) {
 }
 }
 
+std::optional<uint32_t> ParseSubscriptionData(base::ReadStream& stream_in) {
+  BaseReadStream stream{stream_in};
+
+  const auto maybe_subframe_id = stream.ReadVaruint();
+  if (!maybe_subframe_id ||
+      *maybe_subframe_id != u32(Format::Subframe::kSubscriptionData)) {
+    return {};
+  }
+  return stream.ReadVaruint();
+}
+
 RegisterReply ParseRegisterReply(base::ReadStream& read_stream) {
   std::vector<RegisterValue> data;
   ParseRegisterReply(read_stream, &data);
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <map>
+#include <optional>
 
 #include "mjlib/base/fast_stream.h"
 #include "mjlib/multiplex/format.h"
@@ -41,6 +42,16 @@ class RegisterRequest {
   void WriteSingle(Register, Value);
   void WriteMultiple(Register, const std::vector<Value>&);
 
+  /// Ask the device to send @p num_registers starting at @p
+  /// start_register every @p period_ms without being polled.  If @p
+  /// deadband is non-negative, they are only sent when one has
+  /// changed by more than that amount.  Subscribing does not by
+  /// itself request a response.
+  void Subscribe(uint32_t slot, uint32_t period_ms, float deadband,
+                 Register start_register, uint32_t num_registers,
+                 size_t type_index);
+  void Unsubscribe(uint32_t slot);
+
   std::string_view buffer() const;
   bool request_reply() const { return request_reply_; }
 
@@ -51,6 +62,11 @@ class RegisterRequest {
   bool request_reply_ = false;
 };
 
+/// If @p stream holds subscription data, return its slot, leaving
+/// @p stream positioned so that ParseRegisterReply can be used to
+/// read the values.
+std::optional<uint32_t> ParseSubscriptionData(base::ReadStream& stream);
+
 /// The possible reply to a register operation.
 using RegisterReply = std::map<Format::Register, Format::ReadResult>;
 
@@ -0,0 +1,245 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/replay_frame_stream.h"
+
+#include <functional>
+#include <optional>
+
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/io/deadline_timer.h"
+#include "mjlib/io/now.h"
+#include "mjlib/multiplex/recording_frame_stream.h"
+#include "mjlib/telemetry/binary_read_archive.h"
+
+namespace pl = std::placeholders;
+
+namespace mjlib {
+namespace multiplex {
+
+class ReplayFrameStream::Impl {
+ public:
+  Impl(const boost::asio::any_io_executor& executor,
+       telemetry::FileReader* reader,
+       const Options& options)
+      : executor_(executor),
+        options_(options),
+        items_(reader->items([&]() {
+            telemetry::FileReader::ItemsOptions items_options;
+            items_options.records = { options.record_name };
+            return items_options;
+          }())),
+        next_(items_.begin()),
+        end_(items_.end()) {
+    LoadNext();
+  }
+
+  void AsyncRead(Frame* frame,
+                 boost::posix_time::time_duration timeout,
+                 io::ErrorCallback callback) {
+    BOOST_ASSERT(current_frame_ == nullptr);
+    BOOST_ASSERT(!current_callback_);
+
+    current_frame_ = frame;
+    current_callback_ = std::move(callback);
+
+    if (timeout == boost::posix_time::time_duration()) {
+      timeout_timer_.cancel();
+    } else {
+      timeout_timer_.expires_from_now(timeout);
+      timeout_timer_.async_wait(
+          std::bind(&Impl::HandleTimeout, this, pl::_1));
+    }
+
+    if (!pending_) {
+      Complete(boost::asio::error::eof);
+      return;
+    }
+
+    if (options_.speed <= 0.0) {
+      Complete({});
+      return;
+    }
+
+    const auto now = io::NowNano(executor_.context());
+    if (replay_start_.is_not_a_date_time()) { replay_start_ = now; }
+
+    const auto due = PendingDue();
+    if (due <= now) {
+      Complete({});
+      return;
+    }
+
+    frame_timer_.expires_at(due);
+    frame_timer_.async_wait(std::bind(&Impl::HandleFrameTimer, this, pl::_1));
+  }
+
+  void cancel() {
+    if (!current_callback_) { return; }
+
+    timeout_timer_.cancel();
+    frame_timer_.cancel();
+    current_frame_ = nullptr;
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(current_callback_),
+                  base::error_code(boost::asio::error::operation_aborted)));
+    current_callback_ = {};
+  }
+
+  bool read_data_queued() const {
+    if (!pending_) { return false; }
+    if (options_.speed <= 0.0) { return true; }
+    if (replay_start_.is_not_a_date_time()) { return false; }
+    return PendingDue() <= io::NowNano(executor_.context());
+  }
+
+  boost::asio::any_io_executor executor_;
+
+ private:
+  base::RealtimeNanoTime PendingDue() const {
+    const auto delay = base::NanoDuration(
+        static_cast<int64_t>(
+            (pending_timestamp_ - log_start_).count() / options_.speed));
+    return replay_start_ + delay;
+  }
+
+  void LoadNext() {
+    pending_.reset();
+    while (next_ != end_) {
+      const auto item = *next_;
+      ++next_;
+
+      auto record =
+          telemetry::BinaryReadArchive::Read<RecordedFrame>(item.data);
+      if (!record.received) { continue; }
+
+      if (log_start_.is_not_a_date_time()) {
+        log_start_ = item.nano_timestamp;
+      }
+      pending_timestamp_ = item.nano_timestamp;
+
+      Frame frame;
+      frame.source_id = record.source_id;
+      frame.dest_id = record.dest_id;
+      frame.request_reply = record.request_reply;
+      frame.payload.assign(record.payload.begin(), record.payload.end());
+      pending_ = std::move(frame);
+      return;
+    }
+  }
+
+  void Complete(const base::error_code& ec) {
+    timeout_timer_.cancel();
+    frame_timer_.cancel();
+
+    if (!ec) {
+      *current_frame_ = std::move(*pending_);
+      LoadNext();
+    }
+
+    current_frame_ = nullptr;
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(current_callback_), ec));
+    current_callback_ = {};
+  }
+
+  void HandleFrameTimer(const base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    base::FailIf(ec);
+
+    if (!current_callback_) { return; }
+    Complete({});
+  }
+
+  void HandleTimeout(const base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    base::FailIf(ec);
+
+    if (!current_callback_) { return; }
+
+    // The pending frame remains queued for the next read.
+    frame_timer_.cancel();
+    current_frame_ = nullptr;
+    auto copy = std::move(current_callback_);
+    current_callback_ = {};
+    copy(boost::asio::error::operation_aborted);
+  }
+
+  const Options options_;
+
+  telemetry::FileReader::ItemRange items_;
+  telemetry::FileReader::ItemIterator next_;
+  telemetry::FileReader::ItemIterator end_;
+
+  std::optional<Frame> pending_;
+  base::RealtimeNanoTime pending_timestamp_;
+  base::RealtimeNanoTime log_start_;
+  base::RealtimeNanoTime replay_start_;
+
+  io::DeadlineTimer frame_timer_{executor_};
+  io::DeadlineTimer timeout_timer_{executor_};
+
+  Frame* current_frame_ = nullptr;
+  io::ErrorCallback current_callback_;
+};
+
+ReplayFrameStream::ReplayFrameStream(
+    const boost::asio::any_io_executor& executor,
+    telemetry::FileReader* reader,
+    const Options& options)
+    : impl_(std::make_unique<Impl>(executor, reader, options)) {}
+
+ReplayFrameStream::~ReplayFrameStream() {}
+
+FrameStream::Properties ReplayFrameStream::properties() const {
+  return Properties();
+}
+
+void ReplayFrameStream::AsyncWrite(const Frame*, io::ErrorCallback callback) {
+  boost::asio::post(
+      impl_->executor_,
+      std::bind(std::move(callback), base::error_code()));
+}
+
+void ReplayFrameStream::AsyncWriteMultiple(const std::vector<const Frame*>&,
+                                           io::ErrorCallback callback) {
+  boost::asio::post(
+      impl_->executor_,
+      std::bind(std::move(callback), base::error_code()));
+}
+
+void ReplayFrameStream::AsyncRead(Frame* frame,
+                                  boost::posix_time::time_duration timeout,
+                                  io::ErrorCallback callback) {
+  impl_->AsyncRead(frame, timeout, std::move(callback));
+}
+
+void ReplayFrameStream::cancel() {
+  impl_->cancel();
+}
+
+bool ReplayFrameStream::read_data_queued() const {
+  return impl_->read_data_queued();
+}
+
+boost::asio::any_io_executor ReplayFrameStream::get_executor() const {
+  return impl_->executor_;
+}
+
+}
+}
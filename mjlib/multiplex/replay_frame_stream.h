@@ -0,0 +1,80 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/io/async_types.h"
+#include "mjlib/multiplex/frame_stream.h"
+#include "mjlib/telemetry/file_reader.h"
+
+namespace mjlib {
+namespace multiplex {
+
+/// Serves the frames captured by a RecordingFrameStream back to a
+/// client.  Every frame which was originally received is returned
+/// from AsyncRead, in order.  Writes complete immediately and are
+/// otherwise ignored.
+///
+/// Once all recorded frames have been served, reads complete with
+/// boost::asio::error::eof.
+class ReplayFrameStream : public FrameStream {
+ public:
+  struct Options {
+    std::string record_name = "multiplex_frames";
+
+    /// Frames are made available at their recorded time relative to
+    /// the first read, divided by this factor.  1.0 replays at the
+    /// recorded rate, 2.0 twice as fast, and so on.  0 serves each
+    /// frame as soon as it is requested.
+    double speed = 1.0;
+
+    Options() {}
+  };
+
+  /// @p reader is aliased and must outlive this instance.
+  ReplayFrameStream(const boost::asio::any_io_executor&,
+                    telemetry::FileReader* reader,
+                    const Options& = {});
+  ~ReplayFrameStream() override;
+
+  Properties properties() const override;
+
+  void AsyncWrite(const Frame*, io::ErrorCallback) override;
+
+  void AsyncWriteMultiple(const std::vector<const Frame*>&,
+                          io::ErrorCallback) override;
+
+  void AsyncRead(Frame*, boost::posix_time::time_duration timeout,
+                 io::ErrorCallback callback) override;
+
+  void cancel() override;
+
+  bool read_data_queued() const override;
+
+  boost::asio::any_io_executor get_executor() const override;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
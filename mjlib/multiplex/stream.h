@@ -35,21 +35,23 @@ class ReadStream {
     return ReadScalar<T>();
   }
 
+  /// @return an empty value if the stream ends first, or the encoding
+  /// does not fit in 32 bits.
   std::optional<uint32_t> ReadVaruint() {
     uint32_t result = 0;
     int pos = 0;
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < kMaxVaruintSize; i++) {
       const auto maybe_this_byte = Read<uint8_t>();
       if (!maybe_this_byte) {
         return {};
       }
       const auto this_byte = *maybe_this_byte;
-      result |= (this_byte & 0x7f) << pos;
+      if (VaruintOverflows(pos, this_byte)) { return {}; }
+      result |= static_cast<uint32_t>(this_byte & 0x7f) << pos;
       pos += 7;
       if ((this_byte & 0x80) == 0) { return result; }
     }
-    // Whoops, this was too big.  For now, just return maxint.
-    return std::numeric_limits<uint32_t>::max();
+    return {};
   }
 
   template <typename T>
@@ -78,6 +80,14 @@ class ReadStream {
     return true;
   }
 
+  static constexpr int kMaxVaruintSize = 5;
+
+  // The final byte of a 32 bit varuint only has room for 4 bits, and
+  // may not ask for more.
+  static bool VaruintOverflows(int pos, uint8_t this_byte) {
+    return pos == 7 * (kMaxVaruintSize - 1) && (this_byte & 0xf0) != 0;
+  }
+
   Base& istr_;
 };
 
@@ -92,7 +102,7 @@ ReadStream<base::BufferReadStream>::ReadVaruint() {
 
   int pos = 0;
   int i = 0;
-  for (; i < 5; i++) {
+  for (; i < kMaxVaruintSize; i++) {
     if (remaining == 0) {
       istr_.fast_ignore(i);
       return {};
@@ -102,7 +112,11 @@ ReadStream<base::BufferReadStream>::ReadVaruint() {
     const auto this_byte = *position;
     position++;
 
-    result |= (this_byte & 0x7f) << pos;
+    if (VaruintOverflows(pos, this_byte)) {
+      istr_.fast_ignore(i + 1);
+      return {};
+    }
+    result |= static_cast<uint32_t>(this_byte & 0x7f) << pos;
     pos += 7;
     if ((this_byte & 0x80) == 0) {
       istr_.fast_ignore(i + 1);
@@ -111,8 +125,7 @@ ReadStream<base::BufferReadStream>::ReadVaruint() {
   }
 
   istr_.fast_ignore(i);
-  // Whoops, this was too big.  For now, just return maxint.
-  return std::numeric_limits<uint32_t>::max();
+  return {};
 }
 
 template <>
@@ -15,6 +15,7 @@
 #include "mjlib/multiplex/stream_asio_client.h"
 
 #include <functional>
+#include <map>
 
 #include <boost/asio/post.hpp>
 #include <boost/asio/write.hpp>
@@ -22,8 +23,10 @@
 
 #include "mjlib/base/fail.h"
 #include "mjlib/base/fast_stream.h"
+#include "mjlib/base/flight_recorder.h"
 #include "mjlib/io/deadline_timer.h"
 #include "mjlib/io/exclusive_command.h"
+#include "mjlib/io/now.h"
 #include "mjlib/io/offset_buffer.h"
 
 #include "mjlib/multiplex/frame_stream.h"
@@ -37,11 +40,29 @@ namespace {
 const boost::posix_time::time_duration kDefaultTimeout =
     boost::posix_time::milliseconds(15);
 
+const char* const kTraceLabel = "multiplex";
+
 template <typename T>
 uint32_t u32(T value) {
   return static_cast<uint32_t>(value);
 }
 
+struct DiscoverContext {
+  AsioClient::DiscoverOptions options;
+  AsioClient::Discovery* discovery = nullptr;
+  std::vector<uint8_t> ids;
+  size_t next = 0;
+
+  // The IDs probed in the current window.
+  std::vector<uint8_t> window;
+
+  io::ErrorCallback handler;
+
+  boost::posix_time::time_duration timeout;
+  boost::posix_time::time_duration max_latency;
+  boost::posix_time::ptime window_start;
+};
+
 struct ReadContext {
   io::ReadHandler handler;
   io::MutableBufferSequence buffers;
@@ -71,11 +92,11 @@ class StreamAsioClient::Impl {
     if (reply) { reply->clear(); }
 
     if (any_replies) {
-      SequenceRegister(*request, reply, std::move(handler));
+      SequenceRegister(request, 0, reply, std::move(handler));
     } else {
       // No replies, we can just send this out as one big block with
       // no reads whatsoever.
-      lock_.Invoke([this, request](io::ErrorCallback handler_in) mutable {
+      Invoke([this, request](io::ErrorCallback handler_in) mutable {
           tx_frames_.resize(request->size());
           tx_frame_ptrs_.clear();
 
@@ -86,6 +107,9 @@ class StreamAsioClient::Impl {
             tx_frames_[i].request_reply = false;
             tx_frames_[i].payload = (*request)[i].request.buffer();
             tx_frame_ptrs_.push_back(&tx_frames_[i]);
+            base::FlightRecorder::Record(
+                base::FlightRecorder::kBusWrite, tx_frames_[i].dest_id,
+                kTraceLabel);
           }
 
           frame_stream_.AsyncWriteMultiple(tx_frame_ptrs_, std::move(handler_in));
@@ -94,42 +118,42 @@ class StreamAsioClient::Impl {
     }
   }
 
-  void SequenceRegister(const Request& request, Reply* reply,
+  // @p request is aliased and must remain valid until @p callback is
+  // invoked.
+  void SequenceRegister(const Request* request, size_t index, Reply* reply,
                         io::ErrorCallback callback) {
-    if (request.empty()) {
+    if (index >= request->size()) {
       boost::asio::post(
           executor_,
           std::bind(std::move(callback), base::error_code()));
       return;
     }
 
-    auto this_request = request.front();
-    auto remainder = std::vector<IdRequest>{request.begin() + 1, request.end()};
-
-    auto next = [this, handler=std::move(callback), reply, remainder](
+    auto next = [this, handler=std::move(callback), request, index, reply](
         const base::error_code& ec) mutable {
       if (ec) {
         boost::asio::post(
             executor_,
             std::bind(std::move(handler), ec));
       } else {
-        this->SequenceRegister(remainder, reply, std::move(handler));
+        this->SequenceRegister(request, index + 1, reply, std::move(handler));
       }
     };
 
-    // Do the first one in the list.
-    AsyncRegister(this_request, reply, std::move(next));
+    AsyncRegister(&(*request)[index], reply, std::move(next));
   }
 
-  void AsyncRegister(const IdRequest& request, Reply* reply,
+  void AsyncRegister(const IdRequest* request, Reply* reply,
                      io::ErrorCallback handler) {
-    lock_.Invoke([this, request, reply](io::ErrorCallback handler_in) mutable {
+    Invoke([this, request, reply](io::ErrorCallback handler_in) mutable {
         tx_frame_.source_id = this->options_.source_id;
-        tx_frame_.dest_id = request.id;
-        const bool request_reply = request.request.request_reply();
+        tx_frame_.dest_id = request->id;
+        const bool request_reply = request->request.request_reply();
         tx_frame_.request_reply = request_reply;
-        tx_frame_.payload = request.request.buffer();
+        tx_frame_.payload = request->request.buffer();
 
+        base::FlightRecorder::Record(
+            base::FlightRecorder::kBusWrite, tx_frame_.dest_id, kTraceLabel);
         frame_stream_.AsyncWrite(
             &tx_frame_,
             [this, handler_in=std::move(handler_in), reply, request_reply](
@@ -166,6 +190,8 @@ class StreamAsioClient::Impl {
                   io::ErrorCallback handler) {
     // If we got a timeout, report that upstream.
     if (ec == boost::asio::error::operation_aborted) {
+      base::FlightRecorder::Record(
+          base::FlightRecorder::kBusTimeout, tx_frame_.dest_id, kTraceLabel);
       boost::asio::post(
           executor_,
           std::bind(std::move(handler), ec));
@@ -174,8 +200,10 @@ class StreamAsioClient::Impl {
 
     base::FailIf(ec);
 
-    // If this isn't from who we expected, just read again.
-    if (rx_frame_.source_id != tx_frame_.dest_id ||
+    // If this is subscription data, or isn't from who we expected,
+    // just read again.
+    if (DispatchSubscription(rx_frame_) ||
+        rx_frame_.source_id != tx_frame_.dest_id ||
         rx_frame_.dest_id != tx_frame_.source_id) {
       frame_stream_.AsyncRead(
           &rx_frame_, kDefaultTimeout,
@@ -185,6 +213,9 @@ class StreamAsioClient::Impl {
       return;
     }
 
+    base::FlightRecorder::Record(
+        base::FlightRecorder::kBusRead, rx_frame_.source_id, kTraceLabel);
+
     base::FastIStringStream stream(rx_frame_.payload);
     if (reply) {
       parsed_values_.clear();
@@ -206,7 +237,230 @@ class StreamAsioClient::Impl {
     return std::make_shared<TunnelHolder>(this, id, channel, options);
   }
 
+  void AsyncDiscover(const DiscoverOptions& options,
+                     Discovery* discovery,
+                     io::ErrorCallback handler) {
+    MJ_ASSERT(options.identity.request_reply());
+    MJ_ASSERT(options.window >= 1);
+    discovery->clear();
+
+    auto ctx = std::make_shared<DiscoverContext>();
+    ctx->options = options;
+    ctx->discovery = discovery;
+    ctx->ids = DiscoverIds(options);
+    ctx->timeout = options.max_timeout;
+
+    Invoke([this, ctx](io::ErrorCallback handler_in) mutable {
+        ctx->handler = std::move(handler_in);
+        if (ctx->options.broadcast) {
+          SendDiscoverProbes(ctx, {Format::kBroadcastId});
+        } else {
+          DiscoverNextWindow(ctx);
+        }
+      },
+      std::move(handler));
+  }
+
+  void AddSubscriptionCallback(uint8_t id, uint32_t slot,
+                               SubscriptionCallback callback) {
+    subscription_callbacks_[std::make_pair(id, slot)] = std::move(callback);
+    MaybeListen();
+  }
+
+  void RemoveSubscriptionCallback(uint8_t id, uint32_t slot) {
+    subscription_callbacks_.erase(std::make_pair(id, slot));
+    if (subscription_callbacks_.empty()) {
+      StopListening();
+    }
+  }
+
  private:
+  // All access to the frame stream goes through here, so that any
+  // idle listening for subscription data gets out of the way.
+  template <typename Command, typename Handler>
+  io::ExclusiveCommand::Nonce Invoke(Command command, Handler handler) {
+    StopListening();
+    return lock_.Invoke(std::move(command), std::move(handler));
+  }
+
+  void MaybeListen() {
+    if (subscription_callbacks_.empty()) { return; }
+    if (listen_state_ != ListenState::kIdle) { return; }
+
+    listen_state_ = ListenState::kQueued;
+    lock_.Invoke(
+        [this](io::ErrorCallback handler) {
+          if (listen_state_ != ListenState::kQueued) {
+            // Something else is waiting, let it go first.
+            handler(base::error_code());
+            return;
+          }
+
+          listen_state_ = ListenState::kActive;
+          frame_stream_.AsyncRead(
+              &listen_frame_, {},
+              [this, handler=std::move(handler)](const auto& ec) mutable {
+                if (ec != boost::asio::error::operation_aborted) {
+                  base::FailIf(ec);
+                  this->DispatchSubscription(listen_frame_);
+                }
+                handler(base::error_code());
+              });
+        },
+        [this](const base::error_code&) {
+          listen_state_ = ListenState::kIdle;
+          MaybeListen();
+        });
+  }
+
+  void StopListening() {
+    if (listen_state_ == ListenState::kQueued) {
+      listen_state_ = ListenState::kYield;
+    } else if (listen_state_ == ListenState::kActive) {
+      listen_state_ = ListenState::kYield;
+      frame_stream_.cancel();
+    }
+  }
+
+  void DiscoverNextWindow(std::shared_ptr<DiscoverContext> ctx) {
+    std::vector<uint8_t> window;
+    while (ctx->next < ctx->ids.size() &&
+           static_cast<int>(window.size()) < ctx->options.window) {
+      const auto id = ctx->ids[ctx->next++];
+      // Skip anything which already answered a broadcast.
+      if (ctx->discovery->count(id)) { continue; }
+      window.push_back(id);
+    }
+
+    if (window.empty()) {
+      FinishDiscover(ctx, {});
+      return;
+    }
+
+    SendDiscoverProbes(ctx, window);
+  }
+
+  void SendDiscoverProbes(std::shared_ptr<DiscoverContext> ctx,
+                          const std::vector<uint8_t>& ids) {
+    ctx->window = ids;
+    tx_frames_.resize(ids.size());
+    tx_frame_ptrs_.clear();
+    for (size_t i = 0; i < ids.size(); i++) {
+      auto& frame = tx_frames_[i];
+      frame.source_id = options_.source_id;
+      frame.dest_id = ids[i];
+      frame.request_reply = true;
+      frame.payload = ctx->options.identity.buffer();
+      tx_frame_ptrs_.push_back(&frame);
+    }
+
+    frame_stream_.AsyncWriteMultiple(
+        tx_frame_ptrs_, [this, ctx](const base::error_code& ec) {
+          if (ec) {
+            FinishDiscover(ctx, ec);
+            return;
+          }
+          ctx->window_start = io::Now(executor_.context());
+          ReadDiscoverReply(ctx);
+        });
+  }
+
+  void ReadDiscoverReply(std::shared_ptr<DiscoverContext> ctx) {
+    // Each reply restarts the wait, so that a window ends once the
+    // bus has been quiet for a full timeout.
+    frame_stream_.AsyncRead(
+        &rx_frame_, ctx->timeout,
+        [this, ctx](const base::error_code& ec) {
+          HandleDiscoverReply(ec, ctx);
+        });
+  }
+
+  void HandleDiscoverReply(const base::error_code& ec,
+                           std::shared_ptr<DiscoverContext> ctx) {
+    if (ec == boost::asio::error::operation_aborted) {
+      DiscoverNextWindow(ctx);
+      return;
+    }
+
+    if (ec) {
+      FinishDiscover(ctx, ec);
+      return;
+    }
+
+    if (!DispatchSubscription(rx_frame_) &&
+        rx_frame_.dest_id == options_.source_id &&
+        WasProbed(*ctx, rx_frame_.source_id)) {
+      base::FastIStringStream stream(rx_frame_.payload);
+      (*ctx->discovery)[rx_frame_.source_id] = ParseRegisterReply(stream);
+
+      const auto latency = io::Now(executor_.context()) - ctx->window_start;
+      ctx->max_latency = std::max(ctx->max_latency, latency);
+      ctx->timeout = std::min(
+          ctx->options.max_timeout,
+          std::max(ctx->options.min_timeout, ctx->max_latency * 2));
+
+      // There is no need to wait out the timeout once everyone we
+      // asked has answered.
+      if (WindowComplete(*ctx)) {
+        DiscoverNextWindow(ctx);
+        return;
+      }
+    }
+
+    ReadDiscoverReply(ctx);
+  }
+
+  void FinishDiscover(std::shared_ptr<DiscoverContext> ctx,
+                      const base::error_code& ec) {
+    auto handler = std::move(ctx->handler);
+    handler(ec);
+  }
+
+  // Replies to probes from an earlier window, which arrive after it
+  // timed out, are ignored.
+  static bool WasProbed(const DiscoverContext& ctx, uint8_t id) {
+    for (const auto probed : ctx.window) {
+      if (probed == id || probed == Format::kBroadcastId) { return true; }
+    }
+    return false;
+  }
+
+  // A broadcast window is never complete, as there is no telling how
+  // many devices will answer it.
+  static bool WindowComplete(const DiscoverContext& ctx) {
+    for (const auto probed : ctx.window) {
+      if (probed == Format::kBroadcastId) { return false; }
+      if (ctx.discovery->count(probed) == 0) { return false; }
+    }
+    return true;
+  }
+
+  // @return true if @p frame contained subscription data.
+  bool DispatchSubscription(const Frame& frame) {
+    if (frame.dest_id != options_.source_id) { return false; }
+
+    base::FastIStringStream stream(frame.payload);
+    const auto maybe_slot = ParseSubscriptionData(stream);
+    if (!maybe_slot) { return false; }
+
+    const auto it = subscription_callbacks_.find(
+        std::make_pair(frame.source_id, *maybe_slot));
+    if (it == subscription_callbacks_.end()) { return true; }
+
+    ParseRegisterReply(stream, &parsed_values_);
+    subscription_reply_.clear();
+    for (const auto& parsed_value : parsed_values_) {
+      subscription_reply_.push_back(
+          {frame.source_id, parsed_value.first, parsed_value.second});
+    }
+
+    // The callback may remove itself.
+    auto callback = it->second;
+    callback(subscription_reply_);
+
+    return true;
+  }
+
   class Tunnel : public io::AsyncStream,
                  public std::enable_shared_from_this<Tunnel> {
    public:
@@ -241,7 +495,7 @@ class StreamAsioClient::Impl {
       // this ever be more clear if we could express it with
       // coroutines.
 
-      read_nonce_ = parent_->lock_.Invoke(
+      read_nonce_ = parent_->Invoke(
           [self=shared_from_this(), ctx](io::SizeCallback handler) mutable {
             self->read_nonce_ = {};
 
@@ -276,7 +530,7 @@ class StreamAsioClient::Impl {
       }
 
       write_handler_ = std::move(handler);
-      write_nonce_ = parent_->lock_.Invoke(
+      write_nonce_ = parent_->Invoke(
           [self=shared_from_this(), buffers](
               io::WriteHandler inner_handler) mutable {
             auto size = boost::asio::buffer_size(buffers);
@@ -382,9 +636,15 @@ class StreamAsioClient::Impl {
         return;
       }
 
+      auto& frame = parent_->rx_frame_;
+      if (parent_->DispatchSubscription(frame)) {
+        // Keep waiting for our actual response.
+        HandleRequestRead(base::error_code(), std::move(callback), ctx);
+        return;
+      }
+
       // Verify the response came from who we expected it to, and was
       // addressed to us.
-      auto& frame = parent_->rx_frame_;
       if (frame.source_id != this->id_ ||
           frame.dest_id != parent_->options_.source_id) {
         // Just retry.
@@ -584,6 +844,19 @@ class StreamAsioClient::Impl {
   std::vector<Frame> tx_frames_;
   std::vector<const Frame*> tx_frame_ptrs_;
   std::vector<RegisterValue> parsed_values_;
+
+  enum class ListenState {
+    kIdle,
+    kQueued,
+    kYield,
+    kActive,
+  };
+
+  std::map<std::pair<uint8_t, uint32_t>, SubscriptionCallback>
+      subscription_callbacks_;
+  ListenState listen_state_ = ListenState::kIdle;
+  Frame listen_frame_;
+  Reply subscription_reply_;
 };
 
 StreamAsioClient::StreamAsioClient(FrameStream* stream, const Options& options)
@@ -603,5 +876,20 @@ io::SharedStream StreamAsioClient::MakeTunnel(
   return impl_->MakeTunnel(id, channel, options);
 }
 
+void StreamAsioClient::AsyncDiscover(const DiscoverOptions& options,
+                                     Discovery* discovery,
+                                     io::ErrorCallback handler) {
+  impl_->AsyncDiscover(options, discovery, std::move(handler));
+}
+
+void StreamAsioClient::AddSubscriptionCallback(
+    uint8_t id, uint32_t slot, SubscriptionCallback callback) {
+  impl_->AddSubscriptionCallback(id, slot, std::move(callback));
+}
+
+void StreamAsioClient::RemoveSubscriptionCallback(uint8_t id, uint32_t slot) {
+  impl_->RemoveSubscriptionCallback(id, slot);
+}
+
 }
 }
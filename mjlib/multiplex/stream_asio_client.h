@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
@@ -56,6 +57,26 @@ class StreamAsioClient : public AsioClient {
       uint32_t channel,
       const TunnelOptions& options = TunnelOptions()) override;
 
+  /// Probes are sent in groups of DiscoverOptions::window frames, and
+  /// the wait for their replies adapts to the observed latency.
+  void AsyncDiscover(const DiscoverOptions&,
+                     Discovery*,
+                     io::ErrorCallback) override;
+
+  using SubscriptionCallback = std::function<void (const Reply&)>;
+
+  /// Invoke @p callback with the values from each subscription data
+  /// frame that device @p id sends for @p slot.  The subscription
+  /// itself is made with RegisterRequest::Subscribe.
+  ///
+  /// While any callbacks are registered, the client listens for
+  /// frames whenever it is otherwise idle.  Subscription data which
+  /// arrives while waiting for some other reply is dispatched as
+  /// well.
+  void AddSubscriptionCallback(uint8_t id, uint32_t slot,
+                               SubscriptionCallback callback);
+  void RemoveSubscriptionCallback(uint8_t id, uint32_t slot);
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
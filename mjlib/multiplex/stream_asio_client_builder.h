@@ -92,6 +92,12 @@ class StreamAsioClientBuilder : public AsioClient {
     return client_->MakeTunnel(id, channel, options);
   }
 
+  void AsyncDiscover(const DiscoverOptions& options,
+                     Discovery* discovery,
+                     io::ErrorCallback callback) override {
+    client_->AsyncDiscover(options, discovery, std::move(callback));
+  }
+
  private:
   void HandleStream(const base::error_code& ec, io::SharedStream stream,
                     io::ErrorCallback callback) {
@@ -0,0 +1,188 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Measure host side throughput of MicroFrameParser, compared to the
+/// linear buffer approach MicroStreamDatagram used previously, which
+/// memmoves after every frame and checksums each frame in one pass
+/// once it is complete.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <boost/crc.hpp>
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/multiplex/frame.h"
+#include "mjlib/multiplex/micro_frame_parser.h"
+
+namespace po = boost::program_options;
+using namespace mjlib;
+
+namespace {
+class LinearParser {
+ public:
+  LinearParser(size_t size) : buffer_(size) {}
+
+  base::string_span write_span() {
+    return base::string_span(&buffer_[used_], buffer_.size() - used_);
+  }
+
+  template <typename Handler>
+  void Commit(size_t size, Handler handler) {
+    used_ += size;
+    while (TryOne(handler)) {}
+  }
+
+ private:
+  template <typename Handler>
+  bool TryOne(Handler handler) {
+    const char* const found = static_cast<const char*>(
+        std::memchr(buffer_.data(), 0x54, used_));
+    if (found == nullptr) {
+      used_ = 0;
+      return false;
+    }
+    Consume(found - buffer_.data());
+    if (used_ < 7) { return false; }
+    if (static_cast<uint8_t>(buffer_[1]) != 0xab) {
+      Consume(2);
+      return true;
+    }
+
+    uint32_t size = 0;
+    size_t pos = 4;
+    for (int shift = 0; ; shift += 7) {
+      if (pos >= used_) { return false; }
+      const uint8_t value = buffer_[pos++];
+      size |= (value & 0x7f) << shift;
+      if (!(value & 0x80)) { break; }
+    }
+    if (size + pos + 2 > buffer_.size()) {
+      used_ = 0;
+      return false;
+    }
+    if (pos + size + 2 > used_) { return false; }
+
+    boost::crc_ccitt_type crc;
+    crc.process_bytes(buffer_.data(), pos + size);
+    uint16_t actual = 0;
+    std::memcpy(&actual, &buffer_[pos + size], 2);
+    if (actual == crc.checksum()) {
+      handler(std::string_view(&buffer_[pos], size));
+    }
+    Consume(pos + size + 2);
+    return true;
+  }
+
+  void Consume(size_t size) {
+    std::memmove(buffer_.data(), &buffer_[size], used_ - size);
+    used_ -= size;
+  }
+
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+};
+
+template <typename Parser, typename Commit>
+double MeasureMBps(Parser* parser, const std::string& data,
+                   size_t chunk, int iterations, Commit commit) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      const auto span = parser->write_span();
+      const size_t size = std::min<size_t>(
+          {static_cast<size_t>(span.size()), chunk, data.size() - offset});
+      std::memcpy(span.data(), &data[offset], size);
+      offset += size;
+      commit(size);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  return data.size() * iterations / seconds / 1e6;
+}
+}
+
+int main(int argc, char** argv) {
+  po::options_description desc;
+
+  int iterations = 20;
+  int payload_size = 64;
+  int buffer_size = 256;
+
+  desc.add_options()
+      ("help,h", "display usage message")
+      ("iterations", po::value(&iterations), "")
+      ("payload-size", po::value(&payload_size), "")
+      ("buffer-size", po::value(&buffer_size), "")
+      ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc;
+    return 0;
+  }
+
+  std::mt19937 rng(0);
+  std::string data;
+  while (data.size() < (4 << 20)) {
+    multiplex::Frame frame;
+    frame.source_id = 1;
+    frame.dest_id = 2;
+    for (int i = 0; i < payload_size; i++) {
+      frame.payload.push_back(static_cast<char>(rng()));
+    }
+    data += frame.encode();
+  }
+
+  for (const size_t chunk : {1, 16, 256}) {
+    uint64_t new_frames = 0;
+    std::vector<char> storage(buffer_size);
+    multiplex::MicroFrameParser parser{
+      base::string_span(storage.data(), buffer_size)};
+    const double new_mbps = MeasureMBps(
+        &parser, data, chunk, iterations, [&](size_t size) {
+          parser.Commit(size);
+          while (parser.frame()) {
+            new_frames++;
+            parser.Pop();
+          }
+        });
+
+    uint64_t old_frames = 0;
+    LinearParser linear{static_cast<size_t>(buffer_size)};
+    const double old_mbps = MeasureMBps(
+        &linear, data, chunk, iterations, [&](size_t size) {
+          linear.Commit(size, [&](std::string_view) { old_frames++; });
+        });
+
+    std::cout << fmt::format(
+        "chunk {:4}  ring {:8.1f} MB/s ({} frames)  "
+        "linear {:8.1f} MB/s ({} frames)\n",
+        chunk, new_mbps, new_frames, old_mbps, old_frames);
+  }
+
+  return 0;
+}
@@ -0,0 +1,188 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/micro_frame_parser.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/multiplex/frame.h"
+
+using namespace mjlib;
+using multiplex::MicroFrameParser;
+
+namespace {
+struct Decoded {
+  uint8_t source = 0;
+  uint8_t destination = 0;
+  std::string payload;
+
+  bool operator==(const Decoded& rhs) const {
+    return source == rhs.source &&
+        destination == rhs.destination &&
+        payload == rhs.payload;
+  }
+};
+
+std::ostream& operator<<(std::ostream& ostr, const Decoded& decoded) {
+  return ostr << "Decoded(" << static_cast<int>(decoded.source) << ","
+              << static_cast<int>(decoded.destination) << ","
+              << decoded.payload.size() << ")";
+}
+
+/// Feed @p data through the parser in chunks chosen by @p chunk_size,
+/// as a DMA engine or stream read would, and return every frame.
+template <typename ChunkSize>
+std::vector<Decoded> Parse(MicroFrameParser* dut, const std::string& data,
+                           ChunkSize chunk_size) {
+  std::vector<Decoded> result;
+  auto drain = [&]() {
+    while (const auto* frame = dut->frame()) {
+      Decoded decoded;
+      decoded.source = frame->source;
+      decoded.destination = frame->destination;
+      decoded.payload.resize(frame->size());
+      BOOST_TEST(frame->CopyTo(decoded.payload) == frame->size());
+      result.push_back(decoded);
+      dut->Pop();
+    }
+  };
+
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const auto span = dut->write_span();
+    BOOST_TEST_REQUIRE(span.size() > 0);
+    const size_t size = std::min<size_t>(
+        {static_cast<size_t>(span.size()), chunk_size(),
+         data.size() - offset});
+    std::memcpy(span.data(), &data[offset], size);
+    offset += size;
+    dut->Commit(size);
+    drain();
+  }
+  return result;
+}
+
+Decoded Expected(const multiplex::Frame& frame) {
+  Decoded result;
+  result.source = frame.source_id | (frame.request_reply ? 0x80 : 0x00);
+  result.destination = frame.dest_id;
+  result.payload = frame.payload;
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(MicroFrameParserBasic) {
+  // This frame is from micro_stream_datagram_test.
+  const uint8_t kFrame[] = {
+    0x54, 0xab,
+    0x82,
+    0x01,
+    0x0b,
+    0x40, 0x09, 0x08, 't', 'e', 's', 't', ' ', 'a', 'n', 'd',
+    0x62, 0x0f,
+  };
+  char storage[64] = {};
+  MicroFrameParser dut{storage};
+
+  const auto result = Parse(
+      &dut, std::string(reinterpret_cast<const char*>(kFrame), sizeof(kFrame)),
+      []() { return 1; });
+  BOOST_TEST_REQUIRE(result.size() == 1);
+  BOOST_TEST(result[0].source == 0x82);
+  BOOST_TEST(result[0].destination == 0x01);
+  BOOST_TEST(result[0].payload == std::string("\x40\x09\x08test and"));
+  BOOST_TEST(dut.stats().checksum_mismatch == 0);
+}
+
+BOOST_AUTO_TEST_CASE(MicroFrameParserRandom) {
+  std::mt19937 rng(1234);
+
+  // Generate a long stream of frames, with noise that cannot be
+  // mistaken for a header between some of them.
+  std::vector<Decoded> expected;
+  std::string data;
+  for (int i = 0; i < 2000; i++) {
+    multiplex::Frame frame;
+    frame.source_id = rng() % 0x7f;
+    frame.request_reply = (rng() % 2) == 0;
+    frame.dest_id = rng() % 0x80;
+    const int size = rng() % 200;
+    for (int j = 0; j < size; j++) {
+      frame.payload.push_back(static_cast<char>(rng()));
+    }
+    expected.push_back(Expected(frame));
+    data += frame.encode();
+
+    if ((rng() % 4) == 0) {
+      const int noise = rng() % 10;
+      for (int j = 0; j < noise; j++) {
+        char c = 0;
+        do { c = static_cast<char>(rng()); } while (c == 0x54);
+        data.push_back(c);
+      }
+    }
+  }
+
+  for (const size_t capacity : {210, 256, 1000}) {
+    for (const int max_chunk : {1, 7, 64, 1000}) {
+      BOOST_TEST_CONTEXT("capacity " << capacity << " chunk " << max_chunk) {
+        std::vector<char> storage(capacity);
+        MicroFrameParser dut{base::string_span(storage.data(), capacity)};
+        const auto result = Parse(
+            &dut, data, [&]() { return 1 + rng() % max_chunk; });
+        BOOST_TEST(result == expected, boost::test_tools::per_element());
+        BOOST_TEST(dut.stats().checksum_mismatch == 0);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MicroFrameParserResync) {
+  const multiplex::Frame frame1{1, false, 2, "first"};
+  const multiplex::Frame frame2{3, true, 4, "second"};
+
+  std::string corrupt = frame1.encode();
+  corrupt[6] ^= 0x01;
+
+  // A lone low header byte, then a corrupt frame, then a valid one.
+  // The valid frame is found without needing any more data, even
+  // though it arrives in the same chunk as the corrupt frame.
+  const std::string data =
+      std::string("\x54\x54", 2) + corrupt + frame2.encode();
+
+  char storage[128] = {};
+  MicroFrameParser dut{storage};
+  const auto result = Parse(&dut, data, [&]() { return data.size(); });
+  BOOST_TEST_REQUIRE(result.size() == 1);
+  BOOST_TEST(result[0] == Expected(frame2));
+  BOOST_TEST(dut.stats().checksum_mismatch == 1);
+  BOOST_TEST(dut.stats().bad_header == 2);
+}
+
+BOOST_AUTO_TEST_CASE(MicroFrameParserOversize) {
+  const multiplex::Frame big{1, false, 2, std::string(100, 'x')};
+  const multiplex::Frame small{1, false, 2, "ok"};
+
+  char storage[64] = {};
+  MicroFrameParser dut{storage};
+  const auto result = Parse(
+      &dut, big.encode() + small.encode(), []() { return 5; });
+  BOOST_TEST_REQUIRE(result.size() == 1);
+  BOOST_TEST(result[0] == Expected(small));
+  BOOST_TEST(dut.stats().oversize == 1);
+}
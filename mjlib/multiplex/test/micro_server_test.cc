@@ -16,6 +16,8 @@
 
 #include <boost/test/auto_unit_test.hpp>
 
+#include "mjlib/base/test/allocation_counter.h"
+
 #include "mjlib/micro/stream_pipe.h"
 #include "mjlib/micro/test/persistent_config_fixture.h"
 #include "mjlib/micro/test/str.h"
@@ -791,3 +793,310 @@ BOOST_FIXTURE_TEST_CASE(DiscardTest, Fixture) {
   BOOST_TEST(read_count == 0);
   BOOST_TEST(dut.stats()->discards == 1);
 }
+
+namespace {
+const uint8_t kSubscribe[] = {
+  0x54, 0xab,  // header
+  0x02,  // source id
+  0x01,  // destination id
+  0x09,  // payload size
+    0x60,  // subscribe
+      0x00,  // slot
+      0x02,  // period ms
+      0x00, 0x00, 0x80, 0xbf,  // deadband -1.0
+      0x1e,  // read multiple float x2
+      0x0a,  // register
+  0x1b, 0x08,  // CRC
+  0x00,  // null terminator
+};
+
+const uint8_t kSubscribeDeadband[] = {
+  0x54, 0xab,  // header
+  0x02,  // source id
+  0x01,  // destination id
+  0x09,  // payload size
+    0x60,  // subscribe
+      0x00,  // slot
+      0x01,  // period ms
+      0x00, 0x00, 0x00, 0x3f,  // deadband 0.5
+      0x1e,  // read multiple float x2
+      0x0a,  // register
+  0xfb, 0x36,  // CRC
+  0x00,  // null terminator
+};
+
+const uint8_t kUnsubscribe[] = {
+  0x54, 0xab,  // header
+  0x02,  // source id
+  0x01,  // destination id
+  0x02,  // payload size
+    0x61,  // unsubscribe
+      0x00,  // slot
+  0x59, 0x9c,  // CRC
+  0x00,  // null terminator
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(SubscribeTest, Fixture) {
+  char receive_buffer[256] = {};
+  int read_count = 0;
+  ssize_t read_size = 0;
+  auto start_read = [&]() {
+    dut_stream.side_a()->AsyncReadSome(
+        receive_buffer, [&](micro::error_code ec, ssize_t size) {
+          BOOST_TEST(!ec);
+          read_count++;
+          read_size = size;
+        });
+  };
+  start_read();
+
+  AsyncWrite(*dut_stream.side_a(), str(kSubscribe),
+             [](micro::error_code ec) { BOOST_TEST(!ec); });
+  Poll();
+
+  // Nothing is sent in response to the subscription itself.
+  BOOST_TEST(read_count == 0);
+  BOOST_TEST(dut.stats()->malformed_subframe == 0);
+
+  dut.PollMillisecond();
+  Poll();
+  BOOST_TEST(read_count == 0);
+
+  const uint8_t kExpectedData[] = {
+    0x54, 0xab,
+    0x01,  // source id
+    0x02,  // dest id
+    0x0c,  // payload size
+     0x62,  // subscription data
+      0x00,  // slot
+     0x2e,  // reply float x2
+      0x0a,  // register
+      0x00, 0x00, 0x80, 0x3f,  // 1.0
+      0x00, 0x00, 0x00, 0x40,  // 2.0
+    0x9d, 0xac,  // CRC
+    0x00,  // null terminator
+  };
+
+  for (int i = 0; i < 2; i++) {
+    dut.PollMillisecond();
+    Poll();
+    BOOST_TEST(read_count == i + 1);
+    BOOST_TEST(std::string_view(receive_buffer, read_size) ==
+               str(kExpectedData));
+
+    start_read();
+    dut.PollMillisecond();
+    Poll();
+    BOOST_TEST(read_count == i + 1);
+  }
+
+  AsyncWrite(*dut_stream.side_a(), str(kUnsubscribe),
+             [](micro::error_code ec) { BOOST_TEST(!ec); });
+  Poll();
+
+  for (int i = 0; i < 5; i++) {
+    dut.PollMillisecond();
+    Poll();
+  }
+  BOOST_TEST(read_count == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(SubscribeDeadbandTest, Fixture) {
+  char receive_buffer[256] = {};
+  int read_count = 0;
+  ssize_t read_size = 0;
+  auto start_read = [&]() {
+    dut_stream.side_a()->AsyncReadSome(
+        receive_buffer, [&](micro::error_code ec, ssize_t size) {
+          BOOST_TEST(!ec);
+          read_count++;
+          read_size = size;
+        });
+  };
+  start_read();
+
+  AsyncWrite(*dut_stream.side_a(), str(kSubscribeDeadband),
+             [](micro::error_code ec) { BOOST_TEST(!ec); });
+  Poll();
+
+  // The first set of values is always sent.
+  dut.PollMillisecond();
+  Poll();
+  BOOST_TEST(read_count == 1);
+
+  // Changes within the deadband are not.
+  start_read();
+  server.float_values[10] = 1.25f;
+  for (int i = 0; i < 3; i++) {
+    dut.PollMillisecond();
+    Poll();
+  }
+  BOOST_TEST(read_count == 1);
+
+  // But they accumulate relative to what was last sent.
+  server.float_values[10] = 1.75f;
+  dut.PollMillisecond();
+  Poll();
+  BOOST_TEST(read_count == 2);
+
+  const uint8_t kExpectedData[] = {
+    0x54, 0xab,
+    0x01,  // source id
+    0x02,  // dest id
+    0x0c,  // payload size
+     0x62,  // subscription data
+      0x00,  // slot
+     0x2e,  // reply float x2
+      0x0a,  // register
+      0x00, 0x00, 0xe0, 0x3f,  // 1.75
+      0x00, 0x00, 0x00, 0x40,  // 2.0
+    0x85, 0xf3,  // CRC
+    0x00,  // null terminator
+  };
+  BOOST_TEST(std::string_view(receive_buffer, read_size) ==
+             str(kExpectedData));
+}
+
+BOOST_FIXTURE_TEST_CASE(SubscribeRequestTest, Fixture) {
+  char receive_buffer[256] = {};
+  int read_count = 0;
+  ssize_t read_size = 0;
+  auto start_read = [&]() {
+    dut_stream.side_a()->AsyncReadSome(
+        receive_buffer, [&](micro::error_code ec, ssize_t size) {
+          BOOST_TEST(!ec);
+          read_count++;
+          read_size = size;
+        });
+  };
+
+  AsyncWrite(*dut_stream.side_a(), str(kSubscribe),
+             [](micro::error_code ec) { BOOST_TEST(!ec); });
+  Poll();
+
+  // With nobody reading, the subscription data stays outstanding.
+  dut.PollMillisecond();
+  dut.PollMillisecond();
+  Poll();
+
+  // A request which arrives now must still be answered once the
+  // subscription data has been sent.
+  AsyncWrite(*dut_stream.side_a(), str(kReadSingle),
+             [](micro::error_code ec) { BOOST_TEST(!ec); });
+  Poll();
+
+  start_read();
+  Poll();
+  BOOST_TEST_REQUIRE(read_count == 1);
+  BOOST_TEST(receive_buffer[5] == 0x62);  // subscription data
+
+  start_read();
+  Poll();
+  BOOST_TEST_REQUIRE(read_count == 2);
+
+  const uint8_t kExpectedResponse[] = {
+    0x54, 0xab,
+    0x01,  // source id
+    0x02,  // dest id
+    0x0c,  // payload size
+     0x29,  // reply single int32_t
+      0x09,  // register
+      0x06, 0x07, 0x08, 0x09,  // value
+     0x29,  // reply single int32_t
+      0x10,  // register
+      0x16, 0x17, 0x18, 0x19,  // value
+    0x02, 0x72,  // CRC
+    0x00,  // null terminator
+  };
+  BOOST_TEST(std::string_view(receive_buffer, read_size) ==
+             str(kExpectedResponse));
+}
+
+BOOST_FIXTURE_TEST_CASE(RepeatedReadTest, Fixture) {
+  auto read_once = [&]() {
+    char receive_buffer[256] = {};
+    int read_count = 0;
+    ssize_t read_size = 0;
+    dut_stream.side_a()->AsyncReadSome(
+        receive_buffer, [&](micro::error_code ec, ssize_t size) {
+          BOOST_TEST(!ec);
+          read_count++;
+          read_size = size;
+        });
+
+    AsyncWrite(*dut_stream.side_a(), str(kReadSingle),
+               [](micro::error_code ec) { BOOST_TEST(!ec); });
+    Poll();
+
+    BOOST_TEST(read_count == 1);
+    return std::string(receive_buffer, read_size);
+  };
+
+  const uint8_t kExpectedResponse[] = {
+    0x54, 0xab,
+    0x01,  // source id
+    0x02,  // dest id
+    0x0c,  // payload size
+     0x29,  // reply single int32_t
+      0x09,  // register
+      0x06, 0x07, 0x08, 0x09,  // value
+     0x29,  // reply single int32_t
+      0x10,  // register
+      0x16, 0x17, 0x18, 0x19,  // value
+    0x02, 0x72,  // CRC
+    0x00,  // null terminator
+  };
+
+  BOOST_TEST(read_once() == str(kExpectedResponse));
+  BOOST_TEST(dut.stats()->request_cache_hit == 0);
+
+  BOOST_TEST(read_once() == str(kExpectedResponse));
+  BOOST_TEST(dut.stats()->request_cache_hit == 1);
+
+  // The values themselves are still read every time.
+  server.int32_values[16] = 0x29282726;
+
+  const uint8_t kExpectedResponse2[] = {
+    0x54, 0xab,
+    0x01,  // source id
+    0x02,  // dest id
+    0x0c,  // payload size
+     0x29,  // reply single int32_t
+      0x09,  // register
+      0x06, 0x07, 0x08, 0x09,  // value
+     0x29,  // reply single int32_t
+      0x10,  // register
+      0x26, 0x27, 0x28, 0x29,  // value
+    0x88, 0xa8,  // CRC
+    0x00,  // null terminator
+  };
+
+  BOOST_TEST(read_once() == str(kExpectedResponse2));
+  BOOST_TEST(dut.stats()->request_cache_hit == 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(SteadyStateAllocationTest, Fixture) {
+  char receive_buffer[256] = {};
+  int read_count = 0;
+  auto read_once = [&]() {
+    dut_stream.side_a()->AsyncReadSome(
+        receive_buffer, [&](micro::error_code ec, ssize_t) {
+          BOOST_TEST(!ec);
+          read_count++;
+        });
+
+    AsyncWrite(*dut_stream.side_a(), str(kReadSingle),
+               [](micro::error_code ec) { BOOST_TEST(!ec); });
+    Poll();
+  };
+
+  // Let any one time initialization happen.
+  for (int i = 0; i < 3; i++) { read_once(); }
+
+  base::test::AllocationCounter counter;
+  for (int i = 0; i < 10; i++) { read_once(); }
+
+  BOOST_TEST(read_count == 13);
+  BOOST_TEST(counter.allocations() == 0, counter.Report());
+}
@@ -15,7 +15,10 @@
 # limitations under the License.
 
 import asyncio
+import binascii
 import io
+import os
+import struct
 import unittest
 
 
@@ -122,6 +125,56 @@ class MultiplexProtocolTest(unittest.TestCase):
     def test_multiplex_client_write(self):
         _run(self.async_test_multiplex_client_write())
 
+    async def async_test_multiplex_client_readline(self):
+        pipe = sh.PipeStream()
+        mm = mp.MultiplexManager(pipe.side_a)
+        mc1 = mp.MultiplexClient(mm, 5)
+
+        def response(data):
+            return mp._pack_frame(
+                5, 0, bytes([0x41, 0x01, len(data)]) + data)
+
+        async def server():
+            for data in [b'\r\nfirst\r', b'\nsec', b'ond\n']:
+                await pipe.side_b.read(10)
+                pipe.side_b.write(response(data))
+                await pipe.side_b.drain()
+
+        async def client():
+            return [await mc1.readline(), await mc1.readline()]
+
+        results = await asyncio.gather(server(), client())
+        self.assertEqual(results[1], [b'first', b'second'])
+
+    def test_multiplex_client_readline(self):
+        _run(self.async_test_multiplex_client_readline())
+
+    def test_pack_frame(self):
+        for source, dest, payload, size in [
+                (0x00, 0x05, b'', [0x00]),
+                (0x80, 0x7f, b'\x40\x01\x04test', [0x07]),
+                (0x01, 0x02, bytes(range(200)), [0xc8, 0x01]),
+        ]:
+            frame = mp._pack_frame(source, dest, payload)
+            header = bytes([0x54, 0xab, source, dest] + size)
+            self.assertEqual(frame[0:len(header)], header)
+            self.assertEqual(frame[len(header):-2], payload)
+            self.assertEqual(
+                struct.unpack('<H', frame[-2:])[0],
+                binascii.crc_hqx(frame[0:-2], 0xffff))
+
+    def test_write_varuint(self):
+        for value, expected in [
+                (0, [0x00]),
+                (0x7f, [0x7f]),
+                (0x85, [0x85, 0x01]),
+                (0x4085, [0x85, 0x81, 0x01]),
+                (2 ** 32 - 1, [0xff, 0xff, 0xff, 0xff, 0x0f]),
+        ]:
+            stream = io.BytesIO()
+            mp.write_varuint(stream, value)
+            self.assertEqual(stream.getvalue(), bytes(expected))
+
 
 class RegisterTest(unittest.TestCase):
     async def async_test_simple_parse_register(self):
@@ -155,6 +208,62 @@ class RegisterTest(unittest.TestCase):
     def test_simple_parse_register(self):
         _run(self.async_test_simple_parse_register())
 
+    async def async_test_parse_register_error(self):
+        result = await mp.ParseRegisterReply(
+            bytes([0x28, 0x03, 0x02, 0x29, 0x04, 0x05, 0x20, 0x06, 0x07]))
+        self.assertEqual(sorted(result.keys()), [3, 4, 6])
+        self.assertEqual(result[3].error, 2)
+        self.assertEqual(result[4].error, 5)
+        self.assertEqual(result[6], mp.RegisterValue(7, 0))
+
+        # Unknown subframes terminate parsing.
+        result = await mp.ParseRegisterReply(
+            bytes([0x20, 0x01, 0x02, 0x50, 0x20, 0x03, 0x04]))
+        self.assertEqual(result, { 1 : mp.RegisterValue(2, 0) })
+
+    def test_parse_register_error(self):
+        _run(self.async_test_parse_register_error())
+
+    def test_register_request(self):
+        request = mp.RegisterRequest()
+        request.read_single(0x10, 1)
+        request.read_multiple(0x200, 3, 3)
+        request.write_single(0x05, mp.RegisterValue(-2, 2))
+        request.write_multiple(0x06, [mp.RegisterValue(1, 1),
+                                      mp.RegisterValue(-1, 1)])
+        request.write_single(0x07, mp.RegisterValue(1.0, 3))
+        self.assertEqual(request.data.getvalue(), bytes([
+            0x19, 0x10,
+            0x1f, 0x80, 0x04, 0x03,
+            0x12, 0x05, 0xfe, 0xff, 0xff, 0xff,
+            0x15, 0x06, 0x02, 0x01, 0x00, 0xff, 0xff,
+            0x13, 0x07, 0x00, 0x00, 0x80, 0x3f]))
+
+
+class _PythonOnly:
+    '''Runs the tests without the native extension, if it exists.'''
+    def setUp(self):
+        self._native = mp._native
+        mp._native = None
+
+    def tearDown(self):
+        mp._native = self._native
+
+
+class PythonMultiplexProtocolTest(_PythonOnly, MultiplexProtocolTest):
+    pass
+
+
+class PythonRegisterTest(_PythonOnly, RegisterTest):
+    pass
+
+
+class NativeTest(unittest.TestCase):
+    @unittest.skipUnless(os.environ.get('MJLIB_MULTIPLEX_NATIVE'),
+                         'the native extension is not built')
+    def test_available(self):
+        self.assertIsNotNone(mp._native)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,228 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/recording_frame_stream.h"
+
+#include <optional>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/io/debug_deadline_service.h"
+#include "mjlib/io/stream_pipe_factory.h"
+#include "mjlib/io/test/reader.h"
+#include "mjlib/multiplex/replay_frame_stream.h"
+#include "mjlib/multiplex/rs485_frame_stream.h"
+#include "mjlib/telemetry/binary_read_archive.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace mp = mjlib::multiplex;
+
+namespace {
+struct Fixture {
+  Fixture() {
+    debug_service->SetTime(
+        boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)));
+  }
+
+  void Poll() {
+    context.poll();
+    context.reset();
+  }
+
+  void Advance(int ms) {
+    debug_service->SetTime(
+        debug_service->now() + boost::posix_time::milliseconds(ms));
+    Poll();
+  }
+
+  void Read(mp::FrameStream* stream,
+            boost::posix_time::time_duration timeout = {}) {
+    read_result = {};
+    stream->AsyncRead(&read_frame, timeout, [&](const base::error_code& ec) {
+        read_result = ec;
+      });
+  }
+
+  // Record a single request and two replies spaced in time.
+  void Record() {
+    io::StreamPipeFactory pipe_factory{context.get_executor()};
+    io::SharedStream client_side{pipe_factory.GetStream("", 1)};
+    io::SharedStream server_side{pipe_factory.GetStream("", 0)};
+    io::test::Reader server_reader{server_side.get()};
+    mp::Rs485FrameStream base{context.get_executor(), {}, client_side.get()};
+
+    telemetry::FileWriter writer{tempfile.native()};
+    mp::RecordingFrameStream dut{&base, &writer};
+
+    mp::Frame request{1, true, 2, "\x11\x01"};
+    int write_done = 0;
+    dut.AsyncWrite(&request, [&](const base::error_code& ec) {
+        base::FailIf(ec);
+        write_done++;
+      });
+    Poll();
+    BOOST_TEST(write_done == 1);
+    BOOST_TEST(server_reader.data() == request.encode());
+
+    for (const auto& reply : replies) {
+      Advance(10);
+      const auto encoded = reply.encode();
+      boost::asio::async_write(
+          *server_side, boost::asio::buffer(encoded),
+          [](auto&& ec, auto&&) { base::FailIf(ec); });
+      Read(&dut);
+      Poll();
+      BOOST_TEST_REQUIRE(!!read_result);
+      BOOST_TEST(!*read_result);
+      BOOST_TEST(read_frame.payload == reply.payload);
+      Advance(10);
+    }
+  }
+
+  boost::asio::io_context context;
+  io::DebugDeadlineService* const debug_service{
+    io::DebugDeadlineService::Install(context)};
+  base::TemporaryFile tempfile;
+
+  const std::vector<mp::Frame> replies = {
+    {2, false, 1, "\x21\x01\x05"},
+    {2, false, 1, "\x21\x01\x06"},
+  };
+
+  mp::Frame read_frame;
+  std::optional<base::error_code> read_result;
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(RecordingFrameStreamTest, Fixture) {
+  Record();
+
+  telemetry::FileReader reader{tempfile.native()};
+  std::vector<mp::RecordedFrame> records;
+  for (const auto& item : reader.items()) {
+    records.push_back(
+        telemetry::BinaryReadArchive::Read<mp::RecordedFrame>(item.data));
+  }
+
+  BOOST_TEST_REQUIRE(records.size() == 3);
+  BOOST_TEST(records[0].received == false);
+  BOOST_TEST(records[0].source_id == 1);
+  BOOST_TEST(records[0].dest_id == 2);
+  BOOST_TEST(records[0].request_reply == true);
+  BOOST_TEST(records[0].payload == base::Bytes({0x11, 0x01}));
+
+  BOOST_TEST(records[1].received == true);
+  BOOST_TEST(records[1].source_id == 2);
+  BOOST_TEST(records[1].dest_id == 1);
+  BOOST_TEST(records[1].payload == base::Bytes({0x21, 0x01, 0x05}));
+  BOOST_TEST(records[2].payload == base::Bytes({0x21, 0x01, 0x06}));
+}
+
+BOOST_FIXTURE_TEST_CASE(ReplayFrameStreamTimedTest, Fixture) {
+  Record();
+
+  telemetry::FileReader reader{tempfile.native()};
+  mp::ReplayFrameStream dut{context.get_executor(), &reader};
+
+  // Writes are accepted and ignored.
+  mp::Frame request{1, true, 2, "\x11\x01"};
+  int write_done = 0;
+  dut.AsyncWrite(&request, [&](const base::error_code& ec) {
+      base::FailIf(ec);
+      write_done++;
+    });
+
+  // The first received frame is available immediately.
+  Read(&dut);
+  Poll();
+  BOOST_TEST(write_done == 1);
+  BOOST_TEST_REQUIRE(!!read_result);
+  BOOST_TEST(!*read_result);
+  BOOST_TEST(read_frame.source_id == 2);
+  BOOST_TEST(read_frame.payload == replies[0].payload);
+
+  // The second was recorded 20ms later.  A read which times out
+  // before then leaves it queued.
+  Read(&dut, boost::posix_time::milliseconds(5));
+  Poll();
+  BOOST_TEST(!read_result);
+  Advance(6);
+  BOOST_TEST_REQUIRE(!!read_result);
+  BOOST_TEST(*read_result == boost::asio::error::operation_aborted);
+  BOOST_TEST(!dut.read_data_queued());
+
+  Read(&dut);
+  Advance(10);
+  BOOST_TEST(!read_result);
+  Advance(5);
+  BOOST_TEST_REQUIRE(!!read_result);
+  BOOST_TEST(!*read_result);
+  BOOST_TEST(read_frame.payload == replies[1].payload);
+
+  Read(&dut);
+  Poll();
+  BOOST_TEST_REQUIRE(!!read_result);
+  BOOST_TEST(*read_result == boost::asio::error::eof);
+}
+
+BOOST_FIXTURE_TEST_CASE(ReplayFrameStreamScaledTest, Fixture) {
+  Record();
+
+  telemetry::FileReader reader{tempfile.native()};
+
+  {
+    mp::ReplayFrameStream::Options options;
+    options.speed = 4.0;
+    mp::ReplayFrameStream dut{context.get_executor(), &reader, options};
+
+    Read(&dut);
+    Poll();
+    BOOST_TEST_REQUIRE(!!read_result);
+
+    Read(&dut);
+    Advance(4);
+    BOOST_TEST(!read_result);
+    Advance(1);
+    BOOST_TEST_REQUIRE(!!read_result);
+    BOOST_TEST(!*read_result);
+    BOOST_TEST(read_frame.payload == replies[1].payload);
+  }
+
+  {
+    mp::ReplayFrameStream::Options options;
+    options.speed = 0.0;
+    mp::ReplayFrameStream dut{context.get_executor(), &reader, options};
+
+    BOOST_TEST(dut.read_data_queued());
+    for (const auto& reply : replies) {
+      Read(&dut);
+      Poll();
+      BOOST_TEST_REQUIRE(!!read_result);
+      BOOST_TEST(!*read_result);
+      BOOST_TEST(read_frame.payload == reply.payload);
+    }
+    BOOST_TEST(!dut.read_data_queued());
+
+    Read(&dut);
+    Poll();
+    BOOST_TEST_REQUIRE(!!read_result);
+    BOOST_TEST(*read_result == boost::asio::error::eof);
+  }
+}
@@ -105,3 +105,31 @@ BOOST_AUTO_TEST_CASE(ParseRegisterReplyTest) {
     BOOST_TEST(dut.size() == 0);
   }
 }
+
+BOOST_AUTO_TEST_CASE(SubscribeRegisterTest) {
+  {
+    RegisterRequest dut;
+    dut.Subscribe(0, 2, -1.0f, 0x0a, 2, 3);
+    BOOST_TEST(dut.buffer() ==
+               std::string_view("\x60\x00\x02\x00\x00\x80\xbf\x1e\x0a", 9));
+    BOOST_TEST(dut.request_reply() == false);
+  }
+
+  {
+    RegisterRequest dut;
+    dut.Unsubscribe(1);
+    BOOST_TEST(dut.buffer() == std::string_view("\x61\x01", 2));
+  }
+
+  {
+    const std::string data("\x62\x01\x21\x03\x04", 5);
+    base::FastIStringStream stream(data);
+    const auto maybe_slot = mjlib::multiplex::ParseSubscriptionData(stream);
+    BOOST_TEST_REQUIRE(!!maybe_slot);
+    BOOST_TEST(*maybe_slot == 1);
+
+    const auto reply = ParseRegisterReply(stream);
+    BOOST_TEST(reply.size() == 1);
+    BOOST_TEST((reply.at(3) == ReadResult(Value(static_cast<int8_t>(4)))));
+  }
+}
@@ -0,0 +1,83 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/stream_asio_client.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/test/allocation_counter.h"
+#include "mjlib/io/stream_pipe_factory.h"
+
+#include "mjlib/multiplex/rs485_frame_stream.h"
+
+namespace base = mjlib::base;
+namespace io = mjlib::io;
+namespace mp = mjlib::multiplex;
+using mp::StreamAsioClient;
+
+BOOST_AUTO_TEST_CASE(StreamAsioClientSteadyStateAllocation) {
+  // Transactions are not yet allocation free, (type erased callbacks,
+  // ExclusiveCommand and asio handlers all contribute).  This is a
+  // ceiling for each transaction, including the server side reads and
+  // writes of this test, a little above what is currently measured.
+  constexpr size_t kMaxAllocationsPerTransmit = 48;
+
+  boost::asio::io_context context;
+  io::StreamPipeFactory pipe_factory{context.get_executor()};
+  io::SharedStream client_side{pipe_factory.GetStream("", 1)};
+  io::SharedStream server_side{pipe_factory.GetStream("", 0)};
+  mp::Rs485FrameStream frame_stream{
+    context.get_executor(), {}, client_side.get()};
+  StreamAsioClient dut{&frame_stream};
+
+  mp::RegisterRequest register_request;
+  register_request.ReadSingle(3, 0);
+  mp::AsioClient::Request request = {{2, register_request}};
+  mp::AsioClient::Reply reply;
+
+  char server_buffer[64] = {};
+  int transmit_done = 0;
+
+  auto transmit_once = [&]() {
+    dut.AsyncTransmit(&request, &reply, [&](const base::error_code& ec) {
+        base::FailIf(ec);
+        transmit_done++;
+      });
+    server_side->async_read_some(
+        boost::asio::buffer(server_buffer),
+        [&](auto&& ec, size_t) {
+          base::FailIf(ec);
+          boost::asio::async_write(
+              *server_side,
+              boost::asio::buffer("\x54\xab\x02\x00\x03\x21\x03\x04\xaa\xcf",
+                                  10),
+              [&](auto&& ec, size_t) { base::FailIf(ec); });
+        });
+    context.poll();
+    context.reset();
+  };
+
+  for (int i = 0; i < 3; i++) { transmit_once(); }
+
+  base::test::AllocationCounter counter;
+  for (int i = 0; i < 10; i++) { transmit_once(); }
+
+  BOOST_TEST(transmit_done == 13);
+  BOOST_TEST(reply.size() == 1);
+  BOOST_TEST(counter.allocations() <= 10 * kMaxAllocationsPerTransmit,
+             counter.Report());
+}
@@ -399,3 +399,222 @@ BOOST_FIXTURE_TEST_CASE(StreamAsioClientTunnelReadFlushRace, Fixture) {
                          "\x54\xab\x80\x02\x03\x40\x04\x00\x01\xa1",
                          20));
 }
+
+BOOST_FIXTURE_TEST_CASE(StreamAsioClientSubscription, Fixture) {
+  std::vector<mp::AsioClient::Reply> received;
+  dut.AddSubscriptionCallback(
+      2, 1, [&](const mp::AsioClient::Reply& reply) {
+        received.push_back(reply);
+      });
+
+  Poll();
+  BOOST_TEST(received.size() == 0);
+
+  const std::string kSubscriptionData(
+      "\x54\xab\x02\x00\x05\x62\x01\x21\x03\x04\x18\xf5", 12);
+  const std::string kReply("\x54\xab\x02\x00\x03\x21\x03\x04\xaa\xcf", 10);
+
+  // Data which arrives while idle is dispatched.
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kSubscriptionData),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  BOOST_TEST_REQUIRE(received.size() == 1);
+  BOOST_TEST_REQUIRE(received[0].size() == 1);
+  BOOST_TEST(received[0][0].id == 2);
+  BOOST_TEST(received[0][0].reg == 3);
+  BOOST_TEST((received[0][0].value == mp::Format::ReadResult(
+                  mp::Format::Value(static_cast<int8_t>(4)))));
+
+  // Requests can still be made, and data arriving before their reply
+  // is dispatched rather than being mistaken for it.
+  mp::RegisterRequest request;
+  request.ReadSingle(3, 0);
+  AsyncRegister(request);
+  Poll();
+  BOOST_TEST(register_done == 0);
+  BOOST_TEST(server_reader.data().size() == 9u);
+
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kSubscriptionData + kReply),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  BOOST_TEST(received.size() == 2);
+  BOOST_TEST(register_done == 1);
+  BOOST_TEST(reply.size() == 1);
+
+  // And we go back to listening afterwards.
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kSubscriptionData),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+  BOOST_TEST(received.size() == 3);
+
+  dut.RemoveSubscriptionCallback(2, 1);
+  Poll();
+
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kSubscriptionData),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+  BOOST_TEST(received.size() == 3);
+}
+
+namespace {
+const std::string kDiscoverReply2(
+    "\x54\xab\x02\x00\x03\x21\x00\x05\xd8\x8a", 10);
+}
+
+BOOST_FIXTURE_TEST_CASE(StreamAsioClientDiscover, Fixture) {
+  mp::AsioClient::DiscoverOptions options;
+  options.ids = {1, 2, 3};
+  options.window = 3;
+  options.min_timeout = boost::posix_time::milliseconds(2);
+  options.max_timeout = boost::posix_time::milliseconds(10);
+
+  debug_service->SetTime(
+      boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)));
+
+  mp::AsioClient::Discovery discovery;
+  int discover_done = 0;
+  dut.AsyncDiscover(options, &discovery, [&](const base::error_code& ec) {
+      base::FailIf(ec);
+      discover_done++;
+    });
+
+  Poll();
+
+  // All three probes are sent at once.
+  BOOST_TEST(server_reader.data() ==
+             std::string("\x54\xab\x80\x01\x02\x11\x00\x53\xf2"
+                         "\x54\xab\x80\x02\x02\x11\x00\x8f\x69"
+                         "\x54\xab\x80\x03\x02\x11\x00\x3b\x1f", 27));
+
+  debug_service->SetTime(
+      debug_service->now() + boost::posix_time::milliseconds(1));
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kDiscoverReply2),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  BOOST_TEST(discover_done == 0);
+
+  // Having seen a reply after 1ms, we only wait 2ms for more.
+  debug_service->SetTime(
+      debug_service->now() + boost::posix_time::milliseconds(1));
+  Poll();
+  BOOST_TEST(discover_done == 0);
+
+  debug_service->SetTime(
+      debug_service->now() + boost::posix_time::milliseconds(2));
+  Poll();
+  BOOST_TEST(discover_done == 1);
+
+  BOOST_TEST_REQUIRE(discovery.size() == 1);
+  BOOST_TEST_REQUIRE(discovery.count(2) == 1);
+  BOOST_TEST((discovery.at(2).at(0) == mp::Format::ReadResult(
+                  mp::Format::Value(static_cast<int8_t>(5)))));
+}
+
+BOOST_FIXTURE_TEST_CASE(StreamAsioClientDiscoverComplete, Fixture) {
+  mp::AsioClient::DiscoverOptions options;
+  options.ids = {2};
+  options.window = 1;
+
+  debug_service->SetTime(
+      boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)));
+
+  mp::AsioClient::Discovery discovery;
+  int discover_done = 0;
+  dut.AsyncDiscover(options, &discovery, [&](const base::error_code& ec) {
+      base::FailIf(ec);
+      discover_done++;
+    });
+
+  Poll();
+  BOOST_TEST(discover_done == 0);
+
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kDiscoverReply2),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  // Everything probed has answered, so no timeout is needed.
+  BOOST_TEST(discover_done == 1);
+  BOOST_TEST_REQUIRE(discovery.size() == 1);
+  BOOST_TEST(discovery.count(2) == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(StreamAsioClientDiscoverBroadcast, Fixture) {
+  mp::AsioClient::DiscoverOptions options;
+  options.ids = {1, 2};
+  options.broadcast = true;
+
+  debug_service->SetTime(
+      boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)));
+
+  mp::AsioClient::Discovery discovery;
+  int discover_done = 0;
+  dut.AsyncDiscover(options, &discovery, [&](const base::error_code& ec) {
+      base::FailIf(ec);
+      discover_done++;
+    });
+
+  Poll();
+  BOOST_TEST(server_reader.data() ==
+             std::string("\x54\xab\x80\x7f\x02\x11\x00\x7c\x12", 9));
+
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kDiscoverReply2),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  debug_service->SetTime(
+      debug_service->now() + boost::posix_time::milliseconds(2));
+  Poll();
+
+  // Only the device which did not answer the broadcast is probed
+  // individually.
+  BOOST_TEST(server_reader.data() ==
+             std::string("\x54\xab\x80\x7f\x02\x11\x00\x7c\x12"
+                         "\x54\xab\x80\x01\x02\x11\x00\x53\xf2", 18));
+  BOOST_TEST(discover_done == 0);
+
+  debug_service->SetTime(
+      debug_service->now() + boost::posix_time::milliseconds(2));
+  Poll();
+  BOOST_TEST(discover_done == 1);
+  BOOST_TEST(discovery.size() == 1);
+  BOOST_TEST(discovery.count(2) == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(StreamAsioClientDiscoverUnprobed, Fixture) {
+  mp::AsioClient::DiscoverOptions options;
+  options.ids = {1};
+
+  debug_service->SetTime(
+      boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)));
+
+  mp::AsioClient::Discovery discovery;
+  int discover_done = 0;
+  dut.AsyncDiscover(options, &discovery, [&](const base::error_code& ec) {
+      base::FailIf(ec);
+      discover_done++;
+    });
+  Poll();
+
+  // A reply from an ID which was not probed, as could arrive late
+  // from an earlier window, is not recorded.
+  boost::asio::async_write(
+      *server_side, boost::asio::buffer(kDiscoverReply2),
+      [&](auto&& ec, size_t) { base::FailIf(ec); });
+  Poll();
+
+  debug_service->SetTime(
+      debug_service->now() + options.max_timeout);
+  Poll();
+  BOOST_TEST(discover_done == 1);
+  BOOST_TEST(discovery.empty());
+}
@@ -0,0 +1,58 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/multiplex/stream.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fast_stream.h"
+
+namespace base = mjlib::base;
+namespace mp = mjlib::multiplex;
+
+namespace {
+template <typename Stream>
+std::optional<uint32_t> ReadVaruint(const std::string& data,
+                                    std::streamsize* consumed = nullptr) {
+  Stream stream{data};
+  mp::ReadStream<Stream> reader{stream};
+  const auto result = reader.ReadVaruint();
+  if (consumed) { *consumed = data.size() - stream.remaining(); }
+  return result;
+}
+
+template <typename Stream>
+void TestVaruint() {
+  BOOST_TEST(*ReadVaruint<Stream>(std::string("\x00", 1)) == 0u);
+  BOOST_TEST(*ReadVaruint<Stream>("\x7f") == 0x7fu);
+  BOOST_TEST(*ReadVaruint<Stream>("\x80\x01") == 0x80u);
+  BOOST_TEST(*ReadVaruint<Stream>("\xff\xff\xff\xff\x0f") == 0xffffffffu);
+
+  // Truncated.
+  BOOST_TEST(!ReadVaruint<Stream>("\x80\x80"));
+
+  // Values which do not fit in 32 bits fail rather than being
+  // silently truncated or clamped.
+  BOOST_TEST(!ReadVaruint<Stream>("\xff\xff\xff\xff\x1f"));
+
+  std::streamsize consumed = 0;
+  BOOST_TEST(!ReadVaruint<Stream>("\x80\x80\x80\x80\x80\x01", &consumed));
+  BOOST_TEST(consumed == 5);
+}
+}
+
+BOOST_AUTO_TEST_CASE(StreamVaruintTest) {
+  TestVaruint<base::BufferReadStream>();
+  TestVaruint<base::FastIStringStream>();
+}
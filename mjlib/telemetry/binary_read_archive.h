@@ -107,7 +107,11 @@ class BinaryReadArchive : public base::VisitArchive<BinaryReadArchive> {
   void VisitHelper(const NameValuePair&,
                    std::array<T, N>* value,
                    base::PriorityTag<1>) {
-    VisitArrayHelper(*value);
+    if constexpr (IsContiguousPod<T>::value) {
+      RawReadArray(value->data(), N);
+    } else {
+      VisitArrayHelper(*value);
+    }
   }
 
   template <typename NameValuePair, typename T>
@@ -121,7 +125,18 @@ class BinaryReadArchive : public base::VisitArchive<BinaryReadArchive> {
     }
     const auto size = *maybe_size;
     value->resize(size);
-    VisitArrayHelper(*value);
+    if constexpr (IsContiguousPod<T>::value) {
+      RawReadArray(value->data(), size);
+    } else {
+      VisitArrayHelper(*value);
+    }
+  }
+
+  template <typename T>
+  void RawReadArray(T* data, std::size_t size) {
+    if (!stream_.RawRead(reinterpret_cast<char*>(data), size * sizeof(T))) {
+      error_ = true;
+    }
   }
 
   template <typename Array>
@@ -31,10 +31,9 @@ using FT = Format::Type;
 
 class BinarySchemaParser::Impl {
  public:
-  Impl(std::string_view schema, std::string_view name) {
-    base::BufferReadStream stream{schema};
-
-    root_ = ReadType(nullptr, stream, name);
+  Impl(std::string_view schema, std::string_view name)
+      : schema_(schema) {
+    root_ = ReadType(nullptr, stream_, name);
   }
 
   std::optional<Field> ReadField(
@@ -64,8 +63,10 @@ class BinarySchemaParser::Impl {
 
   Element* ReadType(const Element* parent,
                     base::ReadStream& stream_in, std::string_view name) {
-    base::RecordingStream recording_stream{stream_in};
-    telemetry::ReadStream stream{recording_stream};
+    // Every nested read is ultimately from stream_, so its offset
+    // tells us which portion of the schema this element covers.
+    const auto start = stream_.offset();
+    telemetry::ReadStream stream{stream_in};
 
     elements_.push_back({});
     auto* const result = &elements_.back();
@@ -167,7 +168,7 @@ class BinarySchemaParser::Impl {
       }
     }
 
-    result->binary_schema = recording_stream.str();
+    result->binary_schema = schema_.substr(start, stream_.offset() - start);
     return result;
   }
 
@@ -232,6 +233,10 @@ class BinarySchemaParser::Impl {
 
  private:
 
+  // Each Element::binary_schema is a substring of this.
+  const std::string schema_;
+  base::BufferReadStream stream_{schema_};
+
   const Element* root_;
 
   // We use a deque, so push_back doesn't invalidate existing
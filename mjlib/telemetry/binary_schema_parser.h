@@ -28,6 +28,11 @@ namespace telemetry {
 /// mechanisms for reading the contained fields and extracting data
 /// from data records formatted with this schema dynamically at
 /// runtime.
+///
+/// All Elements are owned by the parser and stored contiguously.  They
+/// keep their own names, children and fields in ordinary containers,
+/// as those are part of the interface.  FileReader avoids most of that
+/// cost by only constructing a parser for records which are used.
 class BinarySchemaParser {
  private:
   class Impl;
@@ -56,6 +61,8 @@ class BinarySchemaParser {
     /// Available for all types.
 
     std::string name;
+
+    /// The portion of the schema describing this element.
     std::string binary_schema;
 
     /// If known, the fixed offset within a data record of this
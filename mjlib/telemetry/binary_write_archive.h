@@ -98,7 +98,11 @@ class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
   void VisitHelper(const NameValuePair&,
                    std::array<T, N>* value,
                    base::PriorityTag<1>) {
-    VisitArrayHelper(*value);
+    if constexpr (IsContiguousPod<T>::value) {
+      RawWriteArray(value->data(), N);
+    } else {
+      VisitArrayHelper(*value);
+    }
   }
 
   template <typename NameValuePair, typename T>
@@ -106,7 +110,16 @@ class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
                    std::vector<T>* value,
                    base::PriorityTag<1>) {
     stream_.WriteVaruint(value->size());
-    VisitArrayHelper(*value);
+    if constexpr (IsContiguousPod<T>::value) {
+      RawWriteArray(value->data(), value->size());
+    } else {
+      VisitArrayHelper(*value);
+    }
+  }
+
+  template <typename T>
+  void RawWriteArray(const T* data, std::size_t size) {
+    stream_.RawWrite({reinterpret_cast<const char*>(data), size * sizeof(T)});
   }
 
   template <typename Array>
@@ -38,6 +38,8 @@ class ErrorCategory : public boost::system::error_category {
       case errc::kDataChecksumMismatch: return "Data checksum mismatch";
       case errc::kDecompressionError: return "Decompression error";
       case errc::kTypeMismatch: return "Type mismatch";
+      case errc::kInvalidBatch: return "Invalid batch";
+      case errc::kInvalidPredicate: return "Invalid predicate";
     }
     return "unknown";
   }
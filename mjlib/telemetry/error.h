@@ -34,6 +34,8 @@ enum class errc {
   kDataChecksumMismatch,
   kDecompressionError,
   kTypeMismatch,
+  kInvalidBatch,
+  kInvalidPredicate,
 };
 
 boost::system::error_code make_error_code(errc);
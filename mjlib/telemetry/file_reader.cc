@@ -14,10 +14,15 @@
 
 #include "mjlib/telemetry/file_reader.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <unordered_map>
 
 #include <boost/crc.hpp>
 
@@ -25,7 +30,9 @@
 
 #include <snappy.h>
 
+#include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/crc_stream.h"
+#include "mjlib/base/fail.h"
 #include "mjlib/base/file_stream.h"
 #include "mjlib/base/system_error.h"
 #include "mjlib/telemetry/error.h"
@@ -34,6 +41,11 @@ namespace mjlib {
 namespace telemetry {
 
 namespace {
+template <typename T>
+uint64_t u64(T value) {
+  return static_cast<uint64_t>(value);
+}
+
 class FilePtr {
  public:
   FilePtr(std::string_view name) {
@@ -110,6 +122,187 @@ class BlockStream : public base::ReadStream {
   base::ReadStream& base_;
   std::streamsize size_;
 };
+
+using Element = BinarySchemaParser::Element;
+using FT = Format::Type;
+using Predicate = FileReader::Predicate;
+
+struct ResolvedPredicate {
+  const Predicate* predicate = nullptr;
+
+  /// Each object traversed to reach the field, and the index of the
+  /// field taken within it.
+  std::vector<std::pair<const Element*, size_t>> path;
+  const Element* element = nullptr;
+
+  /// The offset of the field within the data, if it is preceded only
+  /// by fixed size fields, otherwise -1.
+  int64_t offset = -1;
+};
+
+struct RecordPredicates {
+  /// Sorted by offset when all are fixed.
+  std::vector<ResolvedPredicate> predicates;
+
+  /// True if every predicate's field has a fixed offset, so that they
+  /// can be evaluated without decoding the entire item.
+  bool fixed = true;
+};
+
+[[noreturn]] void ThrowInvalidPredicate(const Predicate& predicate,
+                                        std::string_view reason) {
+  throw base::system_error(
+      {errc::kInvalidPredicate,
+            fmt::format("{}.{}: {}", predicate.record, predicate.field,
+                        reason)});
+}
+
+bool IsBitsOp(Predicate::Op op) {
+  return op == Predicate::kAnyBitsSet ||
+      op == Predicate::kAllBitsSet ||
+      op == Predicate::kNoBitsSet;
+}
+
+ResolvedPredicate ResolvePredicate(const Predicate& predicate,
+                                   const BinarySchemaParser& schema) {
+  ResolvedPredicate result;
+  result.predicate = &predicate;
+
+  const Element* element = schema.root();
+  int64_t offset = 0;
+  std::string_view remaining = predicate.field;
+  while (!remaining.empty()) {
+    const auto dot = remaining.find('.');
+    const auto name = remaining.substr(0, dot);
+    remaining = (dot == std::string_view::npos) ?
+        std::string_view() : remaining.substr(dot + 1);
+
+    if (element->type != FT::kObject) {
+      ThrowInvalidPredicate(predicate, "not an object");
+    }
+    const auto& fields = element->fields;
+    const auto it = std::find_if(
+        fields.begin(), fields.end(), [&](const auto& field) {
+          return field.name == name ||
+              std::count(field.aliases.begin(), field.aliases.end(), name);
+        });
+    if (it == fields.end()) {
+      ThrowInvalidPredicate(predicate, "field not found");
+    }
+    result.path.push_back({element, it - fields.begin()});
+    for (auto prior = fields.begin(); prior != it && offset >= 0; ++prior) {
+      const auto size = prior->element->maybe_fixed_size;
+      offset = (size < 0) ? -1 : (offset + size);
+    }
+    element = it->element;
+  }
+
+  switch (element->type) {
+    case FT::kBoolean:
+    case FT::kFixedInt:
+    case FT::kFixedUInt:
+    case FT::kVarint:
+    case FT::kVaruint:
+    case FT::kEnum:
+    case FT::kTimestamp:
+    case FT::kDuration: {
+      break;
+    }
+    case FT::kFloat32:
+    case FT::kFloat64: {
+      if (IsBitsOp(predicate.op)) {
+        ThrowInvalidPredicate(predicate, "bit tests require an integer");
+      }
+      break;
+    }
+    default: {
+      ThrowInvalidPredicate(predicate, "not a scalar");
+    }
+  }
+
+  result.element = element;
+  result.offset = offset;
+  return result;
+}
+
+struct ScalarValue {
+  double number = 0.0;
+  uint64_t bits = 0;
+};
+
+ScalarValue ReadScalar(const Element* element, base::ReadStream& stream) {
+  ScalarValue result;
+  switch (element->type) {
+    case FT::kBoolean: {
+      result.bits = element->ReadBoolean(stream) ? 1 : 0;
+      result.number = result.bits;
+      break;
+    }
+    case FT::kFixedUInt:
+    case FT::kVaruint:
+    case FT::kEnum: {
+      result.bits = element->ReadUIntLike(stream);
+      result.number = static_cast<double>(result.bits);
+      break;
+    }
+    case FT::kFixedInt:
+    case FT::kVarint:
+    case FT::kTimestamp:
+    case FT::kDuration: {
+      const int64_t value = element->ReadIntLike(stream);
+      result.bits = static_cast<uint64_t>(value);
+      result.number = static_cast<double>(value);
+      break;
+    }
+    case FT::kFloat32:
+    case FT::kFloat64: {
+      result.number = element->ReadFloatLike(stream);
+      break;
+    }
+    default: {
+      base::AssertNotReached();
+    }
+  }
+  return result;
+}
+
+bool Evaluate(const Predicate& predicate, const ScalarValue& value) {
+  switch (predicate.op) {
+    case Predicate::kEqual: { return value.number == predicate.value; }
+    case Predicate::kNotEqual: { return value.number != predicate.value; }
+    case Predicate::kLess: { return value.number < predicate.value; }
+    case Predicate::kLessEqual: { return value.number <= predicate.value; }
+    case Predicate::kGreater: { return value.number > predicate.value; }
+    case Predicate::kGreaterEqual: { return value.number >= predicate.value; }
+    case Predicate::kAnyBitsSet: {
+      return (value.bits & predicate.mask) != 0;
+    }
+    case Predicate::kAllBitsSet: {
+      return (value.bits & predicate.mask) == predicate.mask;
+    }
+    case Predicate::kNoBitsSet: {
+      return (value.bits & predicate.mask) == 0;
+    }
+  }
+  return false;
+}
+
+/// Evaluate against fully decoded data by walking the schema.
+bool EvaluateData(const RecordPredicates& predicates, std::string_view data) {
+  for (const auto& resolved : predicates.predicates) {
+    base::BufferReadStream stream{data};
+    for (const auto& [object, field_index] : resolved.path) {
+      for (size_t i = 0; i < field_index; i++) {
+        object->fields[i].element->Ignore(stream);
+      }
+    }
+    if (!Evaluate(*resolved.predicate,
+                  ReadScalar(resolved.element, stream))) {
+      return false;
+    }
+  }
+  return true;
+}
 }  // namespace
 
 class Filter {
@@ -117,6 +310,11 @@ class Filter {
   virtual ~Filter() {}
   virtual bool check(FileReader::Identifier) = 0;
   virtual void new_schema(FileReader::Identifier, const std::string&) = 0;
+
+  /// Return any predicates which items of @p record must satisfy.
+  virtual const RecordPredicates* predicates(const FileReader::Record*) {
+    return nullptr;
+  }
 };
 
 struct FileReader::ItemRangeContext : public Filter {
@@ -127,6 +325,12 @@ struct FileReader::ItemRangeContext : public Filter {
   std::set<FileReader::Identifier> ids;
   FileReader::ItemsOptions options;
 
+  // Resolved against each record's schema the first time one of its
+  // items is encountered.  Records without predicates map to
+  // nullopt.
+  std::map<FileReader::Identifier,
+           std::optional<RecordPredicates>> resolved;
+
   bool check(Identifier identifier) override {
     if (options.records.empty()) { return true; }
     if (ids.count(identifier)) { return true; }
@@ -139,6 +343,37 @@ struct FileReader::ItemRangeContext : public Filter {
       ids.insert(identifier);
     }
   }
+
+  const RecordPredicates* predicates(const Record* record) override {
+    if (options.predicates.empty()) { return nullptr; }
+
+    auto it = resolved.find(record->identifier);
+    if (it == resolved.end()) {
+      std::optional<RecordPredicates> result;
+      for (const auto& predicate : options.predicates) {
+        if (predicate.record != record->name) { continue; }
+        if (!result) { result.emplace(); }
+        result->predicates.push_back(
+            ResolvePredicate(predicate, *record->schema));
+      }
+
+      if (result) {
+        auto& items = result->predicates;
+        result->fixed = std::all_of(
+            items.begin(), items.end(), [](const auto& item) {
+              return item.offset >= 0;
+            });
+        if (result->fixed) {
+          std::stable_sort(
+              items.begin(), items.end(), [](const auto& a, const auto& b) {
+                return a.offset < b.offset;
+              });
+        }
+      }
+      it = resolved.emplace(record->identifier, std::move(result)).first;
+    }
+    return it->second ? &*it->second : nullptr;
+  }
 };
 
 class FileReader::Impl {
@@ -167,6 +402,7 @@ class FileReader::Impl {
   }
 
   ItemRange items(const ItemsOptions& options) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     auto context = std::make_shared<ItemRangeContext>();
     context->impl = this;
     context->options = options;
@@ -215,8 +451,7 @@ class FileReader::Impl {
       if (it != id_to_record_.end()) { return it->second; }
     }
 
-    records_.push_back({});
-    auto& record = records_.back();
+    auto& record = records_.emplace_back();
 
     record.identifier = identifier;
     record.flags = stream.ReadVaruint().value();
@@ -230,8 +465,7 @@ class FileReader::Impl {
     record.raw_schema.resize(block_stream.remaining());
     block_stream.read(record.raw_schema);
 
-    record.schema = std::make_unique<BinarySchemaParser>(
-        record.raw_schema, record.name);
+    record.schema.Set(record.raw_schema, record.name);
 
     id_to_record_[identifier] = &record;
     name_to_record_[record.name] = &record;
@@ -243,6 +477,7 @@ class FileReader::Impl {
   }
 
   std::pair<Index, Index> ReadUntil(Index start, Filter* filter) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     fptr_.Seek(start);
 
     while (true) {
@@ -264,8 +499,16 @@ class FileReader::Impl {
           const auto identifier = stream.ReadVaruint().value();
           if (!filter->check(identifier)) { break; }
 
-          // This is what we want!
           const auto next = fptr_.Tell() + block_stream.remaining();
+
+          const auto* predicates =
+              filter->predicates(id_to_record_.at(identifier));
+          if (predicates &&
+              !MatchesPredicates(start, next, block_stream, *predicates)) {
+            break;
+          }
+
+          // This is what we want!
           return std::make_pair(start, next);
         }
         case Format::BlockType::kSchema: {
@@ -281,7 +524,78 @@ class FileReader::Impl {
     }
   }
 
-  Item Read(Index index) {
+  /// Evaluate @p predicates for the data block at @p start, whose
+  /// contents after the identifier are in @p block_stream.  On
+  /// return, the file is positioned at @p next.
+  bool MatchesPredicates(Index start, Index next,
+                         BlockStream& block_stream,
+                         const RecordPredicates& predicates) {
+    if (const auto maybe_result =
+        MatchesFixedPredicates(block_stream, predicates)) {
+      block_stream.ignore(block_stream.remaining());
+      return *maybe_result;
+    }
+
+    // Fall back to decoding everything.
+    block_stream.ignore(block_stream.remaining());
+    const auto items = ReadCached(start);
+    fptr_.Seek(next);
+
+    return std::any_of(
+        items->begin(), items->end(), [&](const auto& item) {
+          return EvaluateData(predicates, item.data);
+        });
+  }
+
+  /// Attempt to evaluate @p predicates by reading only as far as the
+  /// last field tested, returning nullopt if that is not possible.
+  std::optional<bool> MatchesFixedPredicates(
+      BlockStream& block_stream, const RecordPredicates& predicates) {
+    if (!predicates.fixed) { return {}; }
+
+    telemetry::ReadStream stream{block_stream};
+    const auto flags = stream.ReadVaruint().value();
+    if (flags & u64(Format::BlockDataFlags::kPreviousOffset)) {
+      stream.ReadVaruint();
+    }
+    if (flags & u64(Format::BlockDataFlags::kTimestamp)) {
+      stream.ReadNanoTimestamp();
+    }
+    if (flags & u64(Format::BlockDataFlags::kChecksum)) {
+      stream.Read<uint32_t>();
+    }
+    const uint64_t plain_flags =
+        u64(Format::BlockDataFlags::kPreviousOffset) |
+        u64(Format::BlockDataFlags::kTimestamp) |
+        u64(Format::BlockDataFlags::kChecksum);
+    if (flags & ~plain_flags) {
+      // Compressed or batched data must be decoded in full.
+      return {};
+    }
+
+    const auto data_size = block_stream.remaining();
+    for (const auto& resolved : predicates.predicates) {
+      const auto* element = resolved.element;
+      const int64_t consumed = data_size - block_stream.remaining();
+      const int64_t to_skip = resolved.offset - consumed;
+      const int64_t size = std::max<int64_t>(element->maybe_fixed_size, 1);
+      if (to_skip < 0 || to_skip + size > block_stream.remaining()) {
+        // Either the same field is tested twice, or this record is
+        // malformed.  Either way, the slow path can handle it.
+        return {};
+      }
+      block_stream.ignore(to_skip);
+      if (!Evaluate(*resolved.predicate,
+                    ReadScalar(element, block_stream))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Read all the items in the data block at @p index.  This is a
+  /// single item unless the block is batched.
+  std::vector<Item> Read(Index index) {
     fptr_.Seek(index);
 
     base::CrcReadStream<boost::crc_32_type> crc_stream{file_};
@@ -314,7 +628,10 @@ class FileReader::Impl {
       stream.ReadVaruint(); // discard
     }
     if (check_flags(Format::BlockDataFlags::kTimestamp)) {
-      result.timestamp = stream.ReadTimestamp().value();
+      result.nano_timestamp = stream.ReadNanoTimestamp().value();
+      if (options_.ptime_timestamps) {
+        result.timestamp = base::ConvertNanoTimeToPtime(result.nano_timestamp);
+      }
     }
 
     std::optional<uint32_t> checksum;
@@ -333,6 +650,8 @@ class FileReader::Impl {
 
     const bool snappy =
         check_flags(Format::BlockDataFlags::kSnappy);
+    const bool batch =
+        check_flags(Format::BlockDataFlags::kBatch);
 
     if (flags != 0) {
       throw base::system_error(errc::kUnknownBlockDataFlag);
@@ -375,10 +694,93 @@ class FileReader::Impl {
 
     result.record = id_to_record_.at(identifier);
 
+    if (!batch) { return {std::move(result)}; }
+
+    return ExpandBatch(result);
+  }
+
+  using ItemsPtr = std::shared_ptr<const std::vector<Item>>;
+
+  /// Like Read, but consults and populates the decoded block cache.
+  ItemsPtr ReadCached(Index index) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    if (options_.block_cache_size == 0) {
+      return std::make_shared<const std::vector<Item>>(Read(index));
+    }
+
+    const auto it = cache_map_.find(index);
+    if (it != cache_map_.end()) {
+      cache_stats_.hits++;
+      cache_.splice(cache_.begin(), cache_, it->second);
+      return it->second->second;
+    }
+    cache_stats_.misses++;
+
+    auto result = std::make_shared<const std::vector<Item>>(Read(index));
+
+    cache_.emplace_front(index, result);
+    cache_map_[index] = cache_.begin();
+    while (cache_.size() > options_.block_cache_size) {
+      cache_map_.erase(cache_.back().first);
+      cache_.pop_back();
+      cache_stats_.evictions++;
+    }
     return result;
   }
 
+  CacheStats cache_stats() const {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+    return cache_stats_;
+  }
+
+  std::vector<Item> ExpandBatch(const Item& block) {
+    std::vector<Item> items;
+
+    base::BufferReadStream buffer_stream{block.data};
+    telemetry::ReadStream stream{buffer_stream};
+    const bool timestamps =
+        (block.flags & u64(Format::BlockDataFlags::kTimestamp)) != 0;
+    auto timestamp = block.nano_timestamp;
+
+    while (buffer_stream.remaining()) {
+      if (timestamps && !items.empty()) {
+        const auto delta_us = stream.ReadVarint();
+        if (!delta_us) {
+          throw base::system_error(errc::kInvalidBatch);
+        }
+        timestamp += base::NanoDuration::microseconds(*delta_us);
+      }
+
+      const auto size = stream.ReadVaruint();
+      if (!size || *size > static_cast<uint64_t>(buffer_stream.remaining())) {
+        throw base::system_error(errc::kInvalidBatch);
+      }
+
+      items.push_back({});
+      auto& item = items.back();
+      item.index = block.index;
+      item.flags = block.flags;
+      item.record = block.record;
+      if (timestamps) {
+        item.nano_timestamp = timestamp;
+        if (options_.ptime_timestamps) {
+          item.timestamp = base::ConvertNanoTimeToPtime(timestamp);
+        }
+      }
+      item.data.assign(buffer_stream.position(), *size);
+      buffer_stream.ignore(*size);
+    }
+
+    // A batch always holds at least one sample.
+    if (items.empty()) {
+      throw base::system_error(errc::kInvalidBatch);
+    }
+
+    return items;
+  }
+
   const Record* record(std::string_view name_view) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     std::string name{name_view};
     if (name_to_record_.count(name)) {
       return name_to_record_.at(name);
@@ -395,6 +797,7 @@ class FileReader::Impl {
   }
 
   std::vector<const Record*> records() {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     if (!all_records_found_) { FullScan(); }
     std::vector<const Record*> result;
     for (const auto& record : records_) {
@@ -404,12 +807,13 @@ class FileReader::Impl {
   }
 
   Index final_item() {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     if (!all_records_found_) { FullScan(); }
     return final_item_;
   }
 
   struct SeekMarkerResult {
-    boost::posix_time::ptime timestamp;
+    base::RealtimeNanoTime timestamp;
     Index index;
     SeekResult seek_result;
   };
@@ -466,7 +870,7 @@ class FileReader::Impl {
     if (flags) {
       throw base::system_error(errc::kUnknownSeekMarkerFlag);
     }
-    result.timestamp = stream.ReadTimestamp().value();
+    result.timestamp = stream.ReadNanoTimestamp().value();
     const auto nelements = stream.ReadVaruint().value();
     for (uint64_t i = 0; i < nelements; i++) {
       const auto identifier = stream.ReadVaruint().value();
@@ -524,7 +928,8 @@ class FileReader::Impl {
     }
   }
 
-  SeekResult Seek(const boost::posix_time::ptime timestamp) {
+  SeekResult Seek(const base::RealtimeNanoTime timestamp) {
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
     // We need to know about all schemas before we can do this.
     if (!all_records_found_) { FullScan(); }
 
@@ -558,8 +963,13 @@ class FileReader::Impl {
     items_options.start = low;
     items_options.end = high;
     for (const auto& item : items(items_options)) {
-      if (item.timestamp.is_not_a_date_time()) { break; }
-      if (item.timestamp > timestamp) { break; }
+      if (item.nano_timestamp.is_not_a_date_time()) { break; }
+      if (item.nano_timestamp > timestamp) {
+        // Batched blocks are written after their final sample, so
+        // later blocks may still contain earlier samples.
+        if (item.flags & u64(Format::BlockDataFlags::kBatch)) { continue; }
+        break;
+      }
       auto& current_last = result[item.record];
       if (item.index > current_last) { current_last = item.index; }
     }
@@ -657,6 +1067,12 @@ class FileReader::Impl {
   }
 
   const Options options_;
+
+  // Iterators on different threads share the file position, the
+  // records, and the block cache.  Many operations nest, for
+  // instance a scan may decode blocks to evaluate predicates.
+  mutable std::recursive_mutex mutex_;
+
   FilePtr fptr_;
   base::FileStream file_{fptr_.file()};
 
@@ -664,6 +1080,12 @@ class FileReader::Impl {
   std::map<Identifier, const Record*> id_to_record_;
   std::map<std::string, const Record*> name_to_record_;
 
+  // The most recently used decoded blocks are at the front.
+  using CacheList = std::list<std::pair<Index, ItemsPtr>>;
+  CacheList cache_;
+  std::unordered_map<Index, CacheList::iterator> cache_map_;
+  CacheStats cache_stats_;
+
   Index final_item_ = -1;
   bool has_index_ = false;
   bool all_records_found_ = false;
@@ -687,19 +1109,37 @@ bool FileReader::has_index() const {
   return impl_->has_index_;
 }
 
+FileReader::CacheStats FileReader::cache_stats() const {
+  return impl_->cache_stats();
+}
+
 FileReader::Index FileReader::final_item() {
   return impl_->final_item();
 }
 
 FileReader::SeekResult FileReader::Seek(boost::posix_time::ptime timestamp) {
+  return impl_->Seek(base::ConvertPtimeToNanoTime(timestamp));
+}
+
+FileReader::SeekResult FileReader::SeekNano(base::RealtimeNanoTime timestamp) {
   return impl_->Seek(timestamp);
 }
 
 FileReader::Item FileReader::ItemIterator::operator*() {
-  return context_->impl->Read(index_);
+  if (!items_) { Load(); }
+  return (*items_)[sample_];
 }
 
 FileReader::ItemIterator& FileReader::ItemIterator::operator++() {
+  // Step through any remaining samples of a batched block first.
+  if (!items_) { Load(); }
+  if (sample_ + 1 < items_->size()) {
+    sample_++;
+    return *this;
+  }
+  sample_ = 0;
+  items_.reset();
+
   // This first call gives us where we started at.
   auto [first, after] = context_->impl->ReadUntil(index_, context_.get());
   auto [advanced, _] = context_->impl->ReadUntil(after, context_.get());
@@ -708,7 +1148,22 @@ FileReader::ItemIterator& FileReader::ItemIterator::operator++() {
 }
 
 bool FileReader::ItemIterator::operator!=(const ItemIterator& rhs) const {
-  return index_ != rhs.index_;
+  return index_ != rhs.index_ || sample_ != rhs.sample_;
+}
+
+void FileReader::ItemIterator::Load() {
+  items_ = context_->impl->ReadCached(index_);
+
+  // Batched blocks may have some samples which do not match.
+  if (items_->size() <= 1) { return; }
+  const auto* predicates = context_->predicates(items_->front().record);
+  if (!predicates) { return; }
+
+  auto filtered = std::make_shared<std::vector<Item>>();
+  for (const auto& item : *items_) {
+    if (EvaluateData(*predicates, item.data)) { filtered->push_back(item); }
+  }
+  items_ = filtered;
 }
 
 FileReader::ItemIterator FileReader::ItemRange::begin() {
@@ -15,10 +15,15 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
+#include "mjlib/base/nano_time.h"
 #include "mjlib/telemetry/binary_schema_parser.h"
 #include "mjlib/telemetry/format.h"
 
@@ -26,6 +31,9 @@ namespace mjlib {
 namespace telemetry {
 
 /// Read log files with a format as described in README.md
+///
+/// A FileReader may be shared between threads, each with its own
+/// ItemRange.  A single ItemRange or iterator must not be.
 class FileReader {
  private:
   class Impl;
@@ -33,9 +41,23 @@ class FileReader {
   struct Options {
     bool verify_checksums = true;
 
+    /// When false, Item::timestamp is left as not_a_date_time and
+    /// only Item::nano_timestamp is populated.
+    bool ptime_timestamps = true;
+
+    /// The number of decoded data blocks to retain, shared between
+    /// all iterators and seeks of this reader.  0 disables caching.
+    size_t block_cache_size = 64;
+
     Options() {}
   };
 
+  struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
   FileReader(std::string_view filename, const Options& options = {});
   ~FileReader();
 
@@ -44,6 +66,36 @@ class FileReader {
   /// An opaque token used to refer to positions in the log file.
   using Index = int64_t;
 
+  /// Parses a schema the first time it is accessed, so that logs
+  /// with many records can be opened without parsing schemas which
+  /// are never used.  Any parse error is reported at that time.
+  class LazySchemaParser {
+   public:
+    LazySchemaParser() {}
+
+    /// Both are aliased and must outlive this instance.
+    void Set(std::string_view schema, std::string_view name) {
+      schema_ = schema;
+      name_ = name;
+    }
+
+    const BinarySchemaParser* get() const {
+      std::call_once(once_, [this]() {
+          parser_ = std::make_unique<BinarySchemaParser>(schema_, name_);
+        });
+      return parser_.get();
+    }
+
+    const BinarySchemaParser* operator->() const { return get(); }
+    const BinarySchemaParser& operator*() const { return *get(); }
+
+   private:
+    std::string_view schema_;
+    std::string_view name_;
+    mutable std::once_flag once_;
+    mutable std::unique_ptr<BinarySchemaParser> parser_;
+  };
+
   struct Record {
     /// An arbitrary identifier.  Should typically not be used by
     /// clients.
@@ -51,7 +103,7 @@ class FileReader {
 
     std::string name;
     std::string raw_schema;
-    std::unique_ptr<BinarySchemaParser> schema;
+    LazySchemaParser schema;
 
     /// The flags as set in the log, corresponding to
     /// Format::BlockSchemaFlags
@@ -63,6 +115,10 @@ class FileReader {
 
   bool has_index() const;
 
+  /// Statistics for the decoded block cache.  It may be accessed
+  /// from any thread.
+  CacheStats cache_stats() const;
+
   Index final_item();
 
   /// The most recent index for all known records.  If no instance
@@ -74,18 +130,70 @@ class FileReader {
   /// timestamp.
   SeekResult Seek(boost::posix_time::ptime timestamp);
 
+  template <typename Clock>
+  SeekResult Seek(base::NanoTime<Clock> timestamp) {
+    static_assert(std::is_same_v<Clock, base::RealtimeClock>,
+                  "log timestamps must be realtime");
+    return SeekNano(timestamp);
+  }
+
+  /// A test on a single scalar field of one record.
+  struct Predicate {
+    enum Op {
+      kEqual,
+      kNotEqual,
+      kLess,
+      kLessEqual,
+      kGreater,
+      kGreaterEqual,
+
+      /// The following test the field, which must be an integer,
+      /// enum, or boolean, against mask.
+      kAnyBitsSet,
+      kAllBitsSet,
+      kNoBitsSet,
+    };
+
+    std::string record;
+
+    /// A '.' separated path of field names from the record root.
+    /// Only object fields may be traversed.
+    std::string field;
+
+    Op op = kEqual;
+
+    /// Comparisons are performed after converting the field to
+    /// double.
+    double value = 0.0;
+    uint64_t mask = 0;
+  };
+
   struct ItemsOptions {
     std::vector<std::string> records;
     Index start = -1;
     Index end = -1;
 
+    /// Only items for which every predicate naming their record is
+    /// true are returned.  Items of records with no predicates are
+    /// unaffected.
+    ///
+    /// When a field has a fixed offset and the block is neither
+    /// compressed nor batched, only the bytes up to that field are
+    /// read for items which do not match.  Otherwise, the item is
+    /// decoded in full to evaluate it.  Invalid predicates throw
+    /// when the first item of their record is encountered.
+    std::vector<Predicate> predicates;
+
     ItemsOptions() {}
   };
 
   struct Item {
+    /// The data block holding this item.  All samples of a batched
+    /// block share the same index.
     Index index = {};
 
     boost::posix_time::ptime timestamp;
+    base::RealtimeNanoTime nano_timestamp;
     std::string data;
 
     // Format::BlockDataFlags
@@ -106,8 +214,15 @@ class FileReader {
     bool operator!=(const ItemIterator&) const;
 
    private:
+    void Load();
+
     std::shared_ptr<ItemRangeContext> context_ = nullptr;
     Index index_ = -1;
+
+    // The decoded contents of the block at index_, and which of them
+    // is current.
+    std::shared_ptr<const std::vector<Item>> items_;
+    size_t sample_ = 0;
   };
 
   struct ItemRange {
@@ -124,6 +239,8 @@ class FileReader {
   ItemRange items(const ItemsOptions& = {});
 
  private:
+  SeekResult SeekNano(base::RealtimeNanoTime);
+
   std::unique_ptr<Impl> impl_;
 };
 
@@ -27,6 +27,7 @@ class DataFlags(enum.IntEnum):
     timestamp = 1 << 1
     checksum = 1 << 2
     snappy = 1 << 4
+    batch = 1 << 5
 
 
 class BlockType(enum.IntEnum):
@@ -133,6 +134,8 @@ class FileReader:
 
 
     def _parse_data(self, id_set, block_data):
+        '''Return a list of all items in this data block.'''
+
         result = FileReader.Item()
 
         raw_stream = io.BytesIO(block_data)
@@ -141,13 +144,13 @@ class FileReader:
         result.identifier = stream.read_varuint()
         if id_set is not None:
             if result.identifier not in id_set:
-                return None
+                return []
 
         result.flags = stream.read_varuint()
         flags = result.flags
 
         if not result.identifier in self._records:
-            return None
+            return []
 
         result.schema = self._records[result.identifier]
 
@@ -168,10 +171,48 @@ class FileReader:
             flags &= ~(DataFlags.snappy)
             result.serialized_data = snappy.uncompress(result.serialized_data)
 
+        batch = False
+        if flags & DataFlags.batch:
+            flags &= ~(DataFlags.batch)
+            batch = True
+
+        assert flags == 0  # no unknown flags
+
+        if batch:
+            return self._parse_batch(result)
+
         result.data = result.schema.reader.read(
             reader.Stream(io.BytesIO(result.serialized_data)))
 
-        assert flags == 0  # no unknown flags
+        return [result]
+
+
+    def _parse_batch(self, block):
+        result = []
+
+        raw_stream = io.BytesIO(block.serialized_data)
+        stream = reader.Stream(raw_stream)
+        timestamps = (block.flags & DataFlags.timestamp) != 0
+        if timestamps:
+            timestamp_us = round(block.timestamp * 1000000)
+
+        while raw_stream.tell() < len(block.serialized_data):
+            item = FileReader.Item()
+            item.identifier = block.identifier
+            item.flags = block.flags
+            item.schema = block.schema
+
+            if timestamps:
+                if result:
+                    delta = stream.read_varuint()
+                    timestamp_us += (delta >> 1) ^ -(delta & 1)
+                item.timestamp = timestamp_us / 1000000.0
+
+            size = stream.read_varuint()
+            item.serialized_data = raw_stream.read(size)
+            item.data = item.schema.reader.read(
+                reader.Stream(io.BytesIO(item.serialized_data)))
+            result.append(item)
 
         return result
 
@@ -191,10 +232,8 @@ class FileReader:
                 if record.name in records and id_set is not None:
                     id_set.add(record.identifier)
             elif block.btype == BlockType.Data:
-                item = self._parse_data(id_set, block.data)
-                if item is None:
-                    continue
-                yield item
+                for item in self._parse_data(id_set, block.data):
+                    yield item
 
     def get(self, records=[]):
         # A convenience interface which reads the entirety of a log
@@ -29,6 +29,7 @@
 
 #include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/fail.h"
+#include "mjlib/base/flight_recorder.h"
 #include "mjlib/base/thread_writer.h"
 
 namespace mjlib {
@@ -71,7 +72,15 @@ struct SchemaRecord {
 class FileWriter::Impl : public ThreadWriter::Reclaimer {
  public:
   Impl(const Options& options)
-      : options_(options) {}
+      : options_(options) {
+    buffers_.reserve(options_.preallocated_buffers);
+    for (int i = 0; i < options_.preallocated_buffers; i++) {
+      auto buffer = std::make_unique<ThreadWriter::OStream>();
+      buffer->data()->reserve(
+          kBufferStartPadding + options_.preallocated_buffer_size);
+      buffers_.push_back(std::move(buffer));
+    }
+  }
 
   virtual ~Impl() {
     Close();
@@ -102,6 +111,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
   void Close() {
     if (!writer_) { return; }
 
+    WriteAllBatches();
     if (options_.index_block) { WriteIndex(); }
     writer_.reset();
     last_seek_block_ = {};
@@ -110,6 +120,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
   void Flush() {
     if (!writer_) { return; }
 
+    WriteAllBatches();
     writer_->Flush();
   }
 
@@ -165,7 +176,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     writer_->Write(std::move(buffer));
   }
 
-  void WriteData(boost::posix_time::ptime timestamp,
+  void WriteData(base::RealtimeNanoTime timestamp,
                  Identifier identifier,
                  std::string_view serialized_data,
                  const WriteFlags& write_flags) {
@@ -233,7 +244,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     buffers_.push_back(std::move(buffer));
   }
 
-  void WriteSeekBlock(boost::posix_time::ptime timestamp) {
+  void WriteSeekBlock(base::RealtimeNanoTime timestamp) {
     auto buffer = GetBuffer();
     WriteStream stream(*buffer);
 
@@ -365,14 +376,156 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     return result;
   }
 
-  void WriteData(boost::posix_time::ptime timestamp,
+  void WriteData(base::RealtimeNanoTime timestamp,
                  Identifier identifier,
                  Buffer buffer,
                  const WriteFlags& write_flags) {
     if (!writer_) { return; }
 
-    uint64_t block_data_flags = 0;
+    base::FlightRecorder::Record(
+        base::FlightRecorder::kLogWrite, identifier, "telemetry");
+
+    std::optional<base::RealtimeNanoTime> timestamp_to_write;
+    if (!timestamp.is_not_a_date_time()) {
+      timestamp_to_write = timestamp;
+    } else if (options_.timestamps_system) {
+      timestamp_to_write = base::RealtimeClock::now();
+    }
+
+    const bool checksum =
+        write_flags.checksum.evaluate(options_.default_checksum_data);
+    const bool compression =
+        write_flags.compression.evaluate(options_.default_compression);
+
+    if (options_.batch_size > 1) {
+      if (timestamp_to_write) { WriteExpiredBatches(*timestamp_to_write); }
+      AddToBatch(timestamp_to_write, identifier, std::move(buffer),
+                 checksum, compression);
+    } else {
+      WriteDataBlock(timestamp_to_write, identifier, std::move(buffer),
+                     checksum, compression, 0);
+    }
+
+    if (options_.seek_block_period_s != 0.0) {
+      if (last_seek_block_.is_not_a_date_time()) {
+        last_seek_block_ = timestamp;
+      } else if (!timestamp.is_not_a_date_time() &&
+                 (timestamp - last_seek_block_) >= seek_block_period_) {
+        WriteSeekBlock(timestamp);
+        last_seek_block_ = timestamp;
+      }
+    }
+  }
+
+  struct Batch {
+    Buffer buffer;
+    int count = 0;
+    std::optional<base::RealtimeNanoTime> first_timestamp;
+    int64_t last_timestamp_us = 0;
+    bool checksum = false;
+    bool compression = false;
+  };
+
+  void AddToBatch(std::optional<base::RealtimeNanoTime> timestamp,
+                  Identifier identifier,
+                  Buffer buffer,
+                  bool checksum,
+                  bool compression) {
+    auto& batch = batches_[identifier];
+
+    if (batch.count > 0 &&
+        (batch.checksum != checksum ||
+         batch.compression != compression ||
+         !!batch.first_timestamp != !!timestamp ||
+         (timestamp && (*timestamp - *batch.first_timestamp) >=
+          batch_period_))) {
+      WriteBatch(identifier, &batch);
+    }
+
+    if (batch.count == 0) {
+      batch.buffer = GetBuffer();
+      batch.first_timestamp = timestamp;
+      if (timestamp && (oldest_batch_.is_not_a_date_time() ||
+                        *timestamp < oldest_batch_)) {
+        oldest_batch_ = *timestamp;
+      }
+      batch.checksum = checksum;
+      batch.compression = compression;
+    }
+
+    WriteStream stream(*batch.buffer);
+    if (timestamp) {
+      const auto timestamp_us =
+          base::ConvertNanoTimeToEpochMicroseconds(*timestamp);
+      if (batch.count > 0) {
+        stream.WriteVarint(timestamp_us - batch.last_timestamp_us);
+      }
+      batch.last_timestamp_us = timestamp_us;
+    }
+    stream.WriteVaruint(buffer->size());
+    stream.RawWrite(buffer->view().substr(buffer->start()));
+    batch.count++;
+
+    Reclaim(std::move(buffer));
 
+    if (batch.count >= options_.batch_size) {
+      WriteBatch(identifier, &batch);
+    }
+  }
+
+  void WriteBatch(Identifier identifier, Batch* batch) {
+    WriteDataBlock(batch->first_timestamp, identifier,
+                   std::move(batch->buffer),
+                   batch->checksum, batch->compression,
+                   u64(Format::BlockDataFlags::kBatch));
+    *batch = {};
+  }
+
+  /// Write every batch which began at least batch_period_s before
+  /// @p now, whatever its identifier, oldest first.  This bounds both
+  /// how long samples are held in memory, and how far out of
+  /// timestamp order blocks may land in the file.
+  void WriteExpiredBatches(base::RealtimeNanoTime now) {
+    if (oldest_batch_.is_not_a_date_time() ||
+        (now - oldest_batch_) < batch_period_) {
+      return;
+    }
+
+    while (true) {
+      Batch* oldest = nullptr;
+      Identifier oldest_identifier = 0;
+      for (auto& pair : batches_) {
+        auto& batch = pair.second;
+        if (batch.count == 0 || !batch.first_timestamp) { continue; }
+        if (!oldest || *batch.first_timestamp < *oldest->first_timestamp) {
+          oldest = &batch;
+          oldest_identifier = pair.first;
+        }
+      }
+
+      if (!oldest || (now - *oldest->first_timestamp) < batch_period_) {
+        oldest_batch_ = oldest ? *oldest->first_timestamp :
+            base::RealtimeNanoTime();
+        return;
+      }
+
+      WriteBatch(oldest_identifier, oldest);
+    }
+  }
+
+  void WriteAllBatches() {
+    for (auto& pair : batches_) {
+      if (pair.second.count == 0) { continue; }
+      WriteBatch(pair.first, &pair.second);
+    }
+  }
+
+  void WriteDataBlock(std::optional<base::RealtimeNanoTime> timestamp_to_write,
+                      Identifier identifier,
+                      Buffer buffer,
+                      bool write_checksum,
+                      bool compression,
+                      uint64_t block_data_flags) {
     uint64_t flag_header_size = 0;
 
     std::optional<FilePosition> previous_offset;
@@ -382,26 +535,17 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
       flag_header_size += Format::GetVaruintSize(*previous_offset);
     }
 
-    std::optional<boost::posix_time::ptime> timestamp_to_write;
-    if (!timestamp.is_not_a_date_time() || options_.timestamps_system) {
+    if (timestamp_to_write) {
       block_data_flags |= u64(Format::BlockDataFlags::kTimestamp);
       flag_header_size += 8;
-      if (!timestamp.is_not_a_date_time()) {
-        timestamp_to_write = timestamp;
-      } else {
-        timestamp_to_write =
-            boost::posix_time::microsec_clock::universal_time();
-      }
     }
 
-    bool write_checksum = false;
-    if (write_flags.checksum.evaluate(options_.default_checksum_data)) {
+    if (write_checksum) {
       block_data_flags |= u64(Format::BlockDataFlags::kChecksum);
       flag_header_size += 4;
-      write_checksum = true;
     }
 
-    if (write_flags.compression.evaluate(options_.default_compression)) {
+    if (compression) {
       // We should try to compress this data.
       const auto original_size = buffer->size();
 
@@ -416,8 +560,9 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
         // We got something better.  Add our flag and swap the buffers.
         block_data_flags |= u64(Format::BlockDataFlags::kSnappy);
         std::swap(buffer, new_buffer);
-        Reclaim(std::move(new_buffer));
       }
+      // Whichever buffer we are not writing can be used again.
+      Reclaim(std::move(new_buffer));
     }
 
     const auto identifier_size = Format::GetVaruintSize(identifier);
@@ -468,16 +613,6 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     schema_[identifier].last_position = writer_->position();
 
     Write(std::move(buffer));
-
-    if (options_.seek_block_period_s != 0.0) {
-      if (last_seek_block_.is_not_a_date_time()) {
-        last_seek_block_ = timestamp;
-      } else if (!timestamp.is_not_a_date_time() &&
-                 (timestamp - last_seek_block_) >= seek_block_period_) {
-        WriteSeekBlock(timestamp);
-        last_seek_block_ = timestamp;
-      }
-    }
   }
 
   void WriteBlock(Format::BlockType block_type,
@@ -502,8 +637,10 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
   }
 
   const Options options_;
-  const boost::posix_time::time_duration seek_block_period_{
-    mjlib::base::ConvertSecondsToDuration(options_.seek_block_period_s)};
+  const base::NanoDuration seek_block_period_{
+    static_cast<int64_t>(options_.seek_block_period_s * 1e9)};
+  const base::NanoDuration batch_period_{
+    static_cast<int64_t>(options_.batch_period_s * 1e9)};
   std::unique_ptr<ThreadWriter> writer_;
 
   std::map<std::string, Identifier> identifier_map_;
@@ -515,7 +652,11 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
   std::vector<Buffer> buffers_;
 
   std::map<Identifier, SchemaRecord> schema_;
-  boost::posix_time::ptime last_seek_block_;
+  std::map<Identifier, Batch> batches_;
+  // No pending batch began before this, although it may be earlier
+  // than the oldest which actually remains.
+  base::RealtimeNanoTime oldest_batch_;
+  base::RealtimeNanoTime last_seek_block_;
 };
 
 FileWriter::FileWriter(const Options& options)
@@ -566,7 +707,8 @@ void FileWriter::WriteData(boost::posix_time::ptime timestamp,
                            Identifier identifier,
                            std::string_view serialized_data,
                            const WriteFlags& write_flags) {
-  impl_->WriteData(timestamp, identifier, serialized_data, write_flags);
+  impl_->WriteData(base::ConvertPtimeToNanoTime(timestamp),
+                   identifier, serialized_data, write_flags);
 }
 
 void FileWriter::WriteBlock(Format::BlockType block_type,
@@ -582,6 +724,21 @@ void FileWriter::WriteData(boost::posix_time::ptime timestamp,
                            Identifier identifier,
                            Buffer buffer,
                            const WriteFlags& write_flags) {
+  impl_->WriteData(base::ConvertPtimeToNanoTime(timestamp),
+                   identifier, std::move(buffer), write_flags);
+}
+
+void FileWriter::WriteNanoData(base::RealtimeNanoTime timestamp,
+                               Identifier identifier,
+                               std::string_view serialized_data,
+                               const WriteFlags& write_flags) {
+  impl_->WriteData(timestamp, identifier, serialized_data, write_flags);
+}
+
+void FileWriter::WriteNanoData(base::RealtimeNanoTime timestamp,
+                               Identifier identifier,
+                               Buffer buffer,
+                               const WriteFlags& write_flags) {
   impl_->WriteData(timestamp, identifier, std::move(buffer), write_flags);
 }
 
@@ -19,7 +19,9 @@
 
 #include <cstdint>
 #include <string_view>
+#include <type_traits>
 
+#include "mjlib/base/nano_time.h"
 #include "mjlib/base/thread_writer.h"
 #include "mjlib/telemetry/format.h"
 
@@ -57,6 +59,26 @@ class FileWriter : boost::noncopyable {
     /// If timestamps are unspecified, use system timestamps.
     bool timestamps_system = true;
 
+    /// When greater than 1, consecutive samples of each identifier
+    /// are accumulated and written as a single batched data block of
+    /// up to this many samples, which share one block header,
+    /// checksum and compression pass.  Pending samples are written by
+    /// Flush() and Close().
+    int batch_size = 1;
+
+    /// A pending batch is also written once a sample of any
+    /// identifier arrives this long after the batch's first sample.
+    /// Thus blocks land in the file at most this far out of timestamp
+    /// order.  Batches of samples without timestamps are only written
+    /// when full, or by Flush() and Close().
+    double batch_period_s = 0.1;
+
+    /// Allocate this many buffers up front, each with room for
+    /// preallocated_buffer_size bytes.  As long as no more than this
+    /// many are outstanding at once, writes need not allocate.
+    int preallocated_buffers = 0;
+    size_t preallocated_buffer_size = 256;
+
     Options() {}
   };
 
@@ -152,7 +174,37 @@ class FileWriter : boost::noncopyable {
   void WriteBlock(Format::BlockType block_type,
                   Buffer buffer);
 
+  /// These variants of WriteData take an integer nanosecond
+  /// timestamp, and avoid ptime entirely.  The log stores
+  /// microseconds, so timestamps are truncated to that resolution.
+  /// As with ptime, a default constructed (not_a_date_time)
+  /// timestamp is obtained from the system.
+  template <typename Clock>
+  void WriteData(base::NanoTime<Clock> timestamp,
+                 Identifier identifier,
+                 std::string_view serialized_data,
+                 const WriteFlags& write_flags = {}) {
+    static_assert(std::is_same_v<Clock, base::RealtimeClock>,
+                  "log timestamps must be realtime");
+    WriteNanoData(timestamp, identifier, serialized_data, write_flags);
+  }
+
+  template <typename Clock>
+  void WriteData(base::NanoTime<Clock> timestamp,
+                 Identifier identifier,
+                 Buffer buffer,
+                 const WriteFlags& write_flags = {}) {
+    static_assert(std::is_same_v<Clock, base::RealtimeClock>,
+                  "log timestamps must be realtime");
+    WriteNanoData(timestamp, identifier, std::move(buffer), write_flags);
+  }
+
  private:
+  void WriteNanoData(base::RealtimeNanoTime, Identifier,
+                     std::string_view, const WriteFlags&);
+  void WriteNanoData(base::RealtimeNanoTime, Identifier,
+                     Buffer, const WriteFlags&);
+
   class Impl;
   std::unique_ptr<Impl> impl_;
 };
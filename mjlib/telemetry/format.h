@@ -14,7 +14,9 @@
 
 #pragma once
 
+#include <array>
 #include <optional>
+#include <type_traits>
 
 #include "mjlib/base/assert.h"
 #include "mjlib/base/bytes.h"
@@ -111,6 +113,17 @@ struct Format {
     /// The DataObject is compressed with the "snappy" compression
     /// algorithm.
     kSnappy = 1 << 4,
+
+    /// The (decompressed) DataObject holds one or more consecutive
+    /// samples of this identifier, each encoded as:
+    ///
+    ///  * varint - microseconds since the previous sample, present
+    ///    only for samples after the first when kTimestamp is set
+    ///  * varuint - size
+    ///  * size bytes of data
+    ///
+    /// The block timestamp, if any, is that of the first sample.
+    kBatch = 1 << 5,
   };
 
   static uint64_t GetVaruintSize(uint64_t value) {
@@ -124,6 +137,30 @@ struct Format {
   }
 };
 
+/// True for types whose serialized form is exactly their in-memory
+/// representation on this (little endian) host.  Contiguous runs of
+/// such types may be read and written in bulk.  bool is excluded, as
+/// arbitrary bytes are not valid bool values.
+template <typename T>
+struct IsContiguousPod : std::false_type {};
+
+template <> struct IsContiguousPod<int8_t> : std::true_type {};
+template <> struct IsContiguousPod<uint8_t> : std::true_type {};
+template <> struct IsContiguousPod<int16_t> : std::true_type {};
+template <> struct IsContiguousPod<uint16_t> : std::true_type {};
+template <> struct IsContiguousPod<int32_t> : std::true_type {};
+template <> struct IsContiguousPod<uint32_t> : std::true_type {};
+template <> struct IsContiguousPod<int64_t> : std::true_type {};
+template <> struct IsContiguousPod<uint64_t> : std::true_type {};
+template <> struct IsContiguousPod<float> : std::true_type {};
+template <> struct IsContiguousPod<double> : std::true_type {};
+
+template <typename T, std::size_t N>
+struct IsContiguousPod<std::array<T, N>>
+    : std::integral_constant<
+  bool,
+  IsContiguousPod<T>::value && sizeof(std::array<T, N>) == N * sizeof(T)> {};
+
 /// This provides C++ APIs for writing primitive types.
 class WriteStream {
  public:
@@ -176,6 +213,10 @@ class WriteStream {
     WriteScalar(base::ConvertPtimeToEpochMicroseconds(timestamp));
   }
 
+  void Write(base::RealtimeNanoTime timestamp) {
+    WriteScalar(base::ConvertNanoTimeToEpochMicroseconds(timestamp));
+  }
+
   void RawWrite(const std::string_view& data) {
     base_.write(data);
   }
@@ -231,6 +272,12 @@ class ReadStream {
     return base::ConvertEpochMicrosecondsToPtime(*maybe_data);
   }
 
+  std::optional<base::RealtimeNanoTime> ReadNanoTimestamp() {
+    const auto maybe_data = Read<int64_t>();
+    if (!maybe_data) { return {}; }
+    return base::ConvertEpochMicrosecondsToNanoTime(*maybe_data);
+  }
+
   std::optional<uint64_t> ReadVaruint() {
     uint64_t result = 0;
     int position = 0;
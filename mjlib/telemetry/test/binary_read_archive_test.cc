@@ -84,3 +84,53 @@ BOOST_AUTO_TEST_CASE(BinaryReadArchive) {
     BOOST_TEST(*another_all_types.value_optional == 9);
   }
 }
+
+namespace {
+struct BulkArrays {
+  std::array<std::array<float, 3>, 2> matrix = {};
+  std::vector<uint32_t> samples;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(matrix));
+    a->Visit(MJ_NVP(samples));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(BinaryReadArchiveBulkArrays) {
+  std::vector<uint8_t> source = {
+    0x00, 0x00, 0x80, 0x3f,  // matrix[0][0] : 1.0
+    0x00, 0x00, 0x00, 0x40,  // matrix[0][1] : 2.0
+    0x00, 0x00, 0x40, 0x40,  // matrix[0][2] : 3.0
+    0x00, 0x00, 0x80, 0x40,  // matrix[1][0] : 4.0
+    0x00, 0x00, 0xa0, 0x40,  // matrix[1][1] : 5.0
+    0x00, 0x00, 0xc0, 0x40,  // matrix[1][2] : 6.0
+    0x02,  // samples : [7, 8]
+    0x07, 0x00, 0x00, 0x00,
+    0x08, 0x00, 0x00, 0x00,
+  };
+  std::string_view source_str(
+      reinterpret_cast<const char*>(&source[0]), source.size());
+
+  {
+    const auto result =
+        telemetry::BinaryReadArchive::Read<BulkArrays>(source_str);
+    BOOST_TEST(result.matrix[0][0] == 1.0f);
+    BOOST_TEST(result.matrix[0][2] == 3.0f);
+    BOOST_TEST(result.matrix[1][0] == 4.0f);
+    BOOST_TEST(result.matrix[1][2] == 6.0f);
+    BOOST_TEST_REQUIRE(result.samples.size() == 2);
+    BOOST_TEST(result.samples[0] == 7);
+    BOOST_TEST(result.samples[1] == 8);
+  }
+
+  {
+    // A truncated bulk array is an error.
+    base::BufferReadStream stream{source_str.substr(0, 10)};
+    telemetry::BinaryReadArchive dut{stream};
+    BulkArrays result;
+    dut.Accept(&result);
+    BOOST_TEST(dut.error());
+  }
+}
@@ -450,3 +450,37 @@ BOOST_AUTO_TEST_CASE(BinarySchemaArchiveNoDefault) {
       expected,
       telemetry::BinarySchemaArchive::Write<base::test::AllTypesTest>(options));
 }
+
+namespace {
+struct BulkArrays {
+  std::array<std::array<double, 2>, 2> matrix = {{{{1.0, 2.0}}, {{3.0, 4.0}}}};
+  std::vector<int16_t> samples = {-1, 2};
+  std::array<bool, 2> flags = {{true, false}};
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(matrix));
+    a->Visit(MJ_NVP(samples));
+    a->Visit(MJ_NVP(flags));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(BinaryWriteArchiveBulkArrays) {
+  static_assert(telemetry::IsContiguousPod<
+                std::array<std::array<double, 2>, 2>>::value);
+  static_assert(!telemetry::IsContiguousPod<std::array<bool, 2>>::value);
+
+  const std::vector<uint8_t> expected = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x3f,  // matrix[0][0] : 1.0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,  // matrix[0][1] : 2.0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x40,  // matrix[1][0] : 3.0
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,  // matrix[1][1] : 4.0
+    0x02, 0xff, 0xff, 0x02, 0x00,  // samples : [-1, 2]
+    0x01, 0x00,  // flags : [true, false]
+  };
+
+  const BulkArrays bulk_arrays;
+  telemetry::test::Compare(
+      expected, telemetry::BinaryWriteArchive::Write(bulk_arrays));
+}
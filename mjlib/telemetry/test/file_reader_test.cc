@@ -14,13 +14,17 @@
 
 #include "mjlib/telemetry/file_reader.h"
 
+#include <cstring>
 #include <fstream>
+#include <thread>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/test/auto_unit_test.hpp>
 
 #include "mjlib/base/temporary_file.h"
 #include "mjlib/base/system_error.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_write_archive.h"
 #include "mjlib/telemetry/error.h"
 #include "mjlib/telemetry/file_writer.h"
 
@@ -420,3 +424,492 @@ BOOST_AUTO_TEST_CASE(SeekTest) {
                      (*items.begin()).timestamp - query)) < 200.0);
   }
 }
+
+BOOST_AUTO_TEST_CASE(NanoTimestampTest) {
+  base::TemporaryFile tempfile;
+
+  // 2020-03-10 00:00:00
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+
+  {
+    telemetry::FileWriter writer{tempfile.native()};
+    const auto id = writer.AllocateIdentifier("test");
+    writer.WriteSchema(id, "\x0a");  // string
+
+    auto timestamp = start;
+    for (int i = 0; i < 2000; i++) {
+      writer.WriteData(timestamp, id, "data");
+      timestamp += base::NanoDuration::seconds(1);
+    }
+  }
+
+  {
+    DUT dut{tempfile.native()};
+    const auto item = *dut.items().begin();
+    BOOST_TEST(item.nano_timestamp == start);
+    BOOST_TEST(item.timestamp == base::ConvertNanoTimeToPtime(start));
+  }
+
+  {
+    DUT::Options options;
+    options.ptime_timestamps = false;
+    DUT dut{tempfile.native(), options};
+
+    std::vector<DUT::Item> items;
+    for (const auto& item : dut.items()) { items.push_back(item); }
+    BOOST_TEST_REQUIRE(items.size() == 2000);
+    BOOST_TEST(items[0].timestamp.is_not_a_date_time());
+    BOOST_TEST(items[1999].nano_timestamp ==
+               start + base::NanoDuration::seconds(1999));
+
+    BOOST_TEST(dut.Seek(start - base::NanoDuration::microseconds(1)).empty());
+
+    const auto query = start + base::NanoDuration::milliseconds(1500500);
+    const auto result = dut.Seek(query);
+    BOOST_TEST_REQUIRE(result.size() == 1);
+    auto found = dut.items(
+        [&]() {
+          DUT::ItemsOptions items_options;
+          items_options.start = result.begin()->second;
+          return items_options;
+        }());
+    BOOST_TEST((*found.begin()).nano_timestamp ==
+               start + base::NanoDuration::seconds(1500));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BatchTest) {
+  // 2020-03-10 00:00:00
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+
+  auto write_log = [&](const std::string& filename, int batch_size) {
+    telemetry::FileWriter::Options options;
+    options.batch_size = batch_size;
+    telemetry::FileWriter writer{filename, options};
+    const auto fast = writer.AllocateIdentifier("fast");
+    writer.WriteSchema(fast, "\x05");  // varuint
+    const auto slow = writer.AllocateIdentifier("slow");
+    writer.WriteSchema(slow, "\x0a");  // string
+
+    // Two seconds of 1kHz data, with a slower record interleaved.
+    for (int i = 0; i < 2000; i++) {
+      const auto timestamp = start + base::NanoDuration::microseconds(i * 1000);
+      char data[1] = { static_cast<char>(i % 100) };
+      writer.WriteData(timestamp, fast, std::string_view(data, 1));
+      if (i % 250 == 0) {
+        writer.WriteData(timestamp, slow, "\x03" "abc");
+      }
+    }
+  };
+
+  base::TemporaryFile unbatched;
+  base::TemporaryFile batched;
+  write_log(unbatched.native(), 1);
+  write_log(batched.native(), 32);
+
+  BOOST_TEST(boost::filesystem::file_size(batched.native()) * 2 <
+             boost::filesystem::file_size(unbatched.native()));
+
+  DUT dut{batched.native()};
+  std::map<std::string, std::vector<DUT::Item>> items;
+  for (const auto& item : dut.items()) {
+    items[item.record->name].push_back(item);
+  }
+
+  BOOST_TEST_REQUIRE(items["fast"].size() == 2000);
+  BOOST_TEST_REQUIRE(items["slow"].size() == 8);
+  for (int i = 0; i < 2000; i++) {
+    const auto& item = items["fast"][i];
+    BOOST_TEST(item.data == std::string(1, static_cast<char>(i % 100)));
+    BOOST_TEST(item.nano_timestamp ==
+               start + base::NanoDuration::microseconds(i * 1000));
+    BOOST_TEST((item.flags &
+                static_cast<uint64_t>(
+                    telemetry::Format::BlockDataFlags::kBatch)) != 0);
+  }
+  BOOST_TEST(items["slow"][7].data == "\x03" "abc");
+  BOOST_TEST(items["slow"][7].nano_timestamp ==
+             start + base::NanoDuration::microseconds(1750000));
+
+  // Only some records can be selected.
+  {
+    DUT::ItemsOptions options;
+    options.records = {"slow"};
+    int count = 0;
+    for (const auto& item : dut.items(options)) {
+      BOOST_TEST(item.record->name == "slow");
+      count++;
+    }
+    BOOST_TEST(count == 8);
+  }
+
+  // Seeking finds the block holding the most recent sample.
+  const auto query = start + base::NanoDuration::microseconds(1500500);
+  const auto result = dut.Seek(query);
+  BOOST_TEST_REQUIRE(result.count(dut.record("fast")) == 1);
+  DUT::ItemsOptions options;
+  options.start = result.at(dut.record("fast"));
+  options.records = {"fast"};
+  bool found = false;
+  for (const auto& item : dut.items(options)) {
+    if (item.nano_timestamp ==
+        start + base::NanoDuration::microseconds(1500000)) {
+      found = true;
+      break;
+    }
+    BOOST_TEST(item.nano_timestamp < query);
+  }
+  BOOST_TEST(found);
+}
+
+BOOST_AUTO_TEST_CASE(EmptyBatchTest) {
+  std::string log_file = MakeString(
+    "TLOG0003\x00"  // file header
+    "\x01\x08"  // BlockType - Schema, size
+    "\x01\x00"  // id=1, flags = 0
+        "\x04test"  // name
+          "\x0a"  // schema
+      "\x02\x02"  // BlockType = Data, size
+      "\x01\x20"  // id=1, flags=batch, and no samples
+  );
+  TemporaryContents contents(log_file);
+
+  DUT dut{contents.native()};
+  auto consume_all = [&]() {
+    for (const auto& item : dut.items()) { (void) item; }
+  };
+
+  auto is_invalid = [](const base::system_error& error) {
+    return error.code() == telemetry::errc::kInvalidBatch;
+  };
+  BOOST_CHECK_EXCEPTION(consume_all(), base::system_error, is_invalid);
+}
+
+BOOST_AUTO_TEST_CASE(BatchPeriodTest) {
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+  base::TemporaryFile tempfile;
+
+  {
+    telemetry::FileWriter::Options options;
+    options.batch_size = 32;
+    telemetry::FileWriter writer{tempfile.native(), options};
+    const auto fast = writer.AllocateIdentifier("fast");
+    writer.WriteSchema(fast, "\x05");  // varuint
+    const auto slow = writer.AllocateIdentifier("slow");
+    writer.WriteSchema(slow, "\x0a");  // string
+
+    // The slow record is written exactly once, so its batch can only
+    // be written because the fast record moved time forward.
+    writer.WriteData(start, slow, "\x03" "abc");
+    for (int i = 0; i < 1000; i++) {
+      const auto timestamp = start + base::NanoDuration::microseconds(i * 1000);
+      char data[1] = { static_cast<char>(i % 100) };
+      writer.WriteData(timestamp, fast, std::string_view(data, 1));
+    }
+  }
+
+  DUT dut{tempfile.native()};
+  bool found_slow = false;
+  int fast_count = 0;
+  base::RealtimeNanoTime latest_before_slow = start;
+  for (const auto& item : dut.items()) {
+    if (item.record->name == "slow") {
+      found_slow = true;
+      continue;
+    }
+    fast_count++;
+    if (!found_slow) { latest_before_slow = item.nano_timestamp; }
+  }
+  BOOST_TEST(found_slow);
+  BOOST_TEST(fast_count == 1000);
+  // At most one period, plus one partial batch, precedes it.
+  BOOST_TEST(latest_before_slow <=
+             start + base::NanoDuration::milliseconds(200));
+}
+
+BOOST_AUTO_TEST_CASE(BlockCacheTest) {
+  base::TemporaryFile tempfile;
+
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+
+  {
+    telemetry::FileWriter writer{tempfile.native()};
+    const auto id = writer.AllocateIdentifier("test");
+    writer.WriteSchema(id, "\x0a");  // string
+
+    for (int i = 0; i < 100; i++) {
+      writer.WriteData(start + base::NanoDuration::seconds(i), id,
+                       "\x04" "data");
+    }
+  }
+
+  DUT::Options options;
+  options.block_cache_size = 50;
+  DUT dut{tempfile.native(), options};
+
+  std::vector<DUT::Index> indices;
+  for (const auto& item : dut.items()) {
+    BOOST_TEST(item.data == "\x04" "data");
+    indices.push_back(item.index);
+  }
+
+  BOOST_TEST_REQUIRE(indices.size() == 100);
+  BOOST_TEST(dut.cache_stats().misses == 100);
+  BOOST_TEST(dut.cache_stats().hits == 0);
+  BOOST_TEST(dut.cache_stats().evictions == 50);
+
+  // The first half has been evicted, the second half should be
+  // served from the cache.
+  DUT::ItemsOptions items_options;
+  items_options.start = indices[50];
+  int count = 0;
+  for (const auto& item : dut.items(items_options)) {
+    BOOST_TEST(item.index == indices[50 + count]);
+    count++;
+  }
+  BOOST_TEST(count == 50);
+  BOOST_TEST(dut.cache_stats().misses == 100);
+  BOOST_TEST(dut.cache_stats().hits == 50);
+
+  // A disabled cache records nothing.
+  options.block_cache_size = 0;
+  DUT uncached{tempfile.native(), options};
+  for (const auto& item : uncached.items()) { (void)item; }
+  BOOST_TEST(uncached.cache_stats().misses == 0);
+  BOOST_TEST(uncached.cache_stats().hits == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentReadersTest) {
+  base::TemporaryFile tempfile;
+
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+
+  {
+    telemetry::FileWriter::Options options;
+    options.batch_size = 8;
+    telemetry::FileWriter writer{tempfile.native(), options};
+    const auto id = writer.AllocateIdentifier("test");
+    writer.WriteSchema(id, "\x05");  // varuint
+
+    for (int i = 0; i < 2000; i++) {
+      char data[1] = { static_cast<char>(i % 100) };
+      writer.WriteData(start + base::NanoDuration::milliseconds(i), id,
+                       std::string_view(data, 1));
+    }
+  }
+
+  DUT::Options options;
+  options.block_cache_size = 16;
+  DUT dut{tempfile.native(), options};
+
+  // Several threads scan the same reader at once, some from partway
+  // through, each with their own range.
+  constexpr int kThreads = 4;
+  std::vector<std::vector<std::string>> results(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int pass = 0; pass < 3; pass++) {
+        results[t].clear();
+        for (const auto& item : dut.items()) {
+          results[t].push_back(item.data);
+        }
+        dut.Seek(start + base::NanoDuration::milliseconds(500 * t));
+      }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  for (const auto& result : results) {
+    BOOST_TEST_REQUIRE(result.size() == 2000);
+    for (int i = 0; i < 2000; i++) {
+      BOOST_TEST(result[i] == std::string(1, static_cast<char>(i % 100)));
+    }
+  }
+
+  const auto stats = dut.cache_stats();
+  BOOST_TEST(stats.hits + stats.misses >= 3u * kThreads * 2000 / 8);
+}
+
+BOOST_AUTO_TEST_CASE(LazySchemaTest) {
+  std::vector<uint8_t> log_data{
+    0x54, 0x4c, 0x4f, 0x47, 0x30, 0x30, 0x30, 0x33, 0x00,
+        0x01, 0x09,  // BlockType=Schema, size
+          0x02,  // identifier=2
+          0x00,  // flags=0
+          0x04, 0x74, 0x65, 0x73, 0x74,  // name="test"
+          0x03, 0x04,  // fixedint(4)
+        0x01, 0x08,  // BlockType=Schema, size
+          0x01,  // identifier=1
+          0x00,  // flags=0
+          0x04, 0x62, 0x61, 0x64, 0x21,  // name="bad!"
+          0x7f,  // an invalid type
+        };
+
+  TemporaryContents contents{log_data};
+  DUT dut{contents.native()};
+
+  // An invalid schema does not prevent the log from being opened or
+  // other records from being used.
+  BOOST_TEST(dut.records().size() == 2);
+  BOOST_TEST(dut.record("test")->schema->root()->name == "test");
+  BOOST_TEST(dut.record("test")->schema->root()->binary_schema ==
+             std::string("\x03\x04"));
+
+  BOOST_CHECK_THROW(dut.record("bad!")->schema->root(),
+                    base::system_error);
+}
+
+namespace {
+struct PredicateStatus {
+  uint16_t fault = 0;
+  float voltage = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(fault));
+    a->Visit(MJ_NVP(voltage));
+  }
+};
+
+struct PredicateSample {
+  int32_t mode = 0;
+  PredicateStatus status;
+  std::string name;
+  int32_t position = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(mode));
+    a->Visit(MJ_NVP(status));
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(position));
+  }
+};
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(PredicateTest) {
+  const base::RealtimeNanoTime start{1583798400000000000ll};
+
+  auto write_log = [&](const std::string& filename,
+                       const telemetry::FileWriter::Options& options) {
+    telemetry::FileWriter writer{filename, options};
+    const auto id = writer.AllocateIdentifier("sample");
+    writer.WriteSchema(
+        id, telemetry::BinarySchemaArchive::schema<PredicateSample>());
+    const auto other = writer.AllocateIdentifier("other");
+    writer.WriteSchema(other, "\x05");  // varuint
+
+    for (int i = 0; i < 100; i++) {
+      const auto timestamp = start + base::NanoDuration::milliseconds(i);
+      PredicateSample sample;
+      sample.mode = i % 10;
+      sample.status.fault = (i % 7 == 0) ? 0x12 : 0;
+      sample.status.voltage = 20.0f + i * 0.1f;
+      sample.name = std::string(i % 5, 'x');
+      sample.position = i;
+      writer.WriteData(
+          timestamp, id, telemetry::BinaryWriteArchive::Write(sample));
+
+      char data[1] = { static_cast<char>(i) };
+      writer.WriteData(timestamp, other, std::string_view(data, 1));
+    }
+  };
+
+  auto read_positions = [&](DUT& dut, const DUT::ItemsOptions& options) {
+    std::vector<int32_t> result;
+    int others = 0;
+    for (const auto& item : dut.items(options)) {
+      if (item.record->name == "other") { others++; continue; }
+      BOOST_TEST(item.record->name == "sample");
+      // The position is the last 4 bytes.
+      int32_t position = 0;
+      std::memcpy(&position, &item.data[item.data.size() - 4], 4);
+      result.push_back(position);
+    }
+    // Records without predicates are unaffected.
+    BOOST_TEST(others == 100);
+    return result;
+  };
+
+  auto check = [&](DUT& dut) {
+    {
+      DUT::ItemsOptions options;
+      options.predicates.push_back({"sample", "mode", DUT::Predicate::kEqual, 3});
+      const auto positions = read_positions(dut, options);
+      BOOST_TEST_REQUIRE(positions.size() == 10u);
+      for (size_t i = 0; i < positions.size(); i++) {
+        BOOST_TEST(positions[i] == static_cast<int32_t>(i * 10 + 3));
+      }
+    }
+
+    {
+      // Multiple predicates must all match, regardless of order.
+      DUT::ItemsOptions options;
+      options.predicates.push_back(
+          {"sample", "status.voltage", DUT::Predicate::kGreaterEqual, 25.0});
+      options.predicates.push_back(
+          {"sample", "status.fault", DUT::Predicate::kAnyBitsSet, 0, 0x02});
+      const auto positions = read_positions(dut, options);
+      const std::vector<int32_t> expected = {56, 63, 70, 77, 84, 91, 98};
+      BOOST_TEST(positions == expected, boost::test_tools::per_element());
+    }
+
+    {
+      DUT::ItemsOptions options;
+      options.predicates.push_back(
+          {"sample", "status.fault", DUT::Predicate::kNoBitsSet, 0, 0x10});
+      BOOST_TEST(read_positions(dut, options).size() == 85u);
+    }
+
+    {
+      // This field follows a string, so has no fixed offset.
+      DUT::ItemsOptions options;
+      options.predicates.push_back(
+          {"sample", "position", DUT::Predicate::kLess, 5});
+      const auto positions = read_positions(dut, options);
+      const std::vector<int32_t> expected = {0, 1, 2, 3, 4};
+      BOOST_TEST(positions == expected, boost::test_tools::per_element());
+    }
+  };
+
+  // Uncompressed single samples can be tested in place.
+  telemetry::FileWriter::Options plain_options;
+  plain_options.default_compression = false;
+  {
+    base::TemporaryFile temp;
+    write_log(temp.native(), plain_options);
+    DUT dut{temp.native()};
+    check(dut);
+  }
+
+  {
+    base::TemporaryFile temp;
+    telemetry::FileWriter::Options options;
+    options.batch_size = 8;
+    write_log(temp.native(), options);
+    DUT dut{temp.native()};
+    check(dut);
+  }
+
+  {
+    base::TemporaryFile temp;
+    write_log(temp.native(), plain_options);
+    DUT dut{temp.native()};
+
+    auto expect_invalid = [&](const DUT::Predicate& predicate) {
+      DUT::ItemsOptions options;
+      options.predicates.push_back(predicate);
+      BOOST_CHECK_EXCEPTION(
+          read_positions(dut, options), base::system_error,
+          [](const auto& e) {
+            return e.code() == telemetry::errc::kInvalidPredicate;
+          });
+    };
+    expect_invalid({"sample", "missing"});
+    expect_invalid({"sample", "status"});
+    expect_invalid({"sample", "name"});
+    expect_invalid({"sample", "mode.fault"});
+    expect_invalid({"sample", "status.voltage", DUT::Predicate::kAllBitsSet});
+  }
+}
@@ -14,8 +14,12 @@
 
 #include "mjlib/telemetry/file_writer.h"
 
+#include <sys/stat.h>
+
+#include <chrono>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include <fmt/format.h>
 
@@ -23,6 +27,7 @@
 #include <boost/test/auto_unit_test.hpp>
 
 #include "mjlib/base/temporary_file.h"
+#include "mjlib/base/test/allocation_counter.h"
 
 using mjlib::telemetry::FileWriter;
 
@@ -357,3 +362,56 @@ BOOST_AUTO_TEST_CASE(FileWriterSeek) {
   const auto contents = Contents(temp.native());
   BOOST_TEST(contents == expected);
 }
+
+BOOST_AUTO_TEST_CASE(FileWriterSteadyStateAllocation) {
+  mjlib::base::TemporaryFile temp;
+  const std::string filename = temp.native();
+
+  // There are fewer buffers than writes, so this relies upon the
+  // writer thread handing each one back before the next is needed.
+  FileWriter::Options options;
+  options.preallocated_buffers = 2;
+  FileWriter dut{filename, options};
+  const auto id = dut.AllocateIdentifier("test");
+  dut.WriteSchema(id, "\x0a");
+
+  auto file_size = [&]() {
+    struct stat buf = {};
+    ::stat(filename.c_str(), &buf);
+    return buf.st_size;
+  };
+
+  // Buffers are reclaimed as soon as they are written, before the
+  // flush which makes them visible in the file.
+  bool all_reclaimed = true;
+  auto wait_for_reclaim = [&](off_t previous_size) {
+    dut.Flush();
+    const auto end =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (file_size() <= previous_size) {
+      if (std::chrono::steady_clock::now() > end) {
+        all_reclaimed = false;
+        return;
+      }
+      std::this_thread::yield();
+    }
+  };
+
+  auto timestamp = MakeTimestamp("2020-01-01 00:00:00");
+  auto write_once = [&]() {
+    const auto previous_size = file_size();
+    auto buffer = dut.GetBuffer();
+    buffer->write("a sample of some data");
+    dut.WriteData(timestamp, id, std::move(buffer));
+    timestamp += boost::posix_time::milliseconds(1);
+    wait_for_reclaim(previous_size);
+  };
+
+  write_once();
+
+  mjlib::base::test::AllocationCounter counter;
+  for (int i = 0; i < 10; i++) { write_once(); }
+
+  BOOST_TEST(all_reclaimed);
+  BOOST_TEST(counter.allocations() == 0, counter.Report());
+}
@@ -0,0 +1,122 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// Compare the per-record cost of ptime and integer nanosecond
+/// timestamps, both for the bare conversion to log microseconds and
+/// for a complete FileWriter::WriteData.
+
+#include <chrono>
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/nano_time.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/telemetry/file_writer.h"
+
+namespace po = boost::program_options;
+using namespace mjlib;
+
+namespace {
+template <typename Functor>
+double TimeNs(int64_t count, Functor functor) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < count; i++) { functor(i); }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count() / static_cast<double>(count);
+}
+
+void Report(const std::string& name, double ptime_ns, double nano_ns) {
+  std::cout << fmt::format("{:<12} ptime {:8.1f} ns  nano {:8.1f} ns  "
+                           "saved {:8.1f} ns/record\n",
+                           name, ptime_ns, nano_ns, ptime_ns - nano_ns);
+}
+}
+
+int main(int argc, char** argv) {
+  po::options_description desc;
+
+  int64_t count = 1000000;
+  std::string filename = "/dev/null";
+
+  desc.add_options()
+      ("help,h", "display usage message")
+      ("count", po::value(&count), "number of records")
+      ("filename", po::value(&filename), "log file to write")
+      ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc;
+    return 0;
+  }
+
+  const auto ptime_start = boost::posix_time::microsec_clock::universal_time();
+  const auto nano_start = base::ConvertPtimeToNanoTime(ptime_start);
+
+  // Keep the compiler from discarding the conversions.
+  volatile int64_t sink = 0;
+
+  Report(
+      "convert",
+      TimeNs(count, [&](int64_t i) {
+          sink = base::ConvertPtimeToEpochMicroseconds(
+              ptime_start + boost::posix_time::microseconds(i));
+        }),
+      TimeNs(count, [&](int64_t i) {
+          sink = base::ConvertNanoTimeToEpochMicroseconds(
+              nano_start + base::NanoDuration::microseconds(i));
+        }));
+
+  Report(
+      "now",
+      TimeNs(count, [&](int64_t) {
+          sink = base::ConvertPtimeToEpochMicroseconds(
+              boost::posix_time::microsec_clock::universal_time());
+        }),
+      TimeNs(count, [&](int64_t) {
+          sink = base::ConvertNanoTimeToEpochMicroseconds(
+              base::RealtimeClock::now());
+        }));
+
+  const std::string data(32, 'x');
+  const auto write_ns = [&](auto functor) {
+    telemetry::FileWriter writer{filename};
+    const auto id = writer.AllocateIdentifier("test");
+    writer.WriteSchema(id, "\x0a");  // string
+    return TimeNs(count, [&](int64_t i) { functor(writer, id, i); });
+  };
+
+  Report(
+      "WriteData",
+      write_ns([&](auto& writer, auto id, int64_t i) {
+          writer.WriteData(
+              ptime_start + boost::posix_time::microseconds(i), id, data);
+        }),
+      write_ns([&](auto& writer, auto id, int64_t i) {
+          writer.WriteData(
+              nano_start + base::NanoDuration::microseconds(i), id, data);
+        }));
+
+  return 0;
+}
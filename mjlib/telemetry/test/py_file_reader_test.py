@@ -83,6 +83,24 @@ _COMPRESSED_LOG = (
     ])
 )
 
+_BATCH_LOG = (
+    b'TLOG0003' +
+    bytes([
+        0x00,  # log flags
+
+        0x01, 0x08,  # BlockType - Schema
+        0x01, 0x00,  # id=1, flags=0
+        0x04, ord('t'), ord('e'), ord('s'), ord('t'),
+        0x02,  # boolean
+
+        0x02, 0x10,  # BlockType - Data
+        0x01, 0x22,  # id=1, flags = (timestamp|batch)
+        0x00, 0x20, 0x07, 0xcd, 0x74, 0xa, 0x05, 0x00,  # timestamp
+        0x01, 0x01,  # size=1, true
+        0xd0, 0x0f,  # delta=+1000us
+        0x01, 0x00,  # size=1, false
+    ]))
+
 class FileReaderTest(unittest.TestCase):
     def test_basic(self):
         dut = file_reader.FileReader(io.BytesIO(_SAMPLE_LOG))
@@ -103,6 +121,15 @@ class FileReaderTest(unittest.TestCase):
         # up denoting the string length.
         self.assertEqual(datalist[0].data, 'a' * ord('a'))
 
+    def test_batch(self):
+        dut = file_reader.FileReader(io.BytesIO(_BATCH_LOG))
+        datalist = dut.get()["test"]
+        self.assertEqual(len(datalist), 2)
+        self.assertEqual(datalist[0].data, True)
+        self.assertEqual(datalist[1].data, False)
+        self.assertAlmostEqual(
+            datalist[1].timestamp - datalist[0].timestamp, 0.001, places=6)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,393 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/websocket_server.h"
+
+#include <future>
+#include <optional>
+#include <set>
+#include <thread>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/buffers_to_string.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket/stream.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/base64.h"
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/format.h"
+
+using namespace mjlib;
+using tcp = boost::asio::ip::tcp;
+namespace websocket = boost::beast::websocket;
+
+namespace {
+struct Reply {
+  std::string command;
+  std::string subscribe_id;
+  std::string publish_id;
+  std::string topic;
+  std::string schema;
+  std::string id;
+  std::string data;
+  std::string message;
+  bool binary = false;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(command));
+    a->Visit(MJ_NVP(subscribe_id));
+    a->Visit(MJ_NVP(publish_id));
+    a->Visit(MJ_NVP(topic));
+    a->Visit(MJ_NVP(schema));
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(data));
+    a->Visit(MJ_NVP(message));
+    a->Visit(MJ_NVP(binary));
+  }
+};
+
+std::string Base64Decode(const std::string& data) {
+  return base::Base64Decode(data).value();
+}
+
+/// A synchronous client, used from the test thread.
+class Client {
+ public:
+  Client(int port, const std::string& target = "/telemetry") {
+    ws_.next_layer().connect(
+        tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+    ws_.handshake("localhost", target);
+  }
+
+  void Send(const std::string& text) {
+    ws_.text(true);
+    ws_.write(boost::asio::buffer(text));
+  }
+
+  struct Frame {
+    bool binary = false;
+    std::string raw;
+    Reply reply;
+  };
+
+  Frame Read() {
+    boost::beast::flat_buffer buffer;
+    ws_.read(buffer);
+    Frame result;
+    result.binary = ws_.got_binary();
+    result.raw = boost::beast::buffers_to_string(buffer.data());
+    if (!result.binary) {
+      result.reply = base::Json5ReadArchive::Read<Reply>(result.raw);
+    }
+    return result;
+  }
+
+  Reply ReadReply() {
+    const auto frame = Read();
+    BOOST_TEST_REQUIRE(!frame.binary);
+    return frame.reply;
+  }
+
+ private:
+  boost::asio::io_context context_;
+  websocket::stream<tcp::socket> ws_{context_};
+};
+
+class Fixture {
+ public:
+  Fixture(const telemetry::WebsocketServer::Options& options = {}) {
+    server_.emplace(context_.get_executor(), options);
+    thread_ = std::thread([this]() { context_.run(); });
+  }
+
+  /// Run @p function on the server's thread and wait for it.
+  template <typename Function>
+  auto Call(Function function) {
+    std::packaged_task<decltype(function())()> task(function);
+    auto future = task.get_future();
+    boost::asio::post(context_, [&]() { task(); });
+    return future.get();
+  }
+
+  ~Fixture() {
+    Call([&]() { server_.reset(); });
+    work_.reset();
+    thread_.join();
+  }
+
+  telemetry::WebsocketServer& server() { return *server_; }
+  int port() { return Call([&]() { return server_->port(); }); }
+
+ private:
+  boost::asio::io_context context_;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_{context_.get_executor()};
+  std::optional<telemetry::WebsocketServer> server_;
+  std::thread thread_;
+};
+
+const base::RealtimeNanoTime kStart{1583798400000000000ll};
+
+telemetry::WebsocketServer::Options SmallQueueOptions() {
+  telemetry::WebsocketServer::Options options;
+  options.stream.tcp_server_client_queue = 100;
+  return options;
+}
+}
+
+BOOST_AUTO_TEST_CASE(WebsocketServerWildcard) {
+  Fixture fixture;
+  auto& server = fixture.server();
+
+  const std::vector<std::string> topics = {
+    "/robot/joint1/state",
+    "/robot/joint2/state",
+    "/robot/joint2/command",
+    "/robot/imu",
+    "/other/imu",
+  };
+  std::vector<telemetry::WebsocketServer::Identifier> ids;
+  fixture.Call([&]() {
+      for (const auto& topic : topics) {
+        ids.push_back(server.AllocateIdentifier(topic));
+        server.WriteSchema(ids.back(), "\x05");
+      }
+    });
+
+  Client client{fixture.port()};
+
+  auto subscribe = [&](const std::string& id, const std::string& topic) {
+    client.Send(fmt::format(
+                    "{{\"command\":\"subscribe\",\"id\":\"{}\","
+                    "\"topic\":\"{}\"}}", id, topic));
+  };
+
+  auto expect_topics = [&](const std::string& id, size_t count) {
+    std::set<std::string> result;
+    for (size_t i = 0; i < count; i++) {
+      const auto reply = client.ReadReply();
+      BOOST_TEST(reply.command == "publish_start");
+      BOOST_TEST(reply.subscribe_id == id);
+      BOOST_TEST(Base64Decode(reply.schema) == "\x05");
+      BOOST_TEST(!reply.binary);
+      result.insert(reply.topic);
+    }
+    return result;
+  };
+
+  subscribe("a", "/robot/*/state");
+  BOOST_TEST((expect_topics("a", 2) ==
+              std::set<std::string>{
+                "/robot/joint1/state", "/robot/joint2/state"}));
+
+  subscribe("b", "/**/imu");
+  BOOST_TEST((expect_topics("b", 2) ==
+              std::set<std::string>{"/robot/imu", "/other/imu"}));
+
+  subscribe("c", "/robot/joint*/c*d");
+  BOOST_TEST((expect_topics("c", 1) ==
+              std::set<std::string>{"/robot/joint2/command"}));
+
+  // An exact match.
+  subscribe("d", "/robot/joint1/state");
+  BOOST_TEST((expect_topics("d", 1) ==
+              std::set<std::string>{"/robot/joint1/state"}));
+
+  // A topic which shows up later is published to existing
+  // subscriptions.
+  fixture.Call([&]() {
+      const auto id = server.AllocateIdentifier("/robot/joint3/state");
+      server.WriteSchema(id, "\x05");
+    });
+  BOOST_TEST((expect_topics("a", 1) ==
+              std::set<std::string>{"/robot/joint3/state"}));
+
+  // Data goes to each subscription which matches.
+  fixture.Call([&]() { server.WriteData(kStart, ids[0], "\x07"); });
+  std::set<std::string> publish_ids;
+  for (int i = 0; i < 2; i++) {
+    const auto reply = client.ReadReply();
+    BOOST_TEST(reply.command == "publish");
+    BOOST_TEST(Base64Decode(reply.data) == "\x07");
+    publish_ids.insert(reply.id);
+  }
+  BOOST_TEST(publish_ids.size() == 2u);
+
+  // Unsubscribing stops everything for that subscription.
+  client.Send("{\"command\":\"unsubscribe\",\"id\":\"a\"}");
+  for (int i = 0; i < 3; i++) {
+    BOOST_TEST(client.ReadReply().command == "publish_stop");
+  }
+
+  // Removing a topic stops it for everyone.
+  fixture.Call([&]() { server.RemoveIdentifier(ids[3]); });
+  BOOST_TEST(client.ReadReply().command == "publish_stop");
+
+  // Which means that this is all that is left.
+  fixture.Call([&]() {
+      server.WriteData(kStart, ids[0], "\x08");
+      server.WriteData(kStart, ids[4], "\x09");
+    });
+  BOOST_TEST(Base64Decode(client.ReadReply().data) == "\x08");
+  BOOST_TEST(Base64Decode(client.ReadReply().data) == "\x09");
+}
+
+BOOST_AUTO_TEST_CASE(WebsocketServerBinaryDecimation) {
+  Fixture fixture;
+  auto& server = fixture.server();
+
+  telemetry::WebsocketServer::Identifier id = 0;
+  fixture.Call([&]() {
+      id = server.AllocateIdentifier("/fast");
+      server.WriteSchema(id, "\x05");
+    });
+
+  Client client{fixture.port()};
+  client.Send("{\"command\":\"subscribe\",\"id\":\"x\",\"topic\":\"/fast\","
+              "\"binary\":true,\"max_rate\":10}");
+  const auto start = client.ReadReply();
+  BOOST_TEST(start.command == "publish_start");
+  BOOST_TEST(start.binary);
+
+  // One second of 100Hz data.
+  fixture.Call([&]() {
+      for (int i = 0; i < 100; i++) {
+        const char data[1] = { static_cast<char>(i) };
+        server.WriteData(kStart + base::NanoDuration::milliseconds(i * 10),
+                         id, std::string_view(data, 1));
+      }
+    });
+  client.Send("{\"command\":\"unsubscribe\",\"id\":\"x\"}");
+
+  std::vector<int> values;
+  while (true) {
+    const auto frame = client.Read();
+    if (!frame.binary) {
+      BOOST_TEST(frame.reply.command == "publish_stop");
+      break;
+    }
+
+    base::BufferReadStream stream{frame.raw};
+    telemetry::ReadStream telemetry_stream{stream};
+    BOOST_TEST(std::to_string(*telemetry_stream.ReadVaruint()) ==
+               start.publish_id);
+    BOOST_TEST_REQUIRE(stream.remaining() == 1);
+    values.push_back(frame.raw.back());
+  }
+
+  const std::vector<int> expected = {
+    0, 10, 20, 30, 40, 50, 60, 70, 80, 90};
+  BOOST_TEST(values == expected, boost::test_tools::per_element());
+  BOOST_TEST(fixture.Call([&]() { return server.stats().decimated; }) ==
+             90u);
+}
+
+BOOST_AUTO_TEST_CASE(WebsocketServerQueueLimit) {
+  Fixture fixture{SmallQueueOptions()};
+  auto& server = fixture.server();
+
+  telemetry::WebsocketServer::Identifier id = 0;
+  fixture.Call([&]() {
+      id = server.AllocateIdentifier("/big");
+      server.WriteSchema(id, "\x09");
+    });
+
+  Client client{fixture.port()};
+  client.Send("{\"command\":\"subscribe\",\"id\":\"x\",\"topic\":\"/big\","
+              "\"binary\":true}");
+  BOOST_TEST(client.ReadReply().command == "publish_start");
+
+  // Everything is queued at once, so only the first few fit.
+  const std::string data(40, 'x');
+  fixture.Call([&]() {
+      for (int i = 0; i < 10; i++) { server.WriteData({}, id, data); }
+    });
+
+  // Control messages are never dropped.
+  client.Send("{\"command\":\"unsubscribe\",\"id\":\"x\"}");
+  int count = 0;
+  while (client.Read().binary) { count++; }
+
+  BOOST_TEST(count == 2);
+  BOOST_TEST(fixture.Call([&]() { return server.stats().dropped; }) == 8u);
+}
+
+BOOST_AUTO_TEST_CASE(WebsocketServerControlLimit) {
+  Fixture fixture{SmallQueueOptions()};
+  auto& server = fixture.server();
+
+  // Subscribing to all of these queues more control messages at once
+  // than twice the queue limit allows.
+  fixture.Call([&]() {
+      for (int i = 0; i < 20; i++) {
+        const auto id = server.AllocateIdentifier(fmt::format("/t/{}", i));
+        server.WriteSchema(id, "\x05");
+      }
+    });
+
+  Client client{fixture.port()};
+  client.Send("{\"command\":\"subscribe\",\"id\":\"x\",\"topic\":\"/**\"}");
+
+  int count = 0;
+  bool closed = false;
+  try {
+    for (; count < 20; count++) { client.Read(); }
+  } catch (const boost::system::system_error&) {
+    closed = true;
+  }
+
+  BOOST_TEST(closed);
+  BOOST_TEST(count < 20);
+  BOOST_TEST(fixture.Call([&]() { return server.stats().disconnected; }) ==
+             1u);
+}
+
+BOOST_AUTO_TEST_CASE(WebsocketServerErrors) {
+  Fixture fixture;
+
+  Client client{fixture.port()};
+
+  client.Send("{\"command\":\"subscribe\",\"id\":\"x\",\"topic\":\"/a/b**\"}");
+  auto reply = client.ReadReply();
+  BOOST_TEST(reply.command == "error");
+  BOOST_TEST(reply.id == "x");
+
+  client.Send("{\"command\":\"subscribe\",\"id\":\"y\",\"topic\":\"/**\"}");
+  client.Send("{\"command\":\"subscribe\",\"id\":\"y\",\"topic\":\"/**\"}");
+  reply = client.ReadReply();
+  BOOST_TEST(reply.command == "error");
+  BOOST_TEST(reply.message == "duplicate subscription id");
+
+  client.Send("{\"command\":\"unsubscribe\",\"id\":\"z\"}");
+  BOOST_TEST(client.ReadReply().command == "error");
+
+  client.Send("{\"command\":\"frobnicate\"}");
+  BOOST_TEST(client.ReadReply().command == "error");
+
+  client.Send("not json");
+  BOOST_TEST(client.ReadReply().command == "error");
+
+  // Only the telemetry endpoint may be used.
+  BOOST_CHECK_THROW(Client(fixture.port(), "/other"),
+                    boost::system::system_error);
+}
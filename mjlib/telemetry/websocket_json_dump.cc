@@ -0,0 +1,176 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// @file
+///
+/// A test client for WebsocketServer, which subscribes to one or
+/// more topic patterns and emits every update as JSON.
+
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/buffers_to_string.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket/stream.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/base64.h"
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/escape_json_string.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/emit_json.h"
+#include "mjlib/telemetry/format.h"
+
+namespace base = mjlib::base;
+namespace telemetry = mjlib::telemetry;
+namespace websocket = boost::beast::websocket;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+struct Message {
+  std::string command;
+  std::string publish_id;
+  std::string topic;
+  std::string schema;
+  std::string id;
+  std::string data;
+  std::string message;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(command));
+    a->Visit(MJ_NVP(publish_id));
+    a->Visit(MJ_NVP(topic));
+    a->Visit(MJ_NVP(schema));
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(data));
+    a->Visit(MJ_NVP(message));
+  }
+};
+
+std::string Base64Decode(const std::string& data) {
+  auto result = base::Base64Decode(data);
+  if (!result) { base::Fail("malformed base64 from server"); }
+  return *result;
+}
+
+struct Publication {
+  std::string topic;
+  std::unique_ptr<telemetry::BinarySchemaParser> schema;
+};
+}
+
+int main(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  std::string port;
+  std::string endpoint = "/telemetry";
+  std::vector<std::string> topics;
+  double max_rate = 0.0;
+  bool binary = false;
+  bool schema_only = false;
+
+  auto group = clipp::group(
+      (clipp::option("host") & clipp::value("", host)) % "server host",
+      (clipp::option("port") & clipp::value("", port)) % "server port",
+      (clipp::option("endpoint") & clipp::value("", endpoint)) %
+      "websocket target",
+      (clipp::option("max-rate") & clipp::value("", max_rate)) %
+      "maximum updates per second per topic",
+      clipp::option("binary").set(binary) % "request binary data frames",
+      clipp::option("schema-only").set(schema_only) %
+      "only report available topics",
+      clipp::repeatable(clipp::value("TOPIC", topics))
+  );
+
+  base::ClippParse(argc, argv, group);
+
+  if (port.empty()) {
+    std::cerr << "--port must be specified\n";
+    return 1;
+  }
+  if (topics.empty()) { topics.push_back("/**"); }
+
+  boost::asio::io_context context;
+  tcp::resolver resolver{context};
+  websocket::stream<tcp::socket> ws{context};
+
+  boost::asio::connect(ws.next_layer(), resolver.resolve(host, port));
+  ws.handshake(host, endpoint);
+
+  for (size_t i = 0; i < topics.size(); i++) {
+    ws.write(boost::asio::buffer(
+                 fmt::format(
+                     "{{\"command\":\"subscribe\",\"id\":\"{}\","
+                     "\"topic\":\"{}\",\"max_rate\":{},\"binary\":{},"
+                     "\"schema_only\":{}}}",
+                     i, base::EscapeJsonString(topics[i]), max_rate,
+                     binary, schema_only)));
+  }
+
+  std::map<std::string, Publication> publications;
+
+  auto emit = [&](const std::string& publish_id, const std::string& data) {
+    const auto it = publications.find(publish_id);
+    if (it == publications.end()) { return; }
+    base::BufferReadStream stream{data};
+    std::cout << "\"" << it->second.topic << "\" ";
+    telemetry::EmitJson(std::cout, it->second.schema->root(), stream);
+    std::cout << "\n";
+  };
+
+  while (true) {
+    boost::beast::flat_buffer buffer;
+    ws.read(buffer);
+    const auto raw = boost::beast::buffers_to_string(buffer.data());
+
+    if (ws.got_binary()) {
+      base::BufferReadStream stream{raw};
+      const auto publish_id =
+          telemetry::ReadStream(stream).ReadVaruint().value();
+      emit(std::to_string(publish_id),
+           raw.substr(raw.size() - stream.remaining()));
+      continue;
+    }
+
+    const auto message = base::Json5ReadArchive::Read<Message>(raw);
+    if (message.command == "publish_start") {
+      auto& publication = publications[message.publish_id];
+      publication.topic = message.topic;
+      publication.schema = std::make_unique<telemetry::BinarySchemaParser>(
+          Base64Decode(message.schema), message.topic);
+      std::cerr << "start " << message.topic << "\n";
+    } else if (message.command == "publish_stop") {
+      const auto it = publications.find(message.id);
+      if (it != publications.end()) {
+        std::cerr << "stop " << it->second.topic << "\n";
+        publications.erase(it);
+      }
+    } else if (message.command == "publish") {
+      emit(message.id, Base64Decode(message.data));
+    } else if (message.command == "error") {
+      std::cerr << "error " << message.id << ": " << message.message << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,686 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/websocket_server.h"
+
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/buffers_to_string.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
+#include <boost/beast/websocket/stream.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/base64.h"
+#include "mjlib/base/escape_json_string.h"
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/telemetry/format.h"
+
+namespace mjlib {
+namespace telemetry {
+
+namespace http = boost::beast::http;
+namespace websocket = boost::beast::websocket;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+/// A topic pattern, compiled once per subscription.
+class TopicPattern {
+ public:
+  /// @return nullopt if @p pattern is malformed.
+  static std::optional<TopicPattern> Compile(std::string_view pattern) {
+    TopicPattern result;
+    for (const auto segment : Split(pattern)) {
+      Segment compiled;
+      if (segment == "**") {
+        compiled.any_depth = true;
+      } else if (segment.find("**") != std::string_view::npos) {
+        // This may only be used as a complete segment.
+        return {};
+      } else {
+        std::string_view remaining = segment;
+        while (true) {
+          const auto star = remaining.find('*');
+          compiled.pieces.push_back(std::string(remaining.substr(0, star)));
+          if (star == std::string_view::npos) { break; }
+          remaining = remaining.substr(star + 1);
+        }
+      }
+      result.segments_.push_back(std::move(compiled));
+    }
+    return result;
+  }
+
+  bool Match(std::string_view topic) const {
+    const auto segments = Split(topic);
+    return Match(0, segments, 0);
+  }
+
+ private:
+  struct Segment {
+    bool any_depth = false;
+
+    /// The literal text between each '*'.  A segment with no
+    /// wildcards has exactly one piece.
+    std::vector<std::string> pieces;
+  };
+
+  static std::vector<std::string_view> Split(std::string_view value) {
+    std::vector<std::string_view> result;
+    while (true) {
+      const auto slash = value.find('/');
+      result.push_back(value.substr(0, slash));
+      if (slash == std::string_view::npos) { break; }
+      value = value.substr(slash + 1);
+    }
+    return result;
+  }
+
+  static bool MatchSegment(const Segment& segment, std::string_view value) {
+    const auto& pieces = segment.pieces;
+    if (pieces.size() == 1) { return value == pieces.front(); }
+
+    const auto& first = pieces.front();
+    const auto& last = pieces.back();
+    if (value.size() < first.size() + last.size()) { return false; }
+    if (value.substr(0, first.size()) != first) { return false; }
+    if (value.substr(value.size() - last.size()) != last) { return false; }
+
+    std::string_view middle = value.substr(
+        first.size(), value.size() - first.size() - last.size());
+    for (size_t i = 1; i + 1 < pieces.size(); i++) {
+      const auto pos = middle.find(pieces[i]);
+      if (pos == std::string_view::npos) { return false; }
+      middle = middle.substr(pos + pieces[i].size());
+    }
+    return true;
+  }
+
+  bool Match(size_t pattern_index,
+             const std::vector<std::string_view>& topic,
+             size_t topic_index) const {
+    if (pattern_index == segments_.size()) {
+      return topic_index == topic.size();
+    }
+
+    const auto& segment = segments_[pattern_index];
+    if (segment.any_depth) {
+      for (size_t i = topic_index; i <= topic.size(); i++) {
+        if (Match(pattern_index + 1, topic, i)) { return true; }
+      }
+      return false;
+    }
+
+    return topic_index < topic.size() &&
+        MatchSegment(segment, topic[topic_index]) &&
+        Match(pattern_index + 1, topic, topic_index + 1);
+  }
+
+  std::vector<Segment> segments_;
+};
+
+struct Command {
+  std::string command;
+  std::string topic;
+  std::string id;
+  bool schema_only = false;
+
+  // Extensions to the protocol in README.md.
+  double max_rate = 0.0;
+  bool binary = false;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(command));
+    a->Visit(MJ_NVP(topic));
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(schema_only));
+    a->Visit(MJ_NVP(max_rate));
+    a->Visit(MJ_NVP(binary));
+  }
+};
+}
+
+class WebsocketServer::Impl : public std::enable_shared_from_this<Impl> {
+ public:
+  Impl(const boost::asio::any_io_executor& executor, const Options& options)
+      : executor_(executor),
+        options_(options),
+        acceptor_(executor) {
+    tcp::endpoint endpoint(tcp::v4(), options_.stream.tcp_server_port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+  }
+
+  ~Impl() {
+    // Outstanding operations keep each client alive, so make sure
+    // they all complete.
+    for (auto& client : clients_) {
+      boost::system::error_code ignored;
+      client->ws.next_layer().close(ignored);
+    }
+  }
+
+  void Start() {
+    Accept();
+  }
+
+  int port() const {
+    return acceptor_.local_endpoint().port();
+  }
+
+  Identifier AllocateIdentifier(std::string_view name) {
+    const auto result = next_identifier_++;
+    topics_[result].name = std::string(name);
+    return result;
+  }
+
+  void WriteSchema(Identifier identifier, std::string_view schema) {
+    auto& topic = topics_.at(identifier);
+    if (topic.schema && *topic.schema == schema) { return; }
+
+    StopTopic(identifier);
+    topic.schema = std::string(schema);
+
+    for (auto& client : clients_) {
+      for (auto& pair : client->subscriptions) {
+        MaybeStart(client, &pair.second, identifier);
+      }
+    }
+  }
+
+  void WriteData(base::RealtimeNanoTime timestamp,
+                 Identifier identifier,
+                 std::string_view data) {
+    if (timestamp.is_not_a_date_time()) {
+      timestamp = base::RealtimeClock::now();
+    }
+
+    auto& topic = topics_.at(identifier);
+
+    // Only encode in base64 once, no matter how many subscribers.
+    std::optional<std::string> base64;
+
+    for (const auto& route : topic.routes) {
+      auto& publication = route.subscription->publications.at(identifier);
+      const auto& client = route.client;
+
+      if (route.subscription->min_interval.count() > 0 &&
+          !publication.last.is_not_a_date_time() &&
+          (timestamp - publication.last) <
+          route.subscription->min_interval) {
+        stats_.decimated++;
+        continue;
+      }
+
+      Message message;
+      message.droppable = true;
+      if (route.subscription->binary) {
+        message.binary = true;
+        base::FastOStringStream ostr;
+        telemetry::WriteStream stream{ostr};
+        stream.WriteVaruint(publication.id);
+        stream.RawWrite(data);
+        message.data = ostr.str();
+      } else {
+        if (!base64) { base64 = base::Base64Encode(data); }
+        message.data = fmt::format(
+            "{{\"command\":\"publish\",\"id\":\"{}\",\"data\":\"{}\"}}",
+            publication.id, *base64);
+      }
+
+      if (Enqueue(client, std::move(message))) {
+        publication.last = timestamp;
+      }
+    }
+  }
+
+  void RemoveIdentifier(Identifier identifier) {
+    StopTopic(identifier);
+    topics_.erase(identifier);
+  }
+
+  Stats stats_;
+
+ private:
+  struct Publication {
+    uint64_t id = 0;
+    base::RealtimeNanoTime last;
+  };
+
+  struct Subscription {
+    std::string id;
+    TopicPattern pattern;
+    bool schema_only = false;
+    bool binary = false;
+    base::NanoDuration min_interval;
+
+    // Indexed by topic identifier.
+    std::map<Identifier, Publication> publications;
+  };
+
+  struct Message {
+    std::string data;
+    bool binary = false;
+
+    // Data may be dropped when the client is slow, but control
+    // messages never are.
+    bool droppable = false;
+  };
+
+  struct Client {
+    Client(const boost::asio::any_io_executor& executor)
+        : ws(executor) {}
+
+    websocket::stream<tcp::socket> ws;
+    bool open = false;
+
+    boost::beast::flat_buffer http_buffer;
+    http::request<http::string_body> request;
+    boost::beast::flat_buffer read_buffer;
+
+    std::deque<Message> queue;
+    size_t queued_bytes = 0;
+    bool writing = false;
+    bool closing = false;
+
+    // Subscriptions are never moved once inserted, so routes may
+    // refer to them.
+    std::map<std::string, Subscription> subscriptions;
+    uint64_t next_publish_id = 1;
+  };
+
+  using ClientPtr = std::shared_ptr<Client>;
+
+  struct Route {
+    ClientPtr client;
+    Subscription* subscription = nullptr;
+  };
+
+  struct Topic {
+    std::string name;
+    std::optional<std::string> schema;
+
+    // Every subscription with an active publication for this topic
+    // that wants data.
+    std::vector<Route> routes;
+  };
+
+  // Invoke a member function only if this server still exists.
+  template <typename Method, typename... Args>
+  auto Bind(Method method, Args... bound) {
+    return [weak=weak_from_this(), method, bound...](const auto&... args) {
+      auto self = weak.lock();
+      if (!self) { return; }
+      ((*self).*method)(bound..., args...);
+    };
+  }
+
+  void Accept() {
+    auto client = std::make_shared<Client>(executor_);
+    // The handler must not be generic, as asio checks it against the
+    // move-accept signature too.
+    acceptor_.async_accept(
+        client->ws.next_layer(),
+        [weak=weak_from_this(), client](const boost::system::error_code& ec) {
+          auto self = weak.lock();
+          if (!self) { return; }
+          self->HandleAccept(client, ec);
+        });
+  }
+
+  void HandleAccept(ClientPtr client, const boost::system::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+
+    if (!ec) {
+      if (static_cast<int>(clients_.size()) >=
+          options_.stream.tcp_server_max_clients) {
+        stats_.rejected_clients++;
+        boost::system::error_code ignored;
+        client->ws.next_layer().close(ignored);
+      } else {
+        io::StreamFactory::ConfigureTcpSocket(&client->ws.next_layer(),
+                                              options_.stream);
+        clients_.push_back(client);
+        stats_.clients++;
+
+        http::async_read(client->ws.next_layer(), client->http_buffer,
+                         client->request,
+                         Bind(&Impl::HandleRequest, client));
+      }
+    }
+
+    Accept();
+  }
+
+  void HandleRequest(ClientPtr client, const boost::system::error_code& ec,
+                     size_t) {
+    if (ec ||
+        !websocket::is_upgrade(client->request) ||
+        client->request.target() != options_.endpoint) {
+      RemoveClient(client);
+      return;
+    }
+
+    client->ws.read_message_max(options_.max_command_size);
+    client->ws.async_accept(
+        client->request, Bind(&Impl::HandleHandshake, client));
+  }
+
+  void HandleHandshake(ClientPtr client, const boost::system::error_code& ec) {
+    if (ec) {
+      RemoveClient(client);
+      return;
+    }
+
+    client->open = true;
+    client->request = {};
+    StartRead(client);
+  }
+
+  void StartRead(ClientPtr client) {
+    client->ws.async_read(client->read_buffer,
+                          Bind(&Impl::HandleRead, client));
+  }
+
+  void HandleRead(ClientPtr client, const boost::system::error_code& ec,
+                  size_t) {
+    if (ec) {
+      RemoveClient(client);
+      return;
+    }
+
+    const auto text =
+        boost::beast::buffers_to_string(client->read_buffer.data());
+    client->read_buffer.consume(client->read_buffer.size());
+
+    HandleCommand(client, text);
+
+    if (IsConnected(client)) { StartRead(client); }
+  }
+
+  void HandleCommand(const ClientPtr& client, const std::string& text) {
+    Command command;
+    try {
+      command = base::Json5ReadArchive::Read<Command>(text);
+    } catch (std::exception& e) {
+      SendError(client, "", fmt::format("malformed command: {}", e.what()));
+      return;
+    }
+
+    if (command.command == "subscribe") {
+      Subscribe(client, command);
+    } else if (command.command == "unsubscribe") {
+      Unsubscribe(client, command);
+    } else {
+      SendError(client, command.id,
+                fmt::format("unknown command '{}'", command.command));
+    }
+  }
+
+  void Subscribe(const ClientPtr& client, const Command& command) {
+    if (client->subscriptions.count(command.id)) {
+      SendError(client, command.id, "duplicate subscription id");
+      return;
+    }
+    auto maybe_pattern = TopicPattern::Compile(command.topic);
+    if (!maybe_pattern) {
+      SendError(client, command.id,
+                fmt::format("invalid topic '{}'", command.topic));
+      return;
+    }
+    if (command.max_rate < 0.0) {
+      SendError(client, command.id, "max_rate must not be negative");
+      return;
+    }
+
+    auto& subscription = client->subscriptions[command.id];
+    subscription.id = command.id;
+    subscription.pattern = std::move(*maybe_pattern);
+    subscription.schema_only = command.schema_only;
+    subscription.binary = command.binary;
+    if (command.max_rate > 0.0) {
+      subscription.min_interval = base::NanoDuration::nanoseconds(
+          static_cast<int64_t>(1e9 / command.max_rate));
+    }
+
+    for (const auto& pair : topics_) {
+      MaybeStart(client, &subscription, pair.first);
+    }
+  }
+
+  void Unsubscribe(const ClientPtr& client, const Command& command) {
+    auto it = client->subscriptions.find(command.id);
+    if (it == client->subscriptions.end()) {
+      SendError(client, command.id, "unknown subscription id");
+      return;
+    }
+
+    auto& subscription = it->second;
+    for (const auto& pair : subscription.publications) {
+      RemoveRoute(pair.first, &subscription);
+      SendControl(client, StopMessage(pair.second));
+    }
+    client->subscriptions.erase(it);
+  }
+
+  void MaybeStart(const ClientPtr& client,
+                  Subscription* subscription,
+                  Identifier identifier) {
+    const auto& topic = topics_.at(identifier);
+    if (!topic.schema) { return; }
+    if (!subscription->pattern.Match(topic.name)) { return; }
+
+    auto& publication = subscription->publications[identifier];
+    publication.id = client->next_publish_id++;
+
+    SendControl(
+        client,
+        fmt::format(
+            "{{\"command\":\"publish_start\",\"subscribe_id\":\"{}\","
+            "\"publish_id\":\"{}\",\"topic\":\"{}\",\"schema\":\"{}\"{}}}",
+            base::EscapeJsonString(subscription->id),
+            publication.id,
+            base::EscapeJsonString(topic.name),
+            base::Base64Encode(*topic.schema),
+            subscription->binary ? ",\"binary\":true" : ""));
+
+    if (!subscription->schema_only) {
+      topics_.at(identifier).routes.push_back({client, subscription});
+    }
+  }
+
+  void StopTopic(Identifier identifier) {
+    auto& topic = topics_.at(identifier);
+    topic.routes.clear();
+
+    for (auto& client : clients_) {
+      for (auto& pair : client->subscriptions) {
+        auto& publications = pair.second.publications;
+        auto it = publications.find(identifier);
+        if (it == publications.end()) { continue; }
+        SendControl(client, StopMessage(it->second));
+        publications.erase(it);
+      }
+    }
+  }
+
+  static std::string StopMessage(const Publication& publication) {
+    return fmt::format("{{\"command\":\"publish_stop\",\"id\":\"{}\"}}",
+                       publication.id);
+  }
+
+  void RemoveRoute(Identifier identifier, const Subscription* subscription) {
+    auto& routes = topics_.at(identifier).routes;
+    routes.erase(
+        std::remove_if(routes.begin(), routes.end(), [&](const auto& route) {
+            return route.subscription == subscription;
+          }),
+        routes.end());
+  }
+
+  void SendError(const ClientPtr& client, std::string_view id,
+                 std::string_view message) {
+    SendControl(
+        client,
+        fmt::format("{{\"command\":\"error\",\"id\":\"{}\",\"message\":\"{}\"}}",
+                    base::EscapeJsonString(std::string(id)),
+                    base::EscapeJsonString(std::string(message))));
+  }
+
+  void SendControl(const ClientPtr& client, std::string data) {
+    Message message;
+    message.data = std::move(data);
+    Enqueue(client, std::move(message));
+  }
+
+  /// @return false if the message was dropped.
+  bool Enqueue(const ClientPtr& client, Message message) {
+    if (client->closing) { return false; }
+
+    const auto queued =
+        static_cast<int64_t>(client->queued_bytes + message.data.size());
+    const auto limit = options_.stream.tcp_server_client_queue;
+    if (message.droppable && queued > limit) {
+      stats_.dropped++;
+      return false;
+    }
+    if (!message.droppable && queued > 2 * limit) {
+      // Control messages cannot be dropped, so a client which lets
+      // this many accumulate is disconnected instead.  This may be
+      // called while iterating over clients, so the close completes
+      // through the failed read, which removes the client.
+      stats_.disconnected++;
+      client->closing = true;
+      boost::system::error_code ignored;
+      client->ws.next_layer().close(ignored);
+      return false;
+    }
+
+    stats_.messages++;
+    stats_.bytes += message.data.size();
+
+    client->queued_bytes += message.data.size();
+    client->queue.push_back(std::move(message));
+
+    StartWrite(client);
+    return true;
+  }
+
+  void StartWrite(const ClientPtr& client) {
+    if (client->writing || !client->open) { return; }
+    if (client->queue.empty()) { return; }
+
+    client->writing = true;
+    const auto& message = client->queue.front();
+    client->ws.binary(message.binary);
+    client->ws.async_write(
+        boost::asio::buffer(message.data),
+        Bind(&Impl::HandleWrite, client));
+  }
+
+  void HandleWrite(ClientPtr client, const boost::system::error_code& ec,
+                   size_t) {
+    client->writing = false;
+    if (ec) {
+      RemoveClient(client);
+      return;
+    }
+
+    client->queued_bytes -= client->queue.front().data.size();
+    client->queue.pop_front();
+
+    StartWrite(client);
+  }
+
+  bool IsConnected(const ClientPtr& client) const {
+    return std::find(clients_.begin(), clients_.end(), client) !=
+        clients_.end();
+  }
+
+  void RemoveClient(ClientPtr client) {
+    auto it = std::find(clients_.begin(), clients_.end(), client);
+    if (it == clients_.end()) { return; }
+
+    for (auto& pair : client->subscriptions) {
+      for (const auto& publication : pair.second.publications) {
+        RemoveRoute(publication.first, &pair.second);
+      }
+    }
+
+    boost::system::error_code ignored;
+    client->ws.next_layer().close(ignored);
+    clients_.erase(it);
+  }
+
+  boost::asio::any_io_executor executor_;
+  const Options options_;
+  tcp::acceptor acceptor_;
+
+  std::list<ClientPtr> clients_;
+
+  std::map<Identifier, Topic> topics_;
+  Identifier next_identifier_ = 1;
+};
+
+WebsocketServer::WebsocketServer(const boost::asio::any_io_executor& executor,
+                                 const Options& options)
+    : impl_(std::make_shared<Impl>(executor, options)) {
+  impl_->Start();
+}
+
+WebsocketServer::~WebsocketServer() {}
+
+int WebsocketServer::port() const {
+  return impl_->port();
+}
+
+WebsocketServer::Identifier WebsocketServer::AllocateIdentifier(
+    std::string_view topic) {
+  return impl_->AllocateIdentifier(topic);
+}
+
+void WebsocketServer::WriteSchema(Identifier identifier,
+                                  std::string_view schema) {
+  impl_->WriteSchema(identifier, schema);
+}
+
+void WebsocketServer::WriteData(base::RealtimeNanoTime timestamp,
+                                Identifier identifier,
+                                std::string_view serialized_data) {
+  impl_->WriteData(timestamp, identifier, serialized_data);
+}
+
+void WebsocketServer::RemoveIdentifier(Identifier identifier) {
+  impl_->RemoveIdentifier(identifier);
+}
+
+const WebsocketServer::Stats& WebsocketServer::stats() const {
+  return impl_->stats_;
+}
+
+}
+}
@@ -0,0 +1,133 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <boost/asio/any_io_executor.hpp>
+
+#include "mjlib/base/nano_time.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/stream_factory.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Serves the websocket telemetry protocol described in README.md.
+///
+/// Topics are registered and fed in the same manner as records are
+/// written with FileWriter.  Each connected client may subscribe to
+/// any number of topic patterns, and is sent a publish_start for
+/// every matching topic which has a schema, followed by its data.
+///
+/// All methods must be invoked from the executor's thread.
+class WebsocketServer {
+ public:
+  struct Options {
+    /// Of these, only tcp_server_port, tcp_server_max_clients,
+    /// tcp_server_client_queue, tcp_nodelay, and tcp_send_buffer are
+    /// used.  The client queue is in bytes, and data for a client
+    /// which has this much outstanding is dropped.  Control messages
+    /// are never dropped, but a client with twice this much
+    /// outstanding is disconnected.
+    io::StreamFactory::Options stream;
+
+    /// The HTTP target which clients must connect to.
+    std::string endpoint = "/telemetry";
+
+    /// Commands larger than this are rejected.
+    size_t max_command_size = 16384;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(stream));
+      a->Visit(MJ_NVP(endpoint));
+      a->Visit(MJ_NVP(max_command_size));
+    }
+
+    Options() {}
+  };
+
+  struct Stats {
+    uint64_t clients = 0;
+    uint64_t rejected_clients = 0;
+
+    /// Messages and bytes queued to all clients.
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+
+    /// Data messages not sent because of a subscription's max_rate.
+    uint64_t decimated = 0;
+
+    /// Data messages not sent because a client's queue was full.
+    uint64_t dropped = 0;
+
+    /// Clients closed because their queue held twice its limit, which
+    /// only control messages may exceed.
+    uint64_t disconnected = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(clients));
+      a->Visit(MJ_NVP(rejected_clients));
+      a->Visit(MJ_NVP(messages));
+      a->Visit(MJ_NVP(bytes));
+      a->Visit(MJ_NVP(decimated));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(disconnected));
+    }
+  };
+
+  /// Start listening immediately.
+  WebsocketServer(const boost::asio::any_io_executor&,
+                  const Options& = Options());
+  ~WebsocketServer();
+
+  /// The port being listened on, which is useful if tcp_server_port
+  /// was 0.
+  int port() const;
+
+  using Identifier = uint64_t;
+
+  /// Allocate a unique identifier for the given topic.
+  Identifier AllocateIdentifier(std::string_view topic);
+
+  /// Set the binary schema of a topic.  Subscribers are only told of
+  /// a topic once it has a schema.  If the schema changes, existing
+  /// publications are stopped and started again.
+  void WriteSchema(Identifier, std::string_view schema);
+
+  /// Send a data record to all subscribers of the topic.  The
+  /// timestamp is used only for decimation.  If default constructed,
+  /// the time is obtained from the system.
+  void WriteData(base::RealtimeNanoTime timestamp,
+                 Identifier,
+                 std::string_view serialized_data);
+
+  /// Remove a topic, sending publish_stop to all subscribers.
+  void RemoveIdentifier(Identifier);
+
+  const Stats& stats() const;
+
+ private:
+  class Impl;
+  std::shared_ptr<Impl> impl_;
+};
+
+}
+}
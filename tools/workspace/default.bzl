@@ -23,6 +23,7 @@ load("//tools/workspace/gl3w:repository.bzl", "gl3w_repository")
 load("//tools/workspace/glfw:repository.bzl", "glfw_repository")
 load("//tools/workspace/imgui:repository.bzl", "imgui_repository")
 load("//tools/workspace/implot:repository.bzl", "implot_repository")
+load("//tools/workspace/python:repository.bzl", "python_repository")
 load("//tools/workspace/rules_mbed:repository.bzl", "rules_mbed_repository")
 
 def add_default_repositories():
@@ -46,3 +47,5 @@ def add_default_repositories():
         imgui_repository(name = "imgui")
     if not native.existing_rule("implot"):
         implot_repository(name = "implot")
+    if not native.existing_rule("python"):
+        python_repository(name = "python")
@@ -0,0 +1,68 @@
+# -*- python -*-
+
+# Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+def _find_include(repository_ctx):
+    # Extensions are only built as .so files, which Windows will not
+    # import.
+    if repository_ctx.os.name.lower().startswith("windows"):
+        return None
+
+    python = repository_ctx.which("python3")
+    if not python:
+        return None
+
+    result = repository_ctx.execute([
+        python, "-c",
+        "import sysconfig; print(sysconfig.get_paths()['include'])"])
+    if result.return_code != 0:
+        return None
+
+    include = repository_ctx.path(result.stdout.strip())
+    if not include.get_child("Python.h").exists:
+        return None
+    return include
+
+def _impl(repository_ctx):
+    include = _find_include(repository_ctx)
+    if include:
+        repository_ctx.symlink(include, "include")
+    else:
+        repository_ctx.file("include/.empty", "")
+
+    repository_ctx.file("defs.bzl", "HAS_PYTHON_HEADERS = {}\n".format(
+        include != None))
+    repository_ctx.file("BUILD", """
+package(default_visibility = ["//visibility:public"])
+
+cc_library(
+    name = "headers",
+    hdrs = glob(["include/**/*.h"]),
+    includes = ["include"],
+)
+""")
+
+_python_repository = repository_rule(
+    implementation = _impl,
+    local = True,
+)
+
+def python_repository(name):
+    """Exposes the headers of the host python3, for building extensions.
+
+    If they cannot be found, HAS_PYTHON_HEADERS in @name//:defs.bzl is
+    False and the headers library is empty.
+    """
+    _python_repository(name = name)